@@ -0,0 +1,430 @@
+#include "benchaccuracy.h"
+/*============================================================================
+benchaccuracy.c
+
+Benchmark the accuracy against the time of approximate methods.
+
+Copyright(c) 2019 HJA Bird
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files(the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+============================================================================*/
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "libcvtx.h"
+#include "benchtools.h"
+#include "bencharraysetup.h"
+
+#define ACC_MAX_N 80000
+
+static const char *m_scales[3] = { "vsmall", "small", "medium" };
+static const int m_sizes[3] = { 1000, 10000, 80000 };
+/* Mesh spacings of the mesh methods as multiples of the particle spacing. */
+static const float m_mesh_factors[3] = { 2.f, 1.f, 0.5f };
+
+/* Settings of the case being run. */
+static float m_sigma, m_mesh;
+static bsv_V3f *m_res3 = NULL;
+static bsv_V2f *m_res2 = NULL;
+static cvtx_F3D *m_filaments = NULL;
+static const cvtx_F3D **m_pfilaments = NULL;
+
+/* Double precision reference results. */
+static cvtx_V3d *m_ref3 = NULL;
+static cvtx_V2d *m_ref2 = NULL;
+
+static void run_P3D_accuracy(const char *quantity);
+static void run_P2D_accuracy(void);
+static void run_F3D_accuracy(void);
+static void create_filaments(int n, float length);
+
+/* Relative L2 and L-infinity errors against the reference results. */
+static void errors_V3(int n, double *l2, double *linf);
+static void errors_V2(int n, double *l2, double *linf);
+
+/* Timed functions ----------------------------------------------------------*/
+static void P3D_vel_float(int n) {
+	cvtx_VortFunc vf = cvtx_VortFunc_gaussian();
+	cvtx_P3D_M2M_vel((const cvtx_P3D**)particle_3D_pptr(), n, v3f_arr(), n,
+		m_res3, &vf, m_sigma);
+}
+
+static void P3D_vel_compensated(int n) {
+	cvtx_Context_set_accumulation(NULL, CVTX_ACCUMULATE_COMPENSATED);
+	P3D_vel_float(n);
+	cvtx_Context_set_accumulation(NULL, CVTX_ACCUMULATE_DEFAULT);
+}
+
+static void P3D_vel_vic(int n) {
+	cvtx_RedistFunc rf = cvtx_RedistFunc_m4p();
+	cvtx_P3D_M2M_vel_vic((const cvtx_P3D**)particle_3D_pptr(), n, v3f_arr(), n,
+		m_res3, &rf, m_mesh);
+}
+
+static void P3D_vel_p3m(int n) {
+	cvtx_VortFunc vf = cvtx_VortFunc_gaussian();
+	cvtx_RedistFunc rf = cvtx_RedistFunc_m4p();
+	cvtx_P3D_M2M_vel_p3m((const cvtx_P3D**)particle_3D_pptr(), n, v3f_arr(), n,
+		m_res3, &vf, m_sigma, &rf, m_mesh);
+}
+
+static void P3D_dvort_float(int n) {
+	cvtx_VortFunc vf = cvtx_VortFunc_gaussian();
+	cvtx_P3D_M2M_dvort((const cvtx_P3D**)particle_3D_pptr(), n,
+		(const cvtx_P3D**)particle_3D_pptr(), n, m_res3, &vf, m_sigma);
+}
+
+static void P3D_dvort_compensated(int n) {
+	cvtx_Context_set_accumulation(NULL, CVTX_ACCUMULATE_COMPENSATED);
+	P3D_dvort_float(n);
+	cvtx_Context_set_accumulation(NULL, CVTX_ACCUMULATE_DEFAULT);
+}
+
+static void P3D_dvort_vic(int n) {
+	cvtx_RedistFunc rf = cvtx_RedistFunc_m4p();
+	cvtx_P3D_M2M_dvort_vic((const cvtx_P3D**)particle_3D_pptr(), n,
+		(const cvtx_P3D**)particle_3D_pptr(), n, m_res3, &rf, m_mesh);
+}
+
+static void P3D_dvort_p3m(int n) {
+	cvtx_VortFunc vf = cvtx_VortFunc_gaussian();
+	cvtx_RedistFunc rf = cvtx_RedistFunc_m4p();
+	cvtx_P3D_M2M_dvort_p3m((const cvtx_P3D**)particle_3D_pptr(), n,
+		(const cvtx_P3D**)particle_3D_pptr(), n, m_res3, &vf, m_sigma, &rf, m_mesh);
+}
+
+static void P2D_vel_float(int n) {
+	cvtx_VortFunc vf = cvtx_VortFunc_gaussian();
+	cvtx_P2D_M2M_vel((const cvtx_P2D**)particle_2D_pptr(), n, v2f_arr(), n,
+		m_res2, &vf, m_sigma);
+}
+
+static void P2D_vel_compensated(int n) {
+	cvtx_Context_set_accumulation(NULL, CVTX_ACCUMULATE_COMPENSATED);
+	P2D_vel_float(n);
+	cvtx_Context_set_accumulation(NULL, CVTX_ACCUMULATE_DEFAULT);
+}
+
+static void P2D_vel_vic(int n) {
+	cvtx_RedistFunc rf = cvtx_RedistFunc_m4p();
+	cvtx_P2D_M2M_vel_vic((const cvtx_P2D**)particle_2D_pptr(), n, v2f_arr(), n,
+		m_res2, &rf, m_mesh);
+}
+
+static void F3D_vel_float(int n) {
+	cvtx_F3D_M2M_vel(m_pfilaments, n, v3f_arr(), n, m_res3);
+}
+
+static void F3D_vel_compensated(int n) {
+	cvtx_Context_set_accumulation(NULL, CVTX_ACCUMULATE_COMPENSATED);
+	F3D_vel_float(n);
+	cvtx_Context_set_accumulation(NULL, CVTX_ACCUMULATE_DEFAULT);
+}
+
+/* A method of evaluating a quantity, and whether it uses a mesh. */
+struct acc_method {
+	const char *name;
+	void(*func)(int);
+	int meshed;
+	int accelerated;
+};
+
+/* Run each method on a case, returning the first record made. The
+reference must already be in m_ref3 or m_ref2. */
+static int run_methods(const char *type_quantity, const char *scale, int n,
+	float spacing, const struct acc_method *methods, int num_methods,
+	int two_d) {
+	char name[128], func[64];
+	int i, j, k, first = bench_num_records(), before, num_acc;
+	double l2, linf;
+	num_acc = cvtx_num_accelerators();
+	for (i = 0; i < num_methods; ++i) {
+		if (methods[i].accelerated && num_acc == 0) { continue; }
+		for (k = 0; k < num_acc; ++k) {
+			if (methods[i].accelerated) { cvtx_accelerator_enable(k); }
+			else { cvtx_accelerator_disable(k); }
+		}
+		sprintf(func, "%s-%s", type_quantity, methods[i].name);
+		for (j = 0; j < (methods[i].meshed ? 3 : 1); ++j) {
+			m_mesh = m_mesh_factors[j] * spacing;
+			if (methods[i].meshed) {
+				sprintf(name, "accuracy %s %s h=%g", func, scale, m_mesh_factors[j]);
+			}
+			else {
+				sprintf(name, "accuracy %s %s", func, scale);
+			}
+			before = bench_num_records();
+			BENCH(name, methods[i].func, test_repeats(), n);
+			if (bench_num_records() > before) {
+				if (two_d) { errors_V2(n, &l2, &linf); }
+				else { errors_V3(n, &l2, &linf); }
+				bench_set_accuracy(before, l2, linf);
+			}
+		}
+	}
+	for (k = 0; k < num_acc; ++k) {
+		cvtx_accelerator_enable(k);
+	}
+	return first;
+}
+
+/* 1 if any method of a case is going to be run. */
+static int case_wanted(const char *type_quantity, const char *scale,
+	const struct acc_method *methods, int num_methods) {
+	char name[128];
+	int i;
+	for (i = 0; i < num_methods; ++i) {
+		sprintf(name, "accuracy %s-%s %s", type_quantity, methods[i].name, scale);
+		if (should_run_test(name)) { return 1; }
+	}
+	return 0;
+}
+
+void run_accuracy_bench(void) {
+	const char *distributions[5] = { "uniform", "ring", "sheet", "tube", "plummer" };
+	char chosen[64];
+	int d, num_distributions = 5;
+	strcpy(chosen, test_distribution());
+	if (test_distribution_chosen()) {
+		distributions[0] = chosen;
+		num_distributions = 1;
+	}
+	m_res3 = malloc(sizeof(bsv_V3f) * ACC_MAX_N);
+	m_res2 = malloc(sizeof(bsv_V2f) * ACC_MAX_N);
+	m_ref3 = malloc(sizeof(cvtx_V3d) * ACC_MAX_N);
+	m_ref2 = malloc(sizeof(cvtx_V2d) * ACC_MAX_N);
+	for (d = 0; d < num_distributions; ++d) {
+		set_test_distribution(distributions[d]);
+		create_particles_3D(ACC_MAX_N, 1.f, 1.f / ACC_MAX_N);
+		create_V3f_arr(ACC_MAX_N, 1.f);
+		run_P3D_accuracy("vel");
+		run_P3D_accuracy("dvort");
+		run_F3D_accuracy();
+		destroy_particles_3D();
+		destroy_V3f_arr();
+		create_particles_2D(ACC_MAX_N, 1.f, 1.f / ACC_MAX_N);
+		create_V2f_arr(ACC_MAX_N, 1.f);
+		run_P2D_accuracy();
+		destroy_particles_2D();
+		destroy_V2f_arr();
+	}
+	set_test_distribution(chosen);
+	free(m_res3);
+	free(m_res2);
+	free(m_ref3);
+	free(m_ref2);
+	return;
+}
+
+static void run_P3D_accuracy(const char *quantity) {
+	const struct acc_method vel_methods[5] = {
+		{"float-cpu", P3D_vel_float, 0, 0}, {"float-gpu", P3D_vel_float, 0, 1},
+		{"compensated", P3D_vel_compensated, 0, 0}, {"vic", P3D_vel_vic, 1, 0},
+		{"p3m", P3D_vel_p3m, 1, 0} };
+	const struct acc_method dvort_methods[5] = {
+		{"float-cpu", P3D_dvort_float, 0, 0}, {"float-gpu", P3D_dvort_float, 0, 1},
+		{"compensated", P3D_dvort_compensated, 0, 0}, {"vic", P3D_dvort_vic, 1, 0},
+		{"p3m", P3D_dvort_p3m, 1, 0} };
+	const struct acc_method *methods = strcmp(quantity, "vel") ? dvort_methods : vel_methods;
+	char type_quantity[32];
+	cvtx_P3Dd *pd;
+	const cvtx_P3Dd **ppd;
+	cvtx_V3d *mesd;
+	cvtx_P3D *p = particle_3D_ptr();
+	bsv_V3f *mes = v3f_arr();
+	cvtx_VortFunc vf = cvtx_VortFunc_gaussian();
+	float spacing;
+	int s, i, j, n;
+	sprintf(type_quantity, "P3D-%s", quantity);
+	for (s = 0; s < 3; ++s) {
+		if (!case_wanted(type_quantity, m_scales[s], methods, 5)) { continue; }
+		n = m_sizes[s];
+		spacing = 1.f / cbrtf((float)n);
+		m_sigma = 2.f * spacing;
+		pd = malloc(sizeof(cvtx_P3Dd) * n);
+		ppd = malloc(sizeof(cvtx_P3Dd*) * n);
+		mesd = malloc(sizeof(cvtx_V3d) * n);
+		for (i = 0; i < n; ++i) {
+			/* Particle volume keeps the total vorticity the same for each n. */
+			p[i].volume = spacing * spacing * spacing;
+			for (j = 0; j < 3; ++j) {
+				pd[i].coord.x[j] = p[i].coord.x[j];
+				pd[i].vorticity.x[j] = p[i].vorticity.x[j];
+				mesd[i].x[j] = mes[i].x[j];
+			}
+			pd[i].volume = p[i].volume;
+			ppd[i] = pd + i;
+		}
+		printf("\nComputing double precision reference for P3D %s, n = %i...\n",
+			quantity, n);
+		if (!strcmp(quantity, "vel")) {
+			cvtx_P3Dd_M2M_vel(ppd, n, mesd, n, m_ref3, &vf, m_sigma);
+		}
+		else {
+			cvtx_P3Dd_M2M_dvort(ppd, n, ppd, n, m_ref3, &vf, m_sigma);
+		}
+		bench_accuracy_summary(
+			run_methods(type_quantity, m_scales[s], n, spacing, methods, 5, 0));
+		free(pd);
+		free(ppd);
+		free(mesd);
+	}
+	return;
+}
+
+static void run_P2D_accuracy(void) {
+	const struct acc_method methods[4] = {
+		{"float-cpu", P2D_vel_float, 0, 0}, {"float-gpu", P2D_vel_float, 0, 1},
+		{"compensated", P2D_vel_compensated, 0, 0}, {"vic", P2D_vel_vic, 1, 0} };
+	cvtx_P2Dd *pd;
+	const cvtx_P2Dd **ppd;
+	cvtx_V2d *mesd;
+	cvtx_P2D *p = particle_2D_ptr();
+	bsv_V2f *mes = v2f_arr();
+	cvtx_VortFunc vf = cvtx_VortFunc_gaussian();
+	float spacing;
+	int s, i, j, n;
+	for (s = 0; s < 3; ++s) {
+		if (!case_wanted("P2D-vel", m_scales[s], methods, 4)) { continue; }
+		n = m_sizes[s];
+		spacing = 1.f / sqrtf((float)n);
+		m_sigma = 2.f * spacing;
+		pd = malloc(sizeof(cvtx_P2Dd) * n);
+		ppd = malloc(sizeof(cvtx_P2Dd*) * n);
+		mesd = malloc(sizeof(cvtx_V2d) * n);
+		for (i = 0; i < n; ++i) {
+			p[i].area = spacing * spacing;
+			for (j = 0; j < 2; ++j) {
+				pd[i].coord.x[j] = p[i].coord.x[j];
+				mesd[i].x[j] = mes[i].x[j];
+			}
+			pd[i].vorticity = p[i].vorticity;
+			pd[i].area = p[i].area;
+			ppd[i] = pd + i;
+		}
+		printf("\nComputing double precision reference for P2D vel, n = %i...\n", n);
+		cvtx_P2Dd_M2M_vel(ppd, n, mesd, n, m_ref2, &vf, m_sigma);
+		bench_accuracy_summary(
+			run_methods("P2D-vel", m_scales[s], n, spacing, methods, 4, 1));
+		free(pd);
+		free(ppd);
+		free(mesd);
+	}
+	return;
+}
+
+static void run_F3D_accuracy(void) {
+	const struct acc_method methods[3] = {
+		{"float-cpu", F3D_vel_float, 0, 0}, {"float-gpu", F3D_vel_float, 0, 1},
+		{"compensated", F3D_vel_compensated, 0, 0} };
+	cvtx_F3Dd *fd;
+	const cvtx_F3Dd **pfd;
+	cvtx_V3d *mesd;
+	bsv_V3f *mes = v3f_arr();
+	float spacing;
+	int s, i, j, n;
+	for (s = 0; s < 3; ++s) {
+		if (!case_wanted("F3D-vel", m_scales[s], methods, 3)) { continue; }
+		n = m_sizes[s];
+		spacing = 1.f / cbrtf((float)n);
+		create_filaments(n, spacing);
+		fd = malloc(sizeof(cvtx_F3Dd) * n);
+		pfd = malloc(sizeof(cvtx_F3Dd*) * n);
+		mesd = malloc(sizeof(cvtx_V3d) * n);
+		for (i = 0; i < n; ++i) {
+			for (j = 0; j < 3; ++j) {
+				fd[i].start.x[j] = m_filaments[i].start.x[j];
+				fd[i].end.x[j] = m_filaments[i].end.x[j];
+				mesd[i].x[j] = mes[i].x[j];
+			}
+			fd[i].strength = m_filaments[i].strength;
+			pfd[i] = fd + i;
+		}
+		printf("\nComputing double precision reference for F3D vel, n = %i...\n", n);
+		cvtx_F3Dd_M2M_vel(pfd, n, mesd, n, m_ref3);
+		bench_accuracy_summary(
+			run_methods("F3D-vel", m_scales[s], n, spacing, methods, 3, 0));
+		free(fd);
+		free(pfd);
+		free(mesd);
+		free(m_filaments);
+		free(m_pfilaments);
+	}
+	return;
+}
+
+/* Filaments along the vorticity of each particle. */
+static void create_filaments(int n, float length) {
+	cvtx_P3D *p = particle_3D_ptr();
+	float mag;
+	int i, j;
+	m_filaments = malloc(sizeof(cvtx_F3D) * n);
+	m_pfilaments = malloc(sizeof(cvtx_F3D*) * n);
+	for (i = 0; i < n; ++i) {
+		mag = bsv_V3f_abs(p[i].vorticity);
+		for (j = 0; j < 3; ++j) {
+			m_filaments[i].start.x[j] = p[i].coord.x[j];
+			m_filaments[i].end.x[j] = p[i].coord.x[j]
+				+ (mag > 0.f ? length * p[i].vorticity.x[j] / mag : 0.f);
+		}
+		m_filaments[i].strength = mag * length * length;
+		m_pfilaments[i] = m_filaments + i;
+	}
+	return;
+}
+
+static void errors_V3(int n, double *l2, double *linf) {
+	double err2 = 0., ref2 = 0., err_max = 0., ref_max = 0., e, r;
+	int i, j;
+	for (i = 0; i < n; ++i) {
+		e = r = 0.;
+		for (j = 0; j < 3; ++j) {
+			e += (m_res3[i].x[j] - m_ref3[i].x[j]) * (m_res3[i].x[j] - m_ref3[i].x[j]);
+			r += m_ref3[i].x[j] * m_ref3[i].x[j];
+		}
+		err2 += e;
+		ref2 += r;
+		err_max = e > err_max ? e : err_max;
+		ref_max = r > ref_max ? r : ref_max;
+	}
+	*l2 = ref2 > 0. ? sqrt(err2 / ref2) : sqrt(err2);
+	*linf = ref_max > 0. ? sqrt(err_max / ref_max) : sqrt(err_max);
+	return;
+}
+
+static void errors_V2(int n, double *l2, double *linf) {
+	double err2 = 0., ref2 = 0., err_max = 0., ref_max = 0., e, r;
+	int i, j;
+	for (i = 0; i < n; ++i) {
+		e = r = 0.;
+		for (j = 0; j < 2; ++j) {
+			e += (m_res2[i].x[j] - m_ref2[i].x[j]) * (m_res2[i].x[j] - m_ref2[i].x[j]);
+			r += m_ref2[i].x[j] * m_ref2[i].x[j];
+		}
+		err2 += e;
+		ref2 += r;
+		err_max = e > err_max ? e : err_max;
+		ref_max = r > ref_max ? r : ref_max;
+	}
+	*l2 = ref2 > 0. ? sqrt(err2 / ref2) : sqrt(err2);
+	*linf = ref_max > 0. ? sqrt(err_max / ref_max) : sqrt(err_max);
+	return;
+}
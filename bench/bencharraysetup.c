@@ -24,9 +24,13 @@ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
 OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
 SOFTWARE.
 ============================================================================*/
+#include <math.h>
 #include <stdlib.h>
+#include <string.h>
 #include "benchtools.h"
 
+#define BENCH_PI 3.14159265f
+
 static cvtx_P3D* particles_3D = NULL;
 static cvtx_P3D* oparticles_3D = NULL;
 static cvtx_P3D** pparticles_3D = NULL;
@@ -39,18 +43,18 @@ static bsv_V3f* m_v3f_arr2 = NULL;
 static bsv_V2f* m_v2f_arr1 = NULL;
 static bsv_V2f* m_v2f_arr2 = NULL;
 
+/* Draw a particle from the distribution chosen by -distribution within
+a box of side maxf. Vorticity magnitudes are up to about maxf. */
+static void distribution_3D(float maxf, bsv_V3f *coord, bsv_V3f *vort);
+static void distribution_2D(float maxf, bsv_V2f *coord, float *vort);
+
 /* Setup / teardown. */
 void create_particles_3D(int np, float maxf, float vol) {
 	particles_3D = malloc(sizeof(cvtx_P3D) * np);
 	pparticles_3D = malloc(sizeof(cvtx_P3D*) * np);
 	int i;
 	for (i = 0; i < np; ++i) {
-		particles_3D[i].coord.x[0] = mrandf(maxf);
-		particles_3D[i].coord.x[1] = mrandf(maxf);
-		particles_3D[i].coord.x[2] = mrandf(maxf);
-		particles_3D[i].vorticity.x[0] = mrandf(maxf);
-		particles_3D[i].vorticity.x[1] = mrandf(maxf);
-		particles_3D[i].vorticity.x[2] = mrandf(maxf);
+		distribution_3D(maxf, &particles_3D[i].coord, &particles_3D[i].vorticity);
 		particles_3D[i].volume = vol;
 		pparticles_3D[i] = &(particles_3D[i]);
 	}
@@ -76,10 +80,7 @@ void create_particles_2D(int np, float maxf, float area) {
 	pparticles_2D = malloc(sizeof(cvtx_P2D*) * np);
 	int i;
 	for (i = 0; i < np; ++i) {
-		particles_2D[i].coord.x[0] = mrandf(maxf);
-		particles_2D[i].coord.x[1] = mrandf(maxf);
-		particles_2D[i].coord.x[2] = mrandf(maxf);
-		particles_2D[i].vorticity = mrandf(maxf);
+		distribution_2D(maxf, &particles_2D[i].coord, &particles_2D[i].vorticity);
 		particles_2D[i].area = area;
 		pparticles_2D[i] = &(particles_2D[i]);
 	}
@@ -104,22 +105,20 @@ void destroy_oparticles_2D() {
 
 void create_V3f_arr(int n, float maxf) {
 	m_v3f_arr1 = malloc(sizeof(bsv_V3f) * n);
+	bsv_V3f vort;
 	int i;
 	for (i = 0; i < n; ++i) {
-		m_v3f_arr1[i].x[0] = mrandf(maxf);
-		m_v3f_arr1[i].x[1] = mrandf(maxf);
-		m_v3f_arr1[i].x[2] = mrandf(maxf);
+		distribution_3D(maxf, &m_v3f_arr1[i], &vort);
 	}
 	return;
 }
 
 void create_V3f_arr2(int n, float maxf) {
 	m_v3f_arr2 = malloc(sizeof(bsv_V3f) * n);
+	bsv_V3f vort;
 	int i;
 	for (i = 0; i < n; ++i) {
-		m_v3f_arr2[i].x[0] = mrandf(maxf);
-		m_v3f_arr2[i].x[1] = mrandf(maxf);
-		m_v3f_arr2[i].x[2] = mrandf(maxf);
+		distribution_3D(maxf, &m_v3f_arr2[i], &vort);
 	}
 	return;
 }
@@ -136,20 +135,20 @@ void destroy_V3f_arr2() {
 
 void create_V2f_arr(int n, float maxf) {
 	m_v2f_arr1 = malloc(sizeof(bsv_V2f) * n);
+	float vort;
 	int i;
 	for (i = 0; i < n; ++i) {
-		m_v2f_arr1[i].x[0] = mrandf(maxf);
-		m_v2f_arr1[i].x[1] = mrandf(maxf);
+		distribution_2D(maxf, &m_v2f_arr1[i], &vort);
 	}
 	return;
 }
 
 void create_V2f_arr2(int n, float maxf) {
 	m_v2f_arr2 = malloc(sizeof(bsv_V2f) * n);
+	float vort;
 	int i;
 	for (i = 0; i < n; ++i) {
-		m_v2f_arr2[i].x[0] = mrandf(maxf);
-		m_v2f_arr2[i].x[1] = mrandf(maxf);
+		distribution_2D(maxf, &m_v2f_arr2[i], &vort);
 	}
 	return;
 }
@@ -203,3 +202,151 @@ bsv_V2f* v2f_arr(void) {
 bsv_V2f* v2f_arr2(void) {
 	return m_v2f_arr2;
 }
+
+/* Distributions ------------------------------------------------------------*/
+/* Normally distributed random number with unit variance. */
+static float mrandn(void) {
+	float u1 = ((float)rand() + 1.f) / ((float)RAND_MAX + 1.f);
+	float u2 = (float)rand() / (float)RAND_MAX;
+	return sqrtf(-2.f * logf(u1)) * cosf(2.f * BENCH_PI * u2);
+}
+
+/* Position along a wake sheet rolled up into a spiral at each tip, and the
+strength of the sheet there. s in [-1, 1] is the spanwise coordinate of
+an elliptically loaded wing. */
+static void rolled_sheet(float s, float span, float *y, float *z, float *strength) {
+	float t, phi, r, tip;
+	/* dGamma/ds of the elliptic loading, limited near the tips to 1. */
+	*strength = -0.1f * s / sqrtf(fmaxf(1.f - s * s, 0.01f));
+	if (fabsf(s) < 0.6f) {
+		*y = s * span;
+		*z = 0.f;
+	}
+	else {
+		/* The outer sheet is wound onto a spiral about the tip vortex. */
+		t = (fabsf(s) - 0.6f) / 0.4f;
+		tip = (s > 0.f ? 0.8f : -0.8f) * span;
+		phi = 6.f * BENCH_PI * t;
+		r = 0.2f * span * (1.f - t);
+		*y = tip + (s > 0.f ? -1.f : 1.f) * r * cosf(phi);
+		*z = r * sinf(phi);
+	}
+	return;
+}
+
+static void distribution_3D(float maxf, bsv_V3f *coord, bsv_V3f *vort) {
+	const char *dist = test_distribution();
+	float c = 0.5f * maxf, theta, rho, phi, r, mag, y, z, a;
+	int i;
+	if (!strcmp(dist, "ring")) {
+		/* Vortex ring in the x-y plane with a Gaussian core. */
+		r = 0.25f * maxf;
+		a = 0.1f * r;
+		theta = mrandf(2.f * BENCH_PI);
+		y = a * mrandn() / sqrtf(2.f);	/* Radial offset in the core. */
+		z = a * mrandn() / sqrtf(2.f);
+		coord->x[0] = c + (r + y) * cosf(theta);
+		coord->x[1] = c + (r + y) * sinf(theta);
+		coord->x[2] = c + z;
+		mag = maxf * expf(-(y * y + z * z) / (a * a));
+		vort->x[0] = -mag * sinf(theta);
+		vort->x[1] = mag * cosf(theta);
+		vort->x[2] = 0.f;
+	}
+	else if (!strcmp(dist, "sheet")) {
+		/* Wake sheet trailing along x, rolling up at its tips. */
+		rolled_sheet(mrandf(2.f) - 1.f, 0.4f * maxf, &y, &z, &mag);
+		coord->x[0] = mrandf(maxf);
+		coord->x[1] = c + y;
+		coord->x[2] = c + z + 0.001f * maxf * mrandn();
+		vort->x[0] = maxf * mag;
+		vort->x[1] = 0.f;
+		vort->x[2] = 0.f;
+	}
+	else if (!strcmp(dist, "tube")) {
+		/* Lamb-Oseen vortex tube along z. */
+		a = 0.05f * maxf;
+		coord->x[0] = c + a * mrandn() / sqrtf(2.f);
+		coord->x[1] = c + a * mrandn() / sqrtf(2.f);
+		coord->x[2] = mrandf(maxf);
+		rho = (coord->x[0] - c) * (coord->x[0] - c)
+			+ (coord->x[1] - c) * (coord->x[1] - c);
+		vort->x[0] = 0.f;
+		vort->x[1] = 0.f;
+		vort->x[2] = maxf * expf(-rho / (a * a));
+	}
+	else if (!strcmp(dist, "plummer")) {
+		/* Plummer sphere, truncated to the box. */
+		a = 0.05f * maxf;
+		do {
+			mag = mrandf(1.f);
+			r = mag < 1.f ? a / sqrtf(powf(mag, -2.f / 3.f) - 1.f) : c + 1.f;
+		} while (!(r <= c));
+		phi = mrandf(2.f * BENCH_PI);
+		z = mrandf(2.f) - 1.f;
+		rho = sqrtf(1.f - z * z);
+		coord->x[0] = c + r * rho * cosf(phi);
+		coord->x[1] = c + r * rho * sinf(phi);
+		coord->x[2] = c + r * z;
+		for (i = 0; i < 3; ++i) { vort->x[i] = mrandf(maxf) - 0.5f * maxf; }
+	}
+	else {
+		coord->x[0] = mrandf(maxf);
+		coord->x[1] = mrandf(maxf);
+		coord->x[2] = mrandf(maxf);
+		vort->x[0] = mrandf(maxf);
+		vort->x[1] = mrandf(maxf);
+		vort->x[2] = mrandf(maxf);
+	}
+	return;
+}
+
+static void distribution_2D(float maxf, bsv_V2f *coord, float *vort) {
+	const char *dist = test_distribution();
+	float c = 0.5f * maxf, r, a, phi, y, z, mag, sign;
+	if (!strcmp(dist, "ring")) {
+		/* Cross section of a vortex ring: a pair of opposite Gaussian cores. */
+		r = 0.25f * maxf;
+		a = 0.1f * r;
+		sign = rand() % 2 ? 1.f : -1.f;
+		y = a * mrandn() / sqrtf(2.f);
+		z = a * mrandn() / sqrtf(2.f);
+		coord->x[0] = c + z;
+		coord->x[1] = c + sign * r + y;
+		*vort = sign * maxf * expf(-(y * y + z * z) / (a * a));
+	}
+	else if (!strcmp(dist, "sheet")) {
+		/* Cross section of a wake sheet rolling up at its tips. */
+		rolled_sheet(mrandf(2.f) - 1.f, 0.4f * maxf, &y, &z, &mag);
+		coord->x[0] = c + y;
+		coord->x[1] = c + z + 0.001f * maxf * mrandn();
+		*vort = maxf * mag;
+	}
+	else if (!strcmp(dist, "tube")) {
+		/* Lamb-Oseen vortex. */
+		a = 0.05f * maxf;
+		y = a * mrandn() / sqrtf(2.f);
+		z = a * mrandn() / sqrtf(2.f);
+		coord->x[0] = c + y;
+		coord->x[1] = c + z;
+		*vort = maxf * expf(-(y * y + z * z) / (a * a));
+	}
+	else if (!strcmp(dist, "plummer")) {
+		/* Surface density of a Plummer sphere, truncated to the box. */
+		a = 0.05f * maxf;
+		do {
+			mag = mrandf(1.f);
+			r = mag < 1.f ? a * sqrtf(mag / (1.f - mag)) : c + 1.f;
+		} while (!(r <= c));
+		phi = mrandf(2.f * BENCH_PI);
+		coord->x[0] = c + r * cosf(phi);
+		coord->x[1] = c + r * sinf(phi);
+		*vort = mrandf(maxf) - 0.5f * maxf;
+	}
+	else {
+		coord->x[0] = mrandf(maxf);
+		coord->x[1] = mrandf(maxf);
+		*vort = mrandf(maxf);
+	}
+	return;
+}
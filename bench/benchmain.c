@@ -36,18 +36,24 @@ SOFTWARE.
 #include "benchredistribution.h"
 #include "benchP3D.h"
 #include "benchP2D.h"
+#include "benchaccuracy.h"
 
 int main(int argc, char* argv[]){
 	if (!parse_command_args(argc, argv)) {
 		return 0;
 	};
+	if (compare_requested()) {
+		return compare_bench_results() != 0;
+	}
 
-	BENCH("init cold", bench_first_initialisation, 1, 1);
+	BENCH_COLD("init cold", bench_first_initialisation, 1);
 	cvtx_initialise();	/* If already run cold-init this does nothing. */
 	BENCH("init reinit", bench_reinitialisation, 6, 1);
 	run_redistribution_tests();
 	run_P3D_bench();
 	run_P2D_bench();
+	run_accuracy_bench();
+	write_bench_results();
 
 	cvtx_finalise();
 	return 0;
@@ -33,29 +33,180 @@ SOFTWARE.
 #ifdef _OPENMP
 #	include <omp.h>
 #endif
+#ifndef _WIN32
+#	include <unistd.h>
+#endif
 
+#include "libcvtx.h"
 #include "benchtools.h"
 
 char m_test_types[2048], m_test_funcs[2048], m_test_scale[2048];
-int m_test_repeats;
+char m_test_distribution[64];
+int m_test_distribution_chosen;
+int m_test_repeats, m_test_warmups;
+char m_json_path[2048], m_csv_path[2048];
+char m_compare_old[2048], m_compare_new[2048];
+double m_compare_threshold;
+/* What parse_command_args accepts. See set_available_tests. */
+char m_available_types[256] = "P2D P3D F3D init accuracy";
+char m_available_funcs[2048] =
+	"vel-gaussian-cpu vel-gaussian-gpu dvort-gaussian-cpu dvort-gaussian-gpu "
+	"vel-singular-cpu vel-singular-gpu dvort-singular-cpu dvort-singular-gpu "
+	"vel-planetary-cpu vel-planetary-gpu dvort-planetary-cpu dvort-planetary-gpu "
+	"vel-winckelmans-cpu vel-winckelmans-gpu dvort-winckelmans-cpu dvort-winckelmans-gpu "
+	"viscdvort-winckelmans-cpu viscdvort-winckelmans-gpu "
+	"viscdvort-gaussian-cpu viscdvort-gaussian-gpu "
+	"vort-gaussian-cpu vort-singular-cpu vort-planetary-cpu vort-winckelmans-cpu "
+	"vort-gaussian-gpu vort-singular-gpu vort-planetary-gpu vort-winckelmans-gpu "
+	"redistribute-lambda0 redistribute-lambda1 redistribute-lambda2 redistribute-lambda3 "
+	"redistribute-m4p cold_initialisation reinitialisation cold reinit "
+	"P3D-vel-float-cpu P3D-vel-float-gpu P3D-vel-compensated P3D-vel-vic P3D-vel-p3m "
+	"P3D-dvort-float-cpu P3D-dvort-float-gpu P3D-dvort-compensated "
+	"P3D-dvort-vic P3D-dvort-p3m "
+	"P2D-vel-float-cpu P2D-vel-float-gpu P2D-vel-compensated P2D-vel-vic "
+	"F3D-vel-float-cpu F3D-vel-float-gpu F3D-vel-compensated";
+char m_available_scales[256] = "vsmall small medium large vlarge huge";
+/* Scaling sweeps. */
+int m_sweep_threads[64], m_num_sweep_threads, m_sweep_devices;
+char m_scaling[16];
+/* Placement of sources on NUMA systems (-numa). */
+char m_numa[16];
+
+/* The result of each benchmark run, kept for the JSON & CSV files. */
+struct bench_record {
+	char name[128];
+	int probsz;
+	char distribution[64];
+	const char *backend;
+	int threads;
+	char device[128];
+	char numa[16];
+	int warmups;
+	int num_samples;
+	double *samples;			/* msec, excluding warm-up. */
+	double median, p10, p90, min, mean, max;
+	double pairs_per_sec, gb_per_sec;
+	const char *scaling;		/* "none", "strong" or "weak". */
+	double efficiency;			/* Relative to the first of a sweep. */
+	double l2_error, linf_error;	/* Relative. -1 if not measured. */
+	int pareto;					/* 1 if on the time-error Pareto front. */
+};
+static struct bench_record *m_records = NULL;
+static int m_num_records = 0, m_max_records = 0;
+
+static void bench_threads(char* file_name, int line_no, char* name,
+	void (func)(int), int repr, int probsz, int warmups, const char *device);
+static int run_bench(char* file_name, int line_no, char* name,
+	void (func)(int), int repr, int probsz, int warmups, const char *device,
+	int base);
+static void bench_work(char *name, int probsz, double *pairs, double *bytes);
+static const char *bench_backend(void);
+static void bench_device(const char *backend, char *device, int max_len);
+static double percentile(const double *sorted, int n, double p);
+static int compare_doubles(const void *a, const void *b);
+static void json_string(FILE *file, const char *str);
 
 float mrandf(float maxf)
 {
 	return (float)rand() / (float)(RAND_MAX / maxf);
 }
 
-void named_bench(char* file_name, int line_no, char* name, void (func)(int), int repr, int probsz) {
+void named_bench(char* file_name, int line_no, char* name, void (func)(int), int repr, int probsz, int warmups) {
+	int i, n, *enabled, num_enabled = 0;
+	if (!should_run_test(name)) { return; }
+	n = cvtx_num_accelerators();
+	enabled = malloc(sizeof(int) * (n + 1));
+	for (i = 0; i < n; ++i) {
+		enabled[i] = cvtx_accelerator_enabled(i);
+		num_enabled += enabled[i];
+	}
+	if (!m_sweep_devices || num_enabled == 0) {
+		bench_threads(file_name, line_no, name, func, repr, probsz, warmups, NULL);
+		free(enabled);
+		return;
+	}
+	/* Each enabled accelerator alone, then all of them together. */
+	for (i = 0; i < n; ++i) {
+		if (enabled[i]) { cvtx_accelerator_disable(i); }
+	}
+	for (i = 0; i < n; ++i) {
+		if (!enabled[i]) { continue; }
+		cvtx_accelerator_enable(i);
+		bench_threads(file_name, line_no, name, func, repr, probsz, warmups,
+			cvtx_accelerator_name(i));
+		cvtx_accelerator_disable(i);
+	}
+	for (i = 0; i < n; ++i) {
+		if (enabled[i]) { cvtx_accelerator_enable(i); }
+	}
+	if (num_enabled > 1) {
+		bench_threads(file_name, line_no, name, func, repr, probsz, warmups,
+			"all enabled");
+	}
+	free(enabled);
+	return;
+}
+
+/* Run a benchmark at each thread count of the sweep, or just once if 
+there isn't one. */
+static void bench_threads(char* file_name, int line_no, char* name,
+	void (func)(int), int repr, int probsz, int warmups, const char *device) {
+	int i, size, base = -1, idx;
+	if (m_num_sweep_threads == 0) {
+		run_bench(file_name, line_no, name, func, repr, probsz, warmups, device, -1);
+		return;
+	}
+#if _OPENMP
+	int original_threads = omp_get_max_threads();
+#endif
+	for (i = 0; i < m_num_sweep_threads; ++i) {
+		/* Weak scaling keeps the problem size per thread fixed. */
+		size = strcmp(m_scaling, "weak") ? probsz : probsz * m_sweep_threads[i];
+		if (size > BENCH_MAX_PROBLEM_SIZE || size < probsz) {
+			printf("\nSkipping %s with %i threads: problem too large.\n",
+				name, m_sweep_threads[i]);
+			continue;
+		}
+#if _OPENMP
+		omp_set_num_threads(m_sweep_threads[i]);
+#endif
+		idx = run_bench(file_name, line_no, name, func, repr, size, warmups,
+			device, base);
+		if (base < 0) { base = idx; }
+	}
+#if _OPENMP
+	omp_set_num_threads(original_threads);
+#endif
+	return;
+}
+
+/* Time a benchmark, print and record the result. Efficiency is relative
+to the record base if it isn't -1. Returns the index of the record. */
+static int run_bench(char* file_name, int line_no, char* name,
+	void (func)(int), int repr, int probsz, int warmups, const char *device,
+	int base) {
 #if _OPENMP
 	double start, end;
 #else
 	clock_t start, end;
 #endif
-	double diff, min = 9e99, max = 0, sum = 0;
+	double diff, sum = 0, pairs, bytes;
+	double *times, *sorted;
+	struct bench_record rec, *grown;
 	start = 0; end = 0;
 	int i;
-	if (!should_run_test(name)) { return; }
 	
 	putchar('\n');
+	for (i = 0; i < warmups; ++i) {
+		printf("\rWarming up test %s for problem size %i (%i of %i)...",
+			name, probsz, i+1, warmups);
+		fflush(stdout);
+		func(probsz);
+	}
+	times = malloc(sizeof(double) * repr);
+	sorted = malloc(sizeof(double) * repr);
+	cvtx_stats_clear();
+	cvtx_stats_enable();
 	for (i = 0; i < repr; ++i) {
 		printf("\rRunning test %s for problem size %i (%i of %i repeats)...",
 			name, probsz, i+1, repr);
@@ -71,41 +222,107 @@ void named_bench(char* file_name, int line_no, char* name, void (func)(int), int
 		end = clock();
 		diff = ((double)end - (double)start) * (1000. / CLOCKS_PER_SEC);
 #endif
+		times[i] = diff;
 		sum += diff;
-		min = min < diff ? min : diff;
-		max = max > diff ? max : diff;
 	}
+	cvtx_stats_disable();
+	memcpy(sorted, times, sizeof(double) * repr);
+	qsort(sorted, repr, sizeof(double), compare_doubles);
+
+	memset(&rec, 0, sizeof(rec));
+	strncpy(rec.name, name, sizeof(rec.name) - 1);
+	rec.probsz = probsz;
+	strcpy(rec.distribution, m_test_distribution);
+	rec.backend = bench_backend();
+	cvtx_stats_clear();
+#if _OPENMP
+	rec.threads = omp_get_max_threads();
+#else
+	rec.threads = 1;
+#endif
+	bench_device(rec.backend, rec.device, sizeof(rec.device));
+	if (device != NULL) { strncpy(rec.device, device, sizeof(rec.device) - 1); }
+	strcpy(rec.numa, m_numa);
+	rec.warmups = warmups;
+	rec.num_samples = repr;
+	rec.samples = times;
+	rec.median = percentile(sorted, repr, 0.5);
+	rec.p10 = percentile(sorted, repr, 0.1);
+	rec.p90 = percentile(sorted, repr, 0.9);
+	rec.min = sorted[0];
+	rec.max = sorted[repr - 1];
+	rec.mean = sum / repr;
+	bench_work(name, probsz, &pairs, &bytes);
+	rec.pairs_per_sec = rec.median > 0 ? pairs / (rec.median * 1e-3) : 0;
+	rec.gb_per_sec = rec.median > 0 ? bytes / (rec.median * 1e-3) / 1e9 : 0;
+	rec.scaling = m_num_sweep_threads > 0 ? m_scaling : "none";
+	rec.efficiency = 1.;
+	rec.l2_error = rec.linf_error = -1.;
+	if (base >= 0 && pairs > 0) {
+		/* Throughput per thread, which also suits weak scaling of n^2 work. */
+		rec.efficiency = (rec.pairs_per_sec / rec.threads)
+			/ (m_records[base].pairs_per_sec / m_records[base].threads);
+	}
+	else if (base >= 0) {
+		rec.efficiency = (m_records[base].median * m_records[base].threads)
+			/ (rec.median * rec.threads);
+	}
+	free(sorted);
+
 	printf("\n\tTest name:\t%s\n", name);
 	printf("\tFile:\t\t%s\n", file_name);
 	printf("\tLine no.:\t%i\n", line_no);
-	printf("\tProb. size:\t%i\n", probsz);
-	printf("\tRepeats:\t%i\n", repr);
-	printf("\tAverage:\t%f (msec)\n", sum / repr);
-	printf("\tMinimum:\t%f (msec)\n", min);
-	printf("\tMaximum:\t%f (msec)\n", max);
+	printf("\tProb. size:\t%i (%s)\n", probsz, m_test_distribution);
+	printf("\tBackend:\t%s (%s, %i threads, NUMA %s)\n", rec.backend, rec.device,
+		rec.threads, rec.numa);
+	printf("\tRepeats:\t%i (+%i warm-up)\n", repr, warmups);
+	printf("\tAverage:\t%f (msec)\n", rec.mean);
+	printf("\tMedian:\t\t%f (msec)\n", rec.median);
+	printf("\tP10 - P90:\t%f - %f (msec)\n", rec.p10, rec.p90);
+	printf("\tMinimum:\t%f (msec)\n", rec.min);
+	printf("\tMaximum:\t%f (msec)\n", rec.max);
+	if (pairs > 0 || bytes > 0) {
+		printf("\tThroughput:\t%.4g (pairs/sec), %.4g (GB/sec)\n",
+			rec.pairs_per_sec, rec.gb_per_sec);
+	}
+	if (base >= 0) {
+		printf("\tEfficiency:\t%.3f (%s scaling from %i threads)\n",
+			rec.efficiency, rec.scaling, m_records[base].threads);
+	}
 	printf("\n");
-	return;
+
+	if (m_num_records == m_max_records) {
+		m_max_records = m_max_records > 0 ? 2 * m_max_records : 64;
+		grown = realloc(m_records, sizeof(struct bench_record) * m_max_records);
+		assert(grown != NULL);
+		m_records = grown;
+	}
+	m_records[m_num_records++] = rec;
+	return m_num_records - 1;
 }
 
 int parse_command_args(int argc, char* argv[]) {
-	char available_types[] = "P2D P3D F3D init";
-	char available_funcs[] =
-		"vel-gaussian-cpu vel-gaussian-gpu dvort-gaussian-cpu dvort-gaussian-gpu "
-		"vel-singular-cpu vel-singular-gpu dvort-singular-cpu dvort-singular-gpu "
-		"vel-planetary-cpu vel-planetary-gpu dvort-planetary-cpu dvort-planetary-gpu "
-		"vel-winckelmans-cpu vel-winckelmans-gpu dvort-winckelmans-cpu dvort-winckelmans-gpu "
-		"viscdvort-winckelmans-cpu viscdvort-winckelmans-gpu "
-		"viscdvort-gaussian-cpu viscdvort-gaussian-gpu "
-		"vort-gaussian-cpu vort-singular-cpu vort-planetary-cpu vort-winckelmans-cpu "
-		"vort-gaussian-gpu vort-singular-gpu vort-planetary-gpu vort-winckelmans-gpu "
-		"redistribute-lambda0 redistribute-lambda1 redistribute-lambda2 redistribute-lambda3 "
-		"redistribute-m4p cold_initialisation reinitialisation cold reinit";
-	char available_scales[] = "vsmall small medium large vlarge huge";
+	char *available_types = m_available_types;
+	char *available_funcs = m_available_funcs;
+	char *available_scales = m_available_scales;
+	char available_distributions[] = "uniform ring sheet tube plummer";
 
 	m_test_repeats = 1;
+	m_test_warmups = 1;
 	strcpy(m_test_types, "");
 	strcpy(m_test_funcs, "");
 	strcpy(m_test_scale, "");
+	strcpy(m_test_distribution, "uniform");
+	m_test_distribution_chosen = 0;
+	strcpy(m_scaling, "strong");
+	m_num_sweep_threads = 0;
+	m_sweep_devices = 0;
+	strcpy(m_numa, "none");
+	strcpy(m_json_path, "");
+	strcpy(m_csv_path, "");
+	strcpy(m_compare_old, "");
+	strcpy(m_compare_new, "");
+	m_compare_threshold = 5.;
 
 	int i = 1, tmpi;
 	int good = 1;
@@ -181,6 +398,112 @@ int parse_command_args(int argc, char* argv[]) {
 			}
 			else { good = 0; break; }
 		}
+		/* Choose how particles are distributed */
+		else if (!strcmp(argv[i], "-distribution")) {
+			++i;
+			if (i < argc && strlen(argv[i]) < 64
+				&& token_in_string(argv[i], available_distributions)) {
+				strcpy(m_test_distribution, argv[i]);
+				m_test_distribution_chosen = 1;
+				++i;
+			}
+			else {
+				printf("Expected a distribution. Known distributions are %s.\n",
+					available_distributions);
+				good = 0; break;
+			}
+		}
+		/* Sweep over thread counts */
+		else if (!strcmp(argv[i], "-threads")) {
+			++i;
+			for (; i < argc; ++i) {
+				if (argv[i][0] == '-') {
+					break;
+				}
+				else if (sscanf(argv[i], "%i%1s", &tmpi, tmpc) == 1 && tmpi > 0
+					&& m_num_sweep_threads < 64) {
+					m_sweep_threads[m_num_sweep_threads++] = tmpi;
+				}
+				else {
+					printf("Thread counts must be more than 0.\n");
+					good = 0; break;
+				}
+			}
+		}
+		/* Strong or weak scaling for the thread sweep */
+		else if (!strcmp(argv[i], "-scaling")) {
+			++i;
+			if (i < argc && (!strcmp(argv[i], "strong") || !strcmp(argv[i], "weak"))) {
+				strcpy(m_scaling, argv[i]);
+				++i;
+			}
+			else {
+				printf("Scaling must be strong or weak.\n");
+				good = 0; break;
+			}
+		}
+		/* Run accelerator benchmarks on each accelerator in turn */
+		else if (!strcmp(argv[i], "-devices")) {
+			m_sweep_devices = 1;
+			++i;
+		}
+		/* Copies of sources for NUMA systems (see cvtx_Context_set_numa) */
+		else if (!strcmp(argv[i], "-numa")) {
+			++i;
+			if (i < argc && (!strcmp(argv[i], "none") || !strcmp(argv[i], "first-touch")
+				|| !strcmp(argv[i], "replicate"))) {
+				strcpy(m_numa, argv[i]);
+				cvtx_Context_set_numa(NULL, !strcmp(argv[i], "none") ? CVTX_NUMA_NONE
+					: !strcmp(argv[i], "replicate") ? CVTX_NUMA_REPLICATE
+					: CVTX_NUMA_FIRST_TOUCH);
+				++i;
+			}
+			else {
+				printf("NUMA mode must be none, first-touch or replicate.\n");
+				good = 0; break;
+			}
+		}
+		/* Set the number of untimed runs before each benchmark */
+		else if (!strcmp(argv[i], "-warmup")) {
+			++i;
+			if (i < argc) {
+				if (sscanf(argv[i], "%i%1s", &tmpi, tmpc) != 1 || tmpi < 0) {
+					printf("Warm-up runs must be 0 or more.\n");
+					good = 0; break;
+				}
+				m_test_warmups = tmpi;
+				++i;
+			}
+			else { good = 0; break; }
+		}
+		/* Write the results to JSON or CSV files */
+		else if (!strcmp(argv[i], "-json") || !strcmp(argv[i], "-csv")) {
+			if (i + 1 < argc && strlen(argv[i + 1]) < 2048) {
+				strcpy(!strcmp(argv[i], "-json") ? m_json_path : m_csv_path,
+					argv[i + 1]);
+				i += 2;
+			}
+			else { good = 0; break; }
+		}
+		/* Compare two CSV result files instead of benchmarking */
+		else if (!strcmp(argv[i], "-compare")) {
+			if (i + 2 < argc && strlen(argv[i + 1]) < 2048
+				&& strlen(argv[i + 2]) < 2048) {
+				strcpy(m_compare_old, argv[i + 1]);
+				strcpy(m_compare_new, argv[i + 2]);
+				i += 3;
+			}
+			else { good = 0; break; }
+		}
+		/* Percentage change in median time considered noise */
+		else if (!strcmp(argv[i], "-threshold")) {
+			++i;
+			if (i < argc && sscanf(argv[i], "%lf%1s", &m_compare_threshold, tmpc) == 1
+				&& m_compare_threshold >= 0) {
+				++i;
+			}
+			else { good = 0; break; }
+		}
 		else if (!strcmp(argv[i], "-help")) {
 			good = 0; break;
 		}
@@ -193,14 +516,28 @@ int parse_command_args(int argc, char* argv[]) {
 	if (good != 1) {
 		printf("Bad arguments!\n"
 			"Expecting to see:\n"
-			"\tall_bench -types [types] -funcs [funcs] -scales [scales] -repeats 10\n\n"
+			"\t%s -types [types] -funcs [funcs] -scales [scales] -repeats 10\n"
+			"\t\t-distribution uniform -warmup 1 -json results.json -csv results.csv\n"
+			"\t\t-threads 1 2 4 -scaling strong -devices -numa none\n"
+			"or, to find changes between two CSV result files:\n"
+			"\t%s -compare old.csv new.csv -threshold 5\n\n"
 			"Where available types are:\n"
-			"%s\n\nAvailable funcs are:\n%s\n\nAvailable scales are:\n%s\n\n",
-			available_types, available_funcs, available_scales);
+			"%s\n\nAvailable funcs are:\n%s\n\nAvailable scales are:\n%s\n\n"
+			"Available distributions are:\n%s\n\n",
+			argv[0], argv[0], available_types, available_funcs, available_scales,
+			available_distributions);
 	}
 	return good;
 }
 
+void set_available_tests(const char *types, const char *funcs,
+	const char *scales) {
+	strncpy(m_available_types, types, sizeof(m_available_types) - 1);
+	strncpy(m_available_funcs, funcs, sizeof(m_available_funcs) - 1);
+	strncpy(m_available_scales, scales, sizeof(m_available_scales) - 1);
+	return;
+}
+
 int should_run_test(char* name) {
 	char* token;
 	char workspace[2048];	/* strtok modifies reference string. */
@@ -261,3 +598,436 @@ char* test_scale() {
 	return m_test_scale;
 }
 
+char* test_distribution() {
+	return m_test_distribution;
+}
+
+int test_distribution_chosen() {
+	return m_test_distribution_chosen;
+}
+
+void set_test_distribution(const char *distribution) {
+	strcpy(m_test_distribution, distribution);
+	return;
+}
+
+int bench_num_records() {
+	return m_num_records;
+}
+
+void bench_set_accuracy(int first, double l2_error, double linf_error) {
+	int i;
+	for (i = first; i < m_num_records; ++i) {
+		m_records[i].l2_error = l2_error;
+		m_records[i].linf_error = linf_error;
+	}
+	return;
+}
+
+void bench_accuracy_summary(int first) {
+	struct bench_record *a, *b;
+	int i, j, dominated;
+	printf("\n%-50s %8s %12s %12s %12s\n", "Benchmark", "Threads",
+		"Median (ms)", "L2 error", "Linf error");
+	for (i = first; i < m_num_records; ++i) {
+		a = &m_records[i];
+		if (a->l2_error < 0) { continue; }
+		/* Dominated if another run on the same hardware is as fast and
+		as accurate, and better in one. */
+		dominated = 0;
+		for (j = first; j < m_num_records && !dominated; ++j) {
+			b = &m_records[j];
+			if (j == i || b->l2_error < 0 || b->threads != a->threads
+				|| strcmp(b->device, a->device)) {
+				continue;
+			}
+			dominated = b->median <= a->median && b->l2_error <= a->l2_error
+				&& (b->median < a->median || b->l2_error < a->l2_error);
+		}
+		a->pareto = !dominated;
+		printf("%-50s %8i %12.4g %12.3e %12.3e %s\n", a->name, a->threads,
+			a->median, a->l2_error, a->linf_error, a->pareto ? "*" : "");
+	}
+	printf("(* on the Pareto front of time against L2 error.)\n");
+	return;
+}
+
+int test_warmups() {
+	return m_test_warmups;
+}
+
+int compare_requested() {
+	return strlen(m_compare_old) > 0;
+}
+
+int write_bench_results() {
+	FILE *file;
+	struct bench_record *rec;
+	char host[256] = "unknown";
+	char date[64] = "";
+	time_t now = time(NULL);
+	int i, j, n, good = 1;
+#ifdef _WIN32
+	if (getenv("COMPUTERNAME") != NULL) {
+		strncpy(host, getenv("COMPUTERNAME"), sizeof(host) - 1);
+	}
+#else
+	gethostname(host, sizeof(host) - 1);
+#endif
+	strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", localtime(&now));
+
+	if (strlen(m_json_path) > 0) {
+		file = fopen(m_json_path, "w");
+		if (file == NULL) {
+			printf("Could not open %s.\n", m_json_path);
+			good = 0;
+		}
+		else {
+			fprintf(file, "{\n\"machine\": {\"host\": ");
+			json_string(file, host);
+			fprintf(file, ", \"date\": \"%s\", \"max_threads\": %i, "
+				"\"accelerators\": [", date,
+#if _OPENMP
+				omp_get_max_threads());
+#else
+				1);
+#endif
+			n = cvtx_num_accelerators();
+			for (i = 0; i < n; ++i) {
+				json_string(file, cvtx_accelerator_name(i));
+				fprintf(file, "%s", i + 1 < n ? ", " : "");
+			}
+			fprintf(file, "]},\n\"results\": [\n");
+			for (i = 0; i < m_num_records; ++i) {
+				rec = &m_records[i];
+				fprintf(file, "{\"id\": ");
+				json_string(file, rec->name);
+				fprintf(file, ", \"problem_size\": %i, \"distribution\": \"%s\", "
+					"\"backend\": \"%s\", \"threads\": %i, \"device\": ",
+					rec->probsz, rec->distribution, rec->backend, rec->threads);
+				json_string(file, rec->device);
+				fprintf(file, ", \"numa\": \"%s\"", rec->numa);
+				fprintf(file, ", \"warmups\": %i, \"median_ms\": %.6g, "
+					"\"p10_ms\": %.6g, \"p90_ms\": %.6g, \"min_ms\": %.6g, "
+					"\"mean_ms\": %.6g, \"max_ms\": %.6g, "
+					"\"pairs_per_sec\": %.6g, \"gb_per_sec\": %.6g, "
+					"\"scaling\": \"%s\", \"efficiency\": %.4g, ",
+					rec->warmups, rec->median, rec->p10, rec->p90, rec->min,
+					rec->mean, rec->max, rec->pairs_per_sec, rec->gb_per_sec,
+					rec->scaling, rec->efficiency);
+				if (rec->l2_error >= 0) {
+					fprintf(file, "\"l2_error\": %.6g, \"linf_error\": %.6g, "
+						"\"pareto\": %s, ", rec->l2_error, rec->linf_error,
+						rec->pareto ? "true" : "false");
+				}
+				fprintf(file, "\"samples_ms\": [");
+				for (j = 0; j < rec->num_samples; ++j) {
+					fprintf(file, "%.6g%s", rec->samples[j],
+						j + 1 < rec->num_samples ? ", " : "");
+				}
+				fprintf(file, "]}%s\n", i + 1 < m_num_records ? "," : "");
+			}
+			fprintf(file, "]\n}\n");
+			fclose(file);
+		}
+	}
+
+	if (strlen(m_csv_path) > 0) {
+		file = fopen(m_csv_path, "w");
+		if (file == NULL) {
+			printf("Could not open %s.\n", m_csv_path);
+			good = 0;
+		}
+		else {
+			fprintf(file, "id,problem_size,distribution,backend,threads,device,numa,warmups,"
+				"samples,median_ms,p10_ms,p90_ms,min_ms,mean_ms,max_ms,"
+				"pairs_per_sec,gb_per_sec,scaling,efficiency,l2_error,linf_error,"
+				"pareto\n");
+			for (i = 0; i < m_num_records; ++i) {
+				rec = &m_records[i];
+				/* Device names may have commas but never quotes. */
+				fprintf(file, "%s,%i,%s,%s,%i,\"%s\",%s,%i,%i,%.6g,%.6g,%.6g,"
+					"%.6g,%.6g,%.6g,%.6g,%.6g,%s,%.4g,",
+					rec->name, rec->probsz, rec->distribution, rec->backend, rec->threads,
+					rec->device, rec->numa, rec->warmups, rec->num_samples, rec->median,
+					rec->p10, rec->p90, rec->min, rec->mean, rec->max,
+					rec->pairs_per_sec, rec->gb_per_sec, rec->scaling,
+					rec->efficiency);
+				if (rec->l2_error >= 0) {
+					fprintf(file, "%.6g,%.6g,%i\n", rec->l2_error,
+						rec->linf_error, rec->pareto);
+				}
+				else {
+					fprintf(file, ",,\n");
+				}
+			}
+			fclose(file);
+		}
+	}
+
+	for (i = 0; i < m_num_records; ++i) {
+		free(m_records[i].samples);
+	}
+	free(m_records);
+	m_records = NULL;
+	m_num_records = m_max_records = 0;
+	return good;
+}
+
+/* A row of a CSV result file, as needed for comparison. */
+struct csv_row {
+	char name[128];
+	char distribution[64];
+	char device[128];
+	int probsz, threads;
+	double median, p10, p90;
+};
+
+/* Read the rows of a CSV result file. Returns the number of rows, or -1. */
+static int read_csv_results(const char *path, struct csv_row **rows) {
+	FILE *file;
+	char line[4096], *field, *next;
+	/* Columns of the fields we need in the file. */
+	const char *wanted[8] = { "id", "problem_size", "threads",
+		"median_ms", "p10_ms", "p90_ms", "distribution", "device" };
+	int column[8] = { -1, -1, -1, -1, -1, -1, -1, -1 };
+	int i, col, n = 0, max_rows = 0, in_quotes, header;
+	struct csv_row row, *grown;
+	*rows = NULL;
+	file = fopen(path, "r");
+	if (file == NULL) {
+		printf("Could not open %s.\n", path);
+		return -1;
+	}
+	while (fgets(line, sizeof(line), file) != NULL) {
+		line[strcspn(line, "\r\n")] = '\0';
+		memset(&row, 0, sizeof(row));
+		header = column[0] < 0;
+		/* Split on commas outside of quotes. */
+		field = line;
+		for (col = 0; field != NULL; ++col) {
+			in_quotes = 0;
+			for (next = field; *next != '\0'; ++next) {
+				if (*next == '"') { in_quotes = !in_quotes; }
+				else if (*next == ',' && !in_quotes) { break; }
+			}
+			if (*next == ',') { *next = '\0'; ++next; }
+			else { next = NULL; }
+			for (i = 0; header && i < 8; ++i) {
+				if (!strcmp(field, wanted[i])) { column[i] = col; }
+			}
+			if (!header) {
+				if (col == column[0]) { strncpy(row.name, field, sizeof(row.name) - 1); }
+				else if (col == column[1]) { row.probsz = atoi(field); }
+				else if (col == column[2]) { row.threads = atoi(field); }
+				else if (col == column[3]) { row.median = atof(field); }
+				else if (col == column[4]) { row.p10 = atof(field); }
+				else if (col == column[5]) { row.p90 = atof(field); }
+				else if (col == column[6]) {
+					strncpy(row.distribution, field, sizeof(row.distribution) - 1);
+				}
+				else if (col == column[7]) {
+					/* Without its quotes. */
+					strncpy(row.device, field[0] == '"' ? field + 1 : field,
+						sizeof(row.device) - 1);
+					row.device[strcspn(row.device, "\"")] = '\0';
+				}
+			}
+			field = next;
+		}
+		if (!header && row.name[0] != '\0') {
+			if (n == max_rows) {
+				max_rows = max_rows > 0 ? 2 * max_rows : 64;
+				grown = realloc(*rows, sizeof(struct csv_row) * max_rows);
+				assert(grown != NULL);
+				*rows = grown;
+			}
+			(*rows)[n++] = row;
+		}
+	}
+	fclose(file);
+	/* Files from before distributions were recorded used uniform ones. */
+	for (i = 0; i < n && column[6] < 0; ++i) {
+		strcpy((*rows)[i].distribution, "uniform");
+	}
+	for (i = 0; i < 6; ++i) {
+		if (column[i] < 0) {
+			printf("%s has no %s column.\n", path, wanted[i]);
+			free(*rows);
+			*rows = NULL;
+			return -1;
+		}
+	}
+	return n;
+}
+
+int compare_bench_results() {
+	struct csv_row *old_rows, *new_rows, *o, *nw;
+	int num_old, num_new, i, j, regressions = 0;
+	double change, threshold = m_compare_threshold / 100.;
+	const char *verdict;
+	char label[300];
+	num_old = read_csv_results(m_compare_old, &old_rows);
+	num_new = read_csv_results(m_compare_new, &new_rows);
+	if (num_old < 0 || num_new < 0) {
+		free(old_rows);
+		free(new_rows);
+		return -1;
+	}
+	printf("%-45s %9s %4s %12s %12s %9s\n", "Benchmark", "Size", "Thr.",
+		"Old (msec)", "New (msec)", "Change");
+	for (i = 0; i < num_old; ++i) {
+		o = &old_rows[i];
+		nw = NULL;
+		for (j = 0; j < num_new; ++j) {
+			if (!strcmp(o->name, new_rows[j].name) && o->probsz == new_rows[j].probsz
+				&& o->threads == new_rows[j].threads
+				&& !strcmp(o->distribution, new_rows[j].distribution)
+				&& !strcmp(o->device, new_rows[j].device)) {
+				nw = &new_rows[j];
+				break;
+			}
+		}
+		strcpy(label, o->name);
+		if (strcmp(o->distribution, "uniform")) {
+			sprintf(label + strlen(label), " (%s)", o->distribution);
+		}
+		if (strcmp(o->device, "cpu") && o->device[0] != '\0') {
+			sprintf(label + strlen(label), " [%.60s]", o->device);
+		}
+		if (nw == NULL) {
+			printf("%-45s %9i %4i %12.4g %12s\n", label, o->probsz, o->threads,
+				o->median, "missing");
+			continue;
+		}
+		change = o->median > 0 ? nw->median / o->median - 1. : 0.;
+		/* A change is only real if it is beyond the threshold and the 
+		P10-P90 ranges of the two runs don't overlap. */
+		verdict = "";
+		if (change > threshold && nw->p10 > o->p90) {
+			verdict = "REGRESSION";
+			++regressions;
+		}
+		else if (change < -threshold && nw->p90 < o->p10) {
+			verdict = "improved";
+		}
+		printf("%-45s %9i %4i %12.4g %12.4g %+8.1f%% %s\n", label, o->probsz,
+			o->threads, o->median, nw->median, change * 100., verdict);
+	}
+	printf("\n%i regression(s) beyond %.1f%%.\n", regressions, m_compare_threshold);
+	free(old_rows);
+	free(new_rows);
+	return regressions;
+}
+
+/* STATIC FUNCTIONS ---------------------------------------------------------*/
+/* The interactions (or particles for redistribution) and the least
+memory traffic of one run of a benchmark, from its name "TYPE FUNC SCALE". 
+For accuracy benchmarks, "accuracy TYPE-FUNC SCALE PARAMETER", these are
+those of the brute force method. For the microbenchmarks (see bench/micro)
+the problem size is the number of items processed, or bytes moved for 
+OpenCL transfers. */
+static void bench_work(char *name, int probsz, double *pairs, double *bytes) {
+	double n = probsz, particle, vec, pointer = sizeof(void*);
+	*pairs = 0;
+	*bytes = 0;
+	if (!strncmp(name, "opencl ", 7)) {
+		if (strstr(name, "upload") != NULL || strstr(name, "readback") != NULL) {
+			*bytes = n;
+		}
+		return;
+	}
+	if (!strncmp(name, "vortfunc ", 9) || !strncmp(name, "sort ", 5)
+		|| !strncmp(name, "redistribute ", 13)) {
+		*pairs = n;
+		return;
+	}
+	if (!strncmp(name, "accuracy ", 9)) {
+		name += 9;
+	}
+	if (!strncmp(name, "F3D", 3)) {
+		particle = sizeof(cvtx_F3D);
+		vec = sizeof(bsv_V3f);
+	}
+	else if (!strncmp(name, "P3D", 3)) {
+		particle = sizeof(cvtx_P3D);
+		vec = sizeof(bsv_V3f);
+	}
+	else if (!strncmp(name, "P2D", 3)) {
+		particle = sizeof(cvtx_P2D);
+		vec = sizeof(bsv_V2f);
+	}
+	else {
+		return;
+	}
+	if (strstr(name, "redistribute") != NULL) {
+		/* Each particle gives up to 4 new ones. */
+		*pairs = n;
+		*bytes = n * (particle + pointer) + 4 * n * particle;
+	}
+	else if (strstr(name, "dvort") != NULL) {
+		/* Particles induce on particles. */
+		*pairs = n * n;
+		*bytes = n * (particle + pointer) + n * vec;
+	}
+	else {
+		/* Particles induce at measurement points. */
+		*pairs = n * n;
+		*bytes = n * (particle + pointer) + 2 * n * vec;
+	}
+	return;
+}
+
+/* The backend used by the library calls of the last benchmark. */
+static const char *bench_backend(void) {
+	cvtx_StatsRecord rec;
+	int i, backend = CVTX_BACKEND_CPU;
+	for (i = 0; cvtx_stats_record(i, &rec) == 0; ++i) {
+		if (rec.backend == CVTX_BACKEND_HYBRID
+			|| (rec.backend == CVTX_BACKEND_OPENCL && backend == CVTX_BACKEND_CPU)) {
+			backend = rec.backend;
+		}
+	}
+	switch (backend) {
+	case CVTX_BACKEND_OPENCL: return "opencl";
+	case CVTX_BACKEND_HYBRID: return "hybrid";
+	default: return "cpu";
+	}
+}
+
+static void bench_device(const char *backend, char *device, int max_len) {
+	int i, n = cvtx_num_accelerators();
+	strncpy(device, "cpu", max_len - 1);
+	device[max_len - 1] = '\0';
+	if (!strcmp(backend, "cpu")) { return; }
+	for (i = 0; i < n; ++i) {
+		if (cvtx_accelerator_enabled(i) && cvtx_accelerator_name(i) != NULL) {
+			strncpy(device, cvtx_accelerator_name(i), max_len - 1);
+			break;
+		}
+	}
+	return;
+}
+
+/* Linearly interpolated percentile of sorted data. */
+static double percentile(const double *sorted, int n, double p) {
+	double pos = p * (n - 1);
+	int i = (int)pos;
+	if (i + 1 >= n) { return sorted[n - 1]; }
+	return sorted[i] + (pos - i) * (sorted[i + 1] - sorted[i]);
+}
+
+static int compare_doubles(const void *a, const void *b) {
+	double da = *(const double*)a, db = *(const double*)b;
+	return (da > db) - (da < db);
+}
+
+static void json_string(FILE *file, const char *str) {
+	fputc('"', file);
+	for (; str != NULL && *str != '\0'; ++str) {
+		if (*str == '"' || *str == '\\') { fputc('\\', file); }
+		if ((unsigned char)*str >= 0x20) { fputc(*str, file); }
+	}
+	fputc('"', file);
+	return;
+}
@@ -26,25 +26,62 @@ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
 SOFTWARE.
 ============================================================================*/
 
-/* Test running function. */
-#define BENCH(N, funcptr, R, S) named_bench(__FILE__, __LINE__, N, funcptr, R, S)
-void named_bench(char* file_name, int line_no, char* name, void (func)(int), int repr, int probsz);
+/* The largest problem the benchmark arrays are made for. */
+#define BENCH_MAX_PROBLEM_SIZE 1000000
+
+/* Test running function. Each is run test_warmups() times before timing,
+except for BENCH_COLD, which is timed once from cold. With -threads, 
+each is repeated for each number of threads, and with -devices, on each 
+enabled accelerator alone and then all of them. */
+#define BENCH(N, funcptr, R, S) named_bench(__FILE__, __LINE__, N, funcptr, R, S, test_warmups())
+#define BENCH_COLD(N, funcptr, S) named_bench(__FILE__, __LINE__, N, funcptr, 1, S, 0)
+void named_bench(char* file_name, int line_no, char* name, void (func)(int), int repr, int probsz, int warmups);
 
 /* Test control */
 int parse_command_args(int argc, char* argv[]);
 int should_run_test(char* name);
+/* Replace the types, funcs and scales that parse_command_args accepts, for
+programs other than all_bench. Call before parse_command_args. */
+void set_available_tests(const char *types, const char *funcs,
+	const char *scales);
 int token_in_string(char* token, char* ref_str);
 
 /* Print the test results. Mincounts give indication of timing resolution. */
 void print_test_res(char* name, double* times, long long int mincounts);
 
+/* Write the results of the benchmarks run to the files given by -json and
+-csv. Returns 0 if a file couldn't be written. */
+int write_bench_results();
+
+/* 1 if asked to -compare result files rather than run benchmarks. */
+int compare_requested();
+
+/* Compare the median times of the CSV result files given by -compare,
+printing the changes. Returns the number of regressions, or -1 if the
+files can't be read. */
+int compare_bench_results();
+
+/* The number of results recorded so far. */
+int bench_num_records();
+
+/* Set the relative errors of the results recorded from first onwards. */
+void bench_set_accuracy(int first, double l2_error, double linf_error);
+
+/* Print the results from first onwards that have errors, marking those on
+the Pareto front of median time against L2 error. */
+void bench_accuracy_summary(int first);
+
 /* Generate a rand between -maxf and maxf*/
 float mrandf(float maxf);
 
 /* Get info on tests to run. */
 int test_repeats();
+int test_warmups();
 char* test_types();
 char* test_funcs();
 char* test_scale();
+char* test_distribution();
+int test_distribution_chosen();
+void set_test_distribution(const char *distribution);
 
 #endif /* CVTX_BENCHTOOLS_H */
@@ -0,0 +1,70 @@
+/*============================================================================
+micromain.c
+
+Microbenchmarks of the internal kernels of cvortex. Unlike all_bench, these
+are built with the library sources rather than against the library, so
+functions that aren't exported can be timed alone.
+
+Copyright(c) 2019 HJA Bird
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files(the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+============================================================================*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "libcvtx.h"
+#include "benchtools.h"
+
+#include "microvortfunc.h"
+#include "microsort.h"
+#include "microopencl.h"
+
+int main(int argc, char* argv[]){
+	set_available_tests("vortfunc sort redistribute opencl",
+		"singular-g3d singular-zeta3d singular-combined3d singular-g2d "
+		"singular-vel-cpu singular-vel-gpu "
+		"winckelmans-g3d winckelmans-zeta3d winckelmans-combined3d winckelmans-g2d "
+		"winckelmans-vel-cpu winckelmans-vel-gpu "
+		"planetary-g3d planetary-zeta3d planetary-combined3d planetary-g2d "
+		"planetary-vel-cpu planetary-vel-gpu "
+		"gaussian-g3d gaussian-zeta3d gaussian-combined3d gaussian-g2d "
+		"gaussian-vel-cpu gaussian-vel-gpu "
+		"key3D-narrow key3D-grid key3D-wide key2D-narrow key2D-grid key2D-wide "
+		"minmax gridkey sort strength-info threshold total "
+		"upload readback launch",
+		"1 4k 16k 64k 1M 16M");
+	if (!parse_command_args(argc, argv)) {
+		return 0;
+	};
+	if (compare_requested()) {
+		return compare_bench_results() != 0;
+	}
+
+	cvtx_initialise();
+	run_vortfunc_micro();
+	run_sort_micro();
+	run_redistribution_micro();
+	run_opencl_micro();
+	write_bench_results();
+
+	cvtx_finalise();
+	return 0;
+}
@@ -0,0 +1,117 @@
+#include "microopencl.h"
+/*============================================================================
+microopencl.c
+
+Microbenchmark OpenCL transfers and kernel launches.
+
+Copyright(c) 2019 HJA Bird
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files(the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+============================================================================*/
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "libcvtx.h"
+#include "benchtools.h"
+
+#ifdef CVTX_USING_OPENCL
+#include "ocl_P3D.h"
+#include "opencl_acc.h"
+#include "workspace.h"
+
+/* The largest buffer transfered. */
+#define MICRO_MAX_BUFFER 16777216
+
+static cl_command_queue m_queue;
+static int m_zero_copy;
+static cl_mem m_buffer;
+static void *m_host;
+
+/* The buffer is made once, so these are the transfer alone. With 
+zero-copy buffers an upload does nothing, and a readback is a map. */
+static void micro_upload(int bytes);
+static void micro_readback(int bytes);
+/* A one particle, one target velocity calculation: the least a call to 
+the accelerator can cost. */
+static void micro_launch(int n);
+
+void run_opencl_micro(void) {
+	const int sizes[] = { 4096, 65536, 1048576, MICRO_MAX_BUFFER };
+	const char *scales[] = { "4k", "64k", "1M", "16M" };
+	char name[128];
+	cl_program program;
+	cl_context context;
+	cl_int status;
+	size_t ws_mark;
+	int i;
+
+	if (opencl_get_device_state(0, &program, &context, &m_queue) != 0) {
+		printf("\nNo accelerator enabled: skipping OpenCL microbenchmarks.\n");
+		return;
+	}
+	m_zero_copy = opencl_queue_zero_copy(m_queue);
+	ws_mark = workspace_mark();
+	m_host = opencl_host_alloc(MICRO_MAX_BUFFER);
+	memset(m_host, 0, MICRO_MAX_BUFFER);
+	m_buffer = opencl_create_host_buffer(context, m_zero_copy,
+		CL_MEM_READ_WRITE, MICRO_MAX_BUFFER, m_host, &status);
+	assert(status == CL_SUCCESS);
+	for (i = 0; i < 4; ++i) {
+		sprintf(name, "opencl upload %s", scales[i]);
+		BENCH(name, micro_upload, test_repeats(), sizes[i]);
+		sprintf(name, "opencl readback %s", scales[i]);
+		BENCH(name, micro_readback, test_repeats(), sizes[i]);
+	}
+	BENCH("opencl launch 1", micro_launch, test_repeats(), 1);
+	clReleaseMemObject(m_buffer);
+	workspace_reset(ws_mark);
+	return;
+}
+
+static void micro_upload(int bytes) {
+	cl_int status = opencl_write_host_buffer(m_queue, m_zero_copy, m_buffer,
+		CL_TRUE, bytes, m_host, 0, NULL, NULL);
+	assert(status == CL_SUCCESS);
+	(void)status;
+}
+
+static void micro_readback(int bytes) {
+	opencl_read_host_buffer(m_queue, m_zero_copy, m_buffer, bytes, m_host,
+		0, NULL);
+}
+
+static void micro_launch(int n) {
+	cvtx_P3D particle = { {{0.f, 0.f, 0.f}}, {{0.f, 0.f, 1.f}}, 1.f };
+	const cvtx_P3D *pparticle = &particle;
+	bsv_V3f mes = {{1.f, 0.f, 0.f}}, res;
+	cvtx_VortFunc vf = cvtx_VortFunc_gaussian();
+	(void)n;
+	opencl_brute_force_P3D_M2M_vel(&pparticle, 1, &mes, 1, &res, &vf, 0.1f);
+}
+
+#else
+
+void run_opencl_micro(void) {
+	printf("\nBuilt without OpenCL: skipping OpenCL microbenchmarks.\n");
+	return;
+}
+
+#endif
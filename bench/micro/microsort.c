@@ -0,0 +1,226 @@
+#include "microsort.h"
+/*============================================================================
+microsort.c
+
+Microbenchmark grid key sorting and the phases of particle redistribution.
+
+Copyright(c) 2019 HJA Bird
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files(the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+============================================================================*/
+
+#include <assert.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "libcvtx.h"
+#include "bencharraysetup.h"
+#include "benchtools.h"
+#include "redistribution_helper_funcs.h"
+#include "uintkey.h"
+
+/* The most keys sorted, and the most particles redistributed. */
+#define MICRO_MAX_KEYS 1048576
+#define MICRO_MAX_REDISTRIBUTED 16384
+
+static UInt32Key3D *m_keys3D = NULL;
+static UInt32Key2D *m_keys2D = NULL;
+static unsigned int *m_perm = NULL;
+/* Redistribution state, for the phases run in the order of 
+cvtx_P3D_redistribute_on_grid. */
+static cvtx_RedistFunc m_redistributor;
+static float m_grid_density, m_minx, m_miny, m_minz;
+static int m_ppop, m_num_created;
+static UInt32Key3D *m_okeys = NULL, *m_nkeys = NULL;
+static float *m_strengths = NULL;
+
+static void make_keys(uint32_t range, int n);
+static void micro_sort_3D(int n);
+static void micro_sort_2D(int n);
+
+static void micro_minmax(int n);
+static void micro_gridkey(int n);
+static void micro_sort_spread(int n);
+static void micro_strength_info(int n);
+static void micro_threshold(int n);
+static void micro_redistribute(int n);
+
+void run_sort_micro(void) {
+	/* Narrow has many equal keys, as when particles are merged. */
+	const char *range_names[] = { "narrow", "grid", "wide" };
+	const uint32_t ranges[] = { 16, 1024, UINT32_MAX };
+	const int sizes[] = { 65536, 1048576 };
+	const char *scales[] = { "64k", "1M" };
+	char name[128];
+	int i, j;
+
+	m_keys3D = malloc(sizeof(UInt32Key3D) * MICRO_MAX_KEYS);
+	m_keys2D = malloc(sizeof(UInt32Key2D) * MICRO_MAX_KEYS);
+	m_perm = malloc(sizeof(unsigned int) * MICRO_MAX_KEYS);
+	assert(m_keys3D != NULL && m_keys2D != NULL && m_perm != NULL);
+	for (i = 0; i < 3; ++i) {
+		make_keys(ranges[i], MICRO_MAX_KEYS);
+		for (j = 0; j < 2; ++j) {
+			sprintf(name, "sort key3D-%s %s", range_names[i], scales[j]);
+			BENCH(name, micro_sort_3D, test_repeats(), sizes[j]);
+			sprintf(name, "sort key2D-%s %s", range_names[i], scales[j]);
+			BENCH(name, micro_sort_2D, test_repeats(), sizes[j]);
+		}
+	}
+	free(m_keys3D);
+	free(m_keys2D);
+	free(m_perm);
+	m_keys3D = NULL;
+	m_keys2D = NULL;
+	m_perm = NULL;
+	return;
+}
+
+void run_redistribution_micro(void) {
+	const int sizes[] = { 4096, 16384 };
+	const char *scales[] = { "4k", "16k" };
+	char name[128];
+	cvtx_P3D *created;
+	int i, j, n;
+
+	m_redistributor = cvtx_RedistFunc_lambda3();
+	m_ppop = (2 * (int)roundf(m_redistributor.radius) + 1);
+	m_ppop = m_ppop * m_ppop * m_ppop;
+	create_particles_3D(MICRO_MAX_REDISTRIBUTED, 1.f, 1.f);
+	m_okeys = malloc(sizeof(UInt32Key3D) * MICRO_MAX_REDISTRIBUTED);
+	m_nkeys = malloc(sizeof(UInt32Key3D) * MICRO_MAX_REDISTRIBUTED * m_ppop);
+	m_perm = malloc(sizeof(unsigned int) * MICRO_MAX_REDISTRIBUTED * m_ppop);
+	created = malloc(sizeof(cvtx_P3D) * MICRO_MAX_REDISTRIBUTED * m_ppop);
+	m_strengths = malloc(sizeof(float) * MICRO_MAX_REDISTRIBUTED * m_ppop);
+	assert(m_okeys != NULL && m_nkeys != NULL && m_perm != NULL);
+	assert(created != NULL && m_strengths != NULL);
+	for (i = 0; i < 2; ++i) {
+		n = sizes[i];
+		/* The particles are in [-1, 1]^3: aim for one per grid cell. */
+		m_grid_density = (float)cbrt(8. / n);
+		/* Keys and strengths as the earlier phases would leave them. */
+		micro_minmax(n);
+		micro_gridkey(n);
+		m_num_created = cvtx_P3D_redistribute_on_grid(
+			(const cvtx_P3D**)particle_3D_pptr(), n, created, n * m_ppop,
+			&m_redistributor, m_grid_density, 0.f);
+		for (j = 0; j < m_num_created; ++j) {
+			m_strengths[j] = bsv_V3f_abs(created[j].vorticity);
+		}
+		sprintf(name, "redistribute minmax %s", scales[i]);
+		BENCH(name, micro_minmax, test_repeats(), n);
+		sprintf(name, "redistribute gridkey %s", scales[i]);
+		BENCH(name, micro_gridkey, test_repeats(), n);
+		sprintf(name, "redistribute sort %s", scales[i]);
+		BENCH(name, micro_sort_spread, test_repeats(), n);
+		sprintf(name, "redistribute strength-info %s", scales[i]);
+		BENCH(name, micro_strength_info, test_repeats(), n);
+		sprintf(name, "redistribute threshold %s", scales[i]);
+		BENCH(name, micro_threshold, test_repeats(), n);
+		/* The remainder is making, merging and removing the new particles. */
+		sprintf(name, "redistribute total %s", scales[i]);
+		BENCH(name, micro_redistribute, test_repeats(), n);
+	}
+	destroy_particles_3D();
+	free(m_okeys);
+	free(m_nkeys);
+	free(m_perm);
+	free(created);
+	free(m_strengths);
+	m_okeys = m_nkeys = NULL;
+	m_perm = NULL;
+	m_strengths = NULL;
+	return;
+}
+
+/* Random keys with each component in [0, range). */
+static void make_keys(uint32_t range, int n) {
+	int i;
+	for (i = 0; i < n; ++i) {
+		uint32_t x = ((uint32_t)rand() << 16) ^ (uint32_t)rand();
+		uint32_t y = ((uint32_t)rand() << 16) ^ (uint32_t)rand();
+		uint32_t z = ((uint32_t)rand() << 16) ^ (uint32_t)rand();
+		if (range != UINT32_MAX) {
+			x %= range;
+			y %= range;
+			z %= range;
+		}
+		m_keys3D[i].k.x = x;
+		m_keys3D[i].k.y = y;
+		m_keys3D[i].k.z = z;
+		m_keys2D[i].k.x = x;
+		m_keys2D[i].k.y = y;
+	}
+}
+
+/* The keys are left unchanged by sorting, so can be reused. */
+static void micro_sort_3D(int n) {
+	sort_perm_UInt32Key3D(m_keys3D, m_perm, n);
+}
+
+static void micro_sort_2D(int n) {
+	sort_perm_UInt32Key2D(m_keys2D, m_perm, n);
+}
+
+static void micro_minmax(int n) {
+	int r = (int)roundf(m_redistributor.radius);
+	minmax_xyz_posn((const cvtx_P3D**)particle_3D_pptr(), n,
+		&m_minx, NULL, &m_miny, NULL, &m_minz, NULL);
+	m_minx -= (r + 0.5f) * m_grid_density;
+	m_miny -= (r + 0.5f) * m_grid_density;
+	m_minz -= (r + 0.5f) * m_grid_density;
+}
+
+static void micro_gridkey(int n) {
+	int i, j, r = (int)roundf(m_redistributor.radius), w = 2 * r + 1;
+	cvtx_P3D **particles = particle_3D_pptr();
+#pragma omp parallel for schedule(static) private(j)
+	for (i = 0; i < n; ++i) {
+		m_okeys[i] = g_P3D_gridkey3D(particles[i],
+			m_grid_density, m_minx, m_miny, m_minz);
+		/* The keys of the new particles around the particle. */
+		for (j = 0; j < m_ppop; ++j) {
+			m_nkeys[i * m_ppop + j].k.x = m_okeys[i].k.x + j / (w * w) - r;
+			m_nkeys[i * m_ppop + j].k.y = m_okeys[i].k.y + (j / w) % w - r;
+			m_nkeys[i * m_ppop + j].k.z = m_okeys[i].k.z + j % w - r;
+		}
+	}
+}
+
+static void micro_sort_spread(int n) {
+	sort_perm_UInt32Key3D(m_nkeys, m_perm, (size_t)n * m_ppop);
+}
+
+static void micro_strength_info(int n) {
+	float mean;
+	(void)n;
+	farray_info(m_strengths, m_num_created, &mean, NULL, NULL);
+}
+
+static void micro_threshold(int n) {
+	/* As if asked for half as many particles out as in. */
+	get_strength_threshold(m_strengths, m_num_created, n / 2);
+}
+
+static void micro_redistribute(int n) {
+	cvtx_P3D_redistribute_on_grid((const cvtx_P3D**)particle_3D_pptr(), n,
+		NULL, 0, &m_redistributor, m_grid_density, 0.f);
+}
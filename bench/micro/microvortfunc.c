@@ -0,0 +1,174 @@
+#include "microvortfunc.h"
+/*============================================================================
+microvortfunc.c
+
+Microbenchmark the regularisation functions of cvortex.
+
+Copyright(c) 2019 HJA Bird
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files(the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+============================================================================*/
+
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "libcvtx.h"
+#include "bencharraysetup.h"
+#include "benchtools.h"
+#ifdef CVTX_USING_OPENCL
+#	include "ocl_P3D.h"
+#endif
+
+/* The largest number of rho values and of particles for the pairs. */
+#define MICRO_MAX_RHO 1048576
+#define MICRO_MAX_PARTICLES 4096
+
+static cvtx_VortFunc m_vf;
+static float *m_rho = NULL, *m_res = NULL;
+
+/* Per-pair evaluation of each function of the regularisation. The
+problem size is the number of evaluations. */
+static void micro_g_3D(int n);
+static void micro_zeta_3D(int n);
+static void micro_combined_3D(int n);
+static void micro_g_2D(int n);
+/* Whole interactions, with the problem size being the number of pairs.
+The CPU one has the accelerators disabled. The GPU one goes straight to the
+OpenCL implementation, avoiding the dispatch. */
+static void micro_vel_cpu(int pairs);
+#ifdef CVTX_USING_OPENCL
+static void micro_vel_gpu(int pairs);
+#endif
+
+void run_vortfunc_micro(void) {
+	const char *names[] = { "singular", "winckelmans", "planetary", "gaussian" };
+	cvtx_VortFunc vfs[4];
+	char name[128];
+	int i, j, n, enabled[64];
+	const int rhos[] = { 65536, 1048576 }, pairs[] = { 1048576, 16777216 };
+	const char *rho_scales[] = { "64k", "1M" }, *pair_scales[] = { "1M", "16M" };
+
+	vfs[0] = cvtx_VortFunc_singular();
+	vfs[1] = cvtx_VortFunc_winckelmans();
+	vfs[2] = cvtx_VortFunc_planetary();
+	vfs[3] = cvtx_VortFunc_gaussian();
+	m_rho = malloc(sizeof(float) * MICRO_MAX_RHO);
+	m_res = malloc(sizeof(float) * MICRO_MAX_RHO);
+	assert(m_rho != NULL && m_res != NULL);
+	for (i = 0; i < MICRO_MAX_RHO; ++i) {
+		/* Mostly near the core, where the functions differ. */
+		m_rho[i] = mrandf(4.f);
+	}
+	create_particles_3D(MICRO_MAX_PARTICLES, 1.f, 1e-3f);
+	create_V3f_arr(MICRO_MAX_PARTICLES, 1.f);
+	create_V3f_arr2(MICRO_MAX_PARTICLES, 1.f);
+
+	n = cvtx_num_accelerators();
+	for (i = 0; i < n && i < 64; ++i) {
+		enabled[i] = cvtx_accelerator_enabled(i);
+	}
+	for (i = 0; i < 4; ++i) {
+		m_vf = vfs[i];
+		for (j = 0; j < 2; ++j) {
+			sprintf(name, "vortfunc %s-g3d %s", names[i], rho_scales[j]);
+			BENCH(name, micro_g_3D, test_repeats(), rhos[j]);
+			sprintf(name, "vortfunc %s-zeta3d %s", names[i], rho_scales[j]);
+			BENCH(name, micro_zeta_3D, test_repeats(), rhos[j]);
+			sprintf(name, "vortfunc %s-combined3d %s", names[i], rho_scales[j]);
+			BENCH(name, micro_combined_3D, test_repeats(), rhos[j]);
+			sprintf(name, "vortfunc %s-g2d %s", names[i], rho_scales[j]);
+			BENCH(name, micro_g_2D, test_repeats(), rhos[j]);
+		}
+		for (j = 0; j < n && j < 64; ++j) {
+			cvtx_accelerator_disable(j);
+		}
+		for (j = 0; j < 2; ++j) {
+			sprintf(name, "vortfunc %s-vel-cpu %s", names[i], pair_scales[j]);
+			BENCH(name, micro_vel_cpu, test_repeats(), pairs[j]);
+		}
+		for (j = 0; j < n && j < 64; ++j) {
+			if (enabled[j]) { cvtx_accelerator_enable(j); }
+		}
+#ifdef CVTX_USING_OPENCL
+		if (cvtx_num_enabled_accelerators() > 0) {
+			for (j = 0; j < 2; ++j) {
+				sprintf(name, "vortfunc %s-vel-gpu %s", names[i], pair_scales[j]);
+				BENCH(name, micro_vel_gpu, test_repeats(), pairs[j]);
+			}
+		}
+#endif
+	}
+	destroy_particles_3D();
+	destroy_V3f_arr();
+	destroy_V3f_arr2();
+	free(m_rho);
+	free(m_res);
+	m_rho = m_res = NULL;
+	return;
+}
+
+static void micro_g_3D(int n) {
+	int i;
+#pragma omp parallel for schedule(static)
+	for (i = 0; i < n; ++i) {
+		m_res[i] = m_vf.g_3D(m_rho[i]);
+	}
+}
+
+static void micro_zeta_3D(int n) {
+	int i;
+#pragma omp parallel for schedule(static)
+	for (i = 0; i < n; ++i) {
+		m_res[i] = m_vf.zeta_3D(m_rho[i]);
+	}
+}
+
+static void micro_combined_3D(int n) {
+	int i;
+#pragma omp parallel for schedule(static)
+	for (i = 0; i < n; ++i) {
+		float g, zeta;
+		m_vf.combined_3D(m_rho[i], &g, &zeta);
+		m_res[i] = g + zeta;
+	}
+}
+
+static void micro_g_2D(int n) {
+	int i;
+#pragma omp parallel for schedule(static)
+	for (i = 0; i < n; ++i) {
+		m_res[i] = m_vf.g_2D(m_rho[i]);
+	}
+}
+
+static void micro_vel_cpu(int pairs) {
+	int np = (int)sqrt((double)pairs);
+	cvtx_P3D_M2M_vel((const cvtx_P3D**)particle_3D_pptr(), np,
+		v3f_arr(), np, v3f_arr2(), &m_vf, 0.05f);
+}
+
+#ifdef CVTX_USING_OPENCL
+static void micro_vel_gpu(int pairs) {
+	int np = (int)sqrt((double)pairs);
+	opencl_brute_force_P3D_M2M_vel((const cvtx_P3D**)particle_3D_pptr(), np,
+		v3f_arr(), np, v3f_arr2(), &m_vf, 0.05f);
+}
+#endif
@@ -44,6 +44,7 @@ SOFTWARE.
 #endif 
 
 #include <bsv/bsv.h>
+#include <stddef.h>
 
 /* A Vortex particle in 3D */
 typedef struct {
@@ -65,6 +66,33 @@ typedef struct {
 	float area;
 } cvtx_P2D;
 
+/* Double precision vectors, and particles and filaments for the
+double precision methods (cvtx_P3Dd_M2M_vel, etc.) */
+typedef struct {
+	double x[3];
+} cvtx_V3d;
+
+typedef struct {
+	double x[2];
+} cvtx_V2d;
+
+typedef struct {
+	cvtx_V3d coord;
+	cvtx_V3d vorticity;
+	double volume;
+} cvtx_P3Dd;
+
+typedef struct {
+	cvtx_V3d start, end;
+	double strength;
+} cvtx_F3Dd;
+
+typedef struct {
+	cvtx_V2d coord;
+	double vorticity;
+	double area;
+} cvtx_P2Dd;
+
 /* Vortex particle regularisation functions
 	Naming is following that of Winckelmans
 	- g(rho): normally used in induced vel
@@ -77,6 +105,13 @@ typedef struct {
 		(NULL for unsupported)
 	- cl_kernel_name_ext: identifies opencl kernel variant to run. 
 		(fall back to OpenMP)
+	- cl_g_3D, cl_g_2D, cl_zeta_3D, cl_eta_3D, cl_eta_2D: OpenCL C
+		expressions in float rho, used to generate the kernels of 
+		functions that aren't built in. cl_combined_3D: OpenCL C
+		statements setting float g & zeta from rho.
+		(NULL for unsupported)
+	- cl_generate: set by cvtx_VortFunc_init. The cl_ sources are
+		ignored unless the struct was started from it.
 	- 2D and 3D variants
 */
 typedef struct {
@@ -87,6 +122,13 @@ typedef struct {
 	float(*eta_3D)(float rho);
 	float(*eta_2D)(float rho);
 	char cl_kernel_name_ext[32];
+	const char *cl_g_3D;
+	const char *cl_g_2D;
+	const char *cl_zeta_3D;
+	const char *cl_combined_3D;
+	const char *cl_eta_3D;
+	const char *cl_eta_2D;
+	unsigned int cl_generate;
 } cvtx_VortFunc;
 
 typedef struct {
@@ -94,6 +136,13 @@ typedef struct {
 	float radius;
 } cvtx_RedistFunc;
 
+/* Library state for a solver: accelerators in use, their command queues,
+thread settings and scratch memory. Opaque. */
+typedef struct cvtx_Context cvtx_Context;
+
+/* A binary file of particles and filaments, mapped into memory. Opaque. */
+typedef struct cvtx_Snapshot cvtx_Snapshot;
+
 /* cvtx libary accelerator controls */
 CVTX_EXPORT void cvtx_initialise();
 CVTX_EXPORT void cvtx_finalise();
@@ -105,7 +154,104 @@ CVTX_EXPORT int cvtx_accelerator_enabled(int accelerator_id);
 CVTX_EXPORT void cvtx_accelerator_enable(int accelerator_id);
 CVTX_EXPORT void cvtx_accelerator_disable(int accelerator_id);
 
+/* CPU or accelerator choice for M2M functions. function_name is that of
+the public function, for instance "cvtx_P3D_M2M_vel". HYBRID is both at
+once, each taking part of the targets. */
+#define CVTX_BACKEND_CPU 0
+#define CVTX_BACKEND_OPENCL 1
+#define CVTX_BACKEND_HYBRID 2
+CVTX_EXPORT int cvtx_last_backend(void);
+CVTX_EXPORT int cvtx_predict_backend(
+	const char *function_name, int num_sources, int num_targets);
+CVTX_EXPORT int cvtx_calibrate_dispatch(void);
+
+/* Performance statistics. Whilst enabled, each call of an M2M, mesh or
+redistribution function is recorded. The fallback is why the CPU was used
+rather than an accelerator. Phase times are accelerator busy times from
+OpenCL event profiling, or 0. */
+#define CVTX_FALLBACK_NONE 0
+#define CVTX_FALLBACK_NO_ACCELERATOR 1
+#define CVTX_FALLBACK_COST_MODEL 2
+#define CVTX_FALLBACK_FORCED 3
+#define CVTX_FALLBACK_UNSUPPORTED 4
+#define CVTX_FALLBACK_ERROR 5
+typedef struct {
+	const char *function;	/* Name of the public function. */
+	int backend;			/* CVTX_BACKEND_XXX */
+	int fallback;			/* CVTX_FALLBACK_XXX */
+	int num_sources;
+	int num_targets;
+	double pairs;			/* Source-target interactions. */
+	int thread;				/* Numbered in order of first record. */
+	double start;			/* Seconds since statistics were enabled. */
+	double time;			/* Wall time of the call in seconds. */
+	double upload_time;
+	double compute_time;
+	double download_time;
+} cvtx_StatsRecord;
+CVTX_EXPORT void cvtx_stats_enable(void);
+CVTX_EXPORT void cvtx_stats_disable(void);
+CVTX_EXPORT int cvtx_stats_enabled(void);
+CVTX_EXPORT int cvtx_stats_num_records(void);
+CVTX_EXPORT int cvtx_stats_record(int index, cvtx_StatsRecord *record);
+CVTX_EXPORT void cvtx_stats_clear(void);
+CVTX_EXPORT int cvtx_stats_write_trace(const char *path);
+
+/* cvtx_Context functions. Other functions use the calling thread's current
+context, or the default context if none is current. Passing NULL as a
+context refers to the default context. */
+CVTX_EXPORT cvtx_Context* cvtx_Context_create(void);
+CVTX_EXPORT void cvtx_Context_destroy(cvtx_Context *context);
+CVTX_EXPORT void cvtx_Context_make_current(cvtx_Context *context);
+CVTX_EXPORT cvtx_Context* cvtx_Context_current(void);
+CVTX_EXPORT void cvtx_Context_set_num_threads(
+	cvtx_Context *context, int num_threads);
+CVTX_EXPORT int cvtx_Context_num_threads(const cvtx_Context *context);
+/* Whether the CPU implementations run in parallel. By DEFAULT, calls 
+from within a parallel region of the caller run on the calling thread 
+alone. NESTED makes them parallel there too. SERIAL is never parallel. */
+#define CVTX_EXECUTE_DEFAULT 0
+#define CVTX_EXECUTE_SERIAL 1
+#define CVTX_EXECUTE_NESTED 2
+CVTX_EXPORT void cvtx_Context_set_execution(
+	cvtx_Context *context, int mode);
+CVTX_EXPORT int cvtx_Context_execution(const cvtx_Context *context);
+/* The OpenMP schedule of the loops over targets of the CPU brute force
+methods. DEFAULT leaves the choice to the library. */
+#define CVTX_SCHEDULE_DEFAULT 0
+#define CVTX_SCHEDULE_STATIC 1
+#define CVTX_SCHEDULE_DYNAMIC 2
+#define CVTX_SCHEDULE_GUIDED 3
+CVTX_EXPORT void cvtx_Context_set_schedule(
+	cvtx_Context *context, int schedule);
+CVTX_EXPORT int cvtx_Context_schedule(const cvtx_Context *context);
+/* How M2M & M2S sums over sources are accumulated. COMPENSATED uses
+compensated (Kahan-Neumaier) float sums on both the CPU and accelerators. */
+#define CVTX_ACCUMULATE_DEFAULT 0
+#define CVTX_ACCUMULATE_COMPENSATED 1
+CVTX_EXPORT void cvtx_Context_set_accumulation(
+	cvtx_Context *context, int mode);
+CVTX_EXPORT int cvtx_Context_accumulation(const cvtx_Context *context);
+/* Placement of the sources of the CPU brute force M2M methods on NUMA 
+systems. NONE reads the caller's arrays. FIRST_TOUCH packs a copy that is
+written by the threads of the call, so its pages are spread across their
+nodes. REPLICATE packs a copy on each node used by the threads. */
+#define CVTX_NUMA_NONE 0
+#define CVTX_NUMA_FIRST_TOUCH 1
+#define CVTX_NUMA_REPLICATE 2
+CVTX_EXPORT void cvtx_Context_set_numa(cvtx_Context *context, int mode);
+CVTX_EXPORT int cvtx_Context_numa(const cvtx_Context *context);
+/* Use P3M in cvtx_P3D_M2M_vel and cvtx_P3D_M2M_dvort, with a mesh of 
+grid_density spacing. A NULL redistributor returns to brute force. */
+CVTX_EXPORT void cvtx_Context_set_p3m(cvtx_Context *context,
+	const cvtx_RedistFunc *redistributor, float grid_density);
+CVTX_EXPORT int cvtx_Context_p3m(const cvtx_Context *context);
+/* Scratch memory is kept between calls. Bytes held & releasing it. */
+CVTX_EXPORT size_t cvtx_Context_workspace_size(const cvtx_Context *context);
+CVTX_EXPORT void cvtx_Context_release_workspace(cvtx_Context *context);
+
 /* cvtx_VortFunc functions */
+CVTX_EXPORT const cvtx_VortFunc cvtx_VortFunc_init(void);
 CVTX_EXPORT const cvtx_VortFunc cvtx_VortFunc_singular(void);
 CVTX_EXPORT const cvtx_VortFunc cvtx_VortFunc_winckelmans(void);
 CVTX_EXPORT const cvtx_VortFunc cvtx_VortFunc_planetary(void);
@@ -215,6 +361,18 @@ CVTX_EXPORT void cvtx_P3D_M2M_vel(
 	const cvtx_VortFunc *kernel,
 	float regularisation_radius);
 
+/* grad_result_array has 3 entries per measurement point with
+grad_result_array[3 * i + j].x[k] = d vel_j / d x_k. */
+CVTX_EXPORT void cvtx_P3D_M2M_vel_grad(
+	const cvtx_P3D **array_start,
+	const int num_particles,
+	const bsv_V3f *mes_start,
+	const int num_mes,
+	bsv_V3f *result_array,
+	bsv_V3f *grad_result_array,
+	const cvtx_VortFunc *kernel,
+	float regularisation_radius);
+
 CVTX_EXPORT void cvtx_P3D_M2M_dvort(
 	const cvtx_P3D **array_start,
 	const int num_particles,
@@ -252,6 +410,54 @@ CVTX_EXPORT int cvtx_P3D_redistribute_on_grid(
 	float grid_density,
 	float negligible_vort);	/* 0 implies nothing is neglidgle, 1 everything*/
 
+CVTX_EXPORT int cvtx_P3D_M2M_vel_vic( /* Returns 0 on success. */
+	const cvtx_P3D **array_start,
+	const int num_particles,
+	const bsv_V3f *mes_start,
+	const int num_mes,
+	bsv_V3f *result_array,
+	const cvtx_RedistFunc *redistributor,
+	float grid_density);
+
+CVTX_EXPORT int cvtx_P3D_M2M_dvort_vic( /* Returns 0 on success. */
+	const cvtx_P3D **array_start,
+	const int num_particles,
+	const cvtx_P3D **induced_start,
+	const int num_induced,
+	bsv_V3f *result_array,
+	const cvtx_RedistFunc *redistributor,
+	float grid_density);
+
+CVTX_EXPORT int cvtx_P3D_M2M_vel_p3m( /* Returns 0 on success. */
+	const cvtx_P3D **array_start,
+	const int num_particles,
+	const bsv_V3f *mes_start,
+	const int num_mes,
+	bsv_V3f *result_array,
+	const cvtx_VortFunc *kernel,
+	float regularisation_radius,
+	const cvtx_RedistFunc *redistributor,
+	float grid_density);
+
+CVTX_EXPORT int cvtx_P3D_M2M_dvort_p3m( /* Returns 0 on success. */
+	const cvtx_P3D **array_start,
+	const int num_particles,
+	const cvtx_P3D **induced_start,
+	const int num_induced,
+	bsv_V3f *result_array,
+	const cvtx_VortFunc *kernel,
+	float regularisation_radius,
+	const cvtx_RedistFunc *redistributor,
+	float grid_density);
+
+/* Use P3M within cvtx_P3D_M2M_vel and cvtx_P3D_M2M_dvort, as 
+cvtx_Context_set_p3m for the calling thread's current context. */
+CVTX_EXPORT void cvtx_P3D_p3m_enable(
+	const cvtx_RedistFunc *redistributor,
+	float grid_density);
+CVTX_EXPORT void cvtx_P3D_p3m_disable(void);
+CVTX_EXPORT int cvtx_P3D_p3m_enabled(void);
+
 CVTX_EXPORT void cvtx_P3D_pedrizzetti_relaxation(
 	cvtx_P3D** input_array_start,
 	const int n_input_particles,
@@ -259,6 +465,37 @@ CVTX_EXPORT void cvtx_P3D_pedrizzetti_relaxation(
 	const cvtx_VortFunc* kernel,
 	float regularisation_radius);
 
+/* Streaming M2M methods for more measurement points than fit in memory.
+The source writes up to max_points points and returns the number written,
+0 when there are no more, or less than 0 on error. The sink receives each
+block of points & results in order and returns non-zero to stop. With
+pipeline, the sink & source run alongside the computation of the block
+between them. block_size of 0 uses the library's choice. */
+typedef int(*cvtx_V3f_source)(void *user_data, bsv_V3f *points, int max_points);
+typedef int(*cvtx_V3f_sink)(void *user_data, const bsv_V3f *points,
+	const bsv_V3f *results, int num_points);
+CVTX_EXPORT int cvtx_P3D_M2M_vel_stream( /* Returns 0 on success. */
+	const cvtx_P3D **array_start,
+	const int num_particles,
+	cvtx_V3f_source source,
+	cvtx_V3f_sink sink,
+	void *user_data,
+	const int block_size,
+	const int pipeline,
+	const cvtx_VortFunc *kernel,
+	float regularisation_radius);
+
+CVTX_EXPORT int cvtx_P3D_M2M_vort_stream( /* Returns 0 on success. */
+	const cvtx_P3D **array_start,
+	const int num_particles,
+	cvtx_V3f_source source,
+	cvtx_V3f_sink sink,
+	void *user_data,
+	const int block_size,
+	const int pipeline,
+	const cvtx_VortFunc *kernel,
+	float regularisation_radius);
+
 /* cvtx_F3D straight vortex filament functions */
 CVTX_EXPORT bsv_V3f cvtx_F3D_S2S_vel(
 	const cvtx_F3D *self,
@@ -365,6 +602,15 @@ CVTX_EXPORT void cvtx_P2D_M2M_visc_dvort(
 	float regularisation_radius,
 	float kinematic_visc);
 
+CVTX_EXPORT int cvtx_P2D_M2M_vel_vic( /* Returns 0 on success. */
+	const cvtx_P2D **array_start,
+	const int num_particles,
+	const bsv_V2f *mes_start,
+	const int num_mes,
+	bsv_V2f *result_array,
+	const cvtx_RedistFunc *redistributor,
+	float grid_density);
+
 CVTX_EXPORT int cvtx_P2D_redistribute_on_grid( /* Returns number of created particles. */
 	const cvtx_P2D **input_array_start,
 	const int num_particles,
@@ -374,4 +620,67 @@ CVTX_EXPORT int cvtx_P2D_redistribute_on_grid( /* Returns number of created part
 	float grid_density,
 	float negligible_vort);
 
+/* Double precision methods */
+CVTX_EXPORT void cvtx_P3Dd_M2M_vel(
+	const cvtx_P3Dd **array_start,
+	const int num_particles,
+	const cvtx_V3d *mes_start,
+	const int num_mes,
+	cvtx_V3d *result_array,
+	const cvtx_VortFunc *kernel,
+	double regularisation_radius);
+
+CVTX_EXPORT void cvtx_P3Dd_M2M_dvort(
+	const cvtx_P3Dd **array_start,
+	const int num_particles,
+	const cvtx_P3Dd **induced_start,
+	const int num_induced,
+	cvtx_V3d *result_array,
+	const cvtx_VortFunc *kernel,
+	double regularisation_radius);
+
+CVTX_EXPORT void cvtx_F3Dd_M2M_vel(
+	const cvtx_F3Dd **array_start,
+	const int num_filaments,
+	const cvtx_V3d *mes_start,
+	const int num_mes,
+	cvtx_V3d *result_array);
+
+CVTX_EXPORT void cvtx_P2Dd_M2M_vel(
+	const cvtx_P2Dd **array_start,
+	const int num_particles,
+	const cvtx_V2d *mes_start,
+	const int num_mes,
+	cvtx_V2d *result_array,
+	const cvtx_VortFunc *kernel,
+	double regularisation_radius);
+
+/* Snapshots of particles and filaments. Opened snapshots are mapped into 
+memory, so that their contents are passed to the M2M methods without being
+read & converted. The kernel may be NULL. */
+CVTX_EXPORT int cvtx_Snapshot_write( /* Returns 0 on success. */
+	const char *path,
+	const cvtx_P3D **p3d_start,
+	const int num_p3d,
+	const cvtx_P2D **p2d_start,
+	const int num_p2d,
+	const cvtx_F3D **f3d_start,
+	const int num_f3d,
+	const cvtx_VortFunc *kernel,
+	float regularisation_radius);
+CVTX_EXPORT cvtx_Snapshot* cvtx_Snapshot_open(const char *path); /* NULL on failure. */
+CVTX_EXPORT void cvtx_Snapshot_close(cvtx_Snapshot *snapshot);
+/* Arrays of pointers into the snapshot, valid until it is closed. */
+CVTX_EXPORT const cvtx_P3D** cvtx_Snapshot_P3D(
+	const cvtx_Snapshot *snapshot, int *num_p3d);
+CVTX_EXPORT const cvtx_P2D** cvtx_Snapshot_P2D(
+	const cvtx_Snapshot *snapshot, int *num_p2d);
+CVTX_EXPORT const cvtx_F3D** cvtx_Snapshot_F3D(
+	const cvtx_Snapshot *snapshot, int *num_f3d);
+CVTX_EXPORT int cvtx_Snapshot_kernel( /* Returns 0 if a built in kernel was saved. */
+	const cvtx_Snapshot *snapshot,
+	cvtx_VortFunc *kernel);
+CVTX_EXPORT float cvtx_Snapshot_regularisation_radius(
+	const cvtx_Snapshot *snapshot);
+
 #endif /* CVTX_LIBCVTX_H */
@@ -27,6 +27,10 @@ SOFTWARE.
 #include <assert.h>
 #include <math.h>
 #include <stdlib.h>
+#include "compensated.h"
+#include "context.h"
+#include "dispatch.h"
+#include "stats.h"
 #include "ocl_F3D.h"
 
 static const float pi_f = 3.14159265359f;
@@ -84,17 +88,35 @@ CVTX_EXPORT bsv_V3f cvtx_F3D_S2S_dvort(
 	return ret;
 };
 
-CVTX_EXPORT bsv_V3f cvtx_F3D_M2S_vel(
+/* The velocity induced at a point by many filaments. If compensated, sums
+in float with compensation (compensated.h) rather than in double. */
+static inline bsv_V3f F3D_vel_sum(
 	const cvtx_F3D **array_start,
 	const int num_particles,
-	const bsv_V3f mes_point) 
+	const bsv_V3f mes_point,
+	int compensated)
 {
-	assert(num_particles >= 0);
-	assert(array_start != NULL);
 	bsv_V3f vel;
-	/* Using Neumaier summation has no effect on result. */
+	/* Using Neumaier summation in double has no effect on result. */
 	double rx = 0, ry = 0, rz = 0;
+	struct csum acc;
 	long i;
+	int l, n;
+	if (compensated) {
+		csum_init(&acc);
+		for (i = 0; i < num_particles; i += CVTX_CSUM_LANES) {
+			n = num_particles - i < CVTX_CSUM_LANES ?
+				(int)(num_particles - i) : CVTX_CSUM_LANES;
+#pragma omp simd
+			for (l = 0; l < n; ++l) {
+				bsv_V3f lvel = cvtx_F3D_S2S_vel(array_start[i + l], mes_point);
+				csum_add3(&acc, l, lvel.x);
+			}
+		}
+		bsv_V3f cret = {
+			csum_result(&acc, 0), csum_result(&acc, 1), csum_result(&acc, 2)};
+		return cret;
+	}
 	for (i = 0; i < num_particles; ++i) {
 		vel = cvtx_F3D_S2S_vel(array_start[i],
 			mes_point);
@@ -106,6 +128,32 @@ CVTX_EXPORT bsv_V3f cvtx_F3D_M2S_vel(
 	return ret;
 }
 
+/* The sum in double of num_blocks partial sums, stride apart. */
+static bsv_V3f F3D_combine_partials(
+	const bsv_V3f *partial, long stride, long num_blocks)
+{
+	double rx = 0, ry = 0, rz = 0;
+	long i;
+	for (i = 0; i < num_blocks; ++i) {
+		rx += partial[i * stride].x[0];
+		ry += partial[i * stride].x[1];
+		rz += partial[i * stride].x[2];
+	}
+	bsv_V3f ret = { (float)rx, (float)ry, (float)rz };
+	return ret;
+}
+
+CVTX_EXPORT bsv_V3f cvtx_F3D_M2S_vel(
+	const cvtx_F3D **array_start,
+	const int num_particles,
+	const bsv_V3f mes_point) 
+{
+	assert(num_particles >= 0);
+	assert(array_start != NULL);
+	return F3D_vel_sum(array_start, num_particles, mes_point,
+		context_compensated());
+}
+
 CVTX_EXPORT bsv_V3f cvtx_F3D_M2S_dvort(
 	const cvtx_F3D **array_start,
 	const int num_particles,
@@ -135,11 +183,39 @@ void cpu_brute_force_StraightVortFilArr_Arr_ind_vel(
 	bsv_V3f *result_array) 
 {
 	long i;
-#pragma omp parallel for schedule(static)
+	int compensated = context_compensated();
+	if (context_tile_sources(num_particles, num_mes)) {
+		/* Tiles of a target and a block of filaments. Partial sums are
+		combined in double. */
+		long num_blocks = (num_particles + CVTX_CSUM_BLOCK - 1) / CVTX_CSUM_BLOCK;
+		size_t ws_mark = workspace_mark();
+		bsv_V3f *partial = workspace_alloc(
+			sizeof(bsv_V3f) * num_mes * num_blocks);
+		if (partial != NULL) {
+#pragma omp parallel for schedule(static) num_threads(context_num_threads())
+			for (i = 0; i < num_mes * num_blocks; ++i) {
+				long first = (i / num_mes) * CVTX_CSUM_BLOCK;
+				partial[i] = F3D_vel_sum(array_start + first,
+					num_particles - first < CVTX_CSUM_BLOCK ?
+						(int)(num_particles - first) : CVTX_CSUM_BLOCK,
+					mes_start[i % num_mes], compensated);
+			}
+			for (i = 0; i < num_mes; ++i) {
+				result_array[i] = F3D_combine_partials(
+					partial + i, num_mes, num_blocks);
+			}
+			workspace_reset(ws_mark);
+			return;
+		}
+		workspace_reset(ws_mark);
+	}
+	struct context_schedule schedule = context_schedule_begin(CVTX_SCHEDULE_STATIC);
+#pragma omp parallel for schedule(runtime) num_threads(context_num_threads())
 	for (i = 0; i < num_mes; ++i) {
-		result_array[i] = cvtx_F3D_M2S_vel(
-			array_start, num_particles, mes_start[i]);
+		result_array[i] = F3D_vel_sum(
+			array_start, num_particles, mes_start[i], compensated);
 	}
+	context_schedule_end(schedule);
 	return;
 }
 
@@ -151,11 +227,13 @@ void cpu_brute_force_StraightVortFilArr_Arr_ind_dvort(
 	bsv_V3f *result_array) 
 {
 	long i;
-#pragma omp parallel for schedule(static)
+	struct context_schedule schedule = context_schedule_begin(CVTX_SCHEDULE_STATIC);
+#pragma omp parallel for schedule(runtime) num_threads(context_num_threads())
 	for (i = 0; i < num_induced; ++i) {
 		result_array[i] = cvtx_F3D_M2S_dvort(
 			array_start, num_particles, induced_start[i]);
 	}
+	context_schedule_end(schedule);
 	return;
 }
 
@@ -166,16 +244,20 @@ CVTX_EXPORT void cvtx_F3D_M2M_vel(
 	const int num_mes,
 	bsv_V3f *result_array)
 {
+	stats_begin("cvtx_F3D_M2M_vel", num_filaments, num_mes);
 #ifdef CVTX_USING_OPENCL
-	if (opencl_brute_force_F3D_M2M_vel(
+	if (!dispatch_use_accelerator(DISPATCH_F3D_VEL, num_filaments, num_mes)
+		|| opencl_brute_force_F3D_M2M_vel(
 			array_start, num_filaments, mes_start,
 			num_mes, result_array) != 0)
 #endif
 	{
+		dispatch_record(CVTX_BACKEND_CPU);
 		cpu_brute_force_StraightVortFilArr_Arr_ind_vel(
 			array_start, num_filaments, mes_start,
 			num_mes, result_array);
 	}
+	stats_end();
 	return;
 }
 
@@ -186,18 +268,20 @@ CVTX_EXPORT void cvtx_F3D_M2M_dvort(
 	const int num_induced,
 	bsv_V3f *result_array)
 {
+	stats_begin("cvtx_F3D_M2M_dvort", num_fil, num_induced);
 #ifdef CVTX_USING_OPENCL
-	if (num_fil < 256
-		|| num_induced < 256
+	if (!dispatch_use_accelerator(DISPATCH_F3D_DVORT, num_fil, num_induced)
 		|| opencl_brute_force_F3D_M2M_dvort(
 			array_start, num_fil, induced_start,
 			num_induced, result_array) != 0)
 #endif
 	{
+		dispatch_record(CVTX_BACKEND_CPU);
 		cpu_brute_force_StraightVortFilArr_Arr_ind_dvort(
 			array_start, num_fil, induced_start,
 			num_induced, result_array);
 	}
+	stats_end();
 	return;
 }
 
@@ -215,7 +299,8 @@ CVTX_EXPORT void cvtx_F3D_inf_mtrx(
 	assert(num_mes >= 0);
 	assert(result_array != NULL);
 	int i;
-#pragma omp parallel for schedule(static)
+	stats_begin("cvtx_F3D_inf_mtrx", num_filaments, num_mes);
+#pragma omp parallel for schedule(static) num_threads(context_num_threads())
 	for (i = 0; i < num_mes; ++i) {
 		int j;
 		bsv_V3f vel;
@@ -224,4 +309,5 @@ CVTX_EXPORT void cvtx_F3D_inf_mtrx(
 			result_array[i * num_filaments + j] = bsv_V3f_dot(vel, dir_start[i]);
 		}
 	}
+	stats_end();
 }
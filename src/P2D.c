@@ -31,7 +31,14 @@ SOFTWARE.
 #include <stdlib.h>
 #include <string.h>
 
+#include "compensated.h"
+#include "context.h"
+#include "dispatch.h"
+#include "numa.h"
+#include "stats.h"
 #include "uintkey.h"
+#include "vortfunc_builtin.h"
+#include "workspace.h"
 #include "redistribution_helper_funcs.h"
 
 #ifdef CVTX_USING_OPENCL
@@ -45,7 +52,7 @@ coefficient 1 / 2pi */
 static inline bsv_V2f P2D_vel_inner(
 	const cvtx_P2D * self,
 	const bsv_V2f mes_point,
-	const cvtx_VortFunc * kernel,
+	float (*g_2D)(float),
 	float recip_reg_rad)
 {
 	bsv_V2f rad, ret;
@@ -57,7 +64,7 @@ static inline bsv_V2f P2D_vel_inner(
 		rad = bsv_V2f_minus(mes_point, self->coord);
 		radd = bsv_V2f_abs(rad);
 		rho = radd * recip_reg_rad;
-		g = kernel->g_2D(rho);
+		g = g_2D(rho);
 		ret.x[0] = rad.x[1] * self->vorticity * g / (radd * radd);
 		ret.x[1] = -rad.x[0] * self->vorticity * g / (radd * radd);
 	}
@@ -71,7 +78,7 @@ CVTX_EXPORT bsv_V2f cvtx_P2D_S2S_vel(
 	float regularisation_radius)
 {
 	bsv_V2f ret;
-	ret = P2D_vel_inner(self, mes_point, kernel,
+	ret = P2D_vel_inner(self, mes_point, kernel->g_2D,
 		1.f / fabsf(regularisation_radius));
 	return bsv_V2f_mult(ret, 1.f / (2.f * acosf(-1.f)));
 }
@@ -84,7 +91,7 @@ CVTX_EXPORT void cvtx_P2D_S2M_vel(
 	const cvtx_VortFunc* kernel,
 	float regularisation_radius) {
 	int i;
-#pragma omp parallel for
+#pragma omp parallel for num_threads(context_num_threads())
 	for (i = 0; i < num_mes; ++i) {
 		result_array[i] = cvtx_P2D_S2S_vel(
 			self, mes_start[i], kernel, regularisation_radius);
@@ -92,6 +99,85 @@ CVTX_EXPORT void cvtx_P2D_S2M_vel(
 	return;
 }
 
+/* The velocity induced at a point by many particles, excluding the
+constant coefficient 1 / 2pi. If compensated, sums in float with
+compensation (compensated.h) rather than in double. */
+static inline bsv_V2f P2D_vel_sum(
+	const cvtx_P2D **array_start,
+	const int num_particles,
+	const bsv_V2f mes_point,
+	float (*g_2D)(float),
+	float recip_reg_rad,
+	int compensated)
+{
+	double rx = 0, ry = 0;
+	struct csum acc;
+	long i;
+	int l, n;
+	if (compensated) {
+		csum_init(&acc);
+		for (i = 0; i < num_particles; i += CVTX_CSUM_LANES) {
+			n = num_particles - i < CVTX_CSUM_LANES ?
+				(int)(num_particles - i) : CVTX_CSUM_LANES;
+#pragma omp simd
+			for (l = 0; l < n; ++l) {
+				bsv_V2f vel = P2D_vel_inner(array_start[i + l],
+					mes_point, g_2D, recip_reg_rad);
+				csum_add2(&acc, l, vel.x);
+			}
+		}
+		bsv_V2f cret = { csum_result(&acc, 0), csum_result(&acc, 1) };
+		return cret;
+	}
+	for (i = 0; i < num_particles; ++i) {
+		bsv_V2f vel = P2D_vel_inner(array_start[i],
+			mes_point, g_2D, recip_reg_rad);
+		rx += vel.x[0];
+		ry += vel.x[1];
+	}
+	bsv_V2f ret = { (float)rx, (float)ry };
+	return ret;
+}
+
+/* P2D_vel_sum for the M2M methods. The regularisation functions of built in
+kernels (builtin is their vortfunc_builtin_index) are inlined into the
+loop rather than called through kernel. */
+static bsv_V2f P2D_M2M_vel_sum(
+	const cvtx_P2D **array_start,
+	const int num_particles,
+	const bsv_V2f mes_point,
+	const cvtx_VortFunc *kernel,
+	int builtin,
+	float recip_reg_rad,
+	int compensated)
+{
+	switch (builtin) {
+#define CVTX_P2D_VEL_CASE(NAME, G_3D, ZETA_3D, ETA_3D, G_2D, ETA_2D, VISCOUS) \
+	case VORTFUNC_##NAME:													\
+		return P2D_vel_sum(array_start, num_particles, mes_point,			\
+			&vortfunc_g_2D_##NAME, recip_reg_rad, compensated);
+		CVTX_BUILTIN_VORTFUNCS(CVTX_P2D_VEL_CASE)
+#undef CVTX_P2D_VEL_CASE
+	default:
+		return P2D_vel_sum(array_start, num_particles, mes_point,
+			kernel->g_2D, recip_reg_rad, compensated);
+	}
+}
+
+/* The sum in double of num_blocks partial sums, stride apart. */
+static bsv_V2f P2D_combine_partials(
+	const bsv_V2f *partial, long stride, long num_blocks)
+{
+	double rx = 0, ry = 0;
+	long i;
+	for (i = 0; i < num_blocks; ++i) {
+		rx += partial[i * stride].x[0];
+		ry += partial[i * stride].x[1];
+	}
+	bsv_V2f ret = { (float)rx, (float)ry };
+	return ret;
+}
+
 CVTX_EXPORT bsv_V2f cvtx_P2D_M2S_vel(
 	const cvtx_P2D **array_start,
 	const int num_particles,
@@ -101,12 +187,27 @@ CVTX_EXPORT bsv_V2f cvtx_P2D_M2S_vel(
 {
 	double rx = 0, ry = 0;
 	long i;
+	int builtin = vortfunc_builtin_index(kernel);
 	float recip_reg_rad = 1.f / fabsf(regularisation_radius);
 	assert(num_particles >= 0);
-#pragma omp parallel for reduction(+:rx, ry)
+	if (context_compensated()) {
+		/* Compensated sums of blocks of particles, combined in double. */
+#pragma omp parallel for reduction(+:rx, ry) schedule(static) num_threads(context_num_threads())
+		for (i = 0; i < num_particles; i += CVTX_CSUM_BLOCK) {
+			bsv_V2f vel = P2D_M2M_vel_sum(array_start + i,
+				num_particles - i < CVTX_CSUM_BLOCK ?
+					(int)(num_particles - i) : CVTX_CSUM_BLOCK,
+				mes_point, kernel, builtin, recip_reg_rad, 1);
+			rx += vel.x[0];
+			ry += vel.x[1];
+		}
+		bsv_V2f cret = { (float)rx, (float)ry };
+		return bsv_V2f_mult(cret, 1.f / (2.f * acosf(-1.f)));
+	}
+#pragma omp parallel for reduction(+:rx, ry) num_threads(context_num_threads())
 	for (i = 0; i < num_particles; ++i) {
 		bsv_V2f vel = P2D_vel_inner(array_start[i],
-			mes_point, kernel, recip_reg_rad);
+			mes_point, kernel->g_2D, recip_reg_rad);
 		rx += vel.x[0];
 		ry += vel.x[1];
 	}
@@ -114,7 +215,6 @@ CVTX_EXPORT bsv_V2f cvtx_P2D_M2S_vel(
 	return bsv_V2f_mult(ret, 1.f / (2.f * acosf(-1.f)));
 }
 
-
 static void cpu_brute_force_P2D_M2M_vel(
 	const cvtx_P2D **array_start,
 	const int num_particles,
@@ -125,12 +225,50 @@ static void cpu_brute_force_P2D_M2M_vel(
 	float regularisation_radius)
 {
 	long i;
-#pragma omp parallel for schedule(static)
+	int builtin = vortfunc_builtin_index(kernel);
+	int compensated = context_compensated();
+	float recip_reg_rad = 1.f / fabsf(regularisation_radius);
+	float coeff = 1.f / (2.f * acosf(-1.f));
+	struct numa_sources copies;
+	numa_sources_create(&copies, (const void**)array_start, num_particles,
+		sizeof(cvtx_P2D));
+	if (context_tile_sources(num_particles, num_mes)) {
+		/* Tiles of a target and a block of sources. Partial sums are
+		combined in double. */
+		long num_blocks = (num_particles + CVTX_CSUM_BLOCK - 1) / CVTX_CSUM_BLOCK;
+		size_t ws_mark = workspace_mark();
+		bsv_V2f *partial = workspace_alloc(
+			sizeof(bsv_V2f) * num_mes * num_blocks);
+		if (partial != NULL) {
+#pragma omp parallel for schedule(static) num_threads(context_num_threads())
+			for (i = 0; i < num_mes * num_blocks; ++i) {
+				const cvtx_P2D **sources = (const cvtx_P2D**)numa_sources_local(&copies);
+				long first = (i / num_mes) * CVTX_CSUM_BLOCK;
+				partial[i] = P2D_M2M_vel_sum(sources + first,
+					num_particles - first < CVTX_CSUM_BLOCK ?
+						(int)(num_particles - first) : CVTX_CSUM_BLOCK,
+					mes_start[i % num_mes], kernel, builtin, recip_reg_rad,
+					compensated);
+			}
+			for (i = 0; i < num_mes; ++i) {
+				result_array[i] = bsv_V2f_mult(
+					P2D_combine_partials(partial + i, num_mes, num_blocks), coeff);
+			}
+			workspace_reset(ws_mark);
+			numa_sources_release(&copies);
+			return;
+		}
+		workspace_reset(ws_mark);
+	}
+	struct context_schedule schedule = context_schedule_begin(CVTX_SCHEDULE_STATIC);
+#pragma omp parallel for schedule(runtime) num_threads(context_num_threads())
 	for (i = 0; i < num_mes; ++i) {
-		result_array[i] = cvtx_P2D_M2S_vel(
-			array_start, num_particles, mes_start[i],
-			kernel, regularisation_radius);
+		result_array[i] = bsv_V2f_mult(P2D_M2M_vel_sum(
+			(const cvtx_P2D**)numa_sources_local(&copies), num_particles,
+			mes_start[i], kernel, builtin, recip_reg_rad, compensated), coeff);
 	}
+	context_schedule_end(schedule);
+	numa_sources_release(&copies);
 	return;
 }
 
@@ -143,17 +281,21 @@ CVTX_EXPORT void cvtx_P2D_M2M_vel(
 	const cvtx_VortFunc *kernel,
 	float regularisation_radius)
 {
+	stats_begin("cvtx_P2D_M2M_vel", num_particles, num_mes);
 #ifdef CVTX_USING_OPENCL
-	if (!strcmp(kernel->cl_kernel_name_ext, "")
+	if (!dispatch_use_accelerator(DISPATCH_P2D_VEL, num_particles, num_mes)
+		|| !strcmp(kernel->cl_kernel_name_ext, "")
 		|| opencl_brute_force_P2D_M2M_vel(
 			array_start, num_particles, mes_start,
 			num_mes, result_array, kernel, regularisation_radius) != 0)
 #endif
 	{
+		dispatch_record(CVTX_BACKEND_CPU);
 		cpu_brute_force_P2D_M2M_vel(
 			array_start, num_particles, mes_start,
 			num_mes, result_array, kernel, regularisation_radius);
 	}
+	stats_end();
 	return;
 }
 
@@ -198,7 +340,7 @@ CVTX_EXPORT void cvtx_P2D_S2M_visc_dvort(
 	float regularisation_radius,
 	float kinematic_visc) {
 	int i;
-#pragma omp parallel for
+#pragma omp parallel for num_threads(context_num_threads())
 	for (i = 0; i < num_induced; ++i) {
 		result_array[i] = cvtx_P2D_S2S_visc_dvort(
 			self, induced_start[i], kernel, 
@@ -207,6 +349,25 @@ CVTX_EXPORT void cvtx_P2D_S2M_visc_dvort(
 	return;
 }
 
+/* The viscous rate of change of vorticity induced on a particle by many,
+summed in double. */
+static double P2D_visc_dvort_sum(
+	const cvtx_P2D **array_start,
+	const int num_particles,
+	const cvtx_P2D *induced_particle,
+	const cvtx_VortFunc *kernel,
+	float regularisation_radius,
+	float kinematic_visc)
+{
+	double dvort = 0.;
+	long i;
+	for (i = 0; i < num_particles; ++i) {
+		dvort += (double)cvtx_P2D_S2S_visc_dvort(array_start[i],
+			induced_particle, kernel, regularisation_radius, kinematic_visc);
+	}
+	return dvort;
+}
+
 CVTX_EXPORT float cvtx_P2D_M2S_visc_dvort(
 	const cvtx_P2D **array_start,
 	const int num_particles,
@@ -218,7 +379,7 @@ CVTX_EXPORT float cvtx_P2D_M2S_visc_dvort(
 	double dvort = 0.;
 	long i;
 	assert(num_particles >= 0);
-#pragma omp parallel for reduction(+:dvort)
+#pragma omp parallel for reduction(+:dvort) num_threads(context_num_threads())
 	for (i = 0; i < num_particles; ++i) {
 		dvort += (double)cvtx_P2D_S2S_visc_dvort(array_start[i],
 			induced_particle, kernel, regularisation_radius, kinematic_visc);
@@ -237,11 +398,43 @@ void cpu_brute_force_P2D_M2M_visc_dvort(
 	float kinematic_visc)
 {
 	long i;
+	if (context_tile_sources(num_particles, num_induced)) {
+		/* As cpu_brute_force_P2D_M2M_vel. */
+		long num_blocks = (num_particles + CVTX_CSUM_BLOCK - 1) / CVTX_CSUM_BLOCK;
+		size_t ws_mark = workspace_mark();
+		double *partial = workspace_alloc(
+			sizeof(double) * num_induced * num_blocks);
+		if (partial != NULL) {
+#pragma omp parallel for schedule(static) num_threads(context_num_threads())
+			for (i = 0; i < num_induced * num_blocks; ++i) {
+				long first = (i / num_induced) * CVTX_CSUM_BLOCK;
+				partial[i] = P2D_visc_dvort_sum(array_start + first,
+					num_particles - first < CVTX_CSUM_BLOCK ?
+						(int)(num_particles - first) : CVTX_CSUM_BLOCK,
+					induced_start[i % num_induced], kernel,
+					regularisation_radius, kinematic_visc);
+			}
+			for (i = 0; i < num_induced; ++i) {
+				double dvort = 0.;
+				long j;
+				for (j = 0; j < num_blocks; ++j) {
+					dvort += partial[i + j * num_induced];
+				}
+				result_array[i] = (float)dvort;
+			}
+			workspace_reset(ws_mark);
+			return;
+		}
+		workspace_reset(ws_mark);
+	}
+	struct context_schedule schedule = context_schedule_begin(CVTX_SCHEDULE_STATIC);
+#pragma omp parallel for schedule(runtime) num_threads(context_num_threads())
 	for (i = 0; i < num_induced; ++i) {
-		result_array[i] = cvtx_P2D_M2S_visc_dvort(
+		result_array[i] = (float)P2D_visc_dvort_sum(
 			array_start, num_particles, induced_start[i],
 			kernel, regularisation_radius, kinematic_visc);
 	}
+	context_schedule_end(schedule);
 	return;
 }
 
@@ -255,19 +448,21 @@ CVTX_EXPORT void cvtx_P2D_M2M_visc_dvort(
 	float regularisation_radius,
 	float kinematic_visc)
 {
+	stats_begin("cvtx_P2D_M2M_visc_dvort", num_particles, num_induced);
 #ifdef CVTX_USING_OPENCL
-	if (num_particles < 256
-		|| num_induced < 256
+	if (!dispatch_use_accelerator(DISPATCH_P2D_VISC_DVORT, num_particles, num_induced)
 		|| !strcmp(kernel->cl_kernel_name_ext, "")
 		|| opencl_brute_force_P2D_M2M_visc_dvort(
 			array_start, num_particles, induced_start,
 			num_induced, result_array, kernel, regularisation_radius, kinematic_visc) != 0)
 #endif
 	{
+		dispatch_record(CVTX_BACKEND_CPU);
 		cpu_brute_force_P2D_M2M_visc_dvort(
 			array_start, num_particles, induced_start,
 			num_induced, result_array, kernel, regularisation_radius, kinematic_visc);
 	}
+	stats_end();
 	return;
 }
 
@@ -304,6 +499,9 @@ CVTX_EXPORT int cvtx_P2D_redistribute_on_grid(
 	unsigned int *nidx_array = NULL;
 	/* For particle removal: */
 	float min_keepable_particle;
+	size_t ws_mark = workspace_mark();	/* To release scratch memory. */
+	stats_begin("cvtx_P2D_redistribute_on_grid",
+		n_input_particles, max_output_particles);
 
 	/* Generate grid keys for existing particles. */
 	minmax_xy_posn(input_array_start, n_input_particles, &minx, NULL, &miny, NULL);
@@ -311,8 +509,19 @@ CVTX_EXPORT int cvtx_P2D_redistribute_on_grid(
 	minx -= grid_radius * grid_density;
 	miny -= grid_radius * grid_density;
 
-	oidx_array = malloc(sizeof(unsigned int) * n_input_particles);
-	okey_array = malloc(sizeof(UInt32Key2D) * n_input_particles);
+	/* ppop = Particles per orginal particle. */
+	ppop = (grid_radius * 2 + 1) * (grid_radius * 2 + 1);
+	oidx_array = workspace_alloc(sizeof(unsigned int) * n_input_particles);
+	okey_array = workspace_alloc(sizeof(UInt32Key2D) * n_input_particles);
+	nkey_array = workspace_alloc(sizeof(UInt32Key2D) * ppop * n_input_particles);
+	nvort_array = workspace_alloc(sizeof(float) * ppop * n_input_particles); 
+	nidx_array = workspace_alloc(sizeof(unsigned int) * ppop * n_input_particles);
+	if (oidx_array == NULL || okey_array == NULL || nkey_array == NULL
+		|| nvort_array == NULL || nidx_array == NULL) {
+		workspace_reset(ws_mark);
+		stats_end();
+		return -1;
+	}
 	for (i = 0; i < n_input_particles; ++i) {
 		oidx_array[i] = i;
 		okey_array[i] = g_P2D_gridkey2D(input_array_start[i],
@@ -320,11 +529,6 @@ CVTX_EXPORT int cvtx_P2D_redistribute_on_grid(
 	}
 	
 	/* Now we make new particles based on grid. */
-	/* ppop = Particles per orginal particle. */
-	ppop = (grid_radius * 2 + 1) * (grid_radius * 2 + 1);
-	nkey_array = malloc(sizeof(UInt32Key2D) * ppop * n_input_particles);
-	nvort_array = malloc(sizeof(float) * ppop * n_input_particles); 
-	nidx_array = malloc(sizeof(unsigned int) * ppop * n_input_particles);
 	for (i = 0; i < n_input_particles; ++i) {
 		int widx = oidx_array[i];
 		unsigned int okx, oky;
@@ -353,14 +557,17 @@ CVTX_EXPORT int cvtx_P2D_redistribute_on_grid(
 			}
 		}
 	}
-	free(oidx_array);
-	free(okey_array);
 
 	/* Now merge our new particles */
-	sort_perm_UInt32Key2D(nkey_array, nidx_array, n_input_particles * ppop);
-
-	nnkey_array = malloc(sizeof(UInt32Key2D) * n_input_particles * ppop);
-	nnvort_array = malloc(sizeof(float) * n_input_particles * ppop);
+	nnkey_array = workspace_alloc(sizeof(UInt32Key2D) * n_input_particles * ppop);
+	nnvort_array = workspace_alloc(sizeof(float) * n_input_particles * ppop);
+	if (nnkey_array == NULL || nnvort_array == NULL
+		|| sort_perm_UInt32Key2D(nkey_array, nidx_array,
+			n_input_particles * ppop) != 0) {
+		workspace_reset(ws_mark);
+		stats_end();
+		return -1;
+	}
 	for (i = 0; i < ppop * n_input_particles; ++i) {
 		nnkey_array[i] = nkey_array[nidx_array[i]];
 		nnvort_array[i] = nvort_array[nidx_array[i]];
@@ -382,27 +589,27 @@ CVTX_EXPORT int cvtx_P2D_redistribute_on_grid(
 			nvort_array[j] = nnvort_array[i];
 		}
 	}
-	free(nnkey_array);
-	free(nnvort_array);
 	n_created_particles = (j < ppop * n_input_particles ? j + 1 : 0);
 
 	/* Go back to array of particles. */
 	cvtx_P2D* created_particles = NULL;
-	created_particles = malloc(n_created_particles * sizeof(cvtx_P2D));
-#pragma omp parallel for
+	created_particles = workspace_alloc(n_created_particles * sizeof(cvtx_P2D));
+	float* strengths = workspace_alloc(sizeof(float) * n_created_particles);
+	if (created_particles == NULL || strengths == NULL) {
+		workspace_reset(ws_mark);
+		stats_end();
+		return -1;
+	}
+#pragma omp parallel for num_threads(context_num_threads())
 	for (i = 0; i < n_created_particles; ++i) {
 		created_particles[i].area = grid_density * grid_density;
 		created_particles[i].vorticity = nvort_array[i];
 		created_particles[i].coord.x[0] = minx + nkey_array[i].k.x * grid_density;
 		created_particles[i].coord.x[1] = miny + nkey_array[i].k.y * grid_density;
 	}
-	free(nkey_array);
-	free(nvort_array);
-	free(nidx_array);
 
 	/* Remove particles with neglidgible vorticity. */
-	float* strengths = malloc(sizeof(float) * n_created_particles);
-#pragma omp parallel for
+#pragma omp parallel for num_threads(context_num_threads())
 	for (i = 0; i < n_created_particles; ++i) {
 		strengths[i] = fabsf(created_particles[i].vorticity);
 	}
@@ -412,7 +619,7 @@ CVTX_EXPORT int cvtx_P2D_redistribute_on_grid(
 		created_particles, strengths, n_created_particles, 
 		min_keepable_particle, n_created_particles);
 	/* The strengths are modified to keep total vorticity constant. */
-#pragma omp parallel for
+#pragma omp parallel for num_threads(context_num_threads())
 	for (i = 0; i < n_created_particles; ++i) {
 		strengths[i] = fabsf(created_particles[i].vorticity);
 	}
@@ -429,8 +636,8 @@ CVTX_EXPORT int cvtx_P2D_redistribute_on_grid(
 		/* And now make an array to return to our caller. */
 		memcpy(output_particles, created_particles, sizeof(cvtx_P2D) * n_created_particles);
 	}
-	/* Free remaining arrays. */
-	free(created_particles);
+	workspace_reset(ws_mark);
+	stats_end();
 	return n_created_particles;
 }
 
@@ -30,9 +30,20 @@ SOFTWARE.
 #include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
+#ifdef CVTX_USING_OPENMP
+#	include <omp.h>
+#endif
 
+#include "compensated.h"
+#include "context.h"
+#include "dispatch.h"
+#include "numa.h"
+#include "stats.h"
+#include "p3m.h"
 #include "redistribution_helper_funcs.h"
 #include "uintkey.h"
+#include "vortfunc_builtin.h"
+#include "workspace.h"
 
 #ifdef CVTX_USING_OPENCL
 #	include "ocl_P3D.h"
@@ -45,7 +56,7 @@ coefficient 1 / 4pi */
 static inline bsv_V3f P3D_vel_inner(
 	const cvtx_P3D * self,
 	const bsv_V3f mes_point,
-	const cvtx_VortFunc * kernel,
+	float (*g_3D)(float),
 	float recip_reg_rad)
 {
 	bsv_V3f rad, num, ret;
@@ -57,7 +68,7 @@ static inline bsv_V3f P3D_vel_inner(
 		rad = bsv_V3f_minus(mes_point, self->coord);
 		radd = bsv_V3f_abs(rad);
 		rho = radd * recip_reg_rad; /* Assume positive. */
-		cor = -kernel->g_3D(rho);
+		cor = -g_3D(rho);
 		den = powf(radd, -3);
 		num = bsv_V3f_cross(rad, self->vorticity);
 		ret = bsv_V3f_mult(num, cor * den);
@@ -65,6 +76,50 @@ static inline bsv_V3f P3D_vel_inner(
 	return ret;
 }
 
+/* The induced velocity and its gradient for a particle excluding the
+constant coefficient 1 / 4pi. grad[j].x[k] is d vel_j / d x_k. */
+static inline void P3D_vel_grad_inner(
+	const cvtx_P3D * self,
+	const bsv_V3f mes_point,
+	void (*combined_3D)(float, float*, float*),
+	float recip_reg_rad,
+	bsv_V3f *vel,
+	bsv_V3f *grad)
+{
+	bsv_V3f rad, a, ar;
+	float g, zeta, radd, rho, f, c;
+	int j;
+	if (bsv_V3f_isequal(self->coord, mes_point)) {
+		*vel = bsv_V3f_zero();
+		for (j = 0; j < 3; ++j) { grad[j] = bsv_V3f_zero(); }
+	}
+	else {
+		rad = bsv_V3f_minus(mes_point, self->coord);
+		radd = bsv_V3f_abs(rad);
+		rho = radd * recip_reg_rad; /* Assume positive. */
+		combined_3D(rho, &g, &zeta);
+		/* vel = f * (a x rad) where f = g / |r|^3 and
+		d f / d x_k = c * rad_k with c = (zeta / sigma^3 - 3 f) / |r|^2 */
+		f = g / (radd * radd * radd);
+		c = zeta != 0.f	/* Avoid 0 * inf for singular kernels. */
+			? zeta * recip_reg_rad * recip_reg_rad * recip_reg_rad : 0.f;
+		c = (c - 3.f * f) / (radd * radd);
+		a = self->vorticity;
+		ar = bsv_V3f_cross(a, rad);
+		*vel = bsv_V3f_mult(ar, f);
+		for (j = 0; j < 3; ++j) {
+			grad[j] = bsv_V3f_mult(rad, c * ar.x[j]);
+		}
+		grad[0].x[1] -= f * a.x[2];
+		grad[0].x[2] += f * a.x[1];
+		grad[1].x[0] += f * a.x[2];
+		grad[1].x[2] -= f * a.x[0];
+		grad[2].x[0] -= f * a.x[1];
+		grad[2].x[1] += f * a.x[0];
+	}
+	return;
+}
+
 CVTX_EXPORT bsv_V3f cvtx_P3D_S2S_vel(
 	const cvtx_P3D * self,
 	const bsv_V3f mes_point,
@@ -72,15 +127,16 @@ CVTX_EXPORT bsv_V3f cvtx_P3D_S2S_vel(
 	float regularisation_radius)
 {
 	bsv_V3f ret;
-	ret = P3D_vel_inner(self, mes_point, kernel, 
+	ret = P3D_vel_inner(self, mes_point, kernel->g_3D, 
 		1.f/fabsf(regularisation_radius));
 	return bsv_V3f_mult(ret, 1.f / (4.f * CVTX_PI_F));
 }
 
-CVTX_EXPORT bsv_V3f cvtx_P3D_S2S_dvort(
+/* The rate of change of vorticity induced on a particle. */
+static inline bsv_V3f P3D_dvort_inner(
 	const cvtx_P3D * self,
 	const cvtx_P3D * induced_particle,
-	const cvtx_VortFunc * kernel,
+	void (*combined_3D)(float, float*, float*),
 	float regularisation_radius)
 {
 	bsv_V3f ret, rad, cross_om, t2, t21, t21n, t22;
@@ -91,7 +147,7 @@ CVTX_EXPORT bsv_V3f cvtx_P3D_S2S_dvort(
 		rad = bsv_V3f_minus(induced_particle->coord, self->coord);
 		radd = bsv_V3f_abs(rad);
 		rho = fabsf(radd / regularisation_radius);
-		kernel->combined_3D(rho, &g, &f);
+		combined_3D(rho, &g, &f);
 		cross_om = bsv_V3f_cross(induced_particle->vorticity, self->vorticity);
 		t1 = 1.f / (4.f * CVTX_PI_F * powf(regularisation_radius, 3));
 		t21n = bsv_V3f_mult(cross_om, g);
@@ -107,6 +163,163 @@ CVTX_EXPORT bsv_V3f cvtx_P3D_S2S_dvort(
 	return ret;
 }
 
+/* The velocity induced at a point by many particles, excluding the
+constant coefficient 1 / 4pi. If compensated, sums in float with
+compensation (compensated.h) rather than in double. */
+static inline bsv_V3f P3D_vel_sum(
+	const cvtx_P3D **array_start,
+	const int num_particles,
+	const bsv_V3f mes_point,
+	float (*g_3D)(float),
+	float recip_reg_rad,
+	int compensated)
+{
+	double rx = 0, ry = 0, rz = 0;
+	struct csum acc;
+	long i;
+	int l, n;
+	if (compensated) {
+		csum_init(&acc);
+		for (i = 0; i < num_particles; i += CVTX_CSUM_LANES) {
+			n = num_particles - i < CVTX_CSUM_LANES ?
+				(int)(num_particles - i) : CVTX_CSUM_LANES;
+#pragma omp simd
+			for (l = 0; l < n; ++l) {
+				bsv_V3f vel = P3D_vel_inner(array_start[i + l],
+					mes_point, g_3D, recip_reg_rad);
+				csum_add3(&acc, l, vel.x);
+			}
+		}
+		bsv_V3f cret = {
+			csum_result(&acc, 0), csum_result(&acc, 1), csum_result(&acc, 2)};
+		return cret;
+	}
+	for (i = 0; i < num_particles; ++i) {
+		bsv_V3f vel = P3D_vel_inner(array_start[i],
+			mes_point, g_3D, recip_reg_rad);
+		rx += vel.x[0];
+		ry += vel.x[1];
+		rz += vel.x[2];
+	}
+	bsv_V3f ret = {(float)rx, (float)ry, (float)rz};
+	return ret;
+}
+
+/* The rate of change of vorticity induced on a particle by many,
+compensated as P3D_vel_sum. */
+static inline bsv_V3f P3D_dvort_sum(
+	const cvtx_P3D **array_start,
+	const int num_particles,
+	const cvtx_P3D *induced_particle,
+	void (*combined_3D)(float, float*, float*),
+	float regularisation_radius,
+	int compensated)
+{
+	bsv_V3f dvort;
+	double rx = 0, ry = 0, rz = 0;
+	struct csum acc;
+	long i;
+	int l, n;
+	if (compensated) {
+		csum_init(&acc);
+		for (i = 0; i < num_particles; i += CVTX_CSUM_LANES) {
+			n = num_particles - i < CVTX_CSUM_LANES ?
+				(int)(num_particles - i) : CVTX_CSUM_LANES;
+#pragma omp simd
+			for (l = 0; l < n; ++l) {
+				bsv_V3f ldvort = P3D_dvort_inner(array_start[i + l],
+					induced_particle, combined_3D, regularisation_radius);
+				csum_add3(&acc, l, ldvort.x);
+			}
+		}
+		bsv_V3f cret = {
+			csum_result(&acc, 0), csum_result(&acc, 1), csum_result(&acc, 2)};
+		return cret;
+	}
+	for (i = 0; i < num_particles; ++i) {
+		dvort = P3D_dvort_inner(array_start[i],
+			induced_particle, combined_3D, regularisation_radius);
+		rx += dvort.x[0];
+		ry += dvort.x[1];
+		rz += dvort.x[2];
+	}
+	bsv_V3f ret = {(float)rx, (float)ry, (float)rz};
+	return ret;
+}
+
+/* P3D_vel_sum for the M2M methods. The regularisation functions of built in
+kernels (builtin is their vortfunc_builtin_index) are inlined into the
+loop rather than called through kernel. */
+static bsv_V3f P3D_M2M_vel_sum(
+	const cvtx_P3D **array_start,
+	const int num_particles,
+	const bsv_V3f mes_point,
+	const cvtx_VortFunc *kernel,
+	int builtin,
+	float recip_reg_rad,
+	int compensated)
+{
+	switch (builtin) {
+#define CVTX_P3D_VEL_CASE(NAME, G_3D, ZETA_3D, ETA_3D, G_2D, ETA_2D, VISCOUS) \
+	case VORTFUNC_##NAME:													\
+		return P3D_vel_sum(array_start, num_particles, mes_point,			\
+			&vortfunc_g_3D_##NAME, recip_reg_rad, compensated);
+		CVTX_BUILTIN_VORTFUNCS(CVTX_P3D_VEL_CASE)
+#undef CVTX_P3D_VEL_CASE
+	default:
+		return P3D_vel_sum(array_start, num_particles, mes_point,
+			kernel->g_3D, recip_reg_rad, compensated);
+	}
+}
+
+/* P3D_dvort_sum for the M2M methods, as P3D_M2M_vel_sum. */
+static bsv_V3f P3D_M2M_dvort_sum(
+	const cvtx_P3D **array_start,
+	const int num_particles,
+	const cvtx_P3D *induced_particle,
+	const cvtx_VortFunc *kernel,
+	int builtin,
+	float regularisation_radius,
+	int compensated)
+{
+	switch (builtin) {
+#define CVTX_P3D_DVORT_CASE(NAME, G_3D, ZETA_3D, ETA_3D, G_2D, ETA_2D, VISCOUS) \
+	case VORTFUNC_##NAME:													\
+		return P3D_dvort_sum(array_start, num_particles, induced_particle,	\
+			&vortfunc_combined_3D_##NAME, regularisation_radius, compensated);
+		CVTX_BUILTIN_VORTFUNCS(CVTX_P3D_DVORT_CASE)
+#undef CVTX_P3D_DVORT_CASE
+	default:
+		return P3D_dvort_sum(array_start, num_particles, induced_particle,
+			kernel->combined_3D, regularisation_radius, compensated);
+	}
+}
+
+/* The sum in double of num_blocks partial sums, stride apart. */
+static bsv_V3f P3D_combine_partials(
+	const bsv_V3f *partial, long stride, long num_blocks)
+{
+	double rx = 0, ry = 0, rz = 0;
+	long i;
+	for (i = 0; i < num_blocks; ++i) {
+		rx += partial[i * stride].x[0];
+		ry += partial[i * stride].x[1];
+		rz += partial[i * stride].x[2];
+	}
+	bsv_V3f ret = {(float)rx, (float)ry, (float)rz};
+	return ret;
+}
+
+CVTX_EXPORT bsv_V3f cvtx_P3D_S2S_dvort(
+	const cvtx_P3D * self,
+	const cvtx_P3D * induced_particle,
+	const cvtx_VortFunc * kernel,
+	float regularisation_radius)
+{
+	return P3D_dvort_inner(self, induced_particle,
+		kernel->combined_3D, regularisation_radius);
+}
+
 CVTX_EXPORT bsv_V3f cvtx_P3D_S2S_visc_dvort(
 	const cvtx_P3D * self,
 	const cvtx_P3D * induced_particle,
@@ -162,7 +375,7 @@ CVTX_EXPORT void cvtx_P3D_S2M_vel(
 	const cvtx_VortFunc* kernel,
 	float regularisation_radius) {
 	int i;
-#pragma omp parallel for
+#pragma omp parallel for num_threads(context_num_threads())
 	for (i = 0; i < num_mes; ++i) {
 		result_array[i] = cvtx_P3D_S2S_vel(
 			self, mes_start[i], kernel, regularisation_radius);
@@ -178,7 +391,7 @@ CVTX_EXPORT void cvtx_P3D_S2M_dvort(
 	const cvtx_VortFunc* kernel,
 	float regularisation_radius) {
 	int i;
-#pragma omp parallel for
+#pragma omp parallel for num_threads(context_num_threads())
 	for (i = 0; i < num_induced; ++i) {
 		result_array[i] = cvtx_P3D_S2S_dvort(
 			self, induced_start[i], kernel, regularisation_radius);
@@ -195,7 +408,7 @@ CVTX_EXPORT void cvtx_P3D_S2M_visc_dvort(
 	float regularisation_radius,
 	float kinematic_visc) {
 	int i;
-#pragma omp parallel for
+#pragma omp parallel for num_threads(context_num_threads())
 	for (i = 0; i < num_induced; ++i) {
 		result_array[i] = cvtx_P3D_S2S_visc_dvort(
 			self, induced_start[i], 
@@ -212,7 +425,7 @@ CVTX_EXPORT void cvtx_P3D_S2M_vort(
 	const cvtx_VortFunc* kernel,
 	float regularisation_radius) {
 	int i;
-#pragma omp parallel for
+#pragma omp parallel for num_threads(context_num_threads())
 	for (i = 0; i < num_mes; ++i) {
 		result_array[i] = cvtx_P3D_S2S_vort(
 			self, mes_start[i],
@@ -230,12 +443,28 @@ CVTX_EXPORT bsv_V3f cvtx_P3D_M2S_vel(
 {
 	double rx = 0, ry = 0, rz = 0;
 	long i;
+	int builtin = vortfunc_builtin_index(kernel);
 	float recip_reg_rad = 1.f / fabsf(regularisation_radius);
 	assert(num_particles >= 0);
-#pragma omp parallel for reduction(+:rx, ry, rz)
+	if (context_compensated()) {
+		/* Compensated sums of blocks of particles, combined in double. */
+#pragma omp parallel for reduction(+:rx, ry, rz) schedule(static) num_threads(context_num_threads())
+		for (i = 0; i < num_particles; i += CVTX_CSUM_BLOCK) {
+			bsv_V3f vel = P3D_M2M_vel_sum(array_start + i,
+				num_particles - i < CVTX_CSUM_BLOCK ?
+					(int)(num_particles - i) : CVTX_CSUM_BLOCK,
+				mes_point, kernel, builtin, recip_reg_rad, 1);
+			rx += vel.x[0];
+			ry += vel.x[1];
+			rz += vel.x[2];
+		}
+		bsv_V3f cret = { (float)rx, (float)ry, (float)rz };
+		return bsv_V3f_mult(cret, 1.f / (4.f * CVTX_PI_F));
+	}
+#pragma omp parallel for reduction(+:rx, ry, rz) num_threads(context_num_threads())
 	for (i = 0; i < num_particles; ++i) {
 		bsv_V3f vel = P3D_vel_inner(array_start[i],
-			mes_point, kernel, recip_reg_rad);
+			mes_point, kernel->g_3D, recip_reg_rad);
 		rx += vel.x[0];
 		ry += vel.x[1];
 		rz += vel.x[2];
@@ -251,19 +480,10 @@ CVTX_EXPORT bsv_V3f cvtx_P3D_M2S_dvort(
 	const cvtx_VortFunc *kernel,
 	float regularisation_radius)
 {
-	bsv_V3f dvort;
-	double rx = 0, ry = 0, rz = 0;
-	long i;
 	assert(num_particles >= 0);
-	for (i = 0; i < num_particles; ++i) {
-		dvort = cvtx_P3D_S2S_dvort(array_start[i],
-			induced_particle, kernel, regularisation_radius);
-		rx += dvort.x[0];
-		ry += dvort.x[1];
-		rz += dvort.x[2];
-	}
-	bsv_V3f ret = {(float)rx, (float)ry, (float)rz};
-	return ret;
+	return P3D_M2M_dvort_sum(array_start, num_particles, induced_particle,
+		kernel, vortfunc_builtin_index(kernel), regularisation_radius,
+		context_compensated());
 }
 
 CVTX_EXPORT bsv_V3f cvtx_P3D_M2S_visc_dvort(
@@ -325,15 +545,113 @@ static void cpu_brute_force_P3D_M2M_vel(
 	float regularisation_radius)
 {
 	long i;
-#pragma omp parallel for schedule(static)
+	int builtin = vortfunc_builtin_index(kernel);
+	int compensated = context_compensated();
+	float recip_reg_rad = 1.f / fabsf(regularisation_radius);
+	float coeff = 1.f / (4.f * CVTX_PI_F);
+	struct numa_sources copies;
+	numa_sources_create(&copies, (const void**)array_start, num_particles,
+		sizeof(cvtx_P3D));
+	if (context_tile_sources(num_particles, num_mes)) {
+		/* Tiles of a target and a block of sources. Partial sums are
+		combined in double. */
+		long num_blocks = (num_particles + CVTX_CSUM_BLOCK - 1) / CVTX_CSUM_BLOCK;
+		size_t ws_mark = workspace_mark();
+		bsv_V3f *partial = workspace_alloc(
+			sizeof(bsv_V3f) * num_mes * num_blocks);
+		if (partial != NULL) {
+#pragma omp parallel for schedule(static) num_threads(context_num_threads())
+			for (i = 0; i < num_mes * num_blocks; ++i) {
+				const cvtx_P3D **sources = (const cvtx_P3D**)numa_sources_local(&copies);
+				long first = (i / num_mes) * CVTX_CSUM_BLOCK;
+				partial[i] = P3D_M2M_vel_sum(sources + first,
+					num_particles - first < CVTX_CSUM_BLOCK ?
+						(int)(num_particles - first) : CVTX_CSUM_BLOCK,
+					mes_start[i % num_mes], kernel, builtin, recip_reg_rad,
+					compensated);
+			}
+			for (i = 0; i < num_mes; ++i) {
+				result_array[i] = bsv_V3f_mult(
+					P3D_combine_partials(partial + i, num_mes, num_blocks), coeff);
+			}
+			workspace_reset(ws_mark);
+			numa_sources_release(&copies);
+			return;
+		}
+		workspace_reset(ws_mark);
+	}
+	struct context_schedule schedule = context_schedule_begin(CVTX_SCHEDULE_STATIC);
+#pragma omp parallel for schedule(runtime) num_threads(context_num_threads())
 	for(i = 0; i < num_mes; ++i){
-		result_array[i] = cvtx_P3D_M2S_vel(
-			array_start, num_particles, mes_start[i], 
-			kernel, regularisation_radius);
+		result_array[i] = bsv_V3f_mult(P3D_M2M_vel_sum(
+			(const cvtx_P3D**)numa_sources_local(&copies), num_particles,
+			mes_start[i], kernel, builtin, recip_reg_rad, compensated), coeff);
 	}
+	context_schedule_end(schedule);
+	numa_sources_release(&copies);
 	return;
 }
 
+#ifdef CVTX_USING_OPENCL
+/* Run on the accelerator. Large calls give some of the measurement points to
+the CPU, running at the same time. Returns 0 if successful, -1 if the
+accelerator failed. */
+static int accelerated_P3D_M2M_vel(
+	const cvtx_P3D **array_start,
+	const int num_particles,
+	const bsv_V3f *mes_start,
+	const int num_mes,
+	bsv_V3f *result_array,
+	const cvtx_VortFunc *kernel,
+	float regularisation_radius)
+{
+	long i;
+	int num_accelerator, status = 0, did_cpu_work;
+	int builtin = vortfunc_builtin_index(kernel);
+	int compensated = context_compensated();
+	float recip_reg_rad = 1.f / fabsf(regularisation_radius);
+	double start, accelerator_time = 0., cpu_time = 0.;
+	num_accelerator = dispatch_split(DISPATCH_P3D_VEL, num_particles, num_mes);
+	if (num_accelerator == num_mes) {
+		return opencl_brute_force_P3D_M2M_vel(
+			array_start, num_particles, mes_start,
+			num_mes, result_array, kernel, regularisation_radius);
+	}
+	start = dispatch_wall_time();
+#pragma omp parallel private(did_cpu_work) num_threads(context_num_threads())
+	{
+		did_cpu_work = 0;
+#ifdef CVTX_USING_OPENMP
+		if (omp_get_thread_num() == 0)
+#endif
+		{
+			status = opencl_brute_force_P3D_M2M_vel(
+				array_start, num_particles, mes_start,
+				num_accelerator, result_array, kernel, regularisation_radius);
+			accelerator_time = dispatch_wall_time() - start;
+		}
+#pragma omp for schedule(dynamic, 16) nowait
+		for (i = num_accelerator; i < num_mes; ++i) {
+			result_array[i] = bsv_V3f_mult(P3D_M2M_vel_sum(
+				array_start, num_particles, mes_start[i],
+				kernel, builtin, recip_reg_rad, compensated),
+				1.f / (4.f * CVTX_PI_F));
+			did_cpu_work = 1;
+		}
+		if (did_cpu_work) {
+#pragma omp critical (cvtx_P3D_accelerated)
+			{
+				cpu_time = fmax(cpu_time, dispatch_wall_time() - start);
+			}
+		}
+	}
+	if (status != 0) { return -1; }
+	dispatch_split_result(DISPATCH_P3D_VEL, num_accelerator, accelerator_time,
+		num_mes - num_accelerator, cpu_time);
+	return 0;
+}
+#endif
+
 CVTX_EXPORT void cvtx_P3D_M2M_vel(
 	const cvtx_P3D **array_start,
 	const int num_particles,
@@ -343,19 +661,181 @@ CVTX_EXPORT void cvtx_P3D_M2M_vel(
 	const cvtx_VortFunc *kernel,
 	float regularisation_radius)
 {
+	cvtx_RedistFunc p3m_redist;
+	float p3m_grid_density;
+	stats_begin("cvtx_P3D_M2M_vel", num_particles, num_mes);
+	if (p3m_P3D_settings(&p3m_redist, &p3m_grid_density)
+		&& cvtx_P3D_M2M_vel_p3m(
+			array_start, num_particles, mes_start, num_mes, result_array,
+			kernel, regularisation_radius, &p3m_redist, p3m_grid_density) == 0) {
+		dispatch_record(CVTX_BACKEND_CPU);
+		stats_end();
+		return;
+	}
 #ifdef CVTX_USING_OPENCL
-	if (num_particles < 256
-		|| num_mes < 256
+	if (!dispatch_use_accelerator(DISPATCH_P3D_VEL, num_particles, num_mes)
 		|| !strcmp(kernel->cl_kernel_name_ext, "")
-		|| opencl_brute_force_P3D_M2M_vel(
+		|| accelerated_P3D_M2M_vel(
 			array_start, num_particles, mes_start,
 			num_mes, result_array, kernel, regularisation_radius) != 0)
 #endif
 	{
+		dispatch_record(CVTX_BACKEND_CPU);
 		cpu_brute_force_P3D_M2M_vel(
 			array_start, num_particles, mes_start,
 			num_mes, result_array, kernel, regularisation_radius);
 	}
+	stats_end();
+	return;
+}
+
+/* The velocity and velocity gradient induced at a point by many particles,
+multiplied by coeff. */
+static inline void P3D_vel_grad_sum(
+	const cvtx_P3D **array_start,
+	const int num_particles,
+	const bsv_V3f mes_point,
+	void (*combined_3D)(float, float*, float*),
+	float recip_reg_rad,
+	float coeff,
+	bsv_V3f *vel_result,
+	bsv_V3f *grad_result)
+{
+	double sum[12] = { 0 };
+	bsv_V3f vel, grad[3];
+	int j, k;
+	long n;
+	for (n = 0; n < num_particles; ++n) {
+		P3D_vel_grad_inner(array_start[n], mes_point,
+			combined_3D, recip_reg_rad, &vel, grad);
+		for (k = 0; k < 3; ++k) {
+			sum[k] += vel.x[k];
+			for (j = 0; j < 3; ++j) {
+				sum[3 + 3 * j + k] += grad[j].x[k];
+			}
+		}
+	}
+	for (k = 0; k < 3; ++k) {
+		vel_result->x[k] = (float)sum[k] * coeff;
+		for (j = 0; j < 3; ++j) {
+			grad_result[j].x[k] = (float)sum[3 + 3 * j + k] * coeff;
+		}
+	}
+	return;
+}
+
+/* P3D_vel_grad_sum for the M2M methods, as P3D_M2M_vel_sum. */
+static void P3D_M2M_vel_grad_sum(
+	const cvtx_P3D **array_start,
+	const int num_particles,
+	const bsv_V3f mes_point,
+	const cvtx_VortFunc *kernel,
+	int builtin,
+	float recip_reg_rad,
+	float coeff,
+	bsv_V3f *vel_result,
+	bsv_V3f *grad_result)
+{
+	switch (builtin) {
+#define CVTX_P3D_VEL_GRAD_CASE(NAME, G_3D, ZETA_3D, ETA_3D, G_2D, ETA_2D, VISCOUS) \
+	case VORTFUNC_##NAME:													\
+		P3D_vel_grad_sum(array_start, num_particles, mes_point,				\
+			&vortfunc_combined_3D_##NAME, recip_reg_rad, coeff,				\
+			vel_result, grad_result);										\
+		break;
+		CVTX_BUILTIN_VORTFUNCS(CVTX_P3D_VEL_GRAD_CASE)
+#undef CVTX_P3D_VEL_GRAD_CASE
+	default:
+		P3D_vel_grad_sum(array_start, num_particles, mes_point,
+			kernel->combined_3D, recip_reg_rad, coeff,
+			vel_result, grad_result);
+	}
+	return;
+}
+
+static void cpu_brute_force_P3D_M2M_vel_grad(
+	const cvtx_P3D **array_start,
+	const int num_particles,
+	const bsv_V3f *mes_start,
+	const int num_mes,
+	bsv_V3f *result_array,
+	bsv_V3f *grad_result_array,
+	const cvtx_VortFunc *kernel,
+	float regularisation_radius)
+{
+	long i;
+	int builtin = vortfunc_builtin_index(kernel);
+	float recip_reg_rad = 1.f / fabsf(regularisation_radius);
+	float coeff = 1.f / (4.f * CVTX_PI_F);
+	if (context_tile_sources(num_particles, num_mes)) {
+		/* As cpu_brute_force_P3D_M2M_vel. Each tile's partial sum is its
+		velocity followed by its three gradient rows. */
+		long num_blocks = (num_particles + CVTX_CSUM_BLOCK - 1) / CVTX_CSUM_BLOCK;
+		size_t ws_mark = workspace_mark();
+		bsv_V3f *partial = workspace_alloc(
+			sizeof(bsv_V3f) * 4 * num_mes * num_blocks);
+		if (partial != NULL) {
+			int j;
+#pragma omp parallel for schedule(static) num_threads(context_num_threads())
+			for (i = 0; i < num_mes * num_blocks; ++i) {
+				long first = (i / num_mes) * CVTX_CSUM_BLOCK;
+				P3D_M2M_vel_grad_sum(array_start + first,
+					num_particles - first < CVTX_CSUM_BLOCK ?
+						(int)(num_particles - first) : CVTX_CSUM_BLOCK,
+					mes_start[i % num_mes], kernel, builtin, recip_reg_rad,
+					1.f, &partial[4 * i], &partial[4 * i + 1]);
+			}
+			for (i = 0; i < num_mes; ++i) {
+				result_array[i] = bsv_V3f_mult(P3D_combine_partials(
+					partial + 4 * i, 4 * num_mes, num_blocks), coeff);
+				for (j = 0; j < 3; ++j) {
+					grad_result_array[3 * i + j] = bsv_V3f_mult(
+						P3D_combine_partials(partial + 4 * i + 1 + j,
+							4 * num_mes, num_blocks), coeff);
+				}
+			}
+			workspace_reset(ws_mark);
+			return;
+		}
+		workspace_reset(ws_mark);
+	}
+	struct context_schedule schedule = context_schedule_begin(CVTX_SCHEDULE_STATIC);
+#pragma omp parallel for schedule(runtime) num_threads(context_num_threads())
+	for (i = 0; i < num_mes; ++i) {
+		P3D_M2M_vel_grad_sum(array_start, num_particles, mes_start[i],
+			kernel, builtin, recip_reg_rad, coeff,
+			&result_array[i], &grad_result_array[3 * i]);
+	}
+	context_schedule_end(schedule);
+	return;
+}
+
+CVTX_EXPORT void cvtx_P3D_M2M_vel_grad(
+	const cvtx_P3D **array_start,
+	const int num_particles,
+	const bsv_V3f *mes_start,
+	const int num_mes,
+	bsv_V3f *result_array,
+	bsv_V3f *grad_result_array,
+	const cvtx_VortFunc *kernel,
+	float regularisation_radius)
+{
+	stats_begin("cvtx_P3D_M2M_vel_grad", num_particles, num_mes);
+#ifdef CVTX_USING_OPENCL
+	if (!dispatch_use_accelerator(DISPATCH_P3D_VEL_GRAD, num_particles, num_mes)
+		|| !strcmp(kernel->cl_kernel_name_ext, "")
+		|| opencl_brute_force_P3D_M2M_vel_grad(
+			array_start, num_particles, mes_start, num_mes,
+			result_array, grad_result_array, kernel,
+			regularisation_radius) != 0)
+#endif
+	{
+		dispatch_record(CVTX_BACKEND_CPU);
+		cpu_brute_force_P3D_M2M_vel_grad(
+			array_start, num_particles, mes_start, num_mes,
+			result_array, grad_result_array, kernel, regularisation_radius);
+	}
+	stats_end();
 	return;
 }
 
@@ -369,15 +849,108 @@ void cpu_brute_force_P3D_M2M_dvort(
 	float regularisation_radius)
 {
 	long i;
-#pragma omp parallel for schedule(static)
+	int builtin = vortfunc_builtin_index(kernel);
+	int compensated = context_compensated();
+	struct numa_sources copies;
+	numa_sources_create(&copies, (const void**)array_start, num_particles,
+		sizeof(cvtx_P3D));
+	if (context_tile_sources(num_particles, num_induced)) {
+		/* As cpu_brute_force_P3D_M2M_vel. */
+		long num_blocks = (num_particles + CVTX_CSUM_BLOCK - 1) / CVTX_CSUM_BLOCK;
+		size_t ws_mark = workspace_mark();
+		bsv_V3f *partial = workspace_alloc(
+			sizeof(bsv_V3f) * num_induced * num_blocks);
+		if (partial != NULL) {
+#pragma omp parallel for schedule(static) num_threads(context_num_threads())
+			for (i = 0; i < num_induced * num_blocks; ++i) {
+				const cvtx_P3D **sources = (const cvtx_P3D**)numa_sources_local(&copies);
+				long first = (i / num_induced) * CVTX_CSUM_BLOCK;
+				partial[i] = P3D_M2M_dvort_sum(sources + first,
+					num_particles - first < CVTX_CSUM_BLOCK ?
+						(int)(num_particles - first) : CVTX_CSUM_BLOCK,
+					induced_start[i % num_induced], kernel, builtin,
+					regularisation_radius, compensated);
+			}
+			for (i = 0; i < num_induced; ++i) {
+				result_array[i] = P3D_combine_partials(
+					partial + i, num_induced, num_blocks);
+			}
+			workspace_reset(ws_mark);
+			numa_sources_release(&copies);
+			return;
+		}
+		workspace_reset(ws_mark);
+	}
+	struct context_schedule schedule = context_schedule_begin(CVTX_SCHEDULE_STATIC);
+#pragma omp parallel for schedule(runtime) num_threads(context_num_threads())
 	for (i = 0; i < num_induced; ++i) {
-		result_array[i] = cvtx_P3D_M2S_dvort(
-			array_start, num_particles, induced_start[i], 
-			kernel, regularisation_radius);
+		result_array[i] = P3D_M2M_dvort_sum(
+			(const cvtx_P3D**)numa_sources_local(&copies), num_particles,
+			induced_start[i], kernel, builtin, regularisation_radius, compensated);
 	}
+	context_schedule_end(schedule);
+	numa_sources_release(&copies);
 	return;
 }
 
+#ifdef CVTX_USING_OPENCL
+/* Run on the accelerator. Large calls give some of the induced particles to
+the CPU, running at the same time. Returns 0 if successful, -1 if the
+accelerator failed. */
+static int accelerated_P3D_M2M_dvort(
+	const cvtx_P3D **array_start,
+	const int num_particles,
+	const cvtx_P3D **induced_start,
+	const int num_induced,
+	bsv_V3f *result_array,
+	const cvtx_VortFunc *kernel,
+	float regularisation_radius)
+{
+	long i;
+	int num_accelerator, status = 0, did_cpu_work;
+	int builtin = vortfunc_builtin_index(kernel);
+	int compensated = context_compensated();
+	double start, accelerator_time = 0., cpu_time = 0.;
+	num_accelerator = dispatch_split(DISPATCH_P3D_DVORT, num_particles, num_induced);
+	if (num_accelerator == num_induced) {
+		return opencl_brute_force_P3D_M2M_dvort(
+			array_start, num_particles, induced_start,
+			num_induced, result_array, kernel, regularisation_radius);
+	}
+	start = dispatch_wall_time();
+#pragma omp parallel private(did_cpu_work) num_threads(context_num_threads())
+	{
+		did_cpu_work = 0;
+#ifdef CVTX_USING_OPENMP
+		if (omp_get_thread_num() == 0)
+#endif
+		{
+			status = opencl_brute_force_P3D_M2M_dvort(
+				array_start, num_particles, induced_start,
+				num_accelerator, result_array, kernel, regularisation_radius);
+			accelerator_time = dispatch_wall_time() - start;
+		}
+#pragma omp for schedule(dynamic, 16) nowait
+		for (i = num_accelerator; i < num_induced; ++i) {
+			result_array[i] = P3D_M2M_dvort_sum(
+				array_start, num_particles, induced_start[i],
+				kernel, builtin, regularisation_radius, compensated);
+			did_cpu_work = 1;
+		}
+		if (did_cpu_work) {
+#pragma omp critical (cvtx_P3D_accelerated)
+			{
+				cpu_time = fmax(cpu_time, dispatch_wall_time() - start);
+			}
+		}
+	}
+	if (status != 0) { return -1; }
+	dispatch_split_result(DISPATCH_P3D_DVORT, num_accelerator, accelerator_time,
+		num_induced - num_accelerator, cpu_time);
+	return 0;
+}
+#endif
+
 CVTX_EXPORT void cvtx_P3D_M2M_dvort(
 	const cvtx_P3D **array_start,
 	const int num_particles,
@@ -387,19 +960,32 @@ CVTX_EXPORT void cvtx_P3D_M2M_dvort(
 	const cvtx_VortFunc *kernel,
 	float regularisation_radius)
 {
+	cvtx_RedistFunc p3m_redist;
+	float p3m_grid_density;
+	stats_begin("cvtx_P3D_M2M_dvort", num_particles, num_induced);
+	if (p3m_P3D_settings(&p3m_redist, &p3m_grid_density)
+		&& cvtx_P3D_M2M_dvort_p3m(
+			array_start, num_particles, induced_start, num_induced,
+			result_array, kernel, regularisation_radius,
+			&p3m_redist, p3m_grid_density) == 0) {
+		dispatch_record(CVTX_BACKEND_CPU);
+		stats_end();
+		return;
+	}
 #ifdef CVTX_USING_OPENCL
-	if (	num_particles < 256
-		||	num_induced < 256
+	if (	!dispatch_use_accelerator(DISPATCH_P3D_DVORT, num_particles, num_induced)
 		||	!strcmp(kernel->cl_kernel_name_ext, "")
-		||	opencl_brute_force_P3D_M2M_dvort(
+		||	accelerated_P3D_M2M_dvort(
 				array_start, num_particles, induced_start,
 				num_induced, result_array, kernel, regularisation_radius) != 0)
 #endif
 	{
+		dispatch_record(CVTX_BACKEND_CPU);
 		cpu_brute_force_P3D_M2M_dvort(
 			array_start, num_particles, induced_start,
 			num_induced, result_array, kernel, regularisation_radius);
 	}
+	stats_end();
 	return;
 }
 
@@ -414,12 +1000,39 @@ void cpu_brute_force_P3D_M2M_visc_dvort(
 	float kinematic_visc)
 {
 	long i;
-#pragma omp parallel for schedule(static)
+	if (context_tile_sources(num_particles, num_induced)) {
+		/* As cpu_brute_force_P3D_M2M_vel. */
+		long num_blocks = (num_particles + CVTX_CSUM_BLOCK - 1) / CVTX_CSUM_BLOCK;
+		size_t ws_mark = workspace_mark();
+		bsv_V3f *partial = workspace_alloc(
+			sizeof(bsv_V3f) * num_induced * num_blocks);
+		if (partial != NULL) {
+#pragma omp parallel for schedule(static) num_threads(context_num_threads())
+			for (i = 0; i < num_induced * num_blocks; ++i) {
+				long first = (i / num_induced) * CVTX_CSUM_BLOCK;
+				partial[i] = cvtx_P3D_M2S_visc_dvort(array_start + first,
+					num_particles - first < CVTX_CSUM_BLOCK ?
+						(int)(num_particles - first) : CVTX_CSUM_BLOCK,
+					induced_start[i % num_induced], kernel,
+					regularisation_radius, kinematic_visc);
+			}
+			for (i = 0; i < num_induced; ++i) {
+				result_array[i] = P3D_combine_partials(
+					partial + i, num_induced, num_blocks);
+			}
+			workspace_reset(ws_mark);
+			return;
+		}
+		workspace_reset(ws_mark);
+	}
+	struct context_schedule schedule = context_schedule_begin(CVTX_SCHEDULE_STATIC);
+#pragma omp parallel for schedule(runtime) num_threads(context_num_threads())
 	for (i = 0; i < num_induced; ++i) {
 		result_array[i] = cvtx_P3D_M2S_visc_dvort(
 			array_start, num_particles, induced_start[i],
 			kernel, regularisation_radius, kinematic_visc);
 	}
+	context_schedule_end(schedule);
 	return;
 }
 
@@ -433,19 +1046,21 @@ CVTX_EXPORT void cvtx_P3D_M2M_visc_dvort(
 	float regularisation_radius,
 	float kinematic_visc)
 {
+	stats_begin("cvtx_P3D_M2M_visc_dvort", num_particles, num_induced);
 #ifdef CVTX_USING_OPENCL
-	if (	num_particles < 256
-		||	num_induced < 256
+	if (	!dispatch_use_accelerator(DISPATCH_P3D_VISC_DVORT, num_particles, num_induced)
 		||	!strcmp(kernel->cl_kernel_name_ext, "")
 		||	opencl_brute_force_P3D_M2M_visc_dvort(
 				array_start, num_particles, induced_start,
 				num_induced, result_array, kernel, regularisation_radius, kinematic_visc) != 0)
 #endif
 	{
+		dispatch_record(CVTX_BACKEND_CPU);
 		cpu_brute_force_P3D_M2M_visc_dvort(
 			array_start, num_particles, induced_start,
 			num_induced, result_array, kernel, regularisation_radius, kinematic_visc);
 	}
+	stats_end();
 	return;
 }
 
@@ -458,12 +1073,14 @@ void cpu_brute_force_P3D_M2M_vort(
 	const cvtx_VortFunc* kernel,
 	float regularisation_radius) {
 	long i;
-#pragma omp parallel for schedule(guided)
+	struct context_schedule schedule = context_schedule_begin(CVTX_SCHEDULE_GUIDED);
+#pragma omp parallel for schedule(runtime) num_threads(context_num_threads())
 	for (i = 0; i < num_mes; ++i) {
 		result_array[i] = cvtx_P3D_M2S_vort(
 			array_start, num_particles, mes_start[i],
 			kernel, regularisation_radius);
 	}
+	context_schedule_end(schedule);
 	return;
 }
 
@@ -475,19 +1092,21 @@ CVTX_EXPORT void cvtx_P3D_M2M_vort(
 	bsv_V3f* result_array,
 	const cvtx_VortFunc* kernel,
 	float regularisation_radius) {
+	stats_begin("cvtx_P3D_M2M_vort", num_particles, num_mes);
 #ifdef CVTX_USING_OPENCL
-	if (num_particles < 256
-		|| num_mes < 256
+	if (!dispatch_use_accelerator(DISPATCH_P3D_VORT, num_particles, num_mes)
 		|| !strcmp(kernel->cl_kernel_name_ext, "")
 		|| opencl_brute_force_P3D_M2M_vort(
 			array_start, num_particles, mes_start,
 			num_mes, result_array, kernel, regularisation_radius) != 0)
 #endif
 	{
+		dispatch_record(CVTX_BACKEND_CPU);
 		cpu_brute_force_P3D_M2M_vort(
 			array_start, num_particles, mes_start,
 			num_mes, result_array, kernel, regularisation_radius);
 	}
+	stats_end();
 	return;
 }
 
@@ -528,6 +1147,9 @@ CVTX_EXPORT int cvtx_P3D_redistribute_on_grid(
 	unsigned int *nidx_array = NULL;
 	/* For particle removal: */
 	float min_keepable_particle;
+	size_t ws_mark = workspace_mark();	/* To release scratch memory. */
+	stats_begin("cvtx_P3D_redistribute_on_grid",
+		n_input_particles, max_output_particles);
 
 	/* Generate grid keys for existing particles. */
 	minmax_xyz_posn(input_array_start, n_input_particles, 
@@ -538,9 +1160,21 @@ CVTX_EXPORT int cvtx_P3D_redistribute_on_grid(
 	miny -= (grid_radius + (float)rand() / (float)(RAND_MAX)) * grid_density;
 	minz -= (grid_radius + (float)rand() / (float)(RAND_MAX)) * grid_density;
 
-	oidx_array = malloc(sizeof(unsigned int) * n_input_particles);
-	okey_array = malloc(sizeof(UInt32Key3D) * n_input_particles);
-#pragma omp parallel for schedule(static)
+	/* ppop = Particles per orginal particle. */
+	ppop = (grid_radius * 2 + 1) * (grid_radius * 2 + 1) 
+		* (grid_radius * 2 + 1);
+	oidx_array = workspace_alloc(sizeof(unsigned int) * n_input_particles);
+	okey_array = workspace_alloc(sizeof(UInt32Key3D) * n_input_particles);
+	nkey_array = workspace_alloc(sizeof(UInt32Key3D) * ppop * n_input_particles);
+	nvort_array = workspace_alloc(sizeof(bsv_V3f) * ppop * n_input_particles);
+	nidx_array = workspace_alloc(sizeof(unsigned int) * ppop * n_input_particles);
+	if (oidx_array == NULL || okey_array == NULL || nkey_array == NULL
+		|| nvort_array == NULL || nidx_array == NULL) {
+		workspace_reset(ws_mark);
+		stats_end();
+		return -1;
+	}
+#pragma omp parallel for schedule(static) num_threads(context_num_threads())
 	for (i = 0; i < n_input_particles; ++i) {
 		oidx_array[i] = i;
 		okey_array[i] = g_P3D_gridkey3D(input_array_start[i],
@@ -548,13 +1182,7 @@ CVTX_EXPORT int cvtx_P3D_redistribute_on_grid(
 	}
 
 	/* Now we make new particles based on grid. */
-	/* ppop = Particles per orginal particle. */
-	ppop = (grid_radius * 2 + 1) * (grid_radius * 2 + 1) 
-		* (grid_radius * 2 + 1);
-	nkey_array = malloc(sizeof(UInt32Key3D) * ppop * n_input_particles);
-	nvort_array = malloc(sizeof(bsv_V3f) * ppop * n_input_particles);
-	nidx_array = malloc(sizeof(unsigned int) * ppop * n_input_particles);
-#pragma omp parallel for schedule(static) private(j, k, m)
+#pragma omp parallel for schedule(static) private(j, k, m) num_threads(context_num_threads())
 	for (i = 0; i < n_input_particles; ++i) {
 		int widx = oidx_array[i];
 		unsigned int okx, oky, okz;
@@ -591,14 +1219,17 @@ CVTX_EXPORT int cvtx_P3D_redistribute_on_grid(
 			}
 		}
 	}
-	free(oidx_array);
-	free(okey_array);
 
 	/* Now merge our new particles */
-	sort_perm_UInt32Key3D(nkey_array, nidx_array, n_input_particles* ppop);
-
-	nnkey_array = malloc(sizeof(UInt32Key3D) * n_input_particles * ppop);
-	nnvort_array = malloc(sizeof(bsv_V3f) * n_input_particles * ppop);
+	nnkey_array = workspace_alloc(sizeof(UInt32Key3D) * n_input_particles * ppop);
+	nnvort_array = workspace_alloc(sizeof(bsv_V3f) * n_input_particles * ppop);
+	if (nnkey_array == NULL || nnvort_array == NULL
+		|| sort_perm_UInt32Key3D(nkey_array, nidx_array,
+			n_input_particles * ppop) != 0) {
+		workspace_reset(ws_mark);
+		stats_end();
+		return -1;
+	}
 	for (i = 0; i < ppop * n_input_particles; ++i) {
 		nnkey_array[i] = nkey_array[nidx_array[i]];
 		nnvort_array[i] = nvort_array[nidx_array[i]];
@@ -621,14 +1252,18 @@ CVTX_EXPORT int cvtx_P3D_redistribute_on_grid(
 			nvort_array[j] = nnvort_array[i];
 		}
 	}
-	free(nnkey_array);
-	free(nnvort_array);
 	n_created_particles = (j < ppop * n_input_particles ? j + 1 : 0);
 
 	/* Go back to array of particles. */
 	cvtx_P3D *created_particles = NULL;
-	created_particles = malloc(n_created_particles * sizeof(cvtx_P3D));
-#pragma omp parallel for
+	created_particles = workspace_alloc(n_created_particles * sizeof(cvtx_P3D));
+	float* strengths = workspace_alloc(sizeof(float) * n_created_particles);
+	if (created_particles == NULL || strengths == NULL) {
+		workspace_reset(ws_mark);
+		stats_end();
+		return -1;
+	}
+#pragma omp parallel for num_threads(context_num_threads())
 	for (i = 0; i < n_created_particles; ++i) {
 		created_particles[i].volume = grid_density * grid_density * grid_density;
 		created_particles[i].vorticity = nvort_array[i];
@@ -636,13 +1271,9 @@ CVTX_EXPORT int cvtx_P3D_redistribute_on_grid(
 		created_particles[i].coord.x[1] = miny + nkey_array[i].k.y * grid_density;
 		created_particles[i].coord.x[2] = minz + nkey_array[i].k.z * grid_density;
 	}
-	free(nkey_array);
-	free(nvort_array);
-	free(nidx_array);
 	
 	/* Remove particles with neglidgible vorticity. */
-	float* strengths = malloc(sizeof(float) * n_created_particles);
-#pragma omp parallel for
+#pragma omp parallel for num_threads(context_num_threads())
 	for (i = 0; i < n_created_particles; ++i) {
 		strengths[i] = bsv_V3f_abs(created_particles[i].vorticity);
 	}
@@ -652,7 +1283,7 @@ CVTX_EXPORT int cvtx_P3D_redistribute_on_grid(
 		created_particles, strengths, n_created_particles, 
 		min_keepable_particle, n_created_particles);
 	/* The strengths are modified to keep total vorticity constant. */
-#pragma omp parallel for
+#pragma omp parallel for num_threads(context_num_threads())
 	for (i = 0; i < n_created_particles; ++i) {
 		strengths[i] = bsv_V3f_abs(created_particles[i].vorticity);
 	}
@@ -668,8 +1299,8 @@ CVTX_EXPORT int cvtx_P3D_redistribute_on_grid(
 		/* And now make an array to return to our caller. */
 		memcpy(output_particles, created_particles, sizeof(cvtx_P3D) * n_created_particles);
 	}
-	/* Free remaining arrays. */
-	free(created_particles);
+	workspace_reset(ws_mark);
+	stats_end();
 	return n_created_particles;
 }
 
@@ -718,17 +1349,26 @@ CVTX_EXPORT void cvtx_P3D_pedrizzetti_relaxation(
 	bsv_V3f *mes_posns = NULL, *omegas = NULL;
 	int i;
 	float tmp;
-	mes_posns = malloc(sizeof(bsv_V3f) * n_input_particles);
-#pragma omp parallel for
+	size_t ws_mark = workspace_mark();
+	stats_begin("cvtx_P3D_pedrizzetti_relaxation",
+		n_input_particles, n_input_particles);
+	mes_posns = workspace_alloc(sizeof(bsv_V3f) * n_input_particles);
+	omegas = workspace_alloc(sizeof(bsv_V3f) * n_input_particles);
+	if (mes_posns == NULL || omegas == NULL) {
+		/* The particles are left unchanged. */
+		workspace_reset(ws_mark);
+		stats_end();
+		return;
+	}
+#pragma omp parallel for num_threads(context_num_threads())
 	for (i = 0; i < n_input_particles; ++i) {
 		mes_posns[i] = input_array_start[i]->coord;
 	}
-	omegas = malloc(sizeof(bsv_V3f) * n_input_particles);
 	cvtx_P3D_M2M_vort(input_array_start, n_input_particles, 
 		mes_posns, n_input_particles, omegas, kernel, regularisation_radius);
 
 	tmp = 1.f - fdt;
-#pragma omp parallel for
+#pragma omp parallel for num_threads(context_num_threads())
 	for (i = 0; i < n_input_particles; ++i) {
 		bsv_V3f ovort, nvort;	/* original & new vorts*/
 		float coeff, absomega;
@@ -741,7 +1381,7 @@ CVTX_EXPORT void cvtx_P3D_pedrizzetti_relaxation(
 		input_array_start[i]->vorticity = nvort;
 	}
 
-	free(mes_posns);
-	free(omegas);
+	workspace_reset(ws_mark);
+	stats_end();
 	return;
 }
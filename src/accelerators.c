@@ -27,6 +27,7 @@ SOFTWARE.
 #include <assert.h>
 #include <stdio.h>
 #include <stdlib.h>	/* Required for not CVTX_USING_OPENCL */
+#include "context.h"
 #include "opencl_acc.h"
 
 static void cvtx_info_init(void);
@@ -46,6 +47,7 @@ CVTX_EXPORT void cvtx_finalise() {
 #ifdef CVTX_USING_OPENCL
 	opencl_finalise();
 #endif
+	cvtx_Context_release_workspace(NULL);
 	cvtx_info_finalise();
 }
 
@@ -0,0 +1,96 @@
+#ifndef CVTX_COMPENSATED_H
+#define CVTX_COMPENSATED_H
+#include "libcvtx.h"
+/*============================================================================
+compensated.h
+
+Compensated (Kahan-Neumaier) float summation for the CVTX_ACCUMULATE_COMPENSATED
+mode.
+
+Copyright(c) 2019 HJA Bird
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files(the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+============================================================================*/
+#include <math.h>
+
+/*
+Sums over sources are split between CVTX_CSUM_LANES independent lanes so
+that the loop over sources vectorises: source i + l of each block of
+CVTX_CSUM_LANES goes to lane l. Each lane carries a running compensation
+for the rounding error of its sum. The lanes are combined at the end.
+
+This relies on the compiler not reassociating float arithmetic, so must not
+be built with -ffast-math or similar.
+*/
+#define CVTX_CSUM_LANES 8
+/* Sources per block of the parallel M2S methods. Blocks' compensated sums
+are combined in double. */
+#define CVTX_CSUM_BLOCK 4096
+
+/* Compensated sums of 3 (or fewer) components. */
+struct csum {
+	float s[3][CVTX_CSUM_LANES];
+	float c[3][CVTX_CSUM_LANES];
+};
+
+static inline void csum_init(struct csum *acc) {
+	int j, l;
+	for (j = 0; j < 3; ++j) {
+		for (l = 0; l < CVTX_CSUM_LANES; ++l) {
+			acc->s[j][l] = 0.f;
+			acc->c[j][l] = 0.f;
+		}
+	}
+	return;
+}
+
+/* Add x to the sum s with compensation c. */
+static inline void csum_add(float *s, float *c, float x) {
+	float t = *s + x;
+	*c += fabsf(*s) >= fabsf(x) ? (*s - t) + x : (x - t) + *s;
+	*s = t;
+	return;
+}
+
+/* Add the vector x to lane l. */
+static inline void csum_add3(struct csum *acc, int l, const float *x) {
+	csum_add(&acc->s[0][l], &acc->c[0][l], x[0]);
+	csum_add(&acc->s[1][l], &acc->c[1][l], x[1]);
+	csum_add(&acc->s[2][l], &acc->c[2][l], x[2]);
+	return;
+}
+
+static inline void csum_add2(struct csum *acc, int l, const float *x) {
+	csum_add(&acc->s[0][l], &acc->c[0][l], x[0]);
+	csum_add(&acc->s[1][l], &acc->c[1][l], x[1]);
+	return;
+}
+
+/* The total of component j over all lanes. */
+static inline float csum_result(const struct csum *acc, int j) {
+	float s = 0.f, c = 0.f;
+	int l;
+	for (l = 0; l < CVTX_CSUM_LANES; ++l) {
+		csum_add(&s, &c, acc->s[j][l]);
+		c += acc->c[j][l];
+	}
+	return s + c;
+}
+
+#endif /* CVTX_COMPENSATED_H */
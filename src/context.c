@@ -0,0 +1,297 @@
+#include "context.h"
+/*============================================================================
+context.c
+
+Per-solver library state: accelerators, threading and scratch memory.
+
+Copyright(c) 2019 HJA Bird
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files(the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+============================================================================*/
+
+#include <assert.h>
+#include <stdlib.h>
+#ifdef CVTX_USING_OPENMP
+#	include <omp.h>
+#endif
+
+#include "compensated.h"
+
+static cvtx_Context default_context;
+/* The context bound to this thread. NULL for the default context. */
+static CVTX_THREAD_LOCAL cvtx_Context *thread_context = NULL;
+/* Set between context_nest_begin and context_nest_end. */
+static CVTX_THREAD_LOCAL int thread_nested = 0;
+/* Scratch memory of this thread whilst using the default context. The
+default context is shared by every thread, so it can't own one. Zeroed,
+as workspace_init. Not freed on thread exit: callers must use
+cvtx_Context_release_workspace(NULL) on each thread. */
+static CVTX_THREAD_LOCAL struct workspace thread_workspace;
+
+cvtx_Context* context_current(void) {
+	return thread_context != NULL ? thread_context : &default_context;
+}
+
+cvtx_Context* context_default(void) {
+	return &default_context;
+}
+
+struct workspace* context_workspace(void) {
+	return thread_context != NULL ?
+		&thread_context->workspace : &thread_workspace;
+}
+
+int context_compensated(void) {
+	return context_current()->accumulation == CVTX_ACCUMULATE_COMPENSATED;
+}
+
+int context_num_threads(void) {
+#ifdef CVTX_USING_OPENMP
+	const cvtx_Context *context = context_current();
+	if (context->execution == CVTX_EXECUTE_SERIAL) { return 1; }
+	if (omp_in_parallel() && context->execution != CVTX_EXECUTE_NESTED
+		&& !thread_nested) {
+		return 1;
+	}
+	return context->num_threads > 0 ? 
+		context->num_threads : omp_get_max_threads();
+#else
+	return 1;
+#endif
+}
+
+int context_tile_sources(int num_sources, int num_targets) {
+	int threads = context_num_threads();
+	/* Enough tiles for each thread to have a few. */
+	return threads > 1 && num_targets < 4 * threads
+		&& num_sources > CVTX_CSUM_BLOCK;
+}
+
+/* The OpenMP maximum number of active levels may be a single setting for
+the whole process, so it is raised by the first thread to need nesting
+and restored by the last. */
+static int nest_users = 0;
+static int nest_saved_levels = 1;
+
+void context_nest_begin(void) {
+	thread_nested = 1;
+#ifdef CVTX_USING_OPENMP
+#pragma omp critical (cvtx_context_nest)
+	{
+		int levels = omp_get_active_level() + 2;
+		if (nest_users++ == 0) {
+			nest_saved_levels = omp_get_max_active_levels();
+		}
+		if (omp_get_max_active_levels() < levels) {
+			omp_set_max_active_levels(levels);
+		}
+	}
+#endif
+	return;
+}
+
+void context_nest_end(void) {
+	thread_nested = 0;
+#ifdef CVTX_USING_OPENMP
+#pragma omp critical (cvtx_context_nest)
+	{
+		if (--nest_users == 0) {
+			omp_set_max_active_levels(nest_saved_levels);
+		}
+	}
+#endif
+	return;
+}
+
+struct context_schedule context_schedule_begin(int default_schedule) {
+	struct context_schedule saved = { 0, 0 };
+#ifdef CVTX_USING_OPENMP
+	omp_sched_t kind;
+	int schedule = context_current()->schedule;
+	assert(default_schedule != CVTX_SCHEDULE_DEFAULT);
+	omp_get_schedule(&kind, &saved.chunk);
+	saved.kind = (int)kind;
+	if (schedule == CVTX_SCHEDULE_DEFAULT) { schedule = default_schedule; }
+	switch (schedule) {
+	case CVTX_SCHEDULE_DYNAMIC:
+		/* Targets are cheap: chunks keep the scheduling overhead down. */
+		omp_set_schedule(omp_sched_dynamic, 16);
+		break;
+	case CVTX_SCHEDULE_GUIDED:
+		omp_set_schedule(omp_sched_guided, 0);
+		break;
+	default:
+		omp_set_schedule(omp_sched_static, 0);
+	}
+#else
+	(void)default_schedule;
+#endif
+	return saved;
+}
+
+void context_schedule_end(struct context_schedule saved) {
+#ifdef CVTX_USING_OPENMP
+	omp_set_schedule((omp_sched_t)saved.kind, saved.chunk);
+#else
+	(void)saved;
+#endif
+	return;
+}
+
+CVTX_EXPORT cvtx_Context* cvtx_Context_create(void) {
+	cvtx_Context *context = malloc(sizeof(cvtx_Context));
+	if (context != NULL) {
+		context->num_threads = 0;
+		context->execution = CVTX_EXECUTE_DEFAULT;
+		context->schedule = CVTX_SCHEDULE_DEFAULT;
+		context->accumulation = CVTX_ACCUMULATE_DEFAULT;
+		context->numa = CVTX_NUMA_NONE;
+		context->p3m = 0;
+		context->p3m_grid_density = 0.f;
+		workspace_init(&context->workspace);
+#ifdef CVTX_USING_OPENCL
+		opencl_device_list_init(&context->devices, 1);
+#endif
+	}
+	return context;
+}
+
+CVTX_EXPORT void cvtx_Context_destroy(cvtx_Context *context) {
+	assert(context != &default_context);
+	if (context == NULL) { return; }
+	if (thread_context == context) {
+		cvtx_Context_make_current(NULL);
+	}
+#ifdef CVTX_USING_OPENCL
+	opencl_device_list_release(&context->devices);
+#endif
+	workspace_release(&context->workspace);
+	free(context);
+	return;
+}
+
+CVTX_EXPORT void cvtx_Context_make_current(cvtx_Context *context) {
+	thread_context = context;
+	return;
+}
+
+CVTX_EXPORT cvtx_Context* cvtx_Context_current(void) {
+	return thread_context;
+}
+
+CVTX_EXPORT void cvtx_Context_set_num_threads(
+	cvtx_Context *context, int num_threads) {
+	assert(num_threads >= 0);
+	if (context == NULL) { context = &default_context; }
+	context->num_threads = num_threads;
+	return;
+}
+
+CVTX_EXPORT int cvtx_Context_num_threads(const cvtx_Context *context) {
+	if (context == NULL) { context = &default_context; }
+	return context->num_threads;
+}
+
+CVTX_EXPORT void cvtx_Context_set_execution(
+	cvtx_Context *context, int mode) {
+	assert(mode == CVTX_EXECUTE_DEFAULT
+		|| mode == CVTX_EXECUTE_SERIAL
+		|| mode == CVTX_EXECUTE_NESTED);
+	if (context == NULL) { context = &default_context; }
+	context->execution = mode;
+	return;
+}
+
+CVTX_EXPORT int cvtx_Context_execution(const cvtx_Context *context) {
+	if (context == NULL) { context = &default_context; }
+	return context->execution;
+}
+
+CVTX_EXPORT void cvtx_Context_set_schedule(
+	cvtx_Context *context, int schedule) {
+	assert(schedule >= CVTX_SCHEDULE_DEFAULT
+		&& schedule <= CVTX_SCHEDULE_GUIDED);
+	if (context == NULL) { context = &default_context; }
+	context->schedule = schedule;
+	return;
+}
+
+CVTX_EXPORT int cvtx_Context_schedule(const cvtx_Context *context) {
+	if (context == NULL) { context = &default_context; }
+	return context->schedule;
+}
+
+CVTX_EXPORT void cvtx_Context_set_numa(cvtx_Context *context, int mode) {
+	assert(mode == CVTX_NUMA_NONE
+		|| mode == CVTX_NUMA_FIRST_TOUCH
+		|| mode == CVTX_NUMA_REPLICATE);
+	if (context == NULL) { context = &default_context; }
+	context->numa = mode;
+	return;
+}
+
+CVTX_EXPORT int cvtx_Context_numa(const cvtx_Context *context) {
+	if (context == NULL) { context = &default_context; }
+	return context->numa;
+}
+
+CVTX_EXPORT void cvtx_Context_set_p3m(cvtx_Context *context,
+	const cvtx_RedistFunc *redistributor, float grid_density) {
+	assert(redistributor == NULL || grid_density > 0.f);
+	if (context == NULL) { context = &default_context; }
+	if (redistributor != NULL) {
+		context->p3m_redistributor = *redistributor;
+		context->p3m_grid_density = grid_density;
+	}
+	context->p3m = redistributor != NULL;
+	return;
+}
+
+CVTX_EXPORT int cvtx_Context_p3m(const cvtx_Context *context) {
+	if (context == NULL) { context = &default_context; }
+	return context->p3m;
+}
+
+CVTX_EXPORT void cvtx_Context_set_accumulation(
+	cvtx_Context *context, int mode) {
+	assert(mode == CVTX_ACCUMULATE_DEFAULT
+		|| mode == CVTX_ACCUMULATE_COMPENSATED);
+	if (context == NULL) { context = &default_context; }
+	context->accumulation = mode;
+	return;
+}
+
+CVTX_EXPORT int cvtx_Context_accumulation(const cvtx_Context *context) {
+	if (context == NULL) { context = &default_context; }
+	return context->accumulation;
+}
+
+CVTX_EXPORT size_t cvtx_Context_workspace_size(const cvtx_Context *context) {
+	if (context == NULL) { return workspace_capacity(&thread_workspace); }
+	return workspace_capacity(&context->workspace);
+}
+
+CVTX_EXPORT void cvtx_Context_release_workspace(cvtx_Context *context) {
+	if (context == NULL) {
+		workspace_release(&thread_workspace);
+		return;
+	}
+	workspace_release(&context->workspace);
+	return;
+}
@@ -0,0 +1,108 @@
+#ifndef CVTX_CONTEXT_H
+#define CVTX_CONTEXT_H
+#include "libcvtx.h"
+/*============================================================================
+context.h
+
+Per-solver library state.
+
+Copyright(c) 2019 HJA Bird
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files(the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+============================================================================*/
+
+#include "workspace.h"
+#ifdef CVTX_USING_OPENCL
+#include "opencl_acc.h"
+#endif
+
+#ifdef _MSC_VER
+#	define CVTX_THREAD_LOCAL __declspec(thread)
+#else
+#	define CVTX_THREAD_LOCAL __thread
+#endif
+
+struct cvtx_Context {
+	int num_threads;					/* 0 to use the OpenMP default. */
+	int execution;						/* CVTX_EXECUTE_XXX */
+	int schedule;						/* CVTX_SCHEDULE_XXX */
+	int accumulation;					/* CVTX_ACCUMULATE_XXX */
+	int numa;							/* CVTX_NUMA_XXX */
+	int p3m;							/* 1 to use P3M in P3D M2M. */
+	float p3m_grid_density;
+	cvtx_RedistFunc p3m_redistributor;
+	struct workspace workspace;			/* Scratch memory. */
+#ifdef CVTX_USING_OPENCL
+	struct ocl_device_list devices;		/* Devices & queues in use. */
+#endif
+};
+
+/* The context bound to the calling thread using cvtx_Context_make_current,
+or the default context if there is none. Never NULL. */
+cvtx_Context* context_current(void);
+
+/* The library's default context, configured by cvtx_initialise. */
+cvtx_Context* context_default(void);
+
+/* The scratch memory of the calling thread's current context. Threads
+using the default context each have their own, since they may call the
+library concurrently. */
+struct workspace* context_workspace(void);
+
+/* 1 if the current context uses compensated sums. Worker threads of a
+parallel region don't share the calling thread's context, so this must be
+called outside them. */
+int context_compensated(void);
+
+/* The number of threads for a parallel region entered by the calling
+thread under the execution policy of its current context. Every parallel
+region of the library gives this as its num_threads clause rather than
+changing the OpenMP settings of the caller. */
+int context_num_threads(void);
+
+/* 1 if an M2M call should be split into tiles of a target and a block of
+CVTX_CSUM_BLOCK sources, the partial sums of each target being combined
+afterwards. This is when there are too few targets to keep the threads 
+busy, as with a few targets and many sources. */
+int context_tile_sources(int num_sources, int num_targets);
+
+/* Around a parallel region of the library in which thread 0 (the calling 
+thread) makes calls that should still use the threads of its context, 
+such as the M2M calls of the pipelined streaming methods. Until 
+context_nest_end, parallel regions entered by the calling thread start
+nested teams. The OpenMP maximum number of active levels is raised if 
+needed, and restored once no thread is between the two. */
+void context_nest_begin(void);
+void context_nest_end(void);
+
+/* The calling thread's OpenMP schedule, to be restored. */
+struct context_schedule {
+	int kind;
+	int chunk;
+};
+
+/* Before a loop over targets with schedule(runtime): set the calling 
+thread's OpenMP schedule to that of its current context, or to 
+default_schedule (a CVTX_SCHEDULE_XXX other than DEFAULT) if the 
+context leaves it to the library. context_schedule_end must be called
+with the returned value after the loop. */
+struct context_schedule context_schedule_begin(int default_schedule);
+void context_schedule_end(struct context_schedule saved);
+
+#endif /* CVTX_CONTEXT_H */
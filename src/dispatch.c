@@ -0,0 +1,576 @@
+#include "dispatch.h"
+/*============================================================================
+dispatch.c
+
+Choice between the CPU and accelerator implementations of M2M methods.
+
+Copyright(c) 2019 HJA Bird
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files(the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+============================================================================*/
+
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#ifdef CVTX_USING_OPENMP
+#	include <omp.h>
+#endif
+
+#include "context.h"
+#include "p3m.h"
+#include "stats.h"
+
+/* Problem sizes (sources = targets) used to calibrate. */
+#define CVTX_DISPATCH_SMALL 512
+#define CVTX_DISPATCH_LARGE 2048
+#define CVTX_DISPATCH_NAME_LENGTH 128
+/* Calls with fewer targets aren't split between the CPU and accelerator. */
+#define CVTX_DISPATCH_MIN_SPLIT_TARGETS 4096
+/* Nor are they if the CPU would get fewer targets than this. */
+#define CVTX_DISPATCH_MIN_CPU_TARGETS 64
+
+/* Predicted time = overhead + per_interaction * sources * targets. */
+struct cost_model {
+	double cpu_overhead, cpu_per_interaction;
+	int cpu_threads;			/* Threads the CPU model was measured with. */
+	double gpu_overhead, gpu_per_interaction;
+};
+
+static const char *op_names[DISPATCH_NUM_OPS] = {
+	"cvtx_P3D_M2M_vel",
+	"cvtx_P3D_M2M_vel_grad",
+	"cvtx_P3D_M2M_dvort",
+	"cvtx_P3D_M2M_visc_dvort",
+	"cvtx_P3D_M2M_vort",
+	"cvtx_P2D_M2M_vel",
+	"cvtx_P2D_M2M_visc_dvort",
+	"cvtx_F3D_M2M_vel",
+	"cvtx_F3D_M2M_dvort",
+	"cvtx_P3Dd_M2M_vel",
+	"cvtx_P3Dd_M2M_dvort",
+	"cvtx_P2Dd_M2M_vel",
+	"cvtx_F3Dd_M2M_vel"
+};
+
+static struct {
+	int loaded;				/* 1 if the profile has been looked for. */
+	char device_name[CVTX_DISPATCH_NAME_LENGTH];
+	int calibrated[DISPATCH_NUM_OPS];
+	struct cost_model models[DISPATCH_NUM_OPS];
+	/* Fraction of targets given to the accelerator when the CPU works
+	alongside it. 0 until first needed. */
+	double split[DISPATCH_NUM_OPS];
+} dispatch_state = { 0 };
+
+/* The backend of the last M2M call on this thread. */
+static CVTX_THREAD_LOCAL int thread_last_backend = CVTX_BACKEND_CPU;
+/* If not -1, the backend to use regardless of the model. */
+static CVTX_THREAD_LOCAL int thread_forced_backend = -1;
+
+/* The rule used for an operation before calibration. */
+static int default_use_accelerator(enum dispatch_op op,
+	int num_sources, int num_targets);
+
+/* Name of the first enabled accelerator, or NULL. */
+static const char *accelerator_name();
+
+/* The path of the profile file. Returns 0 if there is one. */
+static int profile_path(char *path, size_t length);
+
+/* Load the saved cost models for the enabled accelerator, if any. */
+static void load_profile();
+static void save_profile();
+
+static int op_index(const char *function_name);
+
+static int num_cpu_threads();
+
+/* Seconds taken by op on a problem of size n x n on a backend. The best
+of two runs after a warm up. Returns a negative value if the backend
+couldn't be used. */
+static double time_op(enum dispatch_op op, int n, int backend);
+
+int dispatch_use_accelerator(
+	enum dispatch_op op,
+	int num_sources,
+	int num_targets)
+{
+	assert(op >= 0 && op < DISPATCH_NUM_OPS);
+	const struct cost_model *m = &dispatch_state.models[op];
+	const char *name;
+	double interactions, cpu_time, gpu_time;
+	int use, reason = CVTX_FALLBACK_COST_MODEL;
+	if (thread_forced_backend >= 0) {
+		use = thread_forced_backend == CVTX_BACKEND_OPENCL;
+		reason = CVTX_FALLBACK_FORCED;
+	}
+	else {
+		name = accelerator_name();
+		if (name != NULL && (!dispatch_state.loaded
+			|| strncmp(dispatch_state.device_name, name,
+				CVTX_DISPATCH_NAME_LENGTH - 1) != 0)) {
+			/* Profiles are per device. */
+#pragma omp critical (cvtx_dispatch)
+			{
+				load_profile();
+			}
+		}
+		if (name == NULL) {
+			use = 0;
+			reason = CVTX_FALLBACK_NO_ACCELERATOR;
+		}
+		else if (!dispatch_state.calibrated[op]) {
+			use = default_use_accelerator(op, num_sources, num_targets);
+		}
+		else {
+			interactions = (double)num_sources * (double)num_targets;
+			cpu_time = m->cpu_overhead + m->cpu_per_interaction * interactions
+				* m->cpu_threads / num_cpu_threads();
+			gpu_time = m->gpu_overhead + m->gpu_per_interaction * interactions;
+			use = gpu_time < cpu_time;
+		}
+	}
+	if (use) {
+		thread_last_backend = CVTX_BACKEND_OPENCL;
+		stats_backend(CVTX_BACKEND_OPENCL);
+	}
+	else {
+		stats_fallback(reason);
+	}
+	return use;
+}
+
+void dispatch_record(int backend) {
+	thread_last_backend = backend;
+	stats_backend(backend);
+	return;
+}
+
+CVTX_EXPORT int cvtx_last_backend(void) {
+	return thread_last_backend;
+}
+
+CVTX_EXPORT int cvtx_predict_backend(
+	const char *function_name,
+	int num_sources,
+	int num_targets)
+{
+	int op, last, use;
+	op = op_index(function_name);
+	if (op < 0 || cvtx_num_enabled_accelerators() == 0) {
+		return CVTX_BACKEND_CPU;
+	}
+	last = thread_last_backend;
+	use = dispatch_use_accelerator(op, num_sources, num_targets);
+	if (use && (op == DISPATCH_P3D_VEL || op == DISPATCH_P3D_DVORT)
+		&& dispatch_split(op, num_sources, num_targets) < num_targets) {
+		use = 2;
+	}
+	thread_last_backend = last;
+	return use == 2 ? CVTX_BACKEND_HYBRID :
+		use ? CVTX_BACKEND_OPENCL : CVTX_BACKEND_CPU;
+}
+
+CVTX_EXPORT int cvtx_calibrate_dispatch(void) {
+	struct cost_model model;
+	cvtx_RedistFunc p3m_redistributor;
+	float p3m_density;
+	int op, p3m;
+	double small, large, t_small, t_large;
+	const char *name = accelerator_name();
+	if (name == NULL) { return -1; }
+	/* The brute force methods are wanted, not the mesh ones. */
+	p3m = p3m_P3D_settings(&p3m_redistributor, &p3m_density);
+	if (p3m) { cvtx_P3D_p3m_disable(); }
+
+	small = (double)CVTX_DISPATCH_SMALL * CVTX_DISPATCH_SMALL;
+	large = (double)CVTX_DISPATCH_LARGE * CVTX_DISPATCH_LARGE;
+#pragma omp critical (cvtx_dispatch)
+	{
+		load_profile();
+	}
+	for (op = 0; op < DISPATCH_NUM_OPS; ++op) {
+		model.cpu_threads = num_cpu_threads();
+		t_small = time_op(op, CVTX_DISPATCH_SMALL, CVTX_BACKEND_CPU);
+		t_large = time_op(op, CVTX_DISPATCH_LARGE, CVTX_BACKEND_CPU);
+		model.cpu_per_interaction = fmax((t_large - t_small) / (large - small), 0.);
+		model.cpu_overhead = fmax(t_small - model.cpu_per_interaction * small, 0.);
+		t_small = time_op(op, CVTX_DISPATCH_SMALL, CVTX_BACKEND_OPENCL);
+		t_large = time_op(op, CVTX_DISPATCH_LARGE, CVTX_BACKEND_OPENCL);
+		if (t_small < 0. || t_large < 0.) {
+			/* The accelerator can't do this, so never choose it. */
+			model.gpu_per_interaction = HUGE_VAL;
+			model.gpu_overhead = HUGE_VAL;
+		}
+		else {
+			model.gpu_per_interaction = fmax((t_large - t_small) / (large - small), 0.);
+			model.gpu_overhead = fmax(t_small - model.gpu_per_interaction * small, 0.);
+		}
+#pragma omp critical (cvtx_dispatch)
+		{
+			dispatch_state.models[op] = model;
+			dispatch_state.calibrated[op] = 1;
+		}
+	}
+#pragma omp critical (cvtx_dispatch)
+	{
+		save_profile();
+	}
+	if (p3m) { cvtx_P3D_p3m_enable(&p3m_redistributor, p3m_density); }
+	return 0;
+}
+
+int dispatch_split(
+	enum dispatch_op op,
+	int num_sources,
+	int num_targets)
+{
+	assert(op >= 0 && op < DISPATCH_NUM_OPS);
+	const struct cost_model *m = &dispatch_state.models[op];
+	double cpu_cost, interactions, fraction;
+	int threads = num_cpu_threads(), num_accelerator;
+	if (thread_forced_backend >= 0 || threads < 2 || num_sources <= 0
+		|| num_targets < CVTX_DISPATCH_MIN_SPLIT_TARGETS) {
+		return num_targets;
+	}
+#pragma omp critical (cvtx_dispatch)
+	{
+		if (dispatch_state.split[op] == 0.) {
+			if (dispatch_state.calibrated[op] && m->gpu_per_interaction < HUGE_VAL) {
+				/* One thread is kept waiting on the accelerator. Both sides
+				should finish together, overheads included. */
+				cpu_cost = m->cpu_per_interaction * m->cpu_threads / (threads - 1);
+				interactions = (double)num_sources * (double)num_targets;
+				fraction = (m->cpu_overhead - m->gpu_overhead
+					+ cpu_cost * interactions)
+					/ ((cpu_cost + m->gpu_per_interaction) * interactions);
+				dispatch_state.split[op] = fmin(fmax(fraction, 0.), 1.);
+			}
+			else {
+				dispatch_state.split[op] = 0.9;
+			}
+		}
+		fraction = dispatch_state.split[op];
+	}
+	num_accelerator = (int)(fraction * num_targets);
+	if (num_accelerator <= 0
+		|| num_targets - num_accelerator < CVTX_DISPATCH_MIN_CPU_TARGETS) {
+		return num_targets;
+	}
+	thread_last_backend = CVTX_BACKEND_HYBRID;
+	stats_backend(CVTX_BACKEND_HYBRID);
+	return num_accelerator;
+}
+
+void dispatch_split_result(
+	enum dispatch_op op,
+	int accelerator_targets,
+	double accelerator_time,
+	int cpu_targets,
+	double cpu_time)
+{
+	assert(op >= 0 && op < DISPATCH_NUM_OPS);
+	double accelerator_rate, cpu_rate, fraction;
+	if (accelerator_targets <= 0 || cpu_targets <= 0) { return; }
+	accelerator_rate = accelerator_targets / fmax(accelerator_time, 1e-9);
+	cpu_rate = cpu_targets / fmax(cpu_time, 1e-9);
+	/* Both sides should finish together. Averaged with the previous split
+	so that one noisy call doesn't swing it. */
+	fraction = accelerator_rate / (accelerator_rate + cpu_rate);
+#pragma omp critical (cvtx_dispatch)
+	{
+		fraction = 0.5 * (fraction + dispatch_state.split[op]);
+		dispatch_state.split[op] = fmin(fmax(fraction, 0.05), 0.99);
+	}
+	return;
+}
+
+double dispatch_wall_time() {
+#ifdef CVTX_USING_OPENMP
+	return omp_get_wtime();
+#else
+	return (double)clock() / CLOCKS_PER_SEC;
+#endif
+}
+
+/* STATIC FUNCTIONS ---------------------------------------------------------*/
+static int default_use_accelerator(enum dispatch_op op,
+	int num_sources, int num_targets) {
+	long long n = num_sources, m = num_targets;
+	switch (op) {
+	case DISPATCH_P2D_VEL:
+	case DISPATCH_P2DD_VEL:
+		/* A loosey goosey estimate of whether the GPU does better. */
+		return 20000 + n * m / 20 < n * m;
+	case DISPATCH_F3D_VEL:
+	case DISPATCH_F3DD_VEL:
+		return n * m >= n * m / 20 + 5000 + 300 * m;
+	default:
+		return n >= 256 && m >= 256;
+	}
+}
+
+static const char *accelerator_name() {
+	int i;
+	for (i = 0; i < cvtx_num_accelerators(); ++i) {
+		if (cvtx_accelerator_enabled(i)) {
+			return cvtx_accelerator_name(i);
+		}
+	}
+	return NULL;
+}
+
+static int profile_path(char *path, size_t length) {
+	const char *env, *home;
+	env = getenv("CVTX_DISPATCH_FILE");
+	if (env != NULL) {
+		if (strlen(env) == 0 || strlen(env) >= length) { return -1; }
+		strcpy(path, env);
+		return 0;
+	}
+	home = getenv("HOME");
+	if (home == NULL) { home = getenv("USERPROFILE"); }
+	if (home == NULL
+		|| snprintf(path, length, "%s/.cvortex_dispatch", home) >= (int)length) {
+		return -1;
+	}
+	return 0;
+}
+
+static void load_profile() {
+	char path[1024], line[512], op_name[64], device_name[CVTX_DISPATCH_NAME_LENGTH];
+	const char *name = accelerator_name();
+	struct cost_model model;
+	FILE *file;
+	int op;
+	dispatch_state.loaded = 1;
+	memset(dispatch_state.calibrated, 0, sizeof(dispatch_state.calibrated));
+	memset(dispatch_state.split, 0, sizeof(dispatch_state.split));
+	dispatch_state.device_name[0] = '\0';
+	if (name == NULL) { return; }
+	strncpy(dispatch_state.device_name, name, CVTX_DISPATCH_NAME_LENGTH - 1);
+	if (profile_path(path, sizeof(path)) != 0) { return; }
+	file = fopen(path, "r");
+	if (file == NULL) { return; }
+	/* Each line is "function threads cpu_overhead cpu_per_interaction
+	gpu_overhead gpu_per_interaction device name". */
+	while (fgets(line, sizeof(line), file) != NULL) {
+		if (sscanf(line, "%63s %d %lg %lg %lg %lg %127[^\n]", op_name,
+				&model.cpu_threads, &model.cpu_overhead,
+				&model.cpu_per_interaction, &model.gpu_overhead,
+				&model.gpu_per_interaction, device_name) != 7
+			|| model.cpu_threads < 1
+			|| strcmp(device_name, dispatch_state.device_name) != 0) {
+			continue;
+		}
+		op = op_index(op_name);
+		if (op >= 0) {
+			dispatch_state.models[op] = model;
+			dispatch_state.calibrated[op] = 1;
+		}
+	}
+	fclose(file);
+	return;
+}
+
+static void save_profile() {
+	char path[1024], line[512], op_name[64], device_name[CVTX_DISPATCH_NAME_LENGTH];
+	char *others = NULL;
+	size_t others_length = 0;
+	const struct cost_model *m;
+	FILE *file;
+	int op;
+	if (profile_path(path, sizeof(path)) != 0) { return; }
+	/* Keep the profiles of other accelerators. */
+	file = fopen(path, "r");
+	if (file != NULL) {
+		while (fgets(line, sizeof(line), file) != NULL) {
+			if (sscanf(line, "%63s %*d %*g %*g %*g %*g %127[^\n]",
+					op_name, device_name) == 2
+				&& strcmp(device_name, dispatch_state.device_name) != 0) {
+				others = realloc(others, others_length + strlen(line) + 1);
+				strcpy(others + others_length, line);
+				others_length += strlen(line);
+			}
+		}
+		fclose(file);
+	}
+	file = fopen(path, "w");
+	if (file != NULL) {
+		if (others != NULL) { fputs(others, file); }
+		for (op = 0; op < DISPATCH_NUM_OPS; ++op) {
+			if (!dispatch_state.calibrated[op]) { continue; }
+			m = &dispatch_state.models[op];
+			fprintf(file, "%s %d %.6e %.6e %.6e %.6e %s\n", op_names[op],
+				m->cpu_threads, m->cpu_overhead, m->cpu_per_interaction,
+				m->gpu_overhead, m->gpu_per_interaction,
+				dispatch_state.device_name);
+		}
+		fclose(file);
+	}
+	free(others);
+	return;
+}
+
+static int op_index(const char *function_name) {
+	int op;
+	if (function_name == NULL) { return -1; }
+	for (op = 0; op < DISPATCH_NUM_OPS; ++op) {
+		if (!strcmp(function_name, op_names[op])) { return op; }
+	}
+	return -1;
+}
+
+static int num_cpu_threads() {
+	return context_num_threads();
+}
+
+static double time_op(enum dispatch_op op, int n, int backend) {
+	cvtx_VortFunc kernel = cvtx_VortFunc_winckelmans();
+	cvtx_P3D *p3d = malloc(sizeof(cvtx_P3D) * n);
+	cvtx_P2D *p2d = malloc(sizeof(cvtx_P2D) * n);
+	cvtx_F3D *f3d = malloc(sizeof(cvtx_F3D) * n);
+	const cvtx_P3D **p3d_ptrs = malloc(sizeof(cvtx_P3D*) * n);
+	const cvtx_P2D **p2d_ptrs = malloc(sizeof(cvtx_P2D*) * n);
+	const cvtx_F3D **f3d_ptrs = malloc(sizeof(cvtx_F3D*) * n);
+	bsv_V3f *mes3 = malloc(sizeof(bsv_V3f) * n);
+	bsv_V2f *mes2 = malloc(sizeof(bsv_V2f) * n);
+	bsv_V3f *res3 = malloc(sizeof(bsv_V3f) * 3 * n);
+	bsv_V3f *grad3 = malloc(sizeof(bsv_V3f) * 3 * n);
+	float *res1 = malloc(sizeof(float) * n);
+	cvtx_P3Dd *p3dd = malloc(sizeof(cvtx_P3Dd) * n);
+	cvtx_P2Dd *p2dd = malloc(sizeof(cvtx_P2Dd) * n);
+	cvtx_F3Dd *f3dd = malloc(sizeof(cvtx_F3Dd) * n);
+	const cvtx_P3Dd **p3dd_ptrs = malloc(sizeof(cvtx_P3Dd*) * n);
+	const cvtx_P2Dd **p2dd_ptrs = malloc(sizeof(cvtx_P2Dd*) * n);
+	const cvtx_F3Dd **f3dd_ptrs = malloc(sizeof(cvtx_F3Dd*) * n);
+	cvtx_V3d *mes3d = malloc(sizeof(cvtx_V3d) * n);
+	cvtx_V2d *mes2d = malloc(sizeof(cvtx_V2d) * n);
+	cvtx_V3d *res3d = malloc(sizeof(cvtx_V3d) * n);
+	double start, best = HUGE_VAL;
+	int i, j, run, used = 1;
+
+	for (i = 0; i < n; ++i) {
+		/* Anywhere in a unit cube will do. */
+		float x = (float)(i % 16) / 16.f, y = (float)((i / 16) % 16) / 16.f;
+		float z = (float)i / (float)n;
+		p3d[i].coord.x[0] = x;
+		p3d[i].coord.x[1] = y;
+		p3d[i].coord.x[2] = z;
+		p3d[i].vorticity.x[0] = y;
+		p3d[i].vorticity.x[1] = z;
+		p3d[i].vorticity.x[2] = x;
+		p3d[i].volume = 0.01f;
+		p2d[i].coord.x[0] = x;
+		p2d[i].coord.x[1] = z;
+		p2d[i].vorticity = y;
+		p2d[i].area = 0.01f;
+		f3d[i].start = p3d[i].coord;
+		f3d[i].end = p3d[i].coord;
+		f3d[i].end.x[0] += 0.05f;
+		f3d[i].strength = 1.f;
+		mes3[i] = p3d[i].vorticity;
+		mes2[i].x[0] = z;
+		mes2[i].x[1] = y;
+		p3d_ptrs[i] = p3d + i;
+		p2d_ptrs[i] = p2d + i;
+		f3d_ptrs[i] = f3d + i;
+		for (j = 0; j < 3; ++j) {
+			p3dd[i].coord.x[j] = p3d[i].coord.x[j];
+			p3dd[i].vorticity.x[j] = p3d[i].vorticity.x[j];
+			f3dd[i].start.x[j] = f3d[i].start.x[j];
+			f3dd[i].end.x[j] = f3d[i].end.x[j];
+			mes3d[i].x[j] = mes3[i].x[j];
+		}
+		p3dd[i].volume = p3d[i].volume;
+		f3dd[i].strength = f3d[i].strength;
+		for (j = 0; j < 2; ++j) {
+			p2dd[i].coord.x[j] = p2d[i].coord.x[j];
+			mes2d[i].x[j] = mes2[i].x[j];
+		}
+		p2dd[i].vorticity = p2d[i].vorticity;
+		p2dd[i].area = p2d[i].area;
+		p3dd_ptrs[i] = p3dd + i;
+		p2dd_ptrs[i] = p2dd + i;
+		f3dd_ptrs[i] = f3dd + i;
+	}
+
+	thread_forced_backend = backend;
+	for (run = 0; run < 3 && used; ++run) {
+		start = dispatch_wall_time();
+		switch (op) {
+		case DISPATCH_P3D_VEL:
+			cvtx_P3D_M2M_vel(p3d_ptrs, n, mes3, n, res3, &kernel, 0.1f);
+			break;
+		case DISPATCH_P3D_VEL_GRAD:
+			cvtx_P3D_M2M_vel_grad(p3d_ptrs, n, mes3, n, res3, grad3, &kernel, 0.1f);
+			break;
+		case DISPATCH_P3D_DVORT:
+			cvtx_P3D_M2M_dvort(p3d_ptrs, n, p3d_ptrs, n, res3, &kernel, 0.1f);
+			break;
+		case DISPATCH_P3D_VISC_DVORT:
+			cvtx_P3D_M2M_visc_dvort(p3d_ptrs, n, p3d_ptrs, n, res3, &kernel, 0.1f, 1e-3f);
+			break;
+		case DISPATCH_P3D_VORT:
+			cvtx_P3D_M2M_vort(p3d_ptrs, n, mes3, n, res3, &kernel, 0.1f);
+			break;
+		case DISPATCH_P2D_VEL:
+			cvtx_P2D_M2M_vel(p2d_ptrs, n, mes2, n, (bsv_V2f*)res3, &kernel, 0.1f);
+			break;
+		case DISPATCH_P2D_VISC_DVORT:
+			cvtx_P2D_M2M_visc_dvort(p2d_ptrs, n, p2d_ptrs, n, res1, &kernel, 0.1f, 1e-3f);
+			break;
+		case DISPATCH_F3D_VEL:
+			cvtx_F3D_M2M_vel(f3d_ptrs, n, mes3, n, res3);
+			break;
+		case DISPATCH_F3D_DVORT:
+			cvtx_F3D_M2M_dvort(f3d_ptrs, n, p3d_ptrs, n, res3);
+			break;
+		case DISPATCH_P3DD_VEL:
+			cvtx_P3Dd_M2M_vel(p3dd_ptrs, n, mes3d, n, res3d, &kernel, 0.1);
+			break;
+		case DISPATCH_P3DD_DVORT:
+			cvtx_P3Dd_M2M_dvort(p3dd_ptrs, n, p3dd_ptrs, n, res3d, &kernel, 0.1);
+			break;
+		case DISPATCH_P2DD_VEL:
+			cvtx_P2Dd_M2M_vel(p2dd_ptrs, n, mes2d, n, (cvtx_V2d*)res3d, &kernel, 0.1);
+			break;
+		case DISPATCH_F3DD_VEL:
+			cvtx_F3Dd_M2M_vel(f3dd_ptrs, n, mes3d, n, res3d);
+			break;
+		default:
+			assert(0);
+		}
+		/* The first run is a warm up (program builds, tuning, caches). */
+		if (run > 0) { best = fmin(best, dispatch_wall_time() - start); }
+		used = thread_last_backend == backend;
+	}
+	thread_forced_backend = -1;
+
+	free(p3d); free(p2d); free(f3d);
+	free(p3d_ptrs); free(p2d_ptrs); free(f3d_ptrs);
+	free(mes3); free(mes2); free(res3); free(grad3); free(res1);
+	free(p3dd); free(p2dd); free(f3dd);
+	free(p3dd_ptrs); free(p2dd_ptrs); free(f3dd_ptrs);
+	free(mes3d); free(mes2d); free(res3d);
+	return used ? best : -1.;
+}
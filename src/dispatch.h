@@ -0,0 +1,79 @@
+#ifndef CVTX_DISPATCH_H
+#define CVTX_DISPATCH_H
+#include "libcvtx.h"
+/*============================================================================
+dispatch.h
+
+Choice between the CPU and accelerator implementations of M2M methods.
+
+Copyright(c) 2019 HJA Bird
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files(the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+============================================================================*/
+
+/* Operations with both CPU and accelerator implementations. */
+enum dispatch_op {
+	DISPATCH_P3D_VEL,
+	DISPATCH_P3D_VEL_GRAD,
+	DISPATCH_P3D_DVORT,
+	DISPATCH_P3D_VISC_DVORT,
+	DISPATCH_P3D_VORT,
+	DISPATCH_P2D_VEL,
+	DISPATCH_P2D_VISC_DVORT,
+	DISPATCH_F3D_VEL,
+	DISPATCH_F3D_DVORT,
+	DISPATCH_P3DD_VEL,
+	DISPATCH_P3DD_DVORT,
+	DISPATCH_P2DD_VEL,
+	DISPATCH_F3DD_VEL,
+	DISPATCH_NUM_OPS
+};
+
+/* 1 if an operation is predicted to be faster on an accelerator than the
+CPU. Until calibrated, a fixed rule for each operation is used. Records
+CVTX_BACKEND_OPENCL as the last backend if it returns 1. */
+int dispatch_use_accelerator(
+	enum dispatch_op op,
+	int num_sources,
+	int num_targets);
+
+/* Record the backend used by an operation for cvtx_last_backend. */
+void dispatch_record(int backend);
+
+/* For an operation going to the accelerator, the number of targets the
+accelerator should take when the CPU computes the rest at the same time.
+Returns num_targets if it isn't worth splitting. Records
+CVTX_BACKEND_HYBRID as the last backend if less than num_targets. */
+int dispatch_split(
+	enum dispatch_op op,
+	int num_sources,
+	int num_targets);
+
+/* Learn from the times taken by each side of a split call. */
+void dispatch_split_result(
+	enum dispatch_op op,
+	int accelerator_targets,
+	double accelerator_time,
+	int cpu_targets,
+	double cpu_time);
+
+/* Wall clock time in seconds. */
+double dispatch_wall_time();
+
+#endif /* CVTX_DISPATCH_H */
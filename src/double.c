@@ -0,0 +1,481 @@
+#include "libcvtx.h"
+/*============================================================================
+double.c
+
+Double precision vortex particle and filament methods.
+
+Copyright(c) 2019 HJA Bird
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files(the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+============================================================================*/
+#include <assert.h>
+#include <float.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "context.h"
+#include "dispatch.h"
+#include "stats.h"
+#include "vortfunc_builtin.h"
+#include "workspace.h"
+
+#ifdef CVTX_USING_OPENCL
+#	include "ocl_double.h"
+#endif
+
+/*
+The sources are packed into structure of arrays form before the sums so
+that the loop over them vectorises. As with the single precision methods,
+the regularisation functions of built in kernels are inlined into the sums.
+Other kernels only have single precision functions, so are evaluated in
+float through the cvtx_VortFunc.
+*/
+
+/* Sources as structure of arrays. Unused members are NULL. */
+struct double_sources {
+	double *x, *y, *z;
+	double *a, *b, *c;
+	double *s;
+};
+
+/* Workspace memory for n doubles, aligned for vector loads. */
+static double *alloc_doubles(int n) {
+	return workspace_alloc_aligned(sizeof(double) * (n > 0 ? n : 1), 64);
+}
+
+static void pack_P3Dd(const cvtx_P3Dd **array_start, int num_particles,
+	struct double_sources *src) {
+	int i;
+	src->x = alloc_doubles(num_particles);
+	src->y = alloc_doubles(num_particles);
+	src->z = alloc_doubles(num_particles);
+	src->a = alloc_doubles(num_particles);
+	src->b = alloc_doubles(num_particles);
+	src->c = alloc_doubles(num_particles);
+	src->s = NULL;
+	for (i = 0; i < num_particles; ++i) {
+		src->x[i] = array_start[i]->coord.x[0];
+		src->y[i] = array_start[i]->coord.x[1];
+		src->z[i] = array_start[i]->coord.x[2];
+		src->a[i] = array_start[i]->vorticity.x[0];
+		src->b[i] = array_start[i]->vorticity.x[1];
+		src->c[i] = array_start[i]->vorticity.x[2];
+	}
+	return;
+}
+
+/* The velocity induced at a point by many particles, excluding the
+constant coefficient 1 / 4pi. g_3D is NULL to use kernel. */
+static inline cvtx_V3d P3Dd_vel_sum(
+	const struct double_sources *src,
+	const int num_particles,
+	const cvtx_V3d mes_point,
+	double (*g_3D)(double),
+	const cvtx_VortFunc *kernel,
+	double recip_reg_rad)
+{
+	double rx = 0, ry = 0, rz = 0;
+	int i;
+#pragma omp simd reduction(+:rx, ry, rz)
+	for (i = 0; i < num_particles; ++i) {
+		double dx, dy, dz, r2, radd, g, cor;
+		dx = mes_point.x[0] - src->x[i];
+		dy = mes_point.x[1] - src->y[i];
+		dz = mes_point.x[2] - src->z[i];
+		r2 = dx * dx + dy * dy + dz * dz;
+		radd = sqrt(r2);
+		g = g_3D != NULL ? g_3D(radd * recip_reg_rad)
+			: (double)kernel->g_3D((float)(radd * recip_reg_rad));
+		cor = r2 > 0. ? -g / (r2 * radd) : 0.;
+		rx += (dy * src->c[i] - dz * src->b[i]) * cor;
+		ry += (dz * src->a[i] - dx * src->c[i]) * cor;
+		rz += (dx * src->b[i] - dy * src->a[i]) * cor;
+	}
+	cvtx_V3d ret = {{rx, ry, rz}};
+	return ret;
+}
+
+/* The rate of change of vorticity induced on a particle by many, excluding
+the constant coefficient 1 / (4 pi reg_rad^3). combined_3D is NULL to use
+kernel. */
+static inline cvtx_V3d P3Dd_dvort_sum(
+	const struct double_sources *src,
+	const int num_particles,
+	const cvtx_P3Dd *induced_particle,
+	void (*combined_3D)(double, double*, double*),
+	const cvtx_VortFunc *kernel,
+	double recip_reg_rad)
+{
+	const double *ic = induced_particle->coord.x;
+	const double *iv = induced_particle->vorticity.x;
+	double rx = 0, ry = 0, rz = 0;
+	int i;
+#pragma omp simd reduction(+:rx, ry, rz)
+	for (i = 0; i < num_particles; ++i) {
+		double dx, dy, dz, r2, rho, g, f, cx, cy, cz, recip_rho3, t2;
+		float gf, ff;
+		dx = ic[0] - src->x[i];
+		dy = ic[1] - src->y[i];
+		dz = ic[2] - src->z[i];
+		r2 = dx * dx + dy * dy + dz * dz;
+		rho = sqrt(r2) * recip_reg_rad;
+		if (combined_3D != NULL) {
+			combined_3D(rho, &g, &f);
+		}
+		else {
+			kernel->combined_3D((float)rho, &gf, &ff);
+			g = gf;
+			f = ff;
+		}
+		/* induced vorticity x source vorticity */
+		cx = iv[1] * src->c[i] - iv[2] * src->b[i];
+		cy = iv[2] * src->a[i] - iv[0] * src->c[i];
+		cz = iv[0] * src->b[i] - iv[1] * src->a[i];
+		recip_rho3 = 1. / (rho * rho * rho);
+		t2 = -(3. * g * recip_rho3 - f) * (dx * cx + dy * cy + dz * cz) / r2;
+		if (r2 > 0.) {
+			rx += cx * g * recip_rho3 + dx * t2;
+			ry += cy * g * recip_rho3 + dy * t2;
+			rz += cz * g * recip_rho3 + dz * t2;
+		}
+	}
+	cvtx_V3d ret = {{rx, ry, rz}};
+	return ret;
+}
+
+/* The velocity induced at a point by many particles, excluding the
+constant coefficient 1 / 2pi. g_2D is NULL to use kernel. */
+static inline cvtx_V2d P2Dd_vel_sum(
+	const struct double_sources *src,
+	const int num_particles,
+	const cvtx_V2d mes_point,
+	double (*g_2D)(double),
+	const cvtx_VortFunc *kernel,
+	double recip_reg_rad)
+{
+	double rx = 0, ry = 0;
+	int i;
+#pragma omp simd reduction(+:rx, ry)
+	for (i = 0; i < num_particles; ++i) {
+		double dx, dy, r2, rho, g, cor;
+		dx = mes_point.x[0] - src->x[i];
+		dy = mes_point.x[1] - src->y[i];
+		r2 = dx * dx + dy * dy;
+		rho = sqrt(r2) * recip_reg_rad;
+		g = g_2D != NULL ? g_2D(rho) : (double)kernel->g_2D((float)rho);
+		cor = r2 > 0. ? src->s[i] * g / r2 : 0.;
+		rx += dy * cor;
+		ry -= dx * cor;
+	}
+	cvtx_V2d ret = {{rx, ry}};
+	return ret;
+}
+
+/* P3Dd_vel_sum with the regularisation function of kernel inlined if it is
+built in (builtin is its vortfunc_builtin_index). */
+static cvtx_V3d P3Dd_M2M_vel_sum(
+	const struct double_sources *src,
+	const int num_particles,
+	const cvtx_V3d mes_point,
+	const cvtx_VortFunc *kernel,
+	int builtin,
+	double recip_reg_rad)
+{
+	switch (builtin) {
+#define CVTX_P3DD_VEL_CASE(NAME, G_3D, ZETA_3D, ETA_3D, G_2D, ETA_2D, VISCOUS) \
+	case VORTFUNC_##NAME:													\
+		return P3Dd_vel_sum(src, num_particles, mes_point,					\
+			&vortfunc_g_3D_d_##NAME, kernel, recip_reg_rad);
+		CVTX_BUILTIN_VORTFUNCS(CVTX_P3DD_VEL_CASE)
+#undef CVTX_P3DD_VEL_CASE
+	default:
+		return P3Dd_vel_sum(src, num_particles, mes_point,
+			NULL, kernel, recip_reg_rad);
+	}
+}
+
+/* P3Dd_dvort_sum for the M2M method, as P3Dd_M2M_vel_sum. */
+static cvtx_V3d P3Dd_M2M_dvort_sum(
+	const struct double_sources *src,
+	const int num_particles,
+	const cvtx_P3Dd *induced_particle,
+	const cvtx_VortFunc *kernel,
+	int builtin,
+	double recip_reg_rad)
+{
+	switch (builtin) {
+#define CVTX_P3DD_DVORT_CASE(NAME, G_3D, ZETA_3D, ETA_3D, G_2D, ETA_2D, VISCOUS) \
+	case VORTFUNC_##NAME:													\
+		return P3Dd_dvort_sum(src, num_particles, induced_particle,			\
+			&vortfunc_combined_3D_d_##NAME, kernel, recip_reg_rad);
+		CVTX_BUILTIN_VORTFUNCS(CVTX_P3DD_DVORT_CASE)
+#undef CVTX_P3DD_DVORT_CASE
+	default:
+		return P3Dd_dvort_sum(src, num_particles, induced_particle,
+			NULL, kernel, recip_reg_rad);
+	}
+}
+
+/* P2Dd_vel_sum for the M2M method, as P3Dd_M2M_vel_sum. */
+static cvtx_V2d P2Dd_M2M_vel_sum(
+	const struct double_sources *src,
+	const int num_particles,
+	const cvtx_V2d mes_point,
+	const cvtx_VortFunc *kernel,
+	int builtin,
+	double recip_reg_rad)
+{
+	switch (builtin) {
+#define CVTX_P2DD_VEL_CASE(NAME, G_3D, ZETA_3D, ETA_3D, G_2D, ETA_2D, VISCOUS) \
+	case VORTFUNC_##NAME:													\
+		return P2Dd_vel_sum(src, num_particles, mes_point,					\
+			&vortfunc_g_2D_d_##NAME, kernel, recip_reg_rad);
+		CVTX_BUILTIN_VORTFUNCS(CVTX_P2DD_VEL_CASE)
+#undef CVTX_P2DD_VEL_CASE
+	default:
+		return P2Dd_vel_sum(src, num_particles, mes_point,
+			NULL, kernel, recip_reg_rad);
+	}
+}
+
+CVTX_EXPORT void cvtx_P3Dd_M2M_vel(
+	const cvtx_P3Dd **array_start,
+	const int num_particles,
+	const cvtx_V3d *mes_start,
+	const int num_mes,
+	cvtx_V3d *result_array,
+	const cvtx_VortFunc *kernel,
+	double regularisation_radius)
+{
+	struct double_sources src;
+	size_t ws_mark;
+	long i;
+	int j, builtin;
+	double recip_reg_rad, coeff;
+	stats_begin("cvtx_P3Dd_M2M_vel", num_particles, num_mes);
+#ifdef CVTX_USING_OPENCL
+	if (dispatch_use_accelerator(DISPATCH_P3DD_VEL, num_particles, num_mes)
+		&& opencl_brute_force_P3Dd_M2M_vel(
+			array_start, num_particles, mes_start,
+			num_mes, result_array, kernel, regularisation_radius) == 0) {
+		stats_end();
+		return;
+	}
+#endif
+	dispatch_record(CVTX_BACKEND_CPU);
+	builtin = vortfunc_builtin_index(kernel);
+	recip_reg_rad = 1. / fabs(regularisation_radius);
+	coeff = 1. / (4. * acos(-1.));
+	ws_mark = workspace_mark();
+	pack_P3Dd(array_start, num_particles, &src);
+	struct context_schedule schedule = context_schedule_begin(CVTX_SCHEDULE_STATIC);
+#pragma omp parallel for schedule(runtime) private(j) num_threads(context_num_threads())
+	for (i = 0; i < num_mes; ++i) {
+		result_array[i] = P3Dd_M2M_vel_sum(&src, num_particles,
+			mes_start[i], kernel, builtin, recip_reg_rad);
+		for (j = 0; j < 3; ++j) { result_array[i].x[j] *= coeff; }
+	}
+	context_schedule_end(schedule);
+	workspace_reset(ws_mark);
+	stats_end();
+	return;
+}
+
+CVTX_EXPORT void cvtx_P3Dd_M2M_dvort(
+	const cvtx_P3Dd **array_start,
+	const int num_particles,
+	const cvtx_P3Dd **induced_start,
+	const int num_induced,
+	cvtx_V3d *result_array,
+	const cvtx_VortFunc *kernel,
+	double regularisation_radius)
+{
+	struct double_sources src;
+	size_t ws_mark;
+	long i;
+	int j, builtin;
+	double recip_reg_rad, coeff;
+	stats_begin("cvtx_P3Dd_M2M_dvort", num_particles, num_induced);
+#ifdef CVTX_USING_OPENCL
+	if (dispatch_use_accelerator(DISPATCH_P3DD_DVORT, num_particles, num_induced)
+		&& opencl_brute_force_P3Dd_M2M_dvort(
+			array_start, num_particles, induced_start,
+			num_induced, result_array, kernel, regularisation_radius) == 0) {
+		stats_end();
+		return;
+	}
+#endif
+	dispatch_record(CVTX_BACKEND_CPU);
+	builtin = vortfunc_builtin_index(kernel);
+	recip_reg_rad = 1. / fabs(regularisation_radius);
+	coeff = recip_reg_rad * recip_reg_rad * recip_reg_rad / (4. * acos(-1.));
+	ws_mark = workspace_mark();
+	pack_P3Dd(array_start, num_particles, &src);
+	struct context_schedule schedule = context_schedule_begin(CVTX_SCHEDULE_STATIC);
+#pragma omp parallel for schedule(runtime) private(j) num_threads(context_num_threads())
+	for (i = 0; i < num_induced; ++i) {
+		result_array[i] = P3Dd_M2M_dvort_sum(&src, num_particles,
+			induced_start[i], kernel, builtin, recip_reg_rad);
+		for (j = 0; j < 3; ++j) { result_array[i].x[j] *= coeff; }
+	}
+	context_schedule_end(schedule);
+	workspace_reset(ws_mark);
+	stats_end();
+	return;
+}
+
+CVTX_EXPORT void cvtx_F3Dd_M2M_vel(
+	const cvtx_F3Dd **array_start,
+	const int num_filaments,
+	const cvtx_V3d *mes_start,
+	const int num_mes,
+	cvtx_V3d *result_array)
+{
+	struct double_sources src;
+	size_t ws_mark;
+	long i;
+	int j;
+	double coeff;
+	stats_begin("cvtx_F3Dd_M2M_vel", num_filaments, num_mes);
+#ifdef CVTX_USING_OPENCL
+	if (dispatch_use_accelerator(DISPATCH_F3DD_VEL, num_filaments, num_mes)
+		&& opencl_brute_force_F3Dd_M2M_vel(
+			array_start, num_filaments, mes_start,
+			num_mes, result_array) == 0) {
+		stats_end();
+		return;
+	}
+#endif
+	dispatch_record(CVTX_BACKEND_CPU);
+	coeff = 1. / (4. * acos(-1.));
+	ws_mark = workspace_mark();
+	/* Start point and end point. */
+	src.x = alloc_doubles(num_filaments);
+	src.y = alloc_doubles(num_filaments);
+	src.z = alloc_doubles(num_filaments);
+	src.a = alloc_doubles(num_filaments);
+	src.b = alloc_doubles(num_filaments);
+	src.c = alloc_doubles(num_filaments);
+	src.s = alloc_doubles(num_filaments);
+	for (j = 0; j < num_filaments; ++j) {
+		src.x[j] = array_start[j]->start.x[0];
+		src.y[j] = array_start[j]->start.x[1];
+		src.z[j] = array_start[j]->start.x[2];
+		src.a[j] = array_start[j]->end.x[0];
+		src.b[j] = array_start[j]->end.x[1];
+		src.c[j] = array_start[j]->end.x[2];
+		src.s[j] = array_start[j]->strength;
+	}
+	struct context_schedule schedule = context_schedule_begin(CVTX_SCHEDULE_STATIC);
+#pragma omp parallel for schedule(runtime) private(j) num_threads(context_num_threads())
+	for (i = 0; i < num_mes; ++i) {
+		const double *m = mes_start[i].x;
+		double rx = 0, ry = 0, rz = 0;
+#pragma omp simd reduction(+:rx, ry, rz)
+		for (j = 0; j < num_filaments; ++j) {
+			double r1x, r1y, r1z, r2x, r2y, r2z, r0x, r0y, r0z;
+			double cx, cy, cz, c2, t1, t2;
+			r1x = m[0] - src.x[j];
+			r1y = m[1] - src.y[j];
+			r1z = m[2] - src.z[j];
+			r2x = m[0] - src.a[j];
+			r2y = m[1] - src.b[j];
+			r2z = m[2] - src.c[j];
+			r0x = r1x - r2x;
+			r0y = r1y - r2y;
+			r0z = r1z - r2z;
+			cx = r1y * r2z - r1z * r2y;
+			cy = r1z * r2x - r1x * r2z;
+			cz = r1x * r2y - r1y * r2x;
+			c2 = cx * cx + cy * cy + cz * cz;
+			t1 = src.s[j] / c2;
+			t2 = (r1x * r0x + r1y * r0y + r1z * r0z)
+					/ sqrt(r1x * r1x + r1y * r1y + r1z * r1z)
+				- (r2x * r0x + r2y * r0y + r2z * r0z)
+					/ sqrt(r2x * r2x + r2y * r2y + r2z * r2z);
+			/* On the filament's axis the cross product is dodgy, so the
+			result is ignored (NaN fails the comparison). */
+			if (fabs(t1) <= DBL_MAX && fabs(t2) <= DBL_MAX) {
+				rx += cx * t1 * t2;
+				ry += cy * t1 * t2;
+				rz += cz * t1 * t2;
+			}
+		}
+		result_array[i].x[0] = rx * coeff;
+		result_array[i].x[1] = ry * coeff;
+		result_array[i].x[2] = rz * coeff;
+	}
+	context_schedule_end(schedule);
+	workspace_reset(ws_mark);
+	stats_end();
+	return;
+}
+
+CVTX_EXPORT void cvtx_P2Dd_M2M_vel(
+	const cvtx_P2Dd **array_start,
+	const int num_particles,
+	const cvtx_V2d *mes_start,
+	const int num_mes,
+	cvtx_V2d *result_array,
+	const cvtx_VortFunc *kernel,
+	double regularisation_radius)
+{
+	struct double_sources src;
+	size_t ws_mark;
+	long i;
+	int j, builtin;
+	double recip_reg_rad, coeff;
+	stats_begin("cvtx_P2Dd_M2M_vel", num_particles, num_mes);
+#ifdef CVTX_USING_OPENCL
+	if (dispatch_use_accelerator(DISPATCH_P2DD_VEL, num_particles, num_mes)
+		&& opencl_brute_force_P2Dd_M2M_vel(
+			array_start, num_particles, mes_start,
+			num_mes, result_array, kernel, regularisation_radius) == 0) {
+		stats_end();
+		return;
+	}
+#endif
+	dispatch_record(CVTX_BACKEND_CPU);
+	builtin = vortfunc_builtin_index(kernel);
+	recip_reg_rad = 1. / fabs(regularisation_radius);
+	coeff = 1. / (2. * acos(-1.));
+	ws_mark = workspace_mark();
+	memset(&src, 0, sizeof(src));
+	src.x = alloc_doubles(num_particles);
+	src.y = alloc_doubles(num_particles);
+	src.s = alloc_doubles(num_particles);
+	for (j = 0; j < num_particles; ++j) {
+		src.x[j] = array_start[j]->coord.x[0];
+		src.y[j] = array_start[j]->coord.x[1];
+		src.s[j] = array_start[j]->vorticity;
+	}
+	struct context_schedule schedule = context_schedule_begin(CVTX_SCHEDULE_STATIC);
+#pragma omp parallel for schedule(runtime) num_threads(context_num_threads())
+	for (i = 0; i < num_mes; ++i) {
+		result_array[i] = P2Dd_M2M_vel_sum(&src, num_particles,
+			mes_start[i], kernel, builtin, recip_reg_rad);
+		result_array[i].x[0] *= coeff;
+		result_array[i].x[1] *= coeff;
+	}
+	context_schedule_end(schedule);
+	workspace_reset(ws_mark);
+	stats_end();
+	return;
+}
@@ -0,0 +1,145 @@
+#include "fft.h"
+/*============================================================================
+fft.c
+
+Simple radix-2 complex fast fourier transforms for mesh based methods.
+
+Copyright(c) 2019 HJA Bird
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files(the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+============================================================================*/
+
+#include <assert.h>
+#include <math.h>
+#include <stdlib.h>
+#ifdef CVTX_USING_OPENMP
+#	include <omp.h>
+#endif
+
+#include "context.h"
+
+size_t fft_next_pow2(size_t n) {
+	size_t ret = 1;
+	while (ret < n) {
+		ret <<= 1;
+	}
+	return ret;
+}
+
+void fft_c2c_1d(double *data, size_t n, int inverse) {
+	size_t i, j, k, len, half;
+	double sgn = inverse ? 1. : -1.;
+	assert((n & (n - 1)) == 0 && "FFT length must be a power of two.");
+
+	/* Bit reversal permutation. */
+	for (i = 1, j = 0; i < n; ++i) {
+		size_t bit = n >> 1;
+		for (; j & bit; bit >>= 1) {
+			j ^= bit;
+		}
+		j ^= bit;
+		if (i < j) {
+			double tr = data[2 * i], ti = data[2 * i + 1];
+			data[2 * i] = data[2 * j];
+			data[2 * i + 1] = data[2 * j + 1];
+			data[2 * j] = tr;
+			data[2 * j + 1] = ti;
+		}
+	}
+	/* Butterflies. */
+	for (len = 2; len <= n; len <<= 1) {
+		double theta = sgn * 2. * acos(-1.) / (double)len;
+		double wlr = cos(theta), wli = sin(theta);
+		half = len >> 1;
+		for (i = 0; i < n; i += len) {
+			double wr = 1., wi = 0.;
+			for (k = 0; k < half; ++k) {
+				size_t a = 2 * (i + k), b = 2 * (i + k + half);
+				double ur = data[a], ui = data[a + 1];
+				double vr = data[b] * wr - data[b + 1] * wi;
+				double vi = data[b] * wi + data[b + 1] * wr;
+				double twr = wr * wlr - wi * wli;
+				data[a] = ur + vr;
+				data[a + 1] = ui + vi;
+				data[b] = ur - vr;
+				data[b + 1] = ui - vi;
+				wi = wr * wli + wi * wlr;
+				wr = twr;
+			}
+		}
+	}
+	return;
+}
+
+/* Transform all lines of length n with element stride stride. Line l
+starts at (l / n_inner) * outer_stride + l % n_inner. Each thread copies
+its lines into its own slice of a workspace buffer. Returns -1 if the
+buffer cannot be allocated. */
+static int fft_c2c_lines(double *data, size_t n, size_t stride,
+	size_t n_outer, size_t outer_stride, size_t n_inner, int inverse) {
+	long l;
+	long n_lines = (long)(n_outer * n_inner);
+	int num_threads = context_num_threads();
+	size_t ws_mark = workspace_mark();
+	double *lines = workspace_alloc(sizeof(double) * 2 * n * num_threads);
+	if (lines == NULL) {
+		workspace_reset(ws_mark);
+		return -1;
+	}
+#pragma omp parallel num_threads(num_threads)
+	{
+		double *line = lines;
+#ifdef CVTX_USING_OPENMP
+		line += 2 * n * omp_get_thread_num();
+#endif
+#pragma omp for schedule(static)
+		for (l = 0; l < n_lines; ++l) {
+			size_t m, start;
+			start = (l / n_inner) * outer_stride + l % n_inner;
+			for (m = 0; m < n; ++m) {
+				line[2 * m] = data[2 * (start + m * stride)];
+				line[2 * m + 1] = data[2 * (start + m * stride) + 1];
+			}
+			fft_c2c_1d(line, n, inverse);
+			for (m = 0; m < n; ++m) {
+				data[2 * (start + m * stride)] = line[2 * m];
+				data[2 * (start + m * stride) + 1] = line[2 * m + 1];
+			}
+		}
+	}
+	workspace_reset(ws_mark);
+	return 0;
+}
+
+int fft_c2c_2d(double *data, size_t nx, size_t ny, int inverse) {
+	if (fft_c2c_lines(data, ny, 1, nx, ny, 1, inverse)
+		|| fft_c2c_lines(data, nx, ny, 1, 0, ny, inverse)) {
+		return -1;
+	}
+	return 0;
+}
+
+int fft_c2c_3d(double *data, size_t nx, size_t ny, size_t nz, int inverse) {
+	if (fft_c2c_lines(data, nz, 1, nx * ny, nz, 1, inverse)
+		|| fft_c2c_lines(data, ny, nz, nx, ny * nz, nz, inverse)
+		|| fft_c2c_lines(data, nx, ny * nz, 1, 0, ny * nz, inverse)) {
+		return -1;
+	}
+	return 0;
+}
@@ -0,0 +1,47 @@
+#ifndef CVTX_FFT_H
+#define CVTX_FFT_H
+#include "libcvtx.h"
+/*============================================================================
+fft.h
+
+Simple radix-2 complex fast fourier transforms for mesh based methods.
+
+Copyright(c) 2019 HJA Bird
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files(the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+============================================================================*/
+
+#include <stddef.h>
+
+/* Smallest power of two greater than or equal to n. */
+size_t fft_next_pow2(size_t n);
+
+/* In place complex to complex transform of n interleaved (re, im) doubles.
+n must be a power of two. The inverse transform is unscaled. */
+void fft_c2c_1d(double *data, size_t n, int inverse);
+
+/* In place transform of a row-major (y fastest) complex 2D array.
+Returns 0 on success, -1 if scratch memory cannot be allocated. */
+int fft_c2c_2d(double *data, size_t nx, size_t ny, int inverse);
+
+/* In place transform of a row-major (z fastest) complex 3D array.
+Returns 0 on success, -1 if scratch memory cannot be allocated. */
+int fft_c2c_3d(double *data, size_t nx, size_t ny, size_t nz, int inverse);
+
+#endif /* CVTX_FFT_H */
@@ -32,20 +32,70 @@ Definitions for the repeated body of kernels
 ############################################################################*/
 
 
-"#define SQRT_2_OVER_PI 0.7978845608028654f							\n"
-"#define ONE_OVER_SQRT_TWO 0.7071067811865475f						\n"
+/* The kernels are also built in double precision (with -D CVTX_CL_DOUBLE) for
+devices with cl_khr_fp64. */
+"#ifdef CVTX_CL_DOUBLE												\n"
+"#pragma OPENCL EXTENSION cl_khr_fp64 : enable						\n"
+"typedef double cvtx_real;											\n"
+"typedef double2 cvtx_real2;										\n"
+"typedef double3 cvtx_real3;										\n"
+"#define CVTX_CL_PI M_PI											\n"
+"#define CVTX_VF_RECIP_SQRT_2 0.70710678118654752					\n"
+"#define CVTX_VF_SQRT_2_OVER_PI 0.79788456080286536					\n"
+"#else																\n"
+"typedef float cvtx_real;											\n"
+"typedef float2 cvtx_real2;											\n"
+"typedef float3 cvtx_real3;											\n"
+"#define CVTX_CL_PI M_PI_F											\n"
+"#define CVTX_VF_RECIP_SQRT_2 0.7071067811865475f					\n"
+"#define CVTX_VF_SQRT_2_OVER_PI 0.7978845608028654f					\n"
+"#endif																\n"
+
+/* Maths used by regularisation functions (see vortfunc_builtin.h). */
+"#define CVTX_VF_EXP(X) exp(X)										\n"
+"#define CVTX_VF_ERF(X) erf(X)										\n"
+"#define CVTX_VF_POWN(X, N) pown((X), (N))							\n"
+"#define CVTX_VF_RSQRT_POWN(X, N) rsqrt(pown((X), (N)))				\n"
+
+/* With CVTX_CL_COMPENSATED, the sums of the P3D vel & dvort, P2D vel and
+filament vel kernels are compensated: within the workgroup and across the
+workgroups of sources accumulated into results by successive launches. The
+compensation of results[i] is kept in results[get_global_size(1) + i]. */
+"#ifdef CVTX_CL_COMPENSATED											\n"
+"#define CVTX_CL_CORRECTION_WORKSPACE(TYPE)							\\\n"
+"	__local TYPE correction_workspace[CVTX_CL_WORKGROUP_SIZE];		\n"
+"#define CVTX_CL_REDUCE3(WS)										\\\n"
+"	local_workspace_float3_reduce_corrected(WS, correction_workspace)\n"
+"#define CVTX_CL_REDUCE2(WS)										\\\n"
+"	local_workspace_float2_reduce_corrected(WS, correction_workspace)\n"
+"#define CVTX_CL_ACCUMULATE3(RESULTS, IDX, WS)						\\\n"
+"	compensated_accumulate3(RESULTS + IDX,							\\\n"
+"		RESULTS + get_global_size(1) + IDX, WS[0], correction_workspace[0])\n"
+"#define CVTX_CL_ACCUMULATE2(RESULTS, IDX, WS)						\\\n"
+"	compensated_accumulate2(RESULTS + IDX,							\\\n"
+"		RESULTS + get_global_size(1) + IDX, WS[0], correction_workspace[0])\n"
+"#else																\n"
+"#define CVTX_CL_CORRECTION_WORKSPACE(TYPE)							\n"
+"#define CVTX_CL_REDUCE3(WS) local_workspace_float3_reduce(WS)		\n"
+"#define CVTX_CL_REDUCE2(WS) local_workspace_float2_reduce(WS)		\n"
+"#define CVTX_CL_ACCUMULATE3(RESULTS, IDX, WS)						\\\n"
+"	RESULTS[IDX] = WS[0] + RESULTS[IDX]								\n"
+"#define CVTX_CL_ACCUMULATE2(RESULTS, IDX, WS)						\\\n"
+"	RESULTS[IDX] = WS[0] + RESULTS[IDX]								\n"
+"#endif																\n"
 
 "#define CVTX_P3D_VEL_START 										\\\n"
 "(																	\\\n"
-"	__global float3* particle_locs,									\\\n"
-"	__global float3* particle_vorts,								\\\n"
-"	float    recip_reg_rad,								            \\\n"
-"	__global float3* mes_locs,										\\\n"
-"	__global float3* results)										\\\n"
+"	__global cvtx_real3* particle_locs,									\\\n"
+"	__global cvtx_real3* particle_vorts,								\\\n"
+"	cvtx_real    recip_reg_rad,								            \\\n"
+"	__global cvtx_real3* mes_locs,										\\\n"
+"	__global cvtx_real3* results)										\\\n"
 "{																	\\\n"
-"	float3 rad, num, ret;											\\\n"
-"	float cor, den, rho, g, radd;									\\\n"
-"	__local float3 reduction_workspace[CVTX_CL_WORKGROUP_SIZE];		\\\n"
+"	cvtx_real3 rad, num, ret;											\\\n"
+"	cvtx_real cor, den, rho, g, radd;									\\\n"
+"	__local cvtx_real3 reduction_workspace[CVTX_CL_WORKGROUP_SIZE];		\\\n"
+"	CVTX_CL_CORRECTION_WORKSPACE(cvtx_real3)						\\\n"
 "	/* Particle idx, mes_pnt idx and local work item idx */			\\\n"
 "	uint pidx, midx, widx, loop_idx;								\\\n"
 "	midx = get_global_id(1);										\\\n"
@@ -62,28 +112,29 @@ Definitions for the repeated body of kernels
 "	den = pown(radd, 3);											\\\n"
 "	num = cross(rad, particle_vorts[pidx]);							\\\n"
 "	ret = num * (cor / den);										\\\n"
-"	ret = isnormal(ret) && radd != 0.f ? ret : (float3)(0.f, 0.f, 0.f);\\\n"
+"	ret = isnormal(ret) && radd != 0.f ? ret : (cvtx_real3)(0.f, 0.f, 0.f);\\\n"
 "	reduction_workspace[widx] = ret;								\\\n"
-"	local_workspace_float3_reduce(reduction_workspace);				\\\n"
+"	CVTX_CL_REDUCE3(reduction_workspace);							\\\n"
 "	barrier(CLK_LOCAL_MEM_FENCE);									\\\n"
 "	if( widx == 0 ){												\\\n"
-"		results[midx] = reduction_workspace[0] + results[midx];		\\\n"
+"		CVTX_CL_ACCUMULATE3(results, midx, reduction_workspace);	\\\n"
 "	}																\\\n"
 "	return;															\\\n"
 "}																	\n"
 
 "#define CVTX_P3D_DVORT_START										\\\n"
 "(																	\\\n"
-"	__global float3* particle_locs,									\\\n"
-"	__global float3* particle_vorts,								\\\n"
-"	float    recip_reg_rad,			        						\\\n"
-"	__global float3* induced_locs,									\\\n"
-"	__global float3* induced_vorts,									\\\n"
-"	__global float3* results)										\\\n"
+"	__global cvtx_real3* particle_locs,									\\\n"
+"	__global cvtx_real3* particle_vorts,								\\\n"
+"	cvtx_real    recip_reg_rad,			        						\\\n"
+"	__global cvtx_real3* induced_locs,									\\\n"
+"	__global cvtx_real3* induced_vorts,									\\\n"
+"	__global cvtx_real3* results)										\\\n"
 "{																	\\\n"
-"	float3 ret, rad, cross_om, t21, t21n, t22;						\\\n"
-"	float g, f, radd, rho, recip_rho3, t221, t222, t223;			\\\n"
-"	__local float3 reduction_workspace[CVTX_CL_WORKGROUP_SIZE];		\\\n"
+"	cvtx_real3 ret, rad, cross_om, t21, t21n, t22;						\\\n"
+"	cvtx_real g, f, radd, rho, recip_rho3, t221, t222, t223;			\\\n"
+"	__local cvtx_real3 reduction_workspace[CVTX_CL_WORKGROUP_SIZE];		\\\n"
+"	CVTX_CL_CORRECTION_WORKSPACE(cvtx_real3)						\\\n"
 "	/* self (inducing particle) index, induced particle index */	\\\n"
 "	uint sidx, indidx, widx;										\\\n"
 "	indidx = get_global_id(1);										\\\n"
@@ -104,35 +155,95 @@ Definitions for the repeated body of kernels
 "	t222 = 3 * g * recip_rho3 - f;									\\\n"
 "	t223 = dot(rad, cross_om);										\\\n"
 "	ret = fma(t221 * t222 * t223, rad, t21); /* 1/(4 pi reg_dist^3) is host side */\\\n"
-"	ret = isnormal(ret) && radd > 0.f ? ret : (float3)(0.f, 0.f, 0.f);\\\n"
+"	ret = isnormal(ret) && radd > 0.f ? ret : (cvtx_real3)(0.f, 0.f, 0.f);\\\n"
 "	reduction_workspace[widx] = ret;								\\\n"
+"	CVTX_CL_REDUCE3(reduction_workspace);							\\\n"
+"	barrier(CLK_LOCAL_MEM_FENCE);									\\\n"
+"	if( widx == 0 ){												\\\n"
+"		CVTX_CL_ACCUMULATE3(results, indidx, reduction_workspace);	\\\n"
+"	}																\\\n"
+"	return;															\\\n"
+"}																	\n"
+
+"#define CVTX_P3D_VEL_GRAD_START 									\\\n"
+"(																	\\\n"
+"	__global cvtx_real3* particle_locs,									\\\n"
+"	__global cvtx_real3* particle_vorts,								\\\n"
+"	cvtx_real    recip_reg_rad,								            \\\n"
+"	__global cvtx_real3* mes_locs,										\\\n"
+"	__global cvtx_real3* results,										\\\n"
+"	__global cvtx_real3* grad_results)									\\\n"
+"{																	\\\n"
+"	cvtx_real3 rad, vort, ret, gx, gy, gz;								\\\n"
+"	cvtx_real rho, g, f, radd, fr, c;									\\\n"
+"	__local cvtx_real3 reduction_workspace[CVTX_CL_WORKGROUP_SIZE];		\\\n"
+"	__local cvtx_real3 gx_workspace[CVTX_CL_WORKGROUP_SIZE];			\\\n"
+"	__local cvtx_real3 gy_workspace[CVTX_CL_WORKGROUP_SIZE];			\\\n"
+"	__local cvtx_real3 gz_workspace[CVTX_CL_WORKGROUP_SIZE];			\\\n"
+"	/* Particle idx, mes_pnt idx and local work item idx */			\\\n"
+"	uint pidx, midx, widx;											\\\n"
+"	midx = get_global_id(1);										\\\n"
+"	widx = get_local_id(0);											\\\n"
+"	pidx = widx;													\\\n"
+"	rad = mes_locs[midx] - particle_locs[pidx];						\\\n"
+"	radd = length(rad);												\\\n"
+"	rho = radd * recip_reg_rad;    									\n"
+
+/* Fill in f & g calc here. Gradient row j is d vel_j / d x. */
+
+"#define CVTX_P3D_VEL_GRAD_END 										\\\n"
+"	/* 1/4pi term is done by host. */								\\\n"
+"	vort = particle_vorts[pidx];									\\\n"
+"	fr = g / pown(radd, 3);											\\\n"
+"	c = f != 0.f ? f * pown(recip_reg_rad, 3) : 0.f;				\\\n"
+"	c = (c - 3.f * fr) / (radd * radd);								\\\n"
+"	ret = cross(vort, rad);											\\\n"
+"	gx = rad * (c * ret.x) + (cvtx_real3)(0.f, -vort.z, vort.y) * fr;	\\\n"
+"	gy = rad * (c * ret.y) + (cvtx_real3)(vort.z, 0.f, -vort.x) * fr;	\\\n"
+"	gz = rad * (c * ret.z) + (cvtx_real3)(-vort.y, vort.x, 0.f) * fr;	\\\n"
+"	ret = ret * fr;													\\\n"
+"	if (!(radd > 0.f) || !isfinite(c)) {							\\\n"
+"		ret = gx = gy = gz = (cvtx_real3)(0.f, 0.f, 0.f);				\\\n"
+"	}																\\\n"
+"	reduction_workspace[widx] = ret;								\\\n"
+"	gx_workspace[widx] = gx;										\\\n"
+"	gy_workspace[widx] = gy;										\\\n"
+"	gz_workspace[widx] = gz;										\\\n"
 "	local_workspace_float3_reduce(reduction_workspace);				\\\n"
+"	local_workspace_float3_reduce(gx_workspace);					\\\n"
+"	local_workspace_float3_reduce(gy_workspace);					\\\n"
+"	local_workspace_float3_reduce(gz_workspace);					\\\n"
 "	barrier(CLK_LOCAL_MEM_FENCE);									\\\n"
 "	if( widx == 0 ){												\\\n"
-"		results[indidx] = reduction_workspace[0] + results[indidx];	\\\n"
+"		results[midx] = reduction_workspace[0] + results[midx];		\\\n"
+"		grad_results[3 * midx] = gx_workspace[0] + grad_results[3 * midx];\\\n"
+"		grad_results[3 * midx + 1] = gy_workspace[0]				\\\n"
+"			+ grad_results[3 * midx + 1];							\\\n"
+"		grad_results[3 * midx + 2] = gz_workspace[0]				\\\n"
+"			+ grad_results[3 * midx + 2];							\\\n"
 "	}																\\\n"
 "	return;															\\\n"
 "}																	\n"
 
-"float sphere_volume(float radius){									\n"
-"	return 4 * acos((float)-1) * radius * radius * radius / 3.f;    \n"
+"cvtx_real sphere_volume(cvtx_real radius){									\n"
+"	return 4 * acos((cvtx_real)-1) * radius * radius * radius / 3.f;    \n"
 "}																	\n"
 
 "#define CVTX_P3D_VISC_DVORT_START									\\\n"
 "(																	\\\n"
-"	__global float3* particle_locs,									\\\n"
-"	__global float3* particle_vorts,								\\\n"
-"	__global float* particle_vols,									\\\n"
-"	__global float3* induced_locs,									\\\n"
-"	__global float3* induced_vorts,									\\\n"
-"	__global float* induced_vols,									\\\n"
-"	__global float3* results,										\\\n"
-"	float regularisation_dist,										\\\n"
-"	float kinematic_visc)											\\\n"
+"	__global cvtx_real3* particle_locs,									\\\n"
+"	__global cvtx_real3* particle_vorts,								\\\n"
+"	__global cvtx_real* particle_vols,									\\\n"
+"	__global cvtx_real3* induced_locs,									\\\n"
+"	__global cvtx_real3* induced_vorts,									\\\n"
+"	__global cvtx_real* induced_vols,									\\\n"
+"	__global cvtx_real3* results,										\\\n"
+"	cvtx_real regularisation_dist,										\\\n"
+"	cvtx_real kinematic_visc)											\\\n"
 "{																	\\\n"
-"	float3 ret, rad, t211, t212, t21, t2;							\\\n"
-"	float radd, rho, t1, eta;										\\\n"
-"	__local float3 reduction_workspace[CVTX_CL_WORKGROUP_SIZE];		\\\n"
+"	cvtx_real3 ret, rad, t211, t212, t21, t2;							\\\n"
+"	cvtx_real radd, rho, t1, eta;										\\\n"
+"	__local cvtx_real3 reduction_workspace[CVTX_CL_WORKGROUP_SIZE];		\\\n"
 "	/* self (inducing particle) index, induced particle index */	\\\n"
 "	uint sidx, indidx, widx, loop_idx;								\\\n"
 "	sidx = get_global_id(0);										\\\n"
@@ -151,8 +262,8 @@ Definitions for the repeated body of kernels
 "#define CVTX_P3D_VISC_DVORT_END									\\\n"
 "	t2 = t21 * eta;													\\\n"
 "	ret = t2 * t1;													\\\n"
-"	ret = isnormal(ret) && radd != 0.f ? ret : (float3)(0.f, 0.f, 0.f);\\\n"
-"	reduction_workspace[widx] = convert_float3(ret);				\\\n"
+"	ret = isnormal(ret) && radd != 0.f ? ret : (cvtx_real3)(0.f, 0.f, 0.f);\\\n"
+"	reduction_workspace[widx] = ret;				\\\n"
 "	local_workspace_float3_reduce(reduction_workspace);				\\\n"
 "	barrier(CLK_LOCAL_MEM_FENCE);									\\\n"
 "	if( widx == 0 ){												\\\n"
@@ -163,15 +274,15 @@ Definitions for the repeated body of kernels
 
 "#define CVTX_P3D_VORT_START 										\\\n"
 "(																	\\\n"
-"	__global float3* particle_locs,									\\\n"
-"	__global float3* particle_vorts,								\\\n"
-"	float    recip_reg_rad,								            \\\n"
-"	__global float3* mes_locs,										\\\n"
-"	__global float3* results)										\\\n"
+"	__global cvtx_real3* particle_locs,									\\\n"
+"	__global cvtx_real3* particle_vorts,								\\\n"
+"	cvtx_real    recip_reg_rad,								            \\\n"
+"	__global cvtx_real3* mes_locs,										\\\n"
+"	__global cvtx_real3* results)										\\\n"
 "{																	\\\n"
-"	float3 rad, ret;												\\\n"
-"	float radd, rho, zeta;											\\\n"
-"	__local float3 reduction_workspace[CVTX_CL_WORKGROUP_SIZE];		\\\n"
+"	cvtx_real3 rad, ret;												\\\n"
+"	cvtx_real radd, rho, zeta;											\\\n"
+"	__local cvtx_real3 reduction_workspace[CVTX_CL_WORKGROUP_SIZE];		\\\n"
 "	/* Particle idx, mes_pnt idx and local work item idx */			\\\n"
 "	uint pidx, midx, widx, loop_idx;								\\\n"
 "	midx = get_global_id(1);										\\\n"
@@ -186,7 +297,7 @@ Definitions for the repeated body of kernels
 "#define CVTX_P3D_VORT_END 											\\\n"
 "	/* 1/(4pi sigma^3) term is done by host. */						\\\n"
 "	ret = zeta * particle_vorts[pidx];								\\\n"
-"	ret = isnormal(ret) && radd != 0.f ? ret : (float3)(0.f, 0.f, 0.f);\\\n"
+"	ret = isnormal(ret) && radd != 0.f ? ret : (cvtx_real3)(0.f, 0.f, 0.f);\\\n"
 "	reduction_workspace[widx] = ret;								\\\n"
 "	local_workspace_float3_reduce(reduction_workspace);				\\\n"
 "	barrier(CLK_LOCAL_MEM_FENCE);									\\\n"
@@ -196,10 +307,10 @@ Definitions for the repeated body of kernels
 "	return;															\\\n"
 "}																	\n"
 
-/* 	Summation of local array of float3 of length CVTX_CL_WORKGROUP_SIZE
+/* 	Summation of local array of cvtx_real3 of length CVTX_CL_WORKGROUP_SIZE
 	with result left in array[0]	*/
 "inline void local_workspace_float3_reduce(									\n"
-"	__local float3* reduction_workspace)									\n"
+"	__local cvtx_real3* reduction_workspace)									\n"
 "{																			\n"
 "	uint loop_idx = 2;														\n"
 "	uint widx = get_local_id(0);											\n"
@@ -219,15 +330,16 @@ Definitions for the repeated body of kernels
 
 "#define CVTX_P2D_VEL_START 										\\\n"
 "(																	\\\n"
-"	__global float2* particle_locs,									\\\n"
-"	__global float* particle_vorts,									\\\n"
-"	float    recip_reg_rad,								            \\\n"
-"	__global float2* mes_locs,										\\\n"
-"	__global float2* results)										\\\n"
+"	__global cvtx_real2* particle_locs,									\\\n"
+"	__global cvtx_real* particle_vorts,									\\\n"
+"	cvtx_real    recip_reg_rad,								            \\\n"
+"	__global cvtx_real2* mes_locs,										\\\n"
+"	__global cvtx_real2* results)										\\\n"
 "{																	\\\n"
-"	float2 rad, ret;												\\\n"
-"	float cor, den, rho, g, radd;									\\\n"
-"	__local float2 reduction_workspace[CVTX_CL_WORKGROUP_SIZE];		\\\n"
+"	cvtx_real2 rad, ret;												\\\n"
+"	cvtx_real cor, den, rho, g, radd;									\\\n"
+"	__local cvtx_real2 reduction_workspace[CVTX_CL_WORKGROUP_SIZE];		\\\n"
+"	CVTX_CL_CORRECTION_WORKSPACE(cvtx_real2)						\\\n"
 "	/* Particle idx, mes_pnt idx and local work item idx */			\\\n"
 "	uint pidx, midx, widx, loop_idx;								\\\n"
 "	midx = get_global_id(1);										\\\n"
@@ -244,12 +356,12 @@ Definitions for the repeated body of kernels
 "	den = pown(radd, 2);											\\\n"
 "	ret.x = rad.y * (cor * particle_vorts[pidx] / den);				\\\n"
 "	ret.y = -rad.x * (cor * particle_vorts[pidx] / den);			\\\n"
-"	ret = isnormal(ret) && radd != 0.f ? ret : (float2)(0.f, 0.f);	\\\n"
+"	ret = isnormal(ret) && radd != 0.f ? ret : (cvtx_real2)(0.f, 0.f);	\\\n"
 "	reduction_workspace[widx] = ret;								\\\n"
-"	local_workspace_float2_reduce(reduction_workspace);				\\\n"
+"	CVTX_CL_REDUCE2(reduction_workspace);							\\\n"
 "	barrier(CLK_LOCAL_MEM_FENCE);									\\\n"
 "	if( widx == 0 ){												\\\n"
-"		results[midx] = reduction_workspace[0] + results[midx];		\\\n"
+"		CVTX_CL_ACCUMULATE2(results, midx, reduction_workspace);	\\\n"
 "	}																\\\n"
 "	return;															\\\n"
 "}																	\n"	
@@ -257,16 +369,16 @@ Definitions for the repeated body of kernels
 /*	P2D vel for small numbers of measurement points */
 "#define CVTX_P2D_SMALLMES_VEL_START 								\\\n"
 "(																	\\\n"
-"	__global float2* particle_locs,									\\\n"
-"	__global float* particle_vorts,									\\\n"
-"	float    recip_reg_rad,								            \\\n"
-"	__global float2* mes_locs,										\\\n"
-"	__global float2* results,										\\\n"
+"	__global cvtx_real2* particle_locs,									\\\n"
+"	__global cvtx_real* particle_vorts,									\\\n"
+"	cvtx_real    recip_reg_rad,								            \\\n"
+"	__global cvtx_real2* mes_locs,										\\\n"
+"	__global cvtx_real2* results,										\\\n"
 "	unsigned int num_mes)											\\\n"
 "{																	\\\n"
-"	float2 rad, ret;												\\\n"
-"	float cor, den, rho, g, radd;									\\\n"
-"	__local float2 reduction_workspace[CVTX_CL_WORKGROUP_SIZE];		\\\n"
+"	cvtx_real2 rad, ret;												\\\n"
+"	cvtx_real cor, den, rho, g, radd;									\\\n"
+"	__local cvtx_real2 reduction_workspace[CVTX_CL_WORKGROUP_SIZE];		\\\n"
 "	/* Particle idx, mes_pnt idx and local work item idx */			\\\n"
 "	uint pidx, midx, widx, loop_idx;								\\\n"
 "	midx = get_global_id(1);										\\\n"
@@ -281,7 +393,7 @@ Definitions for the repeated body of kernels
 "	den = pown(radd, 2);											\\\n"
 "	ret.x = rad.y * (cor * particle_vorts[pidx] / den);				\\\n"
 "	ret.y = -rad.x * (cor * particle_vorts[pidx] / den);			\\\n"
-"	ret = isnormal(ret) && radd != 0.f ? ret : (float2)(0.f, 0.f);	\\\n"
+"	ret = isnormal(ret) && radd != 0.f ? ret : (cvtx_real2)(0.f, 0.f);	\\\n"
 "	reduction_workspace[widx] = ret;								\\\n"
 "	local_workspace_float2_reduce(reduction_workspace);				\\\n"
 "	barrier(CLK_LOCAL_MEM_FENCE);									\\\n"
@@ -293,20 +405,20 @@ Definitions for the repeated body of kernels
 
 "#define CVTX_P2D_VISC_DVORT_START									\\\n"
 "(																	\\\n"
-"	__global float2* particle_locs,									\\\n"
-"	__global float* particle_vorts,									\\\n"
-"	__global float* particle_areas,									\\\n"
-"	__global float2* induced_locs,									\\\n"
-"	__global float* induced_vorts,									\\\n"
-"	__global float* induced_areas,									\\\n"
-"	__global float* results,										\\\n"
-"	float regularisation_dist,										\\\n"
-"	float kinematic_visc)											\\\n"
+"	__global cvtx_real2* particle_locs,									\\\n"
+"	__global cvtx_real* particle_vorts,									\\\n"
+"	__global cvtx_real* particle_areas,									\\\n"
+"	__global cvtx_real2* induced_locs,									\\\n"
+"	__global cvtx_real* induced_vorts,									\\\n"
+"	__global cvtx_real* induced_areas,									\\\n"
+"	__global cvtx_real* results,										\\\n"
+"	cvtx_real regularisation_dist,										\\\n"
+"	cvtx_real kinematic_visc)											\\\n"
 "{																	\\\n"
-"	float2 rad;														\\\n"
-"	float ret, radd, rho, t1, t2, t21, t211, t212, eta;				\\\n"
-"	__local float reduction_workspace[CVTX_CL_WORKGROUP_SIZE];		\\\n"
-"	__local float correction_workspace[CVTX_CL_WORKGROUP_SIZE];		\\\n"
+"	cvtx_real2 rad;														\\\n"
+"	cvtx_real ret, radd, rho, t1, t2, t21, t211, t212, eta;				\\\n"
+"	__local cvtx_real reduction_workspace[CVTX_CL_WORKGROUP_SIZE];		\\\n"
+"	__local cvtx_real correction_workspace[CVTX_CL_WORKGROUP_SIZE];		\\\n"
 "	/* self (inducing particle) index, induced particle index */	\\\n"
 "	uint sidx, indidx, widx, loop_idx;								\\\n"
 "	sidx = get_global_id(0);										\\\n"
@@ -337,10 +449,10 @@ Definitions for the repeated body of kernels
 "	return;															\\\n"
 "}																	\n"
 
-/* 	Summation of local array of float2 of length CVTX_CL_WORKGROUP_SIZE
+/* 	Summation of local array of cvtx_real2 of length CVTX_CL_WORKGROUP_SIZE
 	with result left in array[0]	*/
 "inline void local_workspace_float2_reduce(									\n"
-"	__local float2* reduction_workspace)									\n"
+"	__local cvtx_real2* reduction_workspace)									\n"
 "{																			\n"
 "	uint loop_idx = 2;														\n"
 "	uint widx = get_local_id(0);											\n"
@@ -356,10 +468,10 @@ Definitions for the repeated body of kernels
 "	return;																	\n"
 "}																			\n"
 
-/* 	Summation of local array of float of length CVTX_CL_WORKGROUP_SIZE
+/* 	Summation of local array of cvtx_real of length CVTX_CL_WORKGROUP_SIZE
 	with result left in array[0]	*/
 "inline void local_workspace_float_reduce(									\n"
-"	__local float* reduction_workspace)										\n"
+"	__local cvtx_real* reduction_workspace)										\n"
 "{																			\n"
 "	uint loop_idx = 2;														\n"
 "	uint widx = get_local_id(0);											\n"
@@ -375,17 +487,17 @@ Definitions for the repeated body of kernels
 "	return;																	\n"
 "}																			\n"
 
-/*  Summation of local array of float of length CVTX_CL_WORKGROUP_SIZE with 
+/*  Summation of local array of cvtx_real of length CVTX_CL_WORKGROUP_SIZE with 
 	result left in array[0] and correction in correction[0].				
 	overwrites correction away (ie. don't need to zero it first.			*/
 "inline void local_workspace_float_reduce_corrected(						\n"
-"	__local float* reduction_workspace, 									\n"
-"	__local float* correction_workspace)									\n"
+"	__local cvtx_real* reduction_workspace, 									\n"
+"	__local cvtx_real* correction_workspace)									\n"
 "{																			\n"
 "	uint loop_idx = 2;														\n"
 "	uint widx = get_local_id(0);											\n"
 /*	Summation variables sa and sb, and lower bit corrections ca and cb.		*/
-"	float sa, sb, ca, cb, t;												\n"
+"	cvtx_real sa, sb, ca, cb, t;												\n"
 "	correction_workspace[widx] = 0.f;										\n"
 "	for(; loop_idx <= CVTX_CL_WORKGROUP_SIZE; 								\n"
 "		loop_idx *= 2)														\n"
@@ -409,217 +521,109 @@ Definitions for the repeated body of kernels
 "	return;																	\n"
 "}																			\n"
 
-/* 	###########################################################
-	3D Velocity calculation kernels here:
-	name cvtx_nb_P3D_vel_XXXXX
-	###########################################################	*/
-
-"__kernel void cvtx_nb_P3D_vel_singular\n"
-"	CVTX_P3D_VEL_START														\n"
-"	g = 1.f;																\n"
-"	CVTX_P3D_VEL_END														\n"
-
-
-"__kernel void cvtx_nb_P3D_vel_winckelmans									\n"
-"	CVTX_P3D_VEL_START														\n"
-"	g = (rho * rho + 2.5f) * rho * rho * rho * rsqrt(pown(rho * rho + 1, 5));\n"
-"	CVTX_P3D_VEL_END														\n"
-
-
-"__kernel void cvtx_nb_P3D_vel_planetary									\n"
-"	CVTX_P3D_VEL_START														\n"
-"	g = rho < 1.f ? rho * rho * rho : 1.f;									\n"
-"	CVTX_P3D_VEL_END														\n"
-
-
-"__kernel void cvtx_nb_P3D_vel_gaussian												\n"
-"	CVTX_P3D_VEL_START																\n"
-"	const float pi = 3.14159265359f;												\n"
-"	float a1 = 0.254829592f, a2 = -0.284496736f, a3 = 1.421413741f;					\n"
-"	float a4 = -1.453152027f, a5 = 1.061405429f, p = 0.3275911f;					\n"
-"	float rho_sr2 = rho / sqrt(2.f);												\n"
-"	float t = 1.f / (1.f + p * rho_sr2);											\n"
-"	float t2 = t * t;	float t3 = t2 * t; float t4 = t2 * t2; float t5 = t3 * t2;	\n"
-"	float erf = 1.f - (a1 * t + a2 * t2 + a3 * t3 + a4 * t4 + a5 * t5) *			\n"
-"		exp(-rho_sr2 * rho_sr2);													\n"
-"	float term2 = rho * SQRT_2_OVER_PI * exp(-rho_sr2 * rho_sr2);					\n"
-"	g = erf - term2;																\n"
-"	CVTX_P3D_VEL_END																\n"
-
-
-
-/* ###########################################################
-	3D Ind Dvort calculation kernels here:
-	name cvtx_nb_P3D_dvort_XXXXX
-	###########################################################	*/	
-
-"__kernel void cvtx_nb_P3D_dvort_singular\n"
-"	CVTX_P3D_DVORT_START\n"
-"	g = 1.f;\n"
-"	f = 0.f;\n"
-"	CVTX_P3D_DVORT_END\n"
-
-
-"__kernel void cvtx_nb_P3D_dvort_planetary\n"
-"	CVTX_P3D_DVORT_START\n"
-"	g = rho < 1.f ? rho * rho * rho : 1.f;\n"
-"	f = rho < 1.f ? 3.f : 0.f;\n"
-"	CVTX_P3D_DVORT_END\n"
-
-
-"__kernel void cvtx_nb_P3D_dvort_winckelmans\n"
-"	CVTX_P3D_DVORT_START\n"
-"	g = (rho * rho + 2.5f) * rho * rho * rho * rsqrt(pown(rho * rho + 1, 5));		\n"
-"	f = 7.5f * rsqrt(pown(rho * rho + 1, 7));										\n"
-"	CVTX_P3D_DVORT_END\n"
-
-
-"__kernel void cvtx_nb_P3D_dvort_gaussian\n"
-"	CVTX_P3D_DVORT_START															\n"
-"	const float pi = 3.14159265359f;												\n"
-"	float a1 = 0.254829592f, a2 = -0.284496736f, a3 = 1.421413741f;					\n"
-"	float a4 = -1.453152027f, a5 = 1.061405429f, p = 0.3275911f;					\n"
-"	float rho_sr2 = rho * ONE_OVER_SQRT_TWO;												\n"
-"	float t = 1.f / (1.f + p * rho_sr2);											\n"
-"	float t2 = t * t;	float t3 = t2 * t; float t4 = t2 * t2; float t5 = t3 * t2;	\n"
-"	float erf = 1.f - (a1 * t + a2 * t2 + a3 * t3 + a4 * t4 + a5 * t5) *			\n"
-"		exp(-rho_sr2 * rho_sr2);													\n"
-"	float term2 = rho * SQRT_2_OVER_PI * exp(-rho_sr2 * rho_sr2);					\n"
-"	g = erf - term2;																\n"
-"	f = SQRT_2_OVER_PI * exp(-rho * rho * 0.5f);									\n"
-"	CVTX_P3D_DVORT_END																\n"
-
-
-/* ###########################################################
-	3D viscous ind Dvort calculation kernels here:
-	name cvtx_nb_P3D_visc_dvort_XXXXX	
-	###########################################################	*/
-
-"	/* Viscocity doesn't work for singular & planetary */							\n"
-
-"__kernel void cvtx_nb_P3D_visc_dvort_winckelmans									\n"
-"	CVTX_P3D_VISC_DVORT_START														\n"
-"	eta = 52.5f * rsqrt(pown(rho * rho + 1, 9));									\n"
-"	CVTX_P3D_VISC_DVORT_END															\n"
-
-
-"__kernel void cvtx_nb_P3D_visc_dvort_gaussian										\n"
-"	CVTX_P3D_VISC_DVORT_START														\n"
-"	const float pi = 3.14159265359f;												\n"
-"	eta = SQRT_2_OVER_PI * exp(-rho * rho * 0.5f);									\n"
-"	CVTX_P3D_VISC_DVORT_END															\n"
-
-
-/* ###########################################################
-	3D vorticity calculation kernels here:
-	name cvtx_nb_P3D_vort_XXXXX	
-	###########################################################	*/
-
-"__kernel void cvtx_nb_P3D_vort_singular\n"/* Arguably, what is the point? */
-"	CVTX_P3D_VORT_START														\n"
-"	zeta = 0.f;																\n"
-"	CVTX_P3D_VORT_END														\n"
-
-
-"__kernel void cvtx_nb_P3D_vort_winckelmans									\n"
-"	CVTX_P3D_VORT_START														\n"
-"	zeta = 7.5f * pow(rho*rho+1, -3.5f);									\n"
-"	CVTX_P3D_VORT_END														\n"
-
-
-"__kernel void cvtx_nb_P3D_vort_planetary									\n"
-"	CVTX_P3D_VORT_START														\n"
-"	zeta = rho < 1.f ? 3.f : 0.f;											\n"
-"	CVTX_P3D_VORT_END														\n"
+/*  As local_workspace_float_reduce_corrected for cvtx_real3. */
+"inline void local_workspace_float3_reduce_corrected(						\n"
+"	__local cvtx_real3* reduction_workspace, 									\n"
+"	__local cvtx_real3* correction_workspace)									\n"
+"{																			\n"
+"	uint loop_idx = 2;														\n"
+"	uint widx = get_local_id(0);											\n"
+"	uint other;																\n"
+"	cvtx_real3 sa, sb, t;														\n"
+"	correction_workspace[widx] = 0.f;										\n"
+"	for(; loop_idx <= CVTX_CL_WORKGROUP_SIZE; 								\n"
+"		loop_idx *= 2)														\n"
+"	{																		\n"
+"		barrier(CLK_LOCAL_MEM_FENCE);										\n"
+"		if( widx < CVTX_CL_WORKGROUP_SIZE/loop_idx ){						\n"
+"			other = widx + CVTX_CL_WORKGROUP_SIZE/loop_idx;					\n"
+"			sa = reduction_workspace[widx];									\n"
+"			sb = reduction_workspace[other];								\n"
+"			t = sa + sb;													\n"
+"			correction_workspace[widx] += correction_workspace[other]		\n"
+"				+ select((sb - t) + sa, (sa - t) + sb,						\n"
+"					isgreaterequal(fabs(sa), fabs(sb)));					\n"
+"			reduction_workspace[widx] = t;									\n"
+"		}																	\n"
+"	}																		\n"
+"	return;																	\n"
+"}																			\n"
 
+/*  As local_workspace_float_reduce_corrected for cvtx_real2. */
+"inline void local_workspace_float2_reduce_corrected(						\n"
+"	__local cvtx_real2* reduction_workspace, 									\n"
+"	__local cvtx_real2* correction_workspace)									\n"
+"{																			\n"
+"	uint loop_idx = 2;														\n"
+"	uint widx = get_local_id(0);											\n"
+"	uint other;																\n"
+"	cvtx_real2 sa, sb, t;														\n"
+"	correction_workspace[widx] = 0.f;										\n"
+"	for(; loop_idx <= CVTX_CL_WORKGROUP_SIZE; 								\n"
+"		loop_idx *= 2)														\n"
+"	{																		\n"
+"		barrier(CLK_LOCAL_MEM_FENCE);										\n"
+"		if( widx < CVTX_CL_WORKGROUP_SIZE/loop_idx ){						\n"
+"			other = widx + CVTX_CL_WORKGROUP_SIZE/loop_idx;					\n"
+"			sa = reduction_workspace[widx];									\n"
+"			sb = reduction_workspace[other];								\n"
+"			t = sa + sb;													\n"
+"			correction_workspace[widx] += correction_workspace[other]		\n"
+"				+ select((sb - t) + sa, (sa - t) + sb,						\n"
+"					isgreaterequal(fabs(sa), fabs(sb)));					\n"
+"			reduction_workspace[widx] = t;									\n"
+"		}																	\n"
+"	}																		\n"
+"	return;																	\n"
+"}																			\n"
 
-"__kernel void cvtx_nb_P3D_vort_gaussian									\n"
-"	CVTX_P3D_VORT_START														\n"
-"	zeta = SQRT_2_OVER_PI * exp(-rho * rho * 0.5f);							\n"
-"	CVTX_P3D_VORT_END														\n"
+/*  Neumaier summation of x + correction into sum, with compensation comp. */
+"inline void compensated_accumulate3(										\n"
+"	__global cvtx_real3* sum, __global cvtx_real3* comp,								\n"
+"	cvtx_real3 x, cvtx_real3 correction)												\n"
+"{																			\n"
+"	cvtx_real3 s = *sum, t = s + x;											\n"
+"	*comp += correction + select((x - t) + s, (s - t) + x,					\n"
+"		isgreaterequal(fabs(s), fabs(x)));									\n"
+"	*sum = t;																\n"
+"	return;																	\n"
+"}																			\n"
 
+/*  Neumaier summation of x + correction into sum, with compensation comp. */
+"inline void compensated_accumulate2(										\n"
+"	__global cvtx_real2* sum, __global cvtx_real2* comp,								\n"
+"	cvtx_real2 x, cvtx_real2 correction)												\n"
+"{																			\n"
+"	cvtx_real2 s = *sum, t = s + x;											\n"
+"	*comp += correction + select((x - t) + s, (s - t) + x,					\n"
+"		isgreaterequal(fabs(s), fabs(x)));									\n"
+"	*sum = t;																\n"
+"	return;																	\n"
+"}																			\n"
 
 /* 	###########################################################
-	2DVelocity calculation kernels here:
-	name cvtx_nb_P2D_vel_XXXXX
-	###########################################################	*/
-
-"__kernel void cvtx_nb_P2D_vel_singular\n"
-"	CVTX_P2D_VEL_START														\n"
-"	g = 1.f;																\n"
-"	CVTX_P2D_VEL_END														\n"
-
-"__kernel void cvtx_nb_P2D_vel_winckelmans									\n"
-"	CVTX_P2D_VEL_START														\n"
-"	g = (rho * rho + 2.0f) * rho * rho * pown(rho * rho + 1.f, -2);			\n"
-"	CVTX_P2D_VEL_END														\n"
-
-"__kernel void cvtx_nb_P2D_vel_planetary									\n"
-"	CVTX_P2D_VEL_START														\n"
-"	g = rho < 1.f ? rho * rho : 1.f;										\n"
-"	CVTX_P2D_VEL_END														\n"
-
-"__kernel void cvtx_nb_P2D_vel_gaussian										\n"
-"	CVTX_P2D_VEL_START														\n"
-"	g = 1.f - exp(-rho * rho * 0.5f);										\n"
-"	CVTX_P2D_VEL_END														\n"
-
-/* Small number of mes points. */
-"__kernel void cvtx_nb_P2D_smallmes_vel_singular							\n"
-"	CVTX_P2D_SMALLMES_VEL_START												\n"
-"	g = 1.f;																\n"
-"	CVTX_P2D_SMALLMES_VEL_END												\n"
-
-"__kernel void cvtx_nb_P2D_smallmes_vel_winckelmans							\n"
-"	CVTX_P2D_SMALLMES_VEL_START												\n"
-"	g = (rho * rho + 2.0f) * rho * rho * pown(rho * rho + 1.f, -2);			\n"
-"	CVTX_P2D_SMALLMES_VEL_END												\n"
-
-"__kernel void cvtx_nb_P2D_smallmes_vel_planetary							\n"
-"	CVTX_P2D_SMALLMES_VEL_START												\n"
-"	g = rho < 1.f ? rho * rho : 1.f;										\n"
-"	CVTX_P2D_SMALLMES_VEL_END												\n"
-
-"__kernel void cvtx_nb_P2D_smallmes_vel_gaussian							\n"
-"	CVTX_P2D_SMALLMES_VEL_START												\n"
-"	g = 1.f - exp(-rho * rho * 0.5f);										\n"
-"	CVTX_P2D_SMALLMES_VEL_END												\n"
-
-/* ###########################################################
-	2D viscous ind Dvort calculation kernels here:
-	name cvtx_nb_P2D_visc_dvort_XXXXX	
+	The kernels for each regularisation function, named
+	cvtx_nb_P3D_vel_XXXXX etc., are generated from the templates above by
+	opencl_acc.c. Those of the built in functions are defined in
+	vortfunc_builtin.h.
 	###########################################################	*/
 
-"	/* Viscocity doesn't work for singular & planetary */							\n"
-
-"__kernel void cvtx_nb_P2D_visc_dvort_winckelmans									\n"
-"	CVTX_P2D_VISC_DVORT_START														\n"
-"	float a = rho * rho + 1.f;														\n"
-"	float a2 = 1.f / (a * a);														\n"
-"	eta = 24.f * exp(4.f * a * (a2 * a2)) * (a2 * a2);								\n"
-"	CVTX_P2D_VISC_DVORT_END															\n"
-
-"__kernel void cvtx_nb_P2D_visc_dvort_gaussian										\n"
-"	CVTX_P2D_VISC_DVORT_START														\n"
-"	eta =  exp(-rho * rho * 0.5f);													\n"
-"	CVTX_P2D_VISC_DVORT_END															\n"
-
 /*	###########################################################
 	vortex_filament code:
 	###########################################################	*/
 
 "__kernel void cvtx_nb_Filament_ind_vel_singular									\n"
 "(																					\n"
-"	__global float3* fil_starts,													\n"
-"	__global float3* fil_ends,														\n"
-"	__global float* fil_strengths,													\n"
-"	__global float3* mes_pnts,														\n"
-"	__global float3* results)														\n"
+"	__global cvtx_real3* fil_starts,													\n"
+"	__global cvtx_real3* fil_ends,														\n"
+"	__global cvtx_real* fil_strengths,													\n"
+"	__global cvtx_real3* mes_pnts,														\n"
+"	__global cvtx_real3* results)														\n"
 "{																					\n"
-"	float3 ret, r0, r1, r2;															\n"
-"	float t1, t2, t21, t22;															\n"
-"	const float pi_f = 3.14159265359f;												\n"
-"	const float bigvar = 3.40282346e38f;											\n"
+"	cvtx_real3 ret, r0, r1, r2;															\n"
+"	cvtx_real t1, t2, t21, t22;															\n"
+"	const cvtx_real pi_f = CVTX_CL_PI;     												\n"
+"	const cvtx_real bigvar = 3.40282346e38f;											\n"
 /* fidx: filament index, midx: measurement index */
 "	uint fidx, midx, loop_idx;														\n"
 "	fidx = get_global_id(0);														\n"
@@ -634,13 +638,14 @@ Definitions for the repeated body of kernels
 "	ret = cross(r1, r2) * t1 * t2;													\n"
 /* 	If t1 * t2 is a really big number then the cross product is dodgy, meaning that
 	r1 & r2 are almost parallel or parallel. We want to ignore this on axis stuff. 	*/
-"	ret = fabs(t1) <= bigvar && fabs(t2) <= bigvar ? ret : (float3)(0.f, 0.f, 0.f);	\n"
-"	__local float3 reduction_workspace[CVTX_CL_WORKGROUP_SIZE];						\n"
+"	ret = fabs(t1) <= bigvar && fabs(t2) <= bigvar ? ret : (cvtx_real3)(0.f, 0.f, 0.f);	\n"
+"	__local cvtx_real3 reduction_workspace[CVTX_CL_WORKGROUP_SIZE];						\n"
+"	CVTX_CL_CORRECTION_WORKSPACE(cvtx_real3)										\n"
 "	reduction_workspace[fidx] = ret;												\n"
-"	local_workspace_float3_reduce(reduction_workspace);								\n"
+"	CVTX_CL_REDUCE3(reduction_workspace);											\n"
 "	barrier(CLK_LOCAL_MEM_FENCE);													\n"
 "	if( fidx == 0 ){																\n"
-"		results[midx] = reduction_workspace[0] + results[midx];						\n"
+"		CVTX_CL_ACCUMULATE3(results, midx, reduction_workspace);					\n"
 "	}																				\n"
 "	return;																			\n"
 "}																					\n"
@@ -648,17 +653,17 @@ Definitions for the repeated body of kernels
 /* A kernel for when there are fewer measurement points. */
 "__kernel void cvtx_nb_Filament_ind_vel_singular_smes								\n"
 "(																					\n"
-"	__global float3* fil_starts,													\n"
-"	__global float3* fil_ends,														\n"
-"	__global float* fil_strengths,													\n"
-"	__global float3* mes_pnts,														\n"
-"	__global float3* results,														\n"
+"	__global cvtx_real3* fil_starts,													\n"
+"	__global cvtx_real3* fil_ends,														\n"
+"	__global cvtx_real* fil_strengths,													\n"
+"	__global cvtx_real3* mes_pnts,														\n"
+"	__global cvtx_real3* results,														\n"
 "	unsigned int num_mes)															\n"
 "{																					\n"
-"	float3 ret, r0, r1, r2;															\n"
-"	float t1, t2, t21, t22;															\n"
-"	const float pi_f = (float)3.14159265359;										\n"
-"	const float bigvar = 3.40282346e38f;											\n"
+"	cvtx_real3 ret, r0, r1, r2;															\n"
+"	cvtx_real t1, t2, t21, t22;															\n"
+"	const cvtx_real pi_f = CVTX_CL_PI;        										\n"
+"	const cvtx_real bigvar = 3.40282346e38f;											\n"
 /* fidx: filament index, midx: measurement index */	
 "	uint fidx, midx, gidx, loop_idx;												\n"
 "	midx = get_global_id(1);														\n"
@@ -672,8 +677,8 @@ Definitions for the repeated body of kernels
 "	t22 = dot(r2, r0) / length(r2);													\n"
 "	t2 = t21 - t22;																	\n"
 "	ret = cross(r1, r2) * t1 * t2;													\n"
-"	ret = fabs(t1) <= bigvar && fabs(t2) <= bigvar ? ret : (float3)(0.f, 0.f, 0.f);	\n"
-"	__local float3 reduction_workspace[CVTX_CL_WORKGROUP_SIZE];						\n"
+"	ret = fabs(t1) <= bigvar && fabs(t2) <= bigvar ? ret : (cvtx_real3)(0.f, 0.f, 0.f);	\n"
+"	__local cvtx_real3 reduction_workspace[CVTX_CL_WORKGROUP_SIZE];						\n"
 "	reduction_workspace[gidx] = ret;												\n"
 "	local_workspace_float3_reduce(reduction_workspace);								\n"
 "	barrier(CLK_LOCAL_MEM_FENCE);													\n"
@@ -685,16 +690,16 @@ Definitions for the repeated body of kernels
 
 "__kernel void cvtx_nb_Filament_ind_dvort_singular									\n"
 "(																					\n"
-"	__global float3* fil_starts,													\n"
-"	__global float3* fil_ends,														\n"
-"	__global float* fil_strengths,													\n"
-"	__global float3* particle_locs,													\n"
-"	__global float3* particle_vorts,												\n"
-"	__global float3* results)														\n"
+"	__global cvtx_real3* fil_starts,													\n"
+"	__global cvtx_real3* fil_ends,														\n"
+"	__global cvtx_real* fil_strengths,													\n"
+"	__global cvtx_real3* particle_locs,													\n"
+"	__global cvtx_real3* particle_vorts,												\n"
+"	__global cvtx_real3* results)														\n"
 "{																					\n"
-"	float3 ret, r0, r1, r2, t211, A, tmp;											\n"
-"	float t1, t2121, t2122, t212, t221, t222, t2221, t2222, B, crosslen;			\n"
-"	const float pi_f = (float)3.14159265359;										\n"
+"	cvtx_real3 ret, r0, r1, r2, t211, A, tmp;											\n"
+"	cvtx_real t1, t2121, t2122, t212, t221, t222, t2221, t2222, B, crosslen;			\n"
+"	const cvtx_real pi_f = CVTX_CL_PI;        										\n"
 /* fidx: filament index, pidx: particle index */
 "	uint fidx, pidx, loop_idx;														\n"
 "	fidx = get_global_id(0);														\n"
@@ -716,8 +721,8 @@ Definitions for the repeated body of kernels
 "	B = t221 * t1 * t222;															\n"
 "	ret = B * particle_vorts[pidx] + cross(A, particle_vorts[pidx]);				\n"
 "	ret = !(ret == ret) || (t222 != t222) || (t212 != t212) ?						\n"
-"							(float3)(0.f, 0.f, 0.f) : ret;							\n"
-"	__local float3 reduction_workspace[CVTX_CL_WORKGROUP_SIZE];						\n"
+"							(cvtx_real3)(0.f, 0.f, 0.f) : ret;							\n"
+"	__local cvtx_real3 reduction_workspace[CVTX_CL_WORKGROUP_SIZE];						\n"
 "	reduction_workspace[fidx] = ret;												\n"
 "	/* Now sum to a single value. */												\n"
 "	local_workspace_float3_reduce(reduction_workspace);								\n"
@@ -0,0 +1,219 @@
+#ifdef __linux__
+/* For sched_getcpu. */
+#	define _GNU_SOURCE
+#endif
+#include "numa.h"
+/*============================================================================
+numa.c
+
+Copies of source arrays placed for NUMA systems (cvtx_Context_set_numa).
+
+Copyright(c) 2019 HJA Bird
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files(the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+============================================================================*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef __linux__
+#	include <sched.h>
+#endif
+
+#include "context.h"
+
+/* CPUs beyond this are treated as on node 0. */
+#define CVTX_NUMA_MAX_CPUS 4096
+/* Elements copied at a time when replicating. */
+#define CVTX_NUMA_CHUNK 1024
+
+static int m_num_nodes = 0;		/* 0 until found. */
+static unsigned char m_cpu_node[CVTX_NUMA_MAX_CPUS];
+
+#ifdef __linux__
+/* Mark the CPUs of a list such as "0-7,16-23" as on node. */
+static void parse_cpulist(const char *list, int node) {
+	char *end;
+	long first, last, cpu;
+	while (*list != '\0' && *list != '\n') {
+		first = strtol(list, &end, 10);
+		if (end == list) { return; }
+		last = first;
+		if (*end == '-') {
+			list = end + 1;
+			last = strtol(list, &end, 10);
+			if (end == list) { return; }
+		}
+		for (cpu = first; cpu <= last && cpu < CVTX_NUMA_MAX_CPUS; ++cpu) {
+			if (cpu >= 0) { m_cpu_node[cpu] = (unsigned char)node; }
+		}
+		list = *end == ',' ? end + 1 : end;
+	}
+	return;
+}
+#endif
+
+/* Find the nodes and their CPUs. Nodes are numbered in order of their
+system numbers, skipping those without CPUs. */
+static int find_nodes(void) {
+	int num_nodes = 0;
+#ifdef __linux__
+	int node;
+	char path[128], list[4096];
+	FILE *file;
+	for (node = 0; node < 1024 && num_nodes < CVTX_NUMA_MAX_NODES; ++node) {
+		sprintf(path, "/sys/devices/system/node/node%i/cpulist", node);
+		file = fopen(path, "r");
+		if (file == NULL) { continue; }
+		if (fgets(list, sizeof(list), file) != NULL
+			&& list[0] >= '0' && list[0] <= '9') {
+			parse_cpulist(list, num_nodes++);
+		}
+		fclose(file);
+	}
+#endif
+	return num_nodes > 0 ? num_nodes : 1;
+}
+
+int numa_num_nodes(void) {
+#pragma omp critical (cvtx_numa)
+	{
+		if (m_num_nodes == 0) { m_num_nodes = find_nodes(); }
+	}
+	return m_num_nodes;
+}
+
+int numa_current_node(void) {
+#ifdef __linux__
+	int cpu = sched_getcpu();
+	if (cpu >= 0 && cpu < CVTX_NUMA_MAX_CPUS) { return m_cpu_node[cpu]; }
+#endif
+	return 0;
+}
+
+/* Allocate a copy. Returns its index, or -1. */
+static int alloc_copy(struct numa_sources *copies, int num_sources, size_t size) {
+	/* Pages aren't placed until they are first written. */
+	void *copy = malloc((sizeof(void*) + size) * num_sources);
+	if (copy == NULL) { return -1; }
+	copies->copies[copies->num_copies] = copy;
+	return copies->num_copies++;
+}
+
+/* Copy sources first to last - 1 into copy c. */
+static void fill_copy(const struct numa_sources *copies, int c,
+	long first, long last, long num_sources, size_t size) {
+	const void **pointers = copies->copies[c];
+	char *data = (char*)(pointers + num_sources);
+	long i;
+	for (i = first; i < last; ++i) {
+		memcpy(data + i * size, copies->original[i], size);
+		pointers[i] = data + i * size;
+	}
+	return;
+}
+
+int numa_sources_create(
+	struct numa_sources *copies,
+	const void **sources,
+	int num_sources,
+	size_t size)
+{
+	int i, c, mode = context_current()->numa;
+	int num_threads = context_num_threads();
+	int present[CVTX_NUMA_MAX_NODES];
+	long j, chunk, num_chunks, next[CVTX_NUMA_MAX_NODES];
+	copies->original = sources;
+	copies->num_copies = 0;
+	for (i = 0; i < CVTX_NUMA_MAX_NODES; ++i) { copies->node_copy[i] = -1; }
+	if (mode == CVTX_NUMA_NONE || num_sources <= 0) { return -1; }
+
+	if (mode == CVTX_NUMA_FIRST_TOUCH || numa_num_nodes() == 1) {
+		/* One copy, each page placed on the node of the thread that 
+		writes it. */
+		if (alloc_copy(copies, num_sources, size) < 0) { return -1; }
+		for (i = 0; i < CVTX_NUMA_MAX_NODES; ++i) { copies->node_copy[i] = 0; }
+#pragma omp parallel for schedule(static) num_threads(num_threads)
+		for (j = 0; j < num_sources; ++j) {
+			fill_copy(copies, 0, j, j + 1, num_sources, size);
+		}
+		return 0;
+	}
+
+	/* A copy for each node with threads, written by those threads. */
+	memset(present, 0, sizeof(present));
+#pragma omp parallel num_threads(num_threads)
+	{
+		int node = numa_current_node();
+#pragma omp critical (cvtx_numa_chunk)
+		{
+			present[node] = 1;
+		}
+	}
+	for (i = 0; i < CVTX_NUMA_MAX_NODES; ++i) {
+		if (!present[i]) { continue; }
+		copies->node_copy[i] = alloc_copy(copies, num_sources, size);
+		if (copies->node_copy[i] < 0) {
+			numa_sources_release(copies);
+			return -1;
+		}
+	}
+	num_chunks = (num_sources + CVTX_NUMA_CHUNK - 1) / CVTX_NUMA_CHUNK;
+	for (c = 0; c < copies->num_copies; ++c) { next[c] = 0; }
+#pragma omp parallel private(c, chunk) num_threads(num_threads)
+	{
+		c = copies->node_copy[numa_current_node()];
+		while (c >= 0) {
+#pragma omp critical (cvtx_numa_chunk)
+			{
+				chunk = next[c]++;
+			}
+			if (chunk >= num_chunks) { break; }
+			fill_copy(copies, c, chunk * CVTX_NUMA_CHUNK,
+				chunk < num_chunks - 1 ? (chunk + 1) * CVTX_NUMA_CHUNK : num_sources,
+				num_sources, size);
+		}
+	}
+	/* Chunks left by threads that moved to a node without a copy. */
+	for (c = 0; c < copies->num_copies; ++c) {
+		for (chunk = next[c]; chunk < num_chunks; ++chunk) {
+			fill_copy(copies, c, chunk * CVTX_NUMA_CHUNK,
+				chunk < num_chunks - 1 ? (chunk + 1) * CVTX_NUMA_CHUNK : num_sources,
+				num_sources, size);
+		}
+	}
+	return 0;
+}
+
+const void **numa_sources_local(const struct numa_sources *copies) {
+	int c;
+	if (copies->num_copies == 0) { return copies->original; }
+	c = copies->node_copy[numa_current_node()];
+	return c >= 0 ? (const void**)copies->copies[c] : copies->original;
+}
+
+void numa_sources_release(struct numa_sources *copies) {
+	int c;
+	for (c = 0; c < copies->num_copies; ++c) {
+		free(copies->copies[c]);
+	}
+	copies->num_copies = 0;
+	for (c = 0; c < CVTX_NUMA_MAX_NODES; ++c) { copies->node_copy[c] = -1; }
+	return;
+}
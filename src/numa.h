@@ -0,0 +1,75 @@
+#ifndef CVTX_NUMA_H
+#define CVTX_NUMA_H
+#include "libcvtx.h"
+/*============================================================================
+numa.h
+
+Copies of source arrays placed for NUMA systems (cvtx_Context_set_numa).
+
+Copyright(c) 2019 HJA Bird
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files(the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+============================================================================*/
+
+#include <stddef.h>
+
+#define CVTX_NUMA_MAX_NODES 64
+
+/* Packed copies of an array of sources, according to the NUMA mode of the
+current context. Typical usage in a CPU brute force method is:
+	struct numa_sources copies;
+	numa_sources_create(&copies, (const void**)array_start, n, sizeof(cvtx_P3D));
+#pragma omp parallel for ...
+	for (...) {
+		const cvtx_P3D **sources = 
+			(const cvtx_P3D**)numa_sources_local(&copies);
+		...
+	}
+	numa_sources_release(&copies);
+*/
+struct numa_sources {
+	const void **original;
+	int num_copies;
+	int node_copy[CVTX_NUMA_MAX_NODES];	/* Copy for each node, or -1. */
+	void *copies[CVTX_NUMA_MAX_NODES];	/* Pointers, then the packed data. */
+};
+
+/* Make the copies of sources, each of size bytes. Must be called outside
+of parallel regions. If the mode is CVTX_NUMA_NONE, or memory can't be 
+found, no copies are made and numa_sources_local gives the original. 
+Returns 0 if copies were made, -1 otherwise. */
+int numa_sources_create(
+	struct numa_sources *copies,
+	const void **sources,
+	int num_sources,
+	size_t size);
+
+/* The sources to be read by the calling thread: the copy on its node if 
+there is one, else the original. */
+const void **numa_sources_local(const struct numa_sources *copies);
+
+void numa_sources_release(struct numa_sources *copies);
+
+/* The number of NUMA nodes of the system. 1 if not known. */
+int numa_num_nodes(void);
+
+/* The node of the CPU running the calling thread. 0 if not known. */
+int numa_current_node(void);
+
+#endif /* CVTX_NUMA_H */
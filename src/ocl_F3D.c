@@ -30,7 +30,10 @@ SOFTWARE.
 #include <stdio.h>
 #include <stdlib.h>
 
+#include "context.h"
 #include "opencl_acc.h"
+#include "opencl_tuning.h"
+#include "workspace.h"
 #include "ocl_F3D.h"
 
 int opencl_brute_force_F3D_M2M_vel(
@@ -42,25 +45,39 @@ int opencl_brute_force_F3D_M2M_vel(
 
 	/* Right now we just use the first active device. */
 	assert(opencl_is_init());
-	long long cpubetter;
 	cl_program prog;
 	cl_context cont;
 	cl_command_queue queue;
-	cpubetter = (long long)num_filaments * (long long)num_mes <
-		(long long)num_filaments * (long long)num_mes / 20 + 5000 + 300 * num_mes ?
-		1 : 0;
+	struct ocl_tuning_trial trial;
+	int i, chunk, group_size, compensated, retv = 0;
 
-	if (!cpubetter && opencl_num_active_devices() > 0 &&
+	if (opencl_num_active_devices() > 0 &&
 		opencl_get_device_state(0, &prog, &cont, &queue) == 0) {
-		if (num_mes < CVTX_WORKGROUP_SIZE) {
+		compensated = context_compensated();
+		if (num_mes < CVTX_WORKGROUP_SIZE && !compensated) {
 			return opencl_brute_force_F3D_M2sM_vel_impl(
 				array_start, num_filaments, mes_start,
 				num_mes, result_array, prog, queue, cont);
 		}
 		else {
-			return opencl_brute_force_F3D_M2M_vel_impl(
-				array_start, num_filaments, mes_start,
-				num_mes, result_array, prog, queue, cont);
+			if ((compensated ?
+				opencl_tuning_begin_compensated(&trial, queue, NULL, &prog, &group_size)
+				: opencl_tuning_begin(&trial, queue,
+					"cvtx_nb_Filament_ind_vel_singular", NULL,
+					(double)num_filaments * (double)num_mes, &prog, &group_size)) != 0) {
+				return -1;
+			}
+			/* Stream the targets through the device in chunks. */
+			chunk = opencl_chunk_items(queue,
+				(compensated ? 3 : 2) * sizeof(cl_float3));
+			for (i = 0; i < num_mes && retv == 0; i += chunk) {
+				retv = opencl_brute_force_F3D_M2M_vel_impl(
+					array_start, num_filaments, mes_start + i,
+					num_mes - i < chunk ? num_mes - i : chunk,
+					result_array + i, group_size, compensated, prog, queue, cont);
+			}
+			opencl_tuning_end(&trial, retv);
+			return retv;
 		}
 	}
 	else
@@ -75,6 +92,8 @@ int opencl_brute_force_F3D_M2M_vel_impl(
 	const bsv_V3f *mes_start,
 	const int num_mes,
 	bsv_V3f *result_array,
+	int group_size,
+	int compensated,
 	cl_program program,
 	cl_command_queue queue,
 	cl_context context)
@@ -86,6 +105,11 @@ int opencl_brute_force_F3D_M2M_vel_impl(
 	cl_float *fil_strength_buff_data;
 	cl_mem mes_pos_buff, res_buff, *fil_start_buff, *fil_end_buff, *fil_strength_buff;
 	cl_int status;
+	int num_res;	/* Results, followed by compensations if compensated. */
+	int zero_copy;	/* Buffers use host memory directly. */
+	int max_groups;	/* Source groups on the device at once. */
+	cl_command_queue transfer_queue;
+	size_t ws_mark;	/* To release scratch memory. */
 	cl_kernel cl_kernel;
 	cl_event *event_chain;
 
@@ -97,44 +121,60 @@ int opencl_brute_force_F3D_M2M_vel_impl(
 			return -1;
 		}
 		/* This has to match the opencl kernels, so be careful with fiddling */
-		workgroup_size[0] = CVTX_WORKGROUP_SIZE;	/* Particles per group */
+		workgroup_size[0] = group_size;	/* Particles per group */
 		workgroup_size[1] = 1;	/* Only 1 measure pos per workgroup. */
-		global_work_size[0] = CVTX_WORKGROUP_SIZE;	/* We use multiple particle buffers */
+		global_work_size[0] = group_size;	/* We use multiple particle buffers */
 		global_work_size[1] = num_mes;
 
 		/* Generate an buffer for the measurement position data  */
-		mes_pos_buff_data = malloc(num_mes * sizeof(cl_float3));
+		zero_copy = opencl_queue_zero_copy(queue);
+		transfer_queue = opencl_transfer_queue(queue);
+		ws_mark = workspace_mark();
+		mes_pos_buff_data = opencl_host_alloc(num_mes * sizeof(cl_float3));
+		if (mes_pos_buff_data == NULL) {
+			workspace_reset(ws_mark);
+			clReleaseKernel(cl_kernel);
+			return -1;
+		}
 		for (i = 0; i < num_mes; ++i) {
 			mes_pos_buff_data[i].x = mes_start[i].x[0];
 			mes_pos_buff_data[i].y = mes_start[i].x[1];
 			mes_pos_buff_data[i].z = mes_start[i].x[2];
 		}
-		mes_pos_buff = clCreateBuffer(context,
-			CL_MEM_READ_ONLY, num_mes * sizeof(cl_float3), NULL, &status);
-		status = clEnqueueWriteBuffer(
-			queue, mes_pos_buff, CL_FALSE,
-			0, num_mes * sizeof(cl_float3), mes_pos_buff_data, 0, NULL, NULL);
+		mes_pos_buff = opencl_create_host_buffer(context, zero_copy,
+			CL_MEM_READ_ONLY, num_mes * sizeof(cl_float3), mes_pos_buff_data, &status);
+		status = opencl_write_host_buffer(
+			queue, zero_copy, mes_pos_buff, CL_FALSE,
+			num_mes * sizeof(cl_float3), mes_pos_buff_data, 0, NULL, NULL);
 		assert(status == CL_SUCCESS);
 		status = clSetKernelArg(cl_kernel, 3, sizeof(cl_mem), &mes_pos_buff);
 		if (status != CL_SUCCESS) {
-			free(mes_pos_buff_data);
+			workspace_reset(ws_mark);
 			clReleaseMemObject(mes_pos_buff);
 			clReleaseKernel(cl_kernel);
 			return -1;
 		}
 
 		/* Generate a results buffer */
-		res_buff_data = malloc(num_mes * sizeof(cl_float3));
-		res_buff = clCreateBuffer(context, CL_MEM_READ_WRITE,
-			sizeof(cl_float3) * num_mes, NULL, &status);
-		for (i = 0; i < num_mes; ++i) {
+		num_res = compensated ? 2 * num_mes : num_mes;
+		res_buff_data = opencl_host_alloc(num_res * sizeof(cl_float3));
+		if (res_buff_data == NULL) {
+			clFinish(queue);
+			workspace_reset(ws_mark);
+			clReleaseMemObject(mes_pos_buff);
+			clReleaseKernel(cl_kernel);
+			return -1;
+		}
+		for (i = 0; i < num_res; ++i) {
 			res_buff_data[i].x = 0;
 			res_buff_data[i].y = 0;
 			res_buff_data[i].z = 0;
 		}
-		status = clEnqueueWriteBuffer(
-			queue, res_buff, CL_FALSE,
-			0, num_mes * sizeof(cl_float3), res_buff_data, 0, NULL, NULL);
+		res_buff = opencl_create_host_buffer(context, zero_copy, CL_MEM_READ_WRITE,
+			sizeof(cl_float3) * num_res, res_buff_data, &status);
+		status = opencl_write_host_buffer(
+			queue, zero_copy, res_buff, CL_FALSE,
+			num_res * sizeof(cl_float3), res_buff_data, 0, NULL, NULL);
 		if (status != CL_SUCCESS) {
 			assert(0);
 			printf("OPENCL:\tFailed to enqueue write buffer.");
@@ -143,16 +183,26 @@ int opencl_brute_force_F3D_M2M_vel_impl(
 		assert(status == CL_SUCCESS);
 
 		/* Now create & dispatch particle buffers and kernel. */
-		num_filament_groups = num_filaments / CVTX_WORKGROUP_SIZE;
-		if (num_filaments % CVTX_WORKGROUP_SIZE) {
-			n_zeroed_particles = CVTX_WORKGROUP_SIZE
-				- num_filaments % CVTX_WORKGROUP_SIZE;
+		num_filament_groups = num_filaments / group_size;
+		if (num_filaments % group_size) {
+			n_zeroed_particles = group_size
+				- num_filaments % group_size;
 			num_filament_groups += 1;
 		}
-		n_modelled_filaments = CVTX_WORKGROUP_SIZE * num_filament_groups;
-		fil_start_buff_data = malloc(n_modelled_filaments * sizeof(cl_float3));
-		fil_end_buff_data = malloc(n_modelled_filaments * sizeof(cl_float3));
-		fil_strength_buff_data = malloc(n_modelled_filaments * sizeof(cl_float));
+		n_modelled_filaments = group_size * num_filament_groups;
+		fil_start_buff_data = opencl_host_alloc(n_modelled_filaments * sizeof(cl_float3));
+		fil_end_buff_data = opencl_host_alloc(n_modelled_filaments * sizeof(cl_float3));
+		fil_strength_buff_data = opencl_host_alloc(n_modelled_filaments * sizeof(cl_float));
+		if (fil_start_buff_data == NULL
+			|| fil_end_buff_data == NULL
+			|| fil_strength_buff_data == NULL) {
+			clFinish(queue);
+			workspace_reset(ws_mark);
+			clReleaseMemObject(res_buff);
+			clReleaseMemObject(mes_pos_buff);
+			clReleaseKernel(cl_kernel);
+			return -1;
+		}
 		for (i = 0; i < num_filaments; ++i) {
 			fil_start_buff_data[i].x = array_start[i]->start.x[0];
 			fil_start_buff_data[i].y = array_start[i]->start.x[1];
@@ -176,30 +226,39 @@ int opencl_brute_force_F3D_M2M_vel_impl(
 		fil_end_buff = malloc(num_filament_groups * sizeof(cl_mem));
 		fil_strength_buff = malloc(num_filament_groups * sizeof(cl_mem));
 		event_chain = malloc(sizeof(cl_event) * num_filament_groups * 4);
+		max_groups = opencl_chunk_items(queue,
+			group_size * 3 * sizeof(cl_float3));
 		for (i = 0; i < num_filament_groups; ++i) {
-			fil_start_buff[i] = clCreateBuffer(context,
-				CL_MEM_READ_ONLY, CVTX_WORKGROUP_SIZE * sizeof(cl_float3), NULL, &status);
+			if (i >= max_groups) {
+				/* Bound the device memory taken by source buffers. */
+				clWaitForEvents(1, event_chain + 4 * (i - max_groups) + 3);
+			}
+			fil_start_buff[i] = opencl_create_host_buffer(context, zero_copy,
+				CL_MEM_READ_ONLY, group_size * sizeof(cl_float3),
+				fil_start_buff_data + i * group_size, &status);
 			assert(status == CL_SUCCESS);
-			status = clEnqueueWriteBuffer(
-				queue, fil_start_buff[i], CL_FALSE,
-				0, CVTX_WORKGROUP_SIZE * sizeof(cl_float3),
-				fil_start_buff_data + i * CVTX_WORKGROUP_SIZE, 0, NULL, event_chain + 4 * i);
+			status = opencl_write_host_buffer(
+				transfer_queue, zero_copy, fil_start_buff[i], CL_FALSE,
+				group_size * sizeof(cl_float3),
+				fil_start_buff_data + i * group_size, 0, NULL, event_chain + 4 * i);
 			assert(status == CL_SUCCESS);
-			fil_end_buff[i] = clCreateBuffer(context,
-				CL_MEM_READ_ONLY, CVTX_WORKGROUP_SIZE * sizeof(cl_float3), NULL, &status);
+			fil_end_buff[i] = opencl_create_host_buffer(context, zero_copy,
+				CL_MEM_READ_ONLY, group_size * sizeof(cl_float3),
+				fil_end_buff_data + i * group_size, &status);
 			assert(status == CL_SUCCESS);
-			status = clEnqueueWriteBuffer(
-				queue, fil_end_buff[i], CL_FALSE,
-				0, CVTX_WORKGROUP_SIZE * sizeof(cl_float3),
-				fil_end_buff_data + i * CVTX_WORKGROUP_SIZE, 0, NULL, event_chain + 4 * i + 1);
+			status = opencl_write_host_buffer(
+				transfer_queue, zero_copy, fil_end_buff[i], CL_FALSE,
+				group_size * sizeof(cl_float3),
+				fil_end_buff_data + i * group_size, 0, NULL, event_chain + 4 * i + 1);
 			assert(status == CL_SUCCESS);
-			fil_strength_buff[i] = clCreateBuffer(context,
-				CL_MEM_READ_ONLY, CVTX_WORKGROUP_SIZE * sizeof(cl_float3), NULL, &status);
+			fil_strength_buff[i] = opencl_create_host_buffer(context, zero_copy,
+				CL_MEM_READ_ONLY, group_size * sizeof(cl_float),
+				fil_strength_buff_data + i * group_size, &status);
 			assert(status == CL_SUCCESS);
-			status = clEnqueueWriteBuffer(
-				queue, fil_strength_buff[i], CL_FALSE,
-				0, CVTX_WORKGROUP_SIZE * sizeof(cl_float),
-				fil_strength_buff_data + i * CVTX_WORKGROUP_SIZE, 0, NULL, event_chain + 4 * i + 2);
+			status = opencl_write_host_buffer(
+				transfer_queue, zero_copy, fil_strength_buff[i], CL_FALSE,
+				group_size * sizeof(cl_float),
+				fil_strength_buff_data + i * group_size, 0, NULL, event_chain + 4 * i + 2);
 			assert(status == CL_SUCCESS);
 			status = clSetKernelArg(cl_kernel, 0, sizeof(cl_mem), fil_start_buff + i);
 			assert(status == CL_SUCCESS);
@@ -207,6 +266,7 @@ int opencl_brute_force_F3D_M2M_vel_impl(
 			assert(status == CL_SUCCESS);
 			status = clSetKernelArg(cl_kernel, 2, sizeof(cl_mem), fil_strength_buff + i);
 			assert(status == CL_SUCCESS);
+			clFlush(transfer_queue);
 			if (i == 0) {
 				status = clEnqueueNDRangeKernel(queue, cl_kernel, 2,
 					NULL, global_work_size, workgroup_size, 3, event_chain, event_chain + 4 * i + 3);
@@ -222,25 +282,40 @@ int opencl_brute_force_F3D_M2M_vel_impl(
 		}
 
 		/* Read back our results! */
-		clEnqueueReadBuffer(queue, res_buff, CL_TRUE, 0,
-			sizeof(cl_float3) * num_mes, res_buff_data, 1,
-			event_chain + 4 * num_filament_groups - 1, NULL);
-		for (i = 0; i < num_filament_groups * 4; ++i) { clReleaseEvent(event_chain[i]); }
+		status = opencl_read_host_buffer(queue, zero_copy, res_buff,
+			sizeof(cl_float3) * num_res, res_buff_data, 1,
+			event_chain + 4 * num_filament_groups - 1);
+		opencl_release_events(event_chain, num_filament_groups * 4);
 		free(event_chain);	/* Its tempting to do this earlier, but remember, this is asynchonous! */
+		if (status != CL_SUCCESS) {
+			clFinish(queue);
+			workspace_reset(ws_mark);
+			free(fil_start_buff);
+			free(fil_end_buff);
+			free(fil_strength_buff);
+			clReleaseMemObject(res_buff);
+			clReleaseMemObject(mes_pos_buff);
+			clReleaseKernel(cl_kernel);
+			return -1;
+		}
+		if (compensated) {
+			/* Each result plus its compensation. */
+			for (i = 0; i < num_mes; ++i) {
+				res_buff_data[i].x += res_buff_data[num_mes + i].x;
+				res_buff_data[i].y += res_buff_data[num_mes + i].y;
+				res_buff_data[i].z += res_buff_data[num_mes + i].z;
+			}
+		}
 		for (i = 0; i < num_mes; ++i) {
 			result_array[i].x[0] = res_buff_data[i].x;
 			result_array[i].x[1] = res_buff_data[i].y;
 			result_array[i].x[2] = res_buff_data[i].z;
 		}
-		free(res_buff_data);
+		workspace_reset(ws_mark);
 
 		free(fil_start_buff);
 		free(fil_end_buff);
 		free(fil_strength_buff);
-		free(fil_start_buff_data);
-		free(fil_end_buff_data);
-		free(fil_strength_buff_data);
-		free(mes_pos_buff_data);
 		clReleaseMemObject(res_buff);
 		clReleaseMemObject(mes_pos_buff);
 		clReleaseKernel(cl_kernel);
@@ -270,6 +345,8 @@ int opencl_brute_force_F3D_M2sM_vel_impl(
 	cl_uint num_mes_cl;
 	cl_mem mes_pos_buff, res_buff, fil_start_buff, fil_end_buff, fil_strength_buff;
 	cl_int status;
+	int zero_copy;	/* Buffers use host memory directly. */
+	size_t ws_mark;	/* To release scratch memory. */
 	cl_kernel cl_kernel;
 
 	if (opencl_init() == 1)
@@ -296,30 +373,44 @@ int opencl_brute_force_F3D_M2sM_vel_impl(
 		assert(status == CL_SUCCESS);
 
 		/* Generate an buffer for the measurement position data  */
-		mes_pos_buff_data = malloc(num_mes * num_filament_groups * sizeof(cl_float3));
+		zero_copy = opencl_queue_zero_copy(queue);
+		ws_mark = workspace_mark();
+		mes_pos_buff_data = opencl_host_alloc(num_mes * num_filament_groups * sizeof(cl_float3));
+		if (mes_pos_buff_data == NULL) {
+			workspace_reset(ws_mark);
+			clReleaseKernel(cl_kernel);
+			return -1;
+		}
 		for (i = 0; i < num_mes * num_filament_groups; ++i) {
 			mes_pos_buff_data[i].x = mes_start[i % num_mes].x[0];
 			mes_pos_buff_data[i].y = mes_start[i % num_mes].x[1];
 			mes_pos_buff_data[i].z = mes_start[i % num_mes].x[2];
 		}
-		mes_pos_buff = clCreateBuffer(context,
-			CL_MEM_READ_ONLY, num_mes  * num_filament_groups * sizeof(cl_float3), NULL, &status);
-		status = clEnqueueWriteBuffer(
-			queue, mes_pos_buff, CL_FALSE,
-			0, num_mes * num_filament_groups * sizeof(cl_float3), mes_pos_buff_data, 0, NULL, NULL);
+		mes_pos_buff = opencl_create_host_buffer(context, zero_copy,
+			CL_MEM_READ_ONLY, num_mes  * num_filament_groups * sizeof(cl_float3), mes_pos_buff_data, &status);
+		status = opencl_write_host_buffer(
+			queue, zero_copy, mes_pos_buff, CL_FALSE,
+			num_mes * num_filament_groups * sizeof(cl_float3), mes_pos_buff_data, 0, NULL, NULL);
 		assert(status == CL_SUCCESS);
 		status = clSetKernelArg(cl_kernel, 3, sizeof(cl_mem), &mes_pos_buff);
 		if (status != CL_SUCCESS) {
-			free(mes_pos_buff_data);
+			workspace_reset(ws_mark);
 			clReleaseMemObject(mes_pos_buff);
 			clReleaseKernel(cl_kernel);
 			return -1;
 		}
 
 		/* Generate a results buffer */
-		res_buff_data = malloc(num_mes * num_filament_groups * sizeof(cl_float3));
-		res_buff = clCreateBuffer(context, CL_MEM_WRITE_ONLY,
-			sizeof(cl_float3) * num_mes * num_filament_groups, NULL, &status);
+		res_buff_data = opencl_host_alloc(num_mes * num_filament_groups * sizeof(cl_float3));
+		if (res_buff_data == NULL) {
+			clFinish(queue);
+			workspace_reset(ws_mark);
+			clReleaseMemObject(mes_pos_buff);
+			clReleaseKernel(cl_kernel);
+			return -1;
+		}
+		res_buff = opencl_create_host_buffer(context, zero_copy, CL_MEM_WRITE_ONLY,
+			sizeof(cl_float3) * num_mes * num_filament_groups, res_buff_data, &status);
 		if (status != CL_SUCCESS) {
 			assert(0);
 			printf("OPENCL:\tFailed to enqueue write buffer.");
@@ -333,9 +424,19 @@ int opencl_brute_force_F3D_M2sM_vel_impl(
 				- num_filaments % CVTX_WORKGROUP_SIZE;
 		}
 		n_modelled_filaments = CVTX_WORKGROUP_SIZE * num_filament_groups;
-		fil_start_buff_data = malloc(n_modelled_filaments * sizeof(cl_float3));
-		fil_end_buff_data = malloc(n_modelled_filaments * sizeof(cl_float3));
-		fil_strength_buff_data = malloc(n_modelled_filaments * sizeof(cl_float));
+		fil_start_buff_data = opencl_host_alloc(n_modelled_filaments * sizeof(cl_float3));
+		fil_end_buff_data = opencl_host_alloc(n_modelled_filaments * sizeof(cl_float3));
+		fil_strength_buff_data = opencl_host_alloc(n_modelled_filaments * sizeof(cl_float));
+		if (fil_start_buff_data == NULL
+			|| fil_end_buff_data == NULL
+			|| fil_strength_buff_data == NULL) {
+			clFinish(queue);
+			workspace_reset(ws_mark);
+			clReleaseMemObject(res_buff);
+			clReleaseMemObject(mes_pos_buff);
+			clReleaseKernel(cl_kernel);
+			return -1;
+		}
 		for (i = 0; i < num_filaments; ++i) {
 			fil_start_buff_data[i].x = array_start[i]->start.x[0];
 			fil_start_buff_data[i].y = array_start[i]->start.x[1];
@@ -355,27 +456,27 @@ int opencl_brute_force_F3D_M2sM_vel_impl(
 			fil_end_buff_data[i].z = 1.0f;
 			fil_strength_buff_data[i] = 0.0f;
 		}
-		fil_start_buff = clCreateBuffer(context,
-			CL_MEM_READ_ONLY, n_modelled_filaments * sizeof(cl_float3), NULL, &status);
-		status = clEnqueueWriteBuffer(
-			queue, fil_start_buff, CL_FALSE,
-			0, n_modelled_filaments * sizeof(cl_float3), fil_start_buff_data, 0, NULL, NULL);
+		fil_start_buff = opencl_create_host_buffer(context, zero_copy,
+			CL_MEM_READ_ONLY, n_modelled_filaments * sizeof(cl_float3), fil_start_buff_data, &status);
+		status = opencl_write_host_buffer(
+			queue, zero_copy, fil_start_buff, CL_FALSE,
+			n_modelled_filaments * sizeof(cl_float3), fil_start_buff_data, 0, NULL, NULL);
 		assert(status == CL_SUCCESS);
 		status = clSetKernelArg(cl_kernel, 0, sizeof(cl_mem), &fil_start_buff);
 
-		fil_end_buff = clCreateBuffer(context,
-			CL_MEM_READ_ONLY, n_modelled_filaments * sizeof(cl_float3), NULL, &status);
-		status = clEnqueueWriteBuffer(
-			queue, fil_end_buff, CL_FALSE,
-			0, n_modelled_filaments * sizeof(cl_float3), fil_end_buff_data, 0, NULL, NULL);
+		fil_end_buff = opencl_create_host_buffer(context, zero_copy,
+			CL_MEM_READ_ONLY, n_modelled_filaments * sizeof(cl_float3), fil_end_buff_data, &status);
+		status = opencl_write_host_buffer(
+			queue, zero_copy, fil_end_buff, CL_FALSE,
+			n_modelled_filaments * sizeof(cl_float3), fil_end_buff_data, 0, NULL, NULL);
 		assert(status == CL_SUCCESS);
 		status = clSetKernelArg(cl_kernel, 1, sizeof(cl_mem), &fil_end_buff);
 
-		fil_strength_buff = clCreateBuffer(context,
-			CL_MEM_READ_ONLY, n_modelled_filaments * sizeof(cl_float), NULL, &status);
-		status = clEnqueueWriteBuffer(
-			queue, fil_strength_buff, CL_FALSE,
-			0, n_modelled_filaments * sizeof(cl_float), fil_strength_buff_data, 0, NULL, NULL);
+		fil_strength_buff = opencl_create_host_buffer(context, zero_copy,
+			CL_MEM_READ_ONLY, n_modelled_filaments * sizeof(cl_float), fil_strength_buff_data, &status);
+		status = opencl_write_host_buffer(
+			queue, zero_copy, fil_strength_buff, CL_FALSE,
+			n_modelled_filaments * sizeof(cl_float), fil_strength_buff_data, 0, NULL, NULL);
 		assert(status == CL_SUCCESS);
 		status = clSetKernelArg(cl_kernel, 2, sizeof(cl_mem), &fil_strength_buff);
 
@@ -386,9 +487,20 @@ int opencl_brute_force_F3D_M2sM_vel_impl(
 
 		/* Read back our results! */
 		clFinish(queue);
-		clEnqueueReadBuffer(queue, res_buff, CL_TRUE, 0,
+		status = opencl_read_host_buffer(queue, zero_copy, res_buff,
 			sizeof(cl_float3) * num_mes * num_filament_groups, res_buff_data, 0,
-			NULL, NULL);
+			NULL);
+		if (status != CL_SUCCESS) {
+			clFinish(queue);
+			workspace_reset(ws_mark);
+			clReleaseMemObject(fil_strength_buff);
+			clReleaseMemObject(fil_end_buff);
+			clReleaseMemObject(fil_start_buff);
+			clReleaseMemObject(res_buff);
+			clReleaseMemObject(mes_pos_buff);
+			clReleaseKernel(cl_kernel);
+			return -1;
+		}
 		for (i = 0; i < num_mes; ++i) {
 			result_array[i].x[0] = res_buff_data[i].x;
 			result_array[i].x[1] = res_buff_data[i].y;
@@ -399,12 +511,8 @@ int opencl_brute_force_F3D_M2sM_vel_impl(
 			result_array[i % num_mes].x[1] += res_buff_data[i].y;
 			result_array[i % num_mes].x[2] += res_buff_data[i].z;
 		}
-		free(res_buff_data);
+		workspace_reset(ws_mark);
 
-		free(fil_start_buff_data);
-		free(fil_end_buff_data);
-		free(fil_strength_buff_data);
-		free(mes_pos_buff_data);
 		clReleaseMemObject(fil_start_buff);
 		clReleaseMemObject(fil_end_buff);
 		clReleaseMemObject(fil_strength_buff);
@@ -431,12 +539,26 @@ int opencl_brute_force_F3D_M2M_dvort(
 	cl_program prog;
 	cl_context cont;
 	cl_command_queue queue;
+	struct ocl_tuning_trial trial;
+	int i, chunk, group_size, retv = 0;
 
 	if (opencl_num_active_devices() > 0 &&
 		opencl_get_device_state(0, &prog, &cont, &queue) == 0) {
-		return opencl_brute_force_F3D_M2M_dvort_impl(
-			array_start, num_fil, induced_start,
-			num_induced, result_array, prog, queue, cont);
+		if (opencl_tuning_begin(&trial, queue,
+			"cvtx_nb_Filament_ind_dvort_singular", NULL,
+			(double)num_fil * (double)num_induced, &prog, &group_size) != 0) {
+			return -1;
+		}
+		/* Stream the targets through the device in chunks. */
+		chunk = opencl_chunk_items(queue, 3 * sizeof(cl_float3));
+		for (i = 0; i < num_induced && retv == 0; i += chunk) {
+			retv = opencl_brute_force_F3D_M2M_dvort_impl(
+				array_start, num_fil, induced_start + i,
+				num_induced - i < chunk ? num_induced - i : chunk,
+				result_array + i, group_size, prog, queue, cont);
+		}
+		opencl_tuning_end(&trial, retv);
+		return retv;
 	}
 	else
 	{
@@ -450,6 +572,7 @@ int opencl_brute_force_F3D_M2M_dvort_impl(
 	const cvtx_P3D **induced_start,
 	const int num_induced,
 	bsv_V3f *result_array,
+	int group_size,
 	cl_program program,
 	cl_command_queue queue,
 	cl_context context)
@@ -463,6 +586,10 @@ int opencl_brute_force_F3D_M2M_dvort_impl(
 	cl_mem part_pos_buff, part_vort_buff, res_buff,
 		*fil_start_buff, *fil_end_buff, *fil_strength_buff;
 	cl_int status;
+	int zero_copy;	/* Buffers use host memory directly. */
+	int max_groups;	/* Source groups on the device at once. */
+	cl_command_queue transfer_queue;
+	size_t ws_mark;	/* To release scratch memory. */
 	cl_kernel cl_kernel;
 	cl_event *event_chain;
 
@@ -474,14 +601,22 @@ int opencl_brute_force_F3D_M2M_dvort_impl(
 			return -1;
 		}
 		/* This has to match the opencl kernels, so be careful with fiddling */
-		workgroup_size[0] = CVTX_WORKGROUP_SIZE;	/* Particles per group */
+		workgroup_size[0] = group_size;	/* Particles per group */
 		workgroup_size[1] = 1;	/* Only 1 measure pos per workgroup. */
-		global_work_size[0] = CVTX_WORKGROUP_SIZE;	/* We use multiple particle buffers */
+		global_work_size[0] = group_size;	/* We use multiple particle buffers */
 		global_work_size[1] = num_induced;
 
 		/* Generate an buffer for the measurement position data  */
-		part_pos_buff_data = malloc(num_induced * sizeof(cl_float3));
-		part_vort_buff_data = malloc(num_induced * sizeof(cl_float3));
+		zero_copy = opencl_queue_zero_copy(queue);
+		transfer_queue = opencl_transfer_queue(queue);
+		ws_mark = workspace_mark();
+		part_pos_buff_data = opencl_host_alloc(num_induced * sizeof(cl_float3));
+		part_vort_buff_data = opencl_host_alloc(num_induced * sizeof(cl_float3));
+		if (part_pos_buff_data == NULL || part_vort_buff_data == NULL) {
+			workspace_reset(ws_mark);
+			clReleaseKernel(cl_kernel);
+			return -1;
+		}
 		for (i = 0; i < num_induced; ++i) {
 			part_pos_buff_data[i].x = induced_start[i]->coord.x[0];
 			part_pos_buff_data[i].y = induced_start[i]->coord.x[1];
@@ -490,24 +625,23 @@ int opencl_brute_force_F3D_M2M_dvort_impl(
 			part_vort_buff_data[i].y = induced_start[i]->vorticity.x[1];
 			part_vort_buff_data[i].z = induced_start[i]->vorticity.x[2];
 		}
-		part_pos_buff = clCreateBuffer(context,
-			CL_MEM_READ_ONLY, num_induced * sizeof(cl_float3), NULL, &status);
-		status = clEnqueueWriteBuffer(
-			queue, part_pos_buff, CL_FALSE,
-			0, num_induced * sizeof(cl_float3), part_pos_buff_data, 0, NULL, NULL);
+		part_pos_buff = opencl_create_host_buffer(context, zero_copy,
+			CL_MEM_READ_ONLY, num_induced * sizeof(cl_float3), part_pos_buff_data, &status);
+		status = opencl_write_host_buffer(
+			queue, zero_copy, part_pos_buff, CL_FALSE,
+			num_induced * sizeof(cl_float3), part_pos_buff_data, 0, NULL, NULL);
 		assert(status == CL_SUCCESS);
 		status = clSetKernelArg(cl_kernel, 3, sizeof(cl_mem), &part_pos_buff);
 		assert(status == CL_SUCCESS);
-		part_vort_buff = clCreateBuffer(context,
-			CL_MEM_READ_ONLY, num_induced * sizeof(cl_float3), NULL, &status);
-		status = clEnqueueWriteBuffer(
-			queue, part_vort_buff, CL_FALSE,
-			0, num_induced * sizeof(cl_float3), part_vort_buff_data, 0, NULL, NULL);
+		part_vort_buff = opencl_create_host_buffer(context, zero_copy,
+			CL_MEM_READ_ONLY, num_induced * sizeof(cl_float3), part_vort_buff_data, &status);
+		status = opencl_write_host_buffer(
+			queue, zero_copy, part_vort_buff, CL_FALSE,
+			num_induced * sizeof(cl_float3), part_vort_buff_data, 0, NULL, NULL);
 		assert(status == CL_SUCCESS);
 		status = clSetKernelArg(cl_kernel, 4, sizeof(cl_mem), &part_vort_buff);
 		if (status != CL_SUCCESS) {
-			free(part_pos_buff_data);
-			free(part_vort_buff_data);
+			workspace_reset(ws_mark);
 			clReleaseMemObject(part_pos_buff);
 			clReleaseMemObject(part_vort_buff);
 			clReleaseKernel(cl_kernel);
@@ -515,17 +649,25 @@ int opencl_brute_force_F3D_M2M_dvort_impl(
 		}
 
 		/* Generate a results buffer */
-		res_buff_data = malloc(num_induced * sizeof(cl_float3));
-		res_buff = clCreateBuffer(context, CL_MEM_READ_WRITE,
-			sizeof(cl_float3) * num_induced, NULL, &status);
+		res_buff_data = opencl_host_alloc(num_induced * sizeof(cl_float3));
+		if (res_buff_data == NULL) {
+			clFinish(queue);
+			workspace_reset(ws_mark);
+			clReleaseMemObject(part_vort_buff);
+			clReleaseMemObject(part_pos_buff);
+			clReleaseKernel(cl_kernel);
+			return -1;
+		}
 		for (i = 0; i < num_induced; ++i) {
 			res_buff_data[i].x = 0;
 			res_buff_data[i].y = 0;
 			res_buff_data[i].z = 0;
 		}
-		status = clEnqueueWriteBuffer(
-			queue, res_buff, CL_FALSE,
-			0, num_induced * sizeof(cl_float3), res_buff_data, 0, NULL, NULL);
+		res_buff = opencl_create_host_buffer(context, zero_copy, CL_MEM_READ_WRITE,
+			sizeof(cl_float3) * num_induced, res_buff_data, &status);
+		status = opencl_write_host_buffer(
+			queue, zero_copy, res_buff, CL_FALSE,
+			num_induced * sizeof(cl_float3), res_buff_data, 0, NULL, NULL);
 		if (status != CL_SUCCESS) {
 			assert(0);
 			printf("OPENCL:\tFailed to enqueue write buffer.");
@@ -534,16 +676,27 @@ int opencl_brute_force_F3D_M2M_dvort_impl(
 		assert(status == CL_SUCCESS);
 
 		/* Now create & dispatch particle buffers and kernel. */
-		num_filament_groups = num_fil / CVTX_WORKGROUP_SIZE;
-		if (num_fil % CVTX_WORKGROUP_SIZE) {
-			n_zeroed_particles = CVTX_WORKGROUP_SIZE
-				- num_fil % CVTX_WORKGROUP_SIZE;
+		num_filament_groups = num_fil / group_size;
+		if (num_fil % group_size) {
+			n_zeroed_particles = group_size
+				- num_fil % group_size;
 			num_filament_groups += 1;
 		}
-		n_modelled_filaments = CVTX_WORKGROUP_SIZE * num_filament_groups;
-		fil_start_buff_data = malloc(n_modelled_filaments * sizeof(cl_float3));
-		fil_end_buff_data = malloc(n_modelled_filaments * sizeof(cl_float3));
-		fil_strength_buff_data = malloc(n_modelled_filaments * sizeof(cl_float));
+		n_modelled_filaments = group_size * num_filament_groups;
+		fil_start_buff_data = opencl_host_alloc(n_modelled_filaments * sizeof(cl_float3));
+		fil_end_buff_data = opencl_host_alloc(n_modelled_filaments * sizeof(cl_float3));
+		fil_strength_buff_data = opencl_host_alloc(n_modelled_filaments * sizeof(cl_float));
+		if (fil_start_buff_data == NULL
+			|| fil_end_buff_data == NULL
+			|| fil_strength_buff_data == NULL) {
+			clFinish(queue);
+			workspace_reset(ws_mark);
+			clReleaseMemObject(res_buff);
+			clReleaseMemObject(part_vort_buff);
+			clReleaseMemObject(part_pos_buff);
+			clReleaseKernel(cl_kernel);
+			return -1;
+		}
 		for (i = 0; i < num_fil; ++i) {
 			fil_start_buff_data[i].x = array_start[i]->start.x[0];
 			fil_start_buff_data[i].y = array_start[i]->start.x[1];
@@ -567,30 +720,39 @@ int opencl_brute_force_F3D_M2M_dvort_impl(
 		fil_end_buff = malloc(num_filament_groups * sizeof(cl_mem));
 		fil_strength_buff = malloc(num_filament_groups * sizeof(cl_mem));
 		event_chain = malloc(sizeof(cl_event) * num_filament_groups * 4);
+		max_groups = opencl_chunk_items(queue,
+			group_size * 3 * sizeof(cl_float3));
 		for (i = 0; i < num_filament_groups; ++i) {
-			fil_start_buff[i] = clCreateBuffer(context,
-				CL_MEM_READ_ONLY, CVTX_WORKGROUP_SIZE * sizeof(cl_float3), NULL, &status);
+			if (i >= max_groups) {
+				/* Bound the device memory taken by source buffers. */
+				clWaitForEvents(1, event_chain + 4 * (i - max_groups) + 3);
+			}
+			fil_start_buff[i] = opencl_create_host_buffer(context, zero_copy,
+				CL_MEM_READ_ONLY, group_size * sizeof(cl_float3),
+				fil_start_buff_data + i * group_size, &status);
 			assert(status == CL_SUCCESS);
-			status = clEnqueueWriteBuffer(
-				queue, fil_start_buff[i], CL_FALSE,
-				0, CVTX_WORKGROUP_SIZE * sizeof(cl_float3),
-				fil_start_buff_data + i * CVTX_WORKGROUP_SIZE, 0, NULL, event_chain + 4 * i);
+			status = opencl_write_host_buffer(
+				transfer_queue, zero_copy, fil_start_buff[i], CL_FALSE,
+				group_size * sizeof(cl_float3),
+				fil_start_buff_data + i * group_size, 0, NULL, event_chain + 4 * i);
 			assert(status == CL_SUCCESS);
-			fil_end_buff[i] = clCreateBuffer(context,
-				CL_MEM_READ_ONLY, CVTX_WORKGROUP_SIZE * sizeof(cl_float3), NULL, &status);
+			fil_end_buff[i] = opencl_create_host_buffer(context, zero_copy,
+				CL_MEM_READ_ONLY, group_size * sizeof(cl_float3),
+				fil_end_buff_data + i * group_size, &status);
 			assert(status == CL_SUCCESS);
-			status = clEnqueueWriteBuffer(
-				queue, fil_end_buff[i], CL_FALSE,
-				0, CVTX_WORKGROUP_SIZE * sizeof(cl_float3),
-				fil_end_buff_data + i * CVTX_WORKGROUP_SIZE, 0, NULL, event_chain + 4 * i + 1);
+			status = opencl_write_host_buffer(
+				transfer_queue, zero_copy, fil_end_buff[i], CL_FALSE,
+				group_size * sizeof(cl_float3),
+				fil_end_buff_data + i * group_size, 0, NULL, event_chain + 4 * i + 1);
 			assert(status == CL_SUCCESS);
-			fil_strength_buff[i] = clCreateBuffer(context,
-				CL_MEM_READ_ONLY, CVTX_WORKGROUP_SIZE * sizeof(cl_float3), NULL, &status);
+			fil_strength_buff[i] = opencl_create_host_buffer(context, zero_copy,
+				CL_MEM_READ_ONLY, group_size * sizeof(cl_float),
+				fil_strength_buff_data + i * group_size, &status);
 			assert(status == CL_SUCCESS);
-			status = clEnqueueWriteBuffer(
-				queue, fil_strength_buff[i], CL_FALSE,
-				0, CVTX_WORKGROUP_SIZE * sizeof(cl_float3),
-				fil_strength_buff_data + i * CVTX_WORKGROUP_SIZE, 0, NULL, event_chain + 4 * i + 2);
+			status = opencl_write_host_buffer(
+				transfer_queue, zero_copy, fil_strength_buff[i], CL_FALSE,
+				group_size * sizeof(cl_float),
+				fil_strength_buff_data + i * group_size, 0, NULL, event_chain + 4 * i + 2);
 			assert(status == CL_SUCCESS);
 			status = clSetKernelArg(cl_kernel, 0, sizeof(cl_mem), fil_start_buff + i);
 			assert(status == CL_SUCCESS);
@@ -598,6 +760,7 @@ int opencl_brute_force_F3D_M2M_dvort_impl(
 			assert(status == CL_SUCCESS);
 			status = clSetKernelArg(cl_kernel, 2, sizeof(cl_mem), fil_strength_buff + i);
 			assert(status == CL_SUCCESS);
+			clFlush(transfer_queue);
 			if (i == 0) {
 				status = clEnqueueNDRangeKernel(queue, cl_kernel, 2,
 					NULL, global_work_size, workgroup_size, 3, event_chain, event_chain + 3);
@@ -613,26 +776,33 @@ int opencl_brute_force_F3D_M2M_dvort_impl(
 		}
 
 		/* Read back our results! */
-		clEnqueueReadBuffer(queue, res_buff, CL_TRUE, 0,
+		status = opencl_read_host_buffer(queue, zero_copy, res_buff,
 			sizeof(cl_float3) * num_induced, res_buff_data, 1,
-			event_chain + 4 * num_filament_groups - 1, NULL);
-		for (i = 0; i < num_filament_groups * 4; ++i) { clReleaseEvent(event_chain[i]); }
+			event_chain + 4 * num_filament_groups - 1);
+		opencl_release_events(event_chain, num_filament_groups * 4);
 		free(event_chain);	/* Its tempting to do this earlier, but remember, this is asynchonous! */
+		if (status != CL_SUCCESS) {
+			clFinish(queue);
+			workspace_reset(ws_mark);
+			free(fil_start_buff);
+			free(fil_end_buff);
+			free(fil_strength_buff);
+			clReleaseMemObject(res_buff);
+			clReleaseMemObject(part_vort_buff);
+			clReleaseMemObject(part_pos_buff);
+			clReleaseKernel(cl_kernel);
+			return -1;
+		}
 		for (i = 0; i < num_induced; ++i) {
 			result_array[i].x[0] = res_buff_data[i].x;
 			result_array[i].x[1] = res_buff_data[i].y;
 			result_array[i].x[2] = res_buff_data[i].z;
 		}
-		free(res_buff_data);
+		workspace_reset(ws_mark);
 
 		free(fil_start_buff);
 		free(fil_end_buff);
 		free(fil_strength_buff);
-		free(fil_start_buff_data);
-		free(fil_end_buff_data);
-		free(fil_strength_buff_data);
-		free(part_pos_buff_data);
-		free(part_vort_buff_data);
 		clReleaseMemObject(res_buff);
 		clReleaseMemObject(part_pos_buff);
 		clReleaseMemObject(part_vort_buff);
@@ -43,6 +43,8 @@ int opencl_brute_force_F3D_M2M_vel_impl(
 	const bsv_V3f *mes_start,
 	const int num_mes,
 	bsv_V3f *result_array,
+	int group_size,
+	int compensated,
 	cl_program program,
 	cl_command_queue queue,
 	cl_context context);
@@ -71,6 +73,7 @@ int opencl_brute_force_F3D_M2M_dvort_impl(
 	const cvtx_P3D **induced_start,
 	const int num_induced,
 	bsv_V3f *result_array,
+	int group_size,
 	cl_program program,
 	cl_command_queue queue,
 	cl_context context);
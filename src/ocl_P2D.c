@@ -31,7 +31,10 @@ SOFTWARE.
 #include <stdlib.h>
 #include <string.h>
 
+#include "context.h"
 #include "opencl_acc.h"
+#include "opencl_tuning.h"
+#include "workspace.h"
 #include "ocl_P2D.h"
 
 int opencl_brute_force_P2D_M2M_vel(
@@ -45,28 +48,43 @@ int opencl_brute_force_P2D_M2M_vel(
 {
 	/* Right now we just use the first active device. */
 	assert(opencl_is_init());
-	long long cpubetter;
 	cl_program prog;
 	cl_context cont;
 	cl_command_queue queue;
-	/* A loosey goosey way of estimating whether we'd do better
-	using the cpu to solve the problem: */
-	cpubetter = 20000 + (long long)num_particles * (long long)num_mes / 20
-		< (long long)num_particles * (long long)num_mes ? 0 : 1;
+	struct ocl_tuning_trial trial;
+	int i, chunk, group_size, compensated, retv = 0;
 
-	if (!cpubetter && opencl_num_active_devices() > 0 &&
+	if (opencl_num_active_devices() > 0 &&
 		opencl_get_device_state(0, &prog, &cont, &queue) == 0) {
-		if (num_mes < CVTX_WORKGROUP_SIZE) {
+		compensated = context_compensated();
+		if (num_mes < CVTX_WORKGROUP_SIZE && !compensated) {
+			prog = opencl_vortfunc_program(queue, kernel, CVTX_WORKGROUP_SIZE);
+			if (prog == NULL) { return -1; }
 			return opencl_brute_force_P2D_M2sM_vel_impl(
 				array_start, num_particles, mes_start,
 				num_mes, result_array, kernel, regularisation_radius,
 				prog, queue, cont);
 		}
 		else {
-			return opencl_brute_force_P2D_M2M_vel_impl(
-				array_start, num_particles, mes_start,
-				num_mes, result_array, kernel, regularisation_radius,
-				prog, queue, cont);
+			if ((compensated ?
+				opencl_tuning_begin_compensated(&trial, queue, kernel, &prog, &group_size)
+				: opencl_tuning_begin(&trial, queue,
+					"cvtx_nb_P2D_vel_", kernel,
+					(double)num_particles * (double)num_mes, &prog, &group_size)) != 0) {
+				return -1;
+			}
+			/* Stream the targets through the device in chunks. */
+			chunk = opencl_chunk_items(queue,
+				(compensated ? 3 : 2) * sizeof(cl_float2));
+			for (i = 0; i < num_mes && retv == 0; i += chunk) {
+				retv = opencl_brute_force_P2D_M2M_vel_impl(
+					array_start, num_particles, mes_start + i,
+					num_mes - i < chunk ? num_mes - i : chunk,
+					result_array + i, kernel, regularisation_radius,
+					group_size, compensated, prog, queue, cont);
+			}
+			opencl_tuning_end(&trial, retv);
+			return retv;
 		}
 	}
 	else
@@ -90,13 +108,28 @@ int opencl_brute_force_P2D_M2M_visc_dvort(
 	cl_program prog;
 	cl_context cont;
 	cl_command_queue queue;
+	struct ocl_tuning_trial trial;
+	int i, chunk, group_size, retv = 0;
 
 	if (opencl_num_active_devices() > 0 &&
 		opencl_get_device_state(0, &prog, &cont, &queue) == 0) {
-		return opencl_brute_force_P2D_M2M_visc_dvort_impl(
-			array_start, num_particles, induced_start, num_induced,
-			result_array, kernel, regularisation_radius, kinematic_visc,
-			prog, queue, cont);
+		if (opencl_tuning_begin(&trial, queue,
+			"cvtx_nb_P2D_visc_dvort_", kernel,
+			(double)num_particles * (double)num_induced, &prog, &group_size) != 0) {
+			return -1;
+		}
+		/* Stream the targets through the device in chunks. */
+		chunk = opencl_chunk_items(queue,
+			sizeof(cl_float2) + 3 * sizeof(cl_float));
+		for (i = 0; i < num_induced && retv == 0; i += chunk) {
+			retv = opencl_brute_force_P2D_M2M_visc_dvort_impl(
+				array_start, num_particles, induced_start + i,
+				num_induced - i < chunk ? num_induced - i : chunk,
+				result_array + i, kernel, regularisation_radius,
+				kinematic_visc, group_size, prog, queue, cont);
+		}
+		opencl_tuning_end(&trial, retv);
+		return retv;
 	}
 	else
 	{
@@ -112,6 +145,8 @@ int opencl_brute_force_P2D_M2M_vel_impl(
 	bsv_V2f *result_array,
 	const cvtx_VortFunc *kernel,
 	float regularisation_radius,
+	int group_size,
+	int compensated,
 	cl_program program,
 	cl_command_queue queue,
 	cl_context context)
@@ -124,6 +159,11 @@ int opencl_brute_force_P2D_M2M_vel_impl(
 	cl_float *part_vort_buff_data;
 	cl_mem mes_pos_buff, res_buff, *part_pos_buff, *part_vort_buff;
 	cl_int status;
+	int num_res;	/* Results, followed by compensations if compensated. */
+	int zero_copy;	/* Buffers use host memory directly. */
+	int max_groups;	/* Source groups on the device at once. */
+	cl_command_queue transfer_queue;
+	size_t ws_mark;	/* To release scratch memory. */
 	cl_kernel cl_kernel;
 	cl_event *event_chain;
 
@@ -136,26 +176,34 @@ int opencl_brute_force_P2D_M2M_vel_impl(
 			return -1;
 		}
 		/* This has to match the opencl kernels, so be careful with fiddling */
-		workgroup_size[0] = CVTX_WORKGROUP_SIZE;	/* Particles per group */
+		workgroup_size[0] = group_size;	/* Particles per group */
 		workgroup_size[1] = 1;	/* Only 1 measure pos per workgroup. */
-		global_work_size[0] = CVTX_WORKGROUP_SIZE;	/* We use multiple particle buffers */
+		global_work_size[0] = group_size;	/* We use multiple particle buffers */
 		global_work_size[1] = num_mes;
 
 		/* Generate an buffer for the measurement position data  */
-		mes_pos_buff_data = malloc(num_mes * sizeof(cl_float2));
+		zero_copy = opencl_queue_zero_copy(queue);
+		transfer_queue = opencl_transfer_queue(queue);
+		ws_mark = workspace_mark();
+		mes_pos_buff_data = opencl_host_alloc(num_mes * sizeof(cl_float2));
+		if (mes_pos_buff_data == NULL) {
+			workspace_reset(ws_mark);
+			clReleaseKernel(cl_kernel);
+			return -1;
+		}
 		for (i = 0; i < num_mes; ++i) {
 			mes_pos_buff_data[i].x = mes_start[i].x[0];
 			mes_pos_buff_data[i].y = mes_start[i].x[1];
 		}
-		mes_pos_buff = clCreateBuffer(context,
-			CL_MEM_READ_ONLY, num_mes * sizeof(cl_float2), NULL, &status);
-		status = clEnqueueWriteBuffer(
-			queue, mes_pos_buff, CL_FALSE,
-			0, num_mes * sizeof(cl_float2), mes_pos_buff_data, 0, NULL, NULL);
+		mes_pos_buff = opencl_create_host_buffer(context, zero_copy,
+			CL_MEM_READ_ONLY, num_mes * sizeof(cl_float2), mes_pos_buff_data, &status);
+		status = opencl_write_host_buffer(
+			queue, zero_copy, mes_pos_buff, CL_FALSE,
+			num_mes * sizeof(cl_float2), mes_pos_buff_data, 0, NULL, NULL);
 		assert(status == CL_SUCCESS);
 		status = clSetKernelArg(cl_kernel, 3, sizeof(cl_mem), &mes_pos_buff);
 		if (status != CL_SUCCESS) {
-			free(mes_pos_buff_data);
+			workspace_reset(ws_mark);
 			clReleaseMemObject(mes_pos_buff);
 			clReleaseKernel(cl_kernel);
 			return -1;
@@ -166,16 +214,24 @@ int opencl_brute_force_P2D_M2M_vel_impl(
 		assert(status == CL_SUCCESS);
 
 		/* Generate a results buffer */
-		res_buff_data = malloc(num_mes * sizeof(cl_float2));
-		res_buff = clCreateBuffer(context, CL_MEM_READ_WRITE,
-			sizeof(cl_float2) * num_mes, NULL, &status);
-		for (i = 0; i < num_mes; ++i) {
+		num_res = compensated ? 2 * num_mes : num_mes;
+		res_buff_data = opencl_host_alloc(num_res * sizeof(cl_float2));
+		if (res_buff_data == NULL) {
+			clFinish(queue);
+			workspace_reset(ws_mark);
+			clReleaseMemObject(mes_pos_buff);
+			clReleaseKernel(cl_kernel);
+			return -1;
+		}
+		for (i = 0; i < num_res; ++i) {
 			res_buff_data[i].x = 0.f;
 			res_buff_data[i].y = 0.f;
 		}
-		status = clEnqueueWriteBuffer(
-			queue, res_buff, CL_FALSE,
-			0, num_mes * sizeof(cl_float2), res_buff_data, 0, NULL, NULL);
+		res_buff = opencl_create_host_buffer(context, zero_copy, CL_MEM_READ_WRITE,
+			sizeof(cl_float2) * num_res, res_buff_data, &status);
+		status = opencl_write_host_buffer(
+			queue, zero_copy, res_buff, CL_FALSE,
+			num_res * sizeof(cl_float2), res_buff_data, 0, NULL, NULL);
 		if (status != CL_SUCCESS) {
 			assert(0);
 		}
@@ -183,15 +239,23 @@ int opencl_brute_force_P2D_M2M_vel_impl(
 		assert(status == CL_SUCCESS);
 
 		/* Now create & dispatch particle buffers and kernel. */
-		n_particle_groups = num_particles / CVTX_WORKGROUP_SIZE;
-		if (num_particles % CVTX_WORKGROUP_SIZE) {
-			n_zeroed_particles = CVTX_WORKGROUP_SIZE
-				- num_particles % CVTX_WORKGROUP_SIZE;
+		n_particle_groups = num_particles / group_size;
+		if (num_particles % group_size) {
+			n_zeroed_particles = group_size
+				- num_particles % group_size;
 			n_particle_groups += 1;
 		}
-		n_modelled_particles = CVTX_WORKGROUP_SIZE * n_particle_groups;
-		part_pos_buff_data = malloc(n_modelled_particles * sizeof(cl_float2));
-		part_vort_buff_data = malloc(n_modelled_particles * sizeof(cl_float));
+		n_modelled_particles = group_size * n_particle_groups;
+		part_pos_buff_data = opencl_host_alloc(n_modelled_particles * sizeof(cl_float2));
+		part_vort_buff_data = opencl_host_alloc(n_modelled_particles * sizeof(cl_float));
+		if (part_pos_buff_data == NULL || part_vort_buff_data == NULL) {
+			clFinish(queue);
+			workspace_reset(ws_mark);
+			clReleaseMemObject(res_buff);
+			clReleaseMemObject(mes_pos_buff);
+			clReleaseKernel(cl_kernel);
+			return -1;
+		}
 		for (i = 0; i < num_particles; ++i) {
 			part_pos_buff_data[i].x = array_start[i]->coord.x[0];
 			part_pos_buff_data[i].y = array_start[i]->coord.x[1];
@@ -206,27 +270,36 @@ int opencl_brute_force_P2D_M2M_vel_impl(
 		part_pos_buff = malloc(n_particle_groups * sizeof(cl_mem));
 		part_vort_buff = malloc(n_particle_groups * sizeof(cl_mem));
 		event_chain = malloc(sizeof(cl_event) * n_particle_groups * 3);
+		max_groups = opencl_chunk_items(queue,
+			group_size * 2 * sizeof(cl_float3));
 		for (i = 0; i < n_particle_groups; ++i) {
-			part_pos_buff[i] = clCreateBuffer(context,
-				CL_MEM_READ_ONLY, CVTX_WORKGROUP_SIZE * sizeof(cl_float2), NULL, &status);
+			if (i >= max_groups) {
+				/* Bound the device memory taken by source buffers. */
+				clWaitForEvents(1, event_chain + 3 * (i - max_groups) + 2);
+			}
+			part_pos_buff[i] = opencl_create_host_buffer(context, zero_copy,
+				CL_MEM_READ_ONLY, group_size * sizeof(cl_float2),
+				part_pos_buff_data + i * group_size, &status);
 			assert(status == CL_SUCCESS);
-			status = clEnqueueWriteBuffer(
-				queue, part_pos_buff[i], CL_FALSE,
-				0, CVTX_WORKGROUP_SIZE * sizeof(cl_float2),
-				part_pos_buff_data + i * CVTX_WORKGROUP_SIZE, 0, NULL, event_chain + 3 * i);
+			status = opencl_write_host_buffer(
+				transfer_queue, zero_copy, part_pos_buff[i], CL_FALSE,
+				group_size * sizeof(cl_float2),
+				part_pos_buff_data + i * group_size, 0, NULL, event_chain + 3 * i);
 			assert(status == CL_SUCCESS);
-			part_vort_buff[i] = clCreateBuffer(context,
-				CL_MEM_READ_ONLY, CVTX_WORKGROUP_SIZE * sizeof(cl_float), NULL, &status);
+			part_vort_buff[i] = opencl_create_host_buffer(context, zero_copy,
+				CL_MEM_READ_ONLY, group_size * sizeof(cl_float),
+				part_vort_buff_data + i * group_size, &status);
 			assert(status == CL_SUCCESS);
-			status = clEnqueueWriteBuffer(
-				queue, part_vort_buff[i], CL_FALSE,
-				0, CVTX_WORKGROUP_SIZE * sizeof(cl_float),
-				part_vort_buff_data + i * CVTX_WORKGROUP_SIZE, 0, NULL, event_chain + 3 * i + 1);
+			status = opencl_write_host_buffer(
+				transfer_queue, zero_copy, part_vort_buff[i], CL_FALSE,
+				group_size * sizeof(cl_float),
+				part_vort_buff_data + i * group_size, 0, NULL, event_chain + 3 * i + 1);
 			assert(status == CL_SUCCESS);
 			status = clSetKernelArg(cl_kernel, 0, sizeof(cl_mem), part_pos_buff + i);
 			assert(status == CL_SUCCESS);
 			status = clSetKernelArg(cl_kernel, 1, sizeof(cl_mem), part_vort_buff + i);
 			assert(status == CL_SUCCESS);
+			clFlush(transfer_queue);
 			if (i == 0) {
 				status = clEnqueueNDRangeKernel(queue, cl_kernel, 2,
 					NULL, global_work_size, workgroup_size, 2, event_chain, event_chain + 3 * i + 2);
@@ -241,23 +314,37 @@ int opencl_brute_force_P2D_M2M_vel_impl(
 		}
 
 		/* Read back our results! */
-		clEnqueueReadBuffer(queue, res_buff, CL_TRUE, 0,
-			sizeof(cl_float2) * num_mes, res_buff_data, 1,
-			event_chain + 3 * n_particle_groups - 1, NULL);
-		for (i = 0; i < n_particle_groups * 3; ++i) { clReleaseEvent(event_chain[i]); }
+		status = opencl_read_host_buffer(queue, zero_copy, res_buff,
+			sizeof(cl_float2) * num_res, res_buff_data, 1,
+			event_chain + 3 * n_particle_groups - 1);
+		opencl_release_events(event_chain, n_particle_groups * 3);
 		free(event_chain);	/* Its tempting to do this earlier, but remember, this is asynchonous! */
+		if (status != CL_SUCCESS) {
+			clFinish(queue);
+			workspace_reset(ws_mark);
+			free(part_pos_buff);
+			free(part_vort_buff);
+			clReleaseMemObject(res_buff);
+			clReleaseMemObject(mes_pos_buff);
+			clReleaseKernel(cl_kernel);
+			return -1;
+		}
+		if (compensated) {
+			/* Each result plus its compensation. */
+			for (i = 0; i < num_mes; ++i) {
+				res_buff_data[i].x += res_buff_data[num_mes + i].x;
+				res_buff_data[i].y += res_buff_data[num_mes + i].y;
+			}
+		}
 		for (i = 0; i < num_mes; ++i) {
 			/* Constant multiplyer is constant the 1/2pi term. */
 			result_array[i].x[0] = res_buff_data[i].x * constant_multiplyer;
 			result_array[i].x[1] = res_buff_data[i].y * constant_multiplyer;
 		}
-		free(res_buff_data);
+		workspace_reset(ws_mark);
 
 		free(part_pos_buff);
 		free(part_vort_buff);
-		free(part_pos_buff_data);
-		free(part_vort_buff_data);
-		free(mes_pos_buff_data);
 		clReleaseMemObject(res_buff);
 		clReleaseMemObject(mes_pos_buff);
 		clReleaseKernel(cl_kernel);
@@ -290,6 +377,8 @@ int opencl_brute_force_P2D_M2sM_vel_impl(
 	cl_uint num_mes_cl;
 	cl_mem mes_pos_buff, res_buff, part_pos_buff, part_vort_buff;
 	cl_int status;
+	int zero_copy;	/* Buffers use host memory directly. */
+	size_t ws_mark;	/* To release scratch memory. */
 	cl_kernel cl_kernel;
 
 	if (opencl_init() == 1)
@@ -317,20 +406,27 @@ int opencl_brute_force_P2D_M2sM_vel_impl(
 		assert(status == CL_SUCCESS);
 
 		/* Generate an buffer for the measurement position data  */
-		mes_pos_buff_data = malloc(num_mes * n_particle_groups * sizeof(cl_float2));
+		zero_copy = opencl_queue_zero_copy(queue);
+		ws_mark = workspace_mark();
+		mes_pos_buff_data = opencl_host_alloc(num_mes * n_particle_groups * sizeof(cl_float2));
+		if (mes_pos_buff_data == NULL) {
+			workspace_reset(ws_mark);
+			clReleaseKernel(cl_kernel);
+			return -1;
+		}
 		for (i = 0; i < num_mes * n_particle_groups; ++i) {
 			mes_pos_buff_data[i].x = mes_start[i % num_mes].x[0];
 			mes_pos_buff_data[i].y = mes_start[i % num_mes].x[1];
 		}
-		mes_pos_buff = clCreateBuffer(context,
-			CL_MEM_READ_ONLY, num_mes  * n_particle_groups * sizeof(cl_float2), NULL, &status);
-		status = clEnqueueWriteBuffer(
-			queue, mes_pos_buff, CL_FALSE,
-			0, num_mes * n_particle_groups * sizeof(cl_float2), mes_pos_buff_data, 0, NULL, NULL);
+		mes_pos_buff = opencl_create_host_buffer(context, zero_copy,
+			CL_MEM_READ_ONLY, num_mes  * n_particle_groups * sizeof(cl_float2), mes_pos_buff_data, &status);
+		status = opencl_write_host_buffer(
+			queue, zero_copy, mes_pos_buff, CL_FALSE,
+			num_mes * n_particle_groups * sizeof(cl_float2), mes_pos_buff_data, 0, NULL, NULL);
 		assert(status == CL_SUCCESS);
 		status = clSetKernelArg(cl_kernel, 3, sizeof(cl_mem), &mes_pos_buff);
 		if (status != CL_SUCCESS) {
-			free(mes_pos_buff_data);
+			workspace_reset(ws_mark);
 			clReleaseMemObject(mes_pos_buff);
 			clReleaseKernel(cl_kernel);
 			return -1;
@@ -341,9 +437,16 @@ int opencl_brute_force_P2D_M2sM_vel_impl(
 		assert(status == CL_SUCCESS);
 
 		/* Generate a results buffer */
-		res_buff_data = malloc(num_mes * n_particle_groups * sizeof(cl_float2));
-		res_buff = clCreateBuffer(context, CL_MEM_WRITE_ONLY,
-			sizeof(cl_float2) * num_mes * n_particle_groups, NULL, &status);
+		res_buff_data = opencl_host_alloc(num_mes * n_particle_groups * sizeof(cl_float2));
+		if (res_buff_data == NULL) {
+			clFinish(queue);
+			workspace_reset(ws_mark);
+			clReleaseMemObject(mes_pos_buff);
+			clReleaseKernel(cl_kernel);
+			return -1;
+		}
+		res_buff = opencl_create_host_buffer(context, zero_copy, CL_MEM_WRITE_ONLY,
+			sizeof(cl_float2) * num_mes * n_particle_groups, res_buff_data, &status);
 		if (status != CL_SUCCESS) {
 			assert(0);
 		}
@@ -357,8 +460,16 @@ int opencl_brute_force_P2D_M2sM_vel_impl(
 		}
 		n_modelled_particles = CVTX_WORKGROUP_SIZE * n_particle_groups;
 		assert(n_modelled_particles >= num_particles);
-		part_pos_buff_data = malloc(n_modelled_particles * sizeof(cl_float2));
-		part_vort_buff_data = malloc(n_modelled_particles * sizeof(cl_float));
+		part_pos_buff_data = opencl_host_alloc(n_modelled_particles * sizeof(cl_float2));
+		part_vort_buff_data = opencl_host_alloc(n_modelled_particles * sizeof(cl_float));
+		if (part_pos_buff_data == NULL || part_vort_buff_data == NULL) {
+			clFinish(queue);
+			workspace_reset(ws_mark);
+			clReleaseMemObject(res_buff);
+			clReleaseMemObject(mes_pos_buff);
+			clReleaseKernel(cl_kernel);
+			return -1;
+		}
 		for (i = 0; i < num_particles; ++i) {
 			part_pos_buff_data[i].x = array_start[i]->coord.x[0];
 			part_pos_buff_data[i].y = array_start[i]->coord.x[1];
@@ -370,19 +481,19 @@ int opencl_brute_force_P2D_M2sM_vel_impl(
 			part_pos_buff_data[i].y = 0.f;
 			part_vort_buff_data[i] = 0.f;
 		}
-		part_pos_buff = clCreateBuffer(context,
-			CL_MEM_READ_ONLY, n_modelled_particles * sizeof(cl_float2), NULL, &status);
-		status = clEnqueueWriteBuffer(
-			queue, part_pos_buff, CL_FALSE,
-			0, n_modelled_particles * sizeof(cl_float2), part_pos_buff_data, 0, NULL, NULL);
+		part_pos_buff = opencl_create_host_buffer(context, zero_copy,
+			CL_MEM_READ_ONLY, n_modelled_particles * sizeof(cl_float2), part_pos_buff_data, &status);
+		status = opencl_write_host_buffer(
+			queue, zero_copy, part_pos_buff, CL_FALSE,
+			n_modelled_particles * sizeof(cl_float2), part_pos_buff_data, 0, NULL, NULL);
 		assert(status == CL_SUCCESS);
 		status = clSetKernelArg(cl_kernel, 0, sizeof(cl_mem), &part_pos_buff);
 
-		part_vort_buff = clCreateBuffer(context,
-			CL_MEM_READ_ONLY, n_modelled_particles * sizeof(cl_float), NULL, &status);
-		status = clEnqueueWriteBuffer(
-			queue, part_vort_buff, CL_FALSE,
-			0, n_modelled_particles * sizeof(cl_float), part_vort_buff_data, 0, NULL, NULL);
+		part_vort_buff = opencl_create_host_buffer(context, zero_copy,
+			CL_MEM_READ_ONLY, n_modelled_particles * sizeof(cl_float), part_vort_buff_data, &status);
+		status = opencl_write_host_buffer(
+			queue, zero_copy, part_vort_buff, CL_FALSE,
+			n_modelled_particles * sizeof(cl_float), part_vort_buff_data, 0, NULL, NULL);
 		assert(status == CL_SUCCESS);
 		status = clSetKernelArg(cl_kernel, 1, sizeof(cl_mem), &part_vort_buff);
 		assert(status == CL_SUCCESS);
@@ -393,9 +504,19 @@ int opencl_brute_force_P2D_M2sM_vel_impl(
 		assert(status == CL_SUCCESS);
 
 		/* Read back our results! */
-		clEnqueueReadBuffer(queue, res_buff, CL_TRUE, 0,
+		status = opencl_read_host_buffer(queue, zero_copy, res_buff,
 			sizeof(cl_float2) * num_mes * n_particle_groups, res_buff_data, 0,
-			NULL, NULL);
+			NULL);
+		if (status != CL_SUCCESS) {
+			clFinish(queue);
+			workspace_reset(ws_mark);
+			clReleaseMemObject(part_vort_buff);
+			clReleaseMemObject(part_pos_buff);
+			clReleaseMemObject(res_buff);
+			clReleaseMemObject(mes_pos_buff);
+			clReleaseKernel(cl_kernel);
+			return -1;
+		}
 		for (i = 0; i < num_mes; ++i) {
 			/* Constant multiplyer is constant the 1/2pi term. */
 			result_array[i].x[0] = res_buff_data[i].x * constant_multiplyer;
@@ -406,10 +527,8 @@ int opencl_brute_force_P2D_M2sM_vel_impl(
 			result_array[i % num_mes].x[0] += res_buff_data[i].x * constant_multiplyer;
 			result_array[i % num_mes].x[1] += res_buff_data[i].y * constant_multiplyer;
 		}
-		free(res_buff_data);
+		workspace_reset(ws_mark);
 
-		free(part_vort_buff_data);
-		free(mes_pos_buff_data);
 		clReleaseMemObject(res_buff);
 		clReleaseMemObject(mes_pos_buff);
 		clReleaseMemObject(part_pos_buff);
@@ -432,6 +551,7 @@ int opencl_brute_force_P2D_M2M_visc_dvort_impl(
 	const cvtx_VortFunc *kernel,
 	float regularisation_radius,
 	float kinematic_visc,
+	int group_size,
 	cl_program program,
 	cl_command_queue queue,
 	cl_context context)
@@ -445,6 +565,10 @@ int opencl_brute_force_P2D_M2M_visc_dvort_impl(
 	cl_mem res_buff, *part1_pos_buff, *part1_vort_buff, *part1_area_buff,
 		part2_pos_buff, part2_vort_buff, part2_area_buff;
 	cl_int status;
+	int zero_copy;	/* Buffers use host memory directly. */
+	int max_groups;	/* Source groups on the device at once. */
+	cl_command_queue transfer_queue;
+	size_t ws_mark;	/* To release scratch memory. */
 	cl_kernel cl_kernel;
 	cl_event *event_chain;
 
@@ -457,15 +581,25 @@ int opencl_brute_force_P2D_M2M_visc_dvort_impl(
 			return -1;
 		}
 		/* This has to match the opencl kernels, so be careful with fiddling */
-		workgroup_size[0] = CVTX_WORKGROUP_SIZE;	/* Particles per group */
+		workgroup_size[0] = group_size;	/* Particles per group */
 		workgroup_size[1] = 1;	/* Only 1 induced particle pos per workgroup. */
-		global_work_size[0] = CVTX_WORKGROUP_SIZE;	/* We use multiple inducing particle buffers */
+		global_work_size[0] = group_size;	/* We use multiple inducing particle buffers */
 		global_work_size[1] = num_induced;
 
 		/* Generate buffers for induced particle data  */
-		part2_pos_buff_data = malloc(num_induced * sizeof(cl_float2));
-		part2_vort_buff_data = malloc(num_induced * sizeof(cl_float));
-		part2_area_buff_data = malloc(num_induced * sizeof(cl_float));
+		zero_copy = opencl_queue_zero_copy(queue);
+		transfer_queue = opencl_transfer_queue(queue);
+		ws_mark = workspace_mark();
+		part2_pos_buff_data = opencl_host_alloc(num_induced * sizeof(cl_float2));
+		part2_vort_buff_data = opencl_host_alloc(num_induced * sizeof(cl_float));
+		part2_area_buff_data = opencl_host_alloc(num_induced * sizeof(cl_float));
+		if (part2_pos_buff_data == NULL
+			|| part2_vort_buff_data == NULL
+			|| part2_area_buff_data == NULL) {
+			workspace_reset(ws_mark);
+			clReleaseKernel(cl_kernel);
+			return -1;
+		}
 		for (i = 0; i < num_induced; ++i) {
 			part2_pos_buff_data[i].x = induced_start[i]->coord.x[0];
 			part2_pos_buff_data[i].y = induced_start[i]->coord.x[1];
@@ -473,41 +607,50 @@ int opencl_brute_force_P2D_M2M_visc_dvort_impl(
 			part2_area_buff_data[i] = induced_start[i]->area;
 		}
 		/* Induced particle Create buffer, enqueue write and set kernel arg. */
-		part2_pos_buff = clCreateBuffer(context,
-			CL_MEM_READ_ONLY, num_induced * sizeof(cl_float2), NULL, &status);
-		status = clEnqueueWriteBuffer(
-			queue, part2_pos_buff, CL_TRUE,
-			0, num_induced * sizeof(cl_float2), part2_pos_buff_data, 0, NULL, NULL);
+		part2_pos_buff = opencl_create_host_buffer(context, zero_copy,
+			CL_MEM_READ_ONLY, num_induced * sizeof(cl_float2), part2_pos_buff_data, &status);
+		status = opencl_write_host_buffer(
+			queue, zero_copy, part2_pos_buff, CL_TRUE,
+			num_induced * sizeof(cl_float2), part2_pos_buff_data, 0, NULL, NULL);
 		assert(status == CL_SUCCESS);
 		status = clSetKernelArg(cl_kernel, 3, sizeof(cl_mem), &part2_pos_buff);
 		assert(status == CL_SUCCESS);
-		part2_vort_buff = clCreateBuffer(context,
-			CL_MEM_READ_ONLY, num_induced * sizeof(cl_float), NULL, &status);
-		status = clEnqueueWriteBuffer(
-			queue, part2_vort_buff, CL_TRUE,
-			0, num_induced * sizeof(cl_float), part2_vort_buff_data, 0, NULL, NULL);
+		part2_vort_buff = opencl_create_host_buffer(context, zero_copy,
+			CL_MEM_READ_ONLY, num_induced * sizeof(cl_float), part2_vort_buff_data, &status);
+		status = opencl_write_host_buffer(
+			queue, zero_copy, part2_vort_buff, CL_TRUE,
+			num_induced * sizeof(cl_float), part2_vort_buff_data, 0, NULL, NULL);
 		assert(status == CL_SUCCESS);
 		status = clSetKernelArg(cl_kernel, 4, sizeof(cl_mem), &part2_vort_buff);
 		assert(status == CL_SUCCESS);
-		part2_area_buff = clCreateBuffer(context,
-			CL_MEM_READ_ONLY, num_induced * sizeof(cl_float), NULL, &status);
-		status = clEnqueueWriteBuffer(
-			queue, part2_area_buff, CL_TRUE,
-			0, num_induced * sizeof(cl_float), part2_area_buff_data, 0, NULL, NULL);
+		part2_area_buff = opencl_create_host_buffer(context, zero_copy,
+			CL_MEM_READ_ONLY, num_induced * sizeof(cl_float), part2_area_buff_data, &status);
+		status = opencl_write_host_buffer(
+			queue, zero_copy, part2_area_buff, CL_TRUE,
+			num_induced * sizeof(cl_float), part2_area_buff_data, 0, NULL, NULL);
 		assert(status == CL_SUCCESS);
 		status = clSetKernelArg(cl_kernel, 5, sizeof(cl_mem), &part2_area_buff);
 		assert(status == CL_SUCCESS);
 
 		/* Generate a results buffer										*/
-		res_buff_data = malloc(num_induced * sizeof(cl_float));
-		res_buff = clCreateBuffer(context, CL_MEM_READ_WRITE,
-			sizeof(cl_float3) * num_induced, NULL, &status);
+		res_buff_data = opencl_host_alloc(num_induced * sizeof(cl_float));
+		if (res_buff_data == NULL) {
+			clFinish(queue);
+			workspace_reset(ws_mark);
+			clReleaseMemObject(part2_area_buff);
+			clReleaseMemObject(part2_vort_buff);
+			clReleaseMemObject(part2_pos_buff);
+			clReleaseKernel(cl_kernel);
+			return -1;
+		}
 		for (i = 0; i < num_induced; ++i) {
 			res_buff_data[i] = 0;
 		}
-		status = clEnqueueWriteBuffer(
-			queue, res_buff, CL_TRUE,
-			0, num_induced * sizeof(cl_float), res_buff_data, 0, NULL, NULL);
+		res_buff = opencl_create_host_buffer(context, zero_copy, CL_MEM_READ_WRITE,
+			sizeof(cl_float) * num_induced, res_buff_data, &status);
+		status = opencl_write_host_buffer(
+			queue, zero_copy, res_buff, CL_TRUE,
+			num_induced * sizeof(cl_float), res_buff_data, 0, NULL, NULL);
 		if (status != CL_SUCCESS) {
 			assert(0);
 		}
@@ -523,18 +666,30 @@ int opencl_brute_force_P2D_M2M_visc_dvort_impl(
 		assert(status == CL_SUCCESS);
 
 		/* Now create & dispatch particle buffers and kernel.
-		Inducing particle count needs to be a multiple of the CVTX_WORKGROUP_SIZE,
+		Inducing particle count needs to be a multiple of the group_size,
 		so we add some zerod particles onto the end of the array. */
-		n_particle_groups = num_particles / CVTX_WORKGROUP_SIZE;
-		if (num_particles % CVTX_WORKGROUP_SIZE) {
-			n_zeroed_particles = CVTX_WORKGROUP_SIZE
-				- num_particles % CVTX_WORKGROUP_SIZE;
+		n_particle_groups = num_particles / group_size;
+		if (num_particles % group_size) {
+			n_zeroed_particles = group_size
+				- num_particles % group_size;
 			n_particle_groups += 1;
 		}
-		n_modelled_particles = CVTX_WORKGROUP_SIZE * n_particle_groups;
-		part1_pos_buff_data = malloc(n_modelled_particles * sizeof(cl_float2));
-		part1_vort_buff_data = malloc(n_modelled_particles * sizeof(cl_float));
-		part1_area_buff_data = malloc(n_modelled_particles * sizeof(cl_float));
+		n_modelled_particles = group_size * n_particle_groups;
+		part1_pos_buff_data = opencl_host_alloc(n_modelled_particles * sizeof(cl_float2));
+		part1_vort_buff_data = opencl_host_alloc(n_modelled_particles * sizeof(cl_float));
+		part1_area_buff_data = opencl_host_alloc(n_modelled_particles * sizeof(cl_float));
+		if (part1_pos_buff_data == NULL
+			|| part1_vort_buff_data == NULL
+			|| part1_area_buff_data == NULL) {
+			clFinish(queue);
+			workspace_reset(ws_mark);
+			clReleaseMemObject(res_buff);
+			clReleaseMemObject(part2_area_buff);
+			clReleaseMemObject(part2_vort_buff);
+			clReleaseMemObject(part2_pos_buff);
+			clReleaseKernel(cl_kernel);
+			return -1;
+		}
 		for (i = 0; i < num_particles; ++i) {
 			part1_pos_buff_data[i].x = array_start[i]->coord.x[0];
 			part1_pos_buff_data[i].y = array_start[i]->coord.x[1];
@@ -552,30 +707,39 @@ int opencl_brute_force_P2D_M2M_visc_dvort_impl(
 		part1_vort_buff = malloc(n_particle_groups * sizeof(cl_mem));
 		part1_area_buff = malloc(n_particle_groups * sizeof(cl_mem));
 		event_chain = malloc(sizeof(cl_event) * n_particle_groups * 4);
+		max_groups = opencl_chunk_items(queue,
+			group_size * 3 * sizeof(cl_float3));
 		for (i = 0; i < n_particle_groups; ++i) {
-			part1_pos_buff[i] = clCreateBuffer(context,
-				CL_MEM_READ_ONLY, CVTX_WORKGROUP_SIZE * sizeof(cl_float2), NULL, &status);
+			if (i >= max_groups) {
+				/* Bound the device memory taken by source buffers. */
+				clWaitForEvents(1, event_chain + 4 * (i - max_groups) + 3);
+			}
+			part1_pos_buff[i] = opencl_create_host_buffer(context, zero_copy,
+				CL_MEM_READ_ONLY, group_size * sizeof(cl_float2),
+				part1_pos_buff_data + i * group_size, &status);
 			assert(status == CL_SUCCESS);
-			status = clEnqueueWriteBuffer(
-				queue, part1_pos_buff[i], CL_FALSE,
-				0, CVTX_WORKGROUP_SIZE * sizeof(cl_float2),
-				part1_pos_buff_data + i * CVTX_WORKGROUP_SIZE, 0, NULL, event_chain + 4 * i);
+			status = opencl_write_host_buffer(
+				transfer_queue, zero_copy, part1_pos_buff[i], CL_FALSE,
+				group_size * sizeof(cl_float2),
+				part1_pos_buff_data + i * group_size, 0, NULL, event_chain + 4 * i);
 			assert(status == CL_SUCCESS);
-			part1_vort_buff[i] = clCreateBuffer(context,
-				CL_MEM_READ_ONLY, CVTX_WORKGROUP_SIZE * sizeof(cl_float), NULL, &status);
+			part1_vort_buff[i] = opencl_create_host_buffer(context, zero_copy,
+				CL_MEM_READ_ONLY, group_size * sizeof(cl_float),
+				part1_vort_buff_data + i * group_size, &status);
 			assert(status == CL_SUCCESS);
-			status = clEnqueueWriteBuffer(
-				queue, part1_vort_buff[i], CL_FALSE,
-				0, CVTX_WORKGROUP_SIZE * sizeof(cl_float),
-				part1_vort_buff_data + i * CVTX_WORKGROUP_SIZE, 0, NULL, event_chain + 4 * i + 1);
+			status = opencl_write_host_buffer(
+				transfer_queue, zero_copy, part1_vort_buff[i], CL_FALSE,
+				group_size * sizeof(cl_float),
+				part1_vort_buff_data + i * group_size, 0, NULL, event_chain + 4 * i + 1);
 			assert(status == CL_SUCCESS);
-			part1_area_buff[i] = clCreateBuffer(context,
-				CL_MEM_READ_ONLY, CVTX_WORKGROUP_SIZE * sizeof(cl_float), NULL, &status);
+			part1_area_buff[i] = opencl_create_host_buffer(context, zero_copy,
+				CL_MEM_READ_ONLY, group_size * sizeof(cl_float),
+				part1_area_buff_data + i * group_size, &status);
 			assert(status == CL_SUCCESS);
-			status = clEnqueueWriteBuffer(
-				queue, part1_area_buff[i], CL_FALSE,
-				0, CVTX_WORKGROUP_SIZE * sizeof(cl_float),
-				part1_area_buff_data + i * CVTX_WORKGROUP_SIZE, 0, NULL, event_chain + 4 * i + 2);
+			status = opencl_write_host_buffer(
+				transfer_queue, zero_copy, part1_area_buff[i], CL_FALSE,
+				group_size * sizeof(cl_float),
+				part1_area_buff_data + i * group_size, 0, NULL, event_chain + 4 * i + 2);
 			assert(status == CL_SUCCESS);
 			status = clSetKernelArg(cl_kernel, 0, sizeof(cl_mem), part1_pos_buff + i);
 			assert(status == CL_SUCCESS);
@@ -583,6 +747,7 @@ int opencl_brute_force_P2D_M2M_visc_dvort_impl(
 			assert(status == CL_SUCCESS);
 			status = clSetKernelArg(cl_kernel, 2, sizeof(cl_mem), part1_area_buff + i);
 			assert(status == CL_SUCCESS);
+			clFlush(transfer_queue);
 			if (i == 0) {
 				status = clEnqueueNDRangeKernel(queue, cl_kernel, 2,
 					NULL, global_work_size, workgroup_size, 3, event_chain + 4 * i, event_chain + 4 * i + 3);
@@ -598,25 +763,32 @@ int opencl_brute_force_P2D_M2M_visc_dvort_impl(
 		}
 
 		/* Read back our results! */
-		clEnqueueReadBuffer(queue, res_buff, CL_TRUE, 0,
+		status = opencl_read_host_buffer(queue, zero_copy, res_buff,
 			sizeof(cl_float) * num_induced, res_buff_data, 1,
-			event_chain + 4 * n_particle_groups - 1, NULL);
-		for (i = 0; i < n_particle_groups * 4; ++i) { clReleaseEvent(event_chain[i]); }
+			event_chain + 4 * n_particle_groups - 1);
+		opencl_release_events(event_chain, n_particle_groups * 4);
 		free(event_chain);	/* Its tempting to do this earlier, but remember, this is asynchonous! */
+		if (status != CL_SUCCESS) {
+			clFinish(queue);
+			workspace_reset(ws_mark);
+			free(part1_pos_buff);
+			free(part1_vort_buff);
+			free(part1_area_buff);
+			clReleaseMemObject(res_buff);
+			clReleaseMemObject(part2_area_buff);
+			clReleaseMemObject(part2_vort_buff);
+			clReleaseMemObject(part2_pos_buff);
+			clReleaseKernel(cl_kernel);
+			return -1;
+		}
 		for (i = 0; i < num_induced; ++i) {
 			result_array[i] = res_buff_data[i];
 		}
-		free(res_buff_data);
+		workspace_reset(ws_mark);
 
 		free(part1_pos_buff);
 		free(part1_vort_buff);
 		free(part1_area_buff);
-		free(part2_pos_buff_data);
-		free(part2_vort_buff_data);
-		free(part2_area_buff_data);
-		free(part1_pos_buff_data);
-		free(part1_vort_buff_data);
-		free(part1_area_buff_data);
 		clReleaseMemObject(res_buff);
 		clReleaseMemObject(part2_pos_buff);
 		clReleaseMemObject(part2_vort_buff);
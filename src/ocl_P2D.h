@@ -57,6 +57,8 @@ int opencl_brute_force_P2D_M2M_vel_impl(
 	bsv_V2f *result_array,
 	const cvtx_VortFunc *kernel,
 	float regularisation_radius,
+	int group_size,
+	int compensated,
 	cl_program program,
 	cl_command_queue queue,
 	cl_context context);
@@ -83,6 +85,7 @@ int opencl_brute_force_P2D_M2M_visc_dvort_impl(
 	const cvtx_VortFunc *kernel,
 	float regularisation_radius,
 	float kinematic_visc,
+	int group_size,
 	cl_program program,
 	cl_command_queue queue,
 	cl_context context);
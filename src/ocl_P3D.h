@@ -39,6 +39,16 @@ int opencl_brute_force_P3D_M2M_vel(
 	const cvtx_VortFunc *kernel,
 	float regularisation_radius);
 
+int opencl_brute_force_P3D_M2M_vel_grad(
+	const cvtx_P3D **array_start,
+	const int num_particles,
+	const bsv_V3f *mes_start,
+	const int num_mes,
+	bsv_V3f *result_array,
+	bsv_V3f *grad_result_array,
+	const cvtx_VortFunc *kernel,
+	float regularisation_radius);
+
 int opencl_brute_force_P3D_M2M_dvort(
 	const cvtx_P3D **array_start,
 	const int num_particles,
@@ -75,6 +85,22 @@ int opencl_brute_force_P3D_M2M_vel_impl(
 	bsv_V3f *result_array,
 	const cvtx_VortFunc *kernel,
 	float regularisation_radius,
+	int group_size,
+	int compensated,
+	cl_program program,
+	cl_command_queue queue,
+	cl_context context);
+
+int opencl_brute_force_P3D_M2M_vel_grad_impl(
+	const cvtx_P3D **array_start,
+	const int num_particles,
+	const bsv_V3f *mes_start,
+	const int num_mes,
+	bsv_V3f *result_array,
+	bsv_V3f *grad_result_array,
+	const cvtx_VortFunc *kernel,
+	float regularisation_radius,
+	int group_size,
 	cl_program program,
 	cl_command_queue queue,
 	cl_context context);
@@ -87,6 +113,8 @@ int opencl_brute_force_P3D_M2M_dvort_impl(
 	bsv_V3f *result_array,
 	const cvtx_VortFunc *kernel,
 	float regularisation_radius,
+	int group_size,
+	int compensated,
 	cl_program program,
 	cl_command_queue queue,
 	cl_context context);
@@ -100,6 +128,7 @@ int opencl_brute_force_P3D_M2M_visc_dvort_impl(
 	const cvtx_VortFunc *kernel,
 	float regularisation_radius,
 	float kinematic_visc,
+	int group_size,
 	cl_program program,
 	cl_command_queue queue,
 	cl_context context);
@@ -112,6 +141,7 @@ int opencl_brute_force_P3D_M2M_vort_impl(
 	bsv_V3f* result_array,
 	const cvtx_VortFunc* kernel,
 	float regularisation_radius,
+	int group_size,
 	cl_program program,
 	cl_command_queue queue,
 	cl_context context);
@@ -0,0 +1,459 @@
+#include "ocl_double.h"
+/*============================================================================
+ocl_double.c
+
+Handles the opencl accelerated double precision methods.
+
+Copyright(c) 2019 HJA Bird
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files(the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+============================================================================*/
+#ifdef CVTX_USING_OPENCL
+#include <assert.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "opencl_acc.h"
+#include "vortfunc_builtin.h"
+#include "workspace.h"
+
+/* A buffer argument of a kernel as packed host data. For sources, there
+is one item per source, zero padded to a multiple of the workgroup size. */
+struct double_arg {
+	void *data;
+	size_t item_bytes;
+};
+
+/*
+All the double precision kernels take their arguments in the order
+	(sources..., [recip_reg_rad], targets..., results)
+and accumulate into results one workgroup of sources at a time, as the
+single precision kernels do. Runs kernel_name of the double precision
+program over all the targets and writes the unscaled results to
+result_data, which has the same item size as the first target arg.
+use_recip is 0 for kernels without recip_reg_rad.
+*/
+static int double_m2m(
+	const char *kernel_name,
+	int num_sources,
+	const struct double_arg *sources,
+	int num_source_args,
+	int use_recip,
+	cl_double recip_reg_rad,
+	int num_targets,
+	const struct double_arg *targets,
+	int num_target_args,
+	void *result_data);
+
+/* The number of sources including zero padding to fill the last group. */
+static int padded_sources(int num_sources);
+
+int opencl_brute_force_P3Dd_M2M_vel(
+	const cvtx_P3Dd **array_start,
+	const int num_particles,
+	const cvtx_V3d *mes_start,
+	const int num_mes,
+	cvtx_V3d *result_array,
+	const cvtx_VortFunc *kernel,
+	double regularisation_radius)
+{
+	char kernel_name[128] = "cvtx_nb_P3D_vel_";
+	struct double_arg sources[2], targets[1];
+	cl_double3 *part_pos, *part_vort, *mes_pos, *res;
+	double constant_multiplyer = 1. / (4. * acos(-1.));
+	int i, n_padded, retv;
+	size_t ws_mark;
+
+	if (vortfunc_builtin_index(kernel) < 0) { return -1; }
+	strncat(kernel_name, kernel->cl_kernel_name_ext, 32);
+	ws_mark = workspace_mark();
+	n_padded = padded_sources(num_particles);
+	part_pos = opencl_host_alloc(n_padded * sizeof(cl_double3));
+	part_vort = opencl_host_alloc(n_padded * sizeof(cl_double3));
+	mes_pos = opencl_host_alloc(num_mes * sizeof(cl_double3));
+	res = opencl_host_alloc(num_mes * sizeof(cl_double3));
+	if (part_pos == NULL || part_vort == NULL || mes_pos == NULL
+		|| res == NULL) {
+		workspace_reset(ws_mark);
+		return -1;
+	}
+	memset(part_pos, 0, n_padded * sizeof(cl_double3));
+	memset(part_vort, 0, n_padded * sizeof(cl_double3));
+	for (i = 0; i < num_particles; ++i) {
+		part_pos[i].x = array_start[i]->coord.x[0];
+		part_pos[i].y = array_start[i]->coord.x[1];
+		part_pos[i].z = array_start[i]->coord.x[2];
+		part_vort[i].x = array_start[i]->vorticity.x[0];
+		part_vort[i].y = array_start[i]->vorticity.x[1];
+		part_vort[i].z = array_start[i]->vorticity.x[2];
+	}
+	for (i = 0; i < num_mes; ++i) {
+		mes_pos[i].x = mes_start[i].x[0];
+		mes_pos[i].y = mes_start[i].x[1];
+		mes_pos[i].z = mes_start[i].x[2];
+	}
+	sources[0].data = part_pos;
+	sources[0].item_bytes = sizeof(cl_double3);
+	sources[1].data = part_vort;
+	sources[1].item_bytes = sizeof(cl_double3);
+	targets[0].data = mes_pos;
+	targets[0].item_bytes = sizeof(cl_double3);
+	retv = double_m2m(kernel_name, num_particles, sources, 2,
+		1, 1. / regularisation_radius, num_mes, targets, 1, res);
+	if (retv == 0) {
+		for (i = 0; i < num_mes; ++i) {
+			/* Constant multiplyer is constant the 1/4pi term. */
+			result_array[i].x[0] = res[i].x * constant_multiplyer;
+			result_array[i].x[1] = res[i].y * constant_multiplyer;
+			result_array[i].x[2] = res[i].z * constant_multiplyer;
+		}
+	}
+	workspace_reset(ws_mark);
+	return retv;
+}
+
+int opencl_brute_force_P3Dd_M2M_dvort(
+	const cvtx_P3Dd **array_start,
+	const int num_particles,
+	const cvtx_P3Dd **induced_start,
+	const int num_induced,
+	cvtx_V3d *result_array,
+	const cvtx_VortFunc *kernel,
+	double regularisation_radius)
+{
+	char kernel_name[128] = "cvtx_nb_P3D_dvort_";
+	struct double_arg sources[2], targets[2];
+	cl_double3 *part_pos, *part_vort, *ind_pos, *ind_vort, *res;
+	double constant_multiplyer = 1. / (4. * acos(-1.)
+		* regularisation_radius * regularisation_radius * regularisation_radius);
+	int i, n_padded, retv;
+	size_t ws_mark;
+
+	if (vortfunc_builtin_index(kernel) < 0) { return -1; }
+	strncat(kernel_name, kernel->cl_kernel_name_ext, 32);
+	ws_mark = workspace_mark();
+	n_padded = padded_sources(num_particles);
+	part_pos = opencl_host_alloc(n_padded * sizeof(cl_double3));
+	part_vort = opencl_host_alloc(n_padded * sizeof(cl_double3));
+	ind_pos = opencl_host_alloc(num_induced * sizeof(cl_double3));
+	ind_vort = opencl_host_alloc(num_induced * sizeof(cl_double3));
+	res = opencl_host_alloc(num_induced * sizeof(cl_double3));
+	if (part_pos == NULL || part_vort == NULL || ind_pos == NULL
+		|| ind_vort == NULL || res == NULL) {
+		workspace_reset(ws_mark);
+		return -1;
+	}
+	memset(part_pos, 0, n_padded * sizeof(cl_double3));
+	memset(part_vort, 0, n_padded * sizeof(cl_double3));
+	for (i = 0; i < num_particles; ++i) {
+		part_pos[i].x = array_start[i]->coord.x[0];
+		part_pos[i].y = array_start[i]->coord.x[1];
+		part_pos[i].z = array_start[i]->coord.x[2];
+		part_vort[i].x = array_start[i]->vorticity.x[0];
+		part_vort[i].y = array_start[i]->vorticity.x[1];
+		part_vort[i].z = array_start[i]->vorticity.x[2];
+	}
+	for (i = 0; i < num_induced; ++i) {
+		ind_pos[i].x = induced_start[i]->coord.x[0];
+		ind_pos[i].y = induced_start[i]->coord.x[1];
+		ind_pos[i].z = induced_start[i]->coord.x[2];
+		ind_vort[i].x = induced_start[i]->vorticity.x[0];
+		ind_vort[i].y = induced_start[i]->vorticity.x[1];
+		ind_vort[i].z = induced_start[i]->vorticity.x[2];
+	}
+	sources[0].data = part_pos;
+	sources[0].item_bytes = sizeof(cl_double3);
+	sources[1].data = part_vort;
+	sources[1].item_bytes = sizeof(cl_double3);
+	targets[0].data = ind_pos;
+	targets[0].item_bytes = sizeof(cl_double3);
+	targets[1].data = ind_vort;
+	targets[1].item_bytes = sizeof(cl_double3);
+	retv = double_m2m(kernel_name, num_particles, sources, 2,
+		1, 1. / regularisation_radius, num_induced, targets, 2, res);
+	if (retv == 0) {
+		for (i = 0; i < num_induced; ++i) {
+			/* Constant multiplyer is the 1/(4 pi reg_rad^3) term. */
+			result_array[i].x[0] = res[i].x * constant_multiplyer;
+			result_array[i].x[1] = res[i].y * constant_multiplyer;
+			result_array[i].x[2] = res[i].z * constant_multiplyer;
+		}
+	}
+	workspace_reset(ws_mark);
+	return retv;
+}
+
+int opencl_brute_force_F3Dd_M2M_vel(
+	const cvtx_F3Dd **array_start,
+	const int num_filaments,
+	const cvtx_V3d *mes_start,
+	const int num_mes,
+	cvtx_V3d *result_array)
+{
+	struct double_arg sources[3], targets[1];
+	cl_double3 *fil_start, *fil_end, *mes_pos, *res;
+	cl_double *fil_str;
+	int i, n_padded, retv;
+	size_t ws_mark;
+
+	ws_mark = workspace_mark();
+	n_padded = padded_sources(num_filaments);
+	fil_start = opencl_host_alloc(n_padded * sizeof(cl_double3));
+	fil_end = opencl_host_alloc(n_padded * sizeof(cl_double3));
+	fil_str = opencl_host_alloc(n_padded * sizeof(cl_double));
+	mes_pos = opencl_host_alloc(num_mes * sizeof(cl_double3));
+	res = opencl_host_alloc(num_mes * sizeof(cl_double3));
+	if (fil_start == NULL || fil_end == NULL || fil_str == NULL
+		|| mes_pos == NULL || res == NULL) {
+		workspace_reset(ws_mark);
+		return -1;
+	}
+	/* Padding filaments have zero length and strength. */
+	memset(fil_start, 0, n_padded * sizeof(cl_double3));
+	memset(fil_end, 0, n_padded * sizeof(cl_double3));
+	memset(fil_str, 0, n_padded * sizeof(cl_double));
+	for (i = 0; i < num_filaments; ++i) {
+		fil_start[i].x = array_start[i]->start.x[0];
+		fil_start[i].y = array_start[i]->start.x[1];
+		fil_start[i].z = array_start[i]->start.x[2];
+		fil_end[i].x = array_start[i]->end.x[0];
+		fil_end[i].y = array_start[i]->end.x[1];
+		fil_end[i].z = array_start[i]->end.x[2];
+		fil_str[i] = array_start[i]->strength;
+	}
+	for (i = 0; i < num_mes; ++i) {
+		mes_pos[i].x = mes_start[i].x[0];
+		mes_pos[i].y = mes_start[i].x[1];
+		mes_pos[i].z = mes_start[i].x[2];
+	}
+	sources[0].data = fil_start;
+	sources[0].item_bytes = sizeof(cl_double3);
+	sources[1].data = fil_end;
+	sources[1].item_bytes = sizeof(cl_double3);
+	sources[2].data = fil_str;
+	sources[2].item_bytes = sizeof(cl_double);
+	targets[0].data = mes_pos;
+	targets[0].item_bytes = sizeof(cl_double3);
+	retv = double_m2m("cvtx_nb_Filament_ind_vel_singular", num_filaments,
+		sources, 3, 0, 0., num_mes, targets, 1, res);
+	if (retv == 0) {
+		for (i = 0; i < num_mes; ++i) {
+			result_array[i].x[0] = res[i].x;
+			result_array[i].x[1] = res[i].y;
+			result_array[i].x[2] = res[i].z;
+		}
+	}
+	workspace_reset(ws_mark);
+	return retv;
+}
+
+int opencl_brute_force_P2Dd_M2M_vel(
+	const cvtx_P2Dd **array_start,
+	const int num_particles,
+	const cvtx_V2d *mes_start,
+	const int num_mes,
+	cvtx_V2d *result_array,
+	const cvtx_VortFunc *kernel,
+	double regularisation_radius)
+{
+	char kernel_name[128] = "cvtx_nb_P2D_vel_";
+	struct double_arg sources[2], targets[1];
+	cl_double2 *part_pos, *mes_pos, *res;
+	cl_double *part_vort;
+	double constant_multiplyer = 1. / (2. * acos(-1.));
+	int i, n_padded, retv;
+	size_t ws_mark;
+
+	if (vortfunc_builtin_index(kernel) < 0) { return -1; }
+	strncat(kernel_name, kernel->cl_kernel_name_ext, 32);
+	ws_mark = workspace_mark();
+	n_padded = padded_sources(num_particles);
+	part_pos = opencl_host_alloc(n_padded * sizeof(cl_double2));
+	part_vort = opencl_host_alloc(n_padded * sizeof(cl_double));
+	mes_pos = opencl_host_alloc(num_mes * sizeof(cl_double2));
+	res = opencl_host_alloc(num_mes * sizeof(cl_double2));
+	if (part_pos == NULL || part_vort == NULL || mes_pos == NULL
+		|| res == NULL) {
+		workspace_reset(ws_mark);
+		return -1;
+	}
+	memset(part_pos, 0, n_padded * sizeof(cl_double2));
+	memset(part_vort, 0, n_padded * sizeof(cl_double));
+	for (i = 0; i < num_particles; ++i) {
+		part_pos[i].x = array_start[i]->coord.x[0];
+		part_pos[i].y = array_start[i]->coord.x[1];
+		part_vort[i] = array_start[i]->vorticity;
+	}
+	for (i = 0; i < num_mes; ++i) {
+		mes_pos[i].x = mes_start[i].x[0];
+		mes_pos[i].y = mes_start[i].x[1];
+	}
+	sources[0].data = part_pos;
+	sources[0].item_bytes = sizeof(cl_double2);
+	sources[1].data = part_vort;
+	sources[1].item_bytes = sizeof(cl_double);
+	targets[0].data = mes_pos;
+	targets[0].item_bytes = sizeof(cl_double2);
+	retv = double_m2m(kernel_name, num_particles, sources, 2,
+		1, 1. / regularisation_radius, num_mes, targets, 1, res);
+	if (retv == 0) {
+		for (i = 0; i < num_mes; ++i) {
+			/* Constant multiplyer is the 1/2pi term. */
+			result_array[i].x[0] = res[i].x * constant_multiplyer;
+			result_array[i].x[1] = res[i].y * constant_multiplyer;
+		}
+	}
+	workspace_reset(ws_mark);
+	return retv;
+}
+
+/* STATIC FUNCTIONS ---------------------------------------------------------*/
+static int double_m2m(
+	const char *kernel_name,
+	int num_sources,
+	const struct double_arg *sources,
+	int num_source_args,
+	int use_recip,
+	cl_double recip_reg_rad,
+	int num_targets,
+	const struct double_arg *targets,
+	int num_target_args,
+	void *result_data)
+{
+	assert(opencl_is_init());
+	assert(num_source_args <= 3);
+	assert(num_target_args <= 2);
+	cl_program prog;
+	cl_context cont;
+	cl_command_queue queue;
+	cl_kernel cl_kernel;
+	cl_mem source_buffs[3], target_buffs[2], res_buff;
+	cl_event *kernel_events;
+	cl_int status = CL_SUCCESS;
+	size_t global_work_size[2], workgroup_size[2], target_bytes, source_bytes;
+	size_t result_bytes = targets[0].item_bytes;
+	int i, j, g, chunk, n_chunk, n_groups, max_groups, zero_copy;
+	int result_arg = num_source_args + use_recip + num_target_args;
+
+	if (opencl_num_active_devices() <= 0 ||
+		opencl_get_device_state(0, &prog, &cont, &queue) != 0) {
+		return -1;
+	}
+	prog = opencl_double_program(queue);
+	if (prog == NULL) { return -1; }
+	cl_kernel = clCreateKernel(prog, kernel_name, &status);
+	if (status != CL_SUCCESS) { return -1; }
+	if (use_recip) {
+		status = clSetKernelArg(cl_kernel, num_source_args,
+			sizeof(cl_double), &recip_reg_rad);
+		assert(status == CL_SUCCESS);
+	}
+	memset(result_data, 0, num_targets * result_bytes);
+	zero_copy = opencl_queue_zero_copy(queue);
+	n_groups = padded_sources(num_sources) / CVTX_WORKGROUP_SIZE;
+	source_bytes = target_bytes = 0;
+	for (j = 0; j < num_source_args; ++j) { source_bytes += sources[j].item_bytes; }
+	for (j = 0; j < num_target_args; ++j) { target_bytes += targets[j].item_bytes; }
+	max_groups = opencl_chunk_items(queue, CVTX_WORKGROUP_SIZE * source_bytes);
+	chunk = opencl_chunk_items(queue, target_bytes + result_bytes);
+	kernel_events = malloc(sizeof(cl_event) * n_groups);
+	/* This has to match the opencl kernels: one workgroup of sources per
+	launch and one target per workgroup. The queue is in order, so each
+	launch follows the uploads enqueued before it. */
+	workgroup_size[0] = CVTX_WORKGROUP_SIZE;
+	workgroup_size[1] = 1;
+	global_work_size[0] = CVTX_WORKGROUP_SIZE;
+
+	for (i = 0; i < num_targets && status == CL_SUCCESS; i += chunk) {
+		n_chunk = num_targets - i < chunk ? num_targets - i : chunk;
+		global_work_size[1] = n_chunk;
+		for (j = 0; j < num_target_args; ++j) {
+			target_buffs[j] = opencl_create_host_buffer(cont, zero_copy,
+				CL_MEM_READ_ONLY, n_chunk * targets[j].item_bytes,
+				(char*)targets[j].data + i * targets[j].item_bytes, &status);
+			assert(status == CL_SUCCESS);
+			status = opencl_write_host_buffer(queue, zero_copy, target_buffs[j],
+				CL_FALSE, n_chunk * targets[j].item_bytes,
+				(char*)targets[j].data + i * targets[j].item_bytes, 0, NULL, NULL);
+			assert(status == CL_SUCCESS);
+			clSetKernelArg(cl_kernel, num_source_args + use_recip + j,
+				sizeof(cl_mem), target_buffs + j);
+		}
+		res_buff = opencl_create_host_buffer(cont, zero_copy, CL_MEM_READ_WRITE,
+			n_chunk * result_bytes, (char*)result_data + i * result_bytes, &status);
+		assert(status == CL_SUCCESS);
+		status = opencl_write_host_buffer(queue, zero_copy, res_buff, CL_FALSE,
+			n_chunk * result_bytes, (char*)result_data + i * result_bytes,
+			0, NULL, NULL);
+		assert(status == CL_SUCCESS);
+		clSetKernelArg(cl_kernel, result_arg, sizeof(cl_mem), &res_buff);
+
+		for (g = 0; g < n_groups && status == CL_SUCCESS; ++g) {
+			if (g >= max_groups) {
+				/* Bound the device memory taken by source buffers. */
+				clWaitForEvents(1, kernel_events + g - max_groups);
+			}
+			for (j = 0; j < num_source_args; ++j) {
+				source_buffs[j] = opencl_create_host_buffer(cont, zero_copy,
+					CL_MEM_READ_ONLY, CVTX_WORKGROUP_SIZE * sources[j].item_bytes,
+					(char*)sources[j].data
+						+ (size_t)g * CVTX_WORKGROUP_SIZE * sources[j].item_bytes,
+					&status);
+				assert(status == CL_SUCCESS);
+				status = opencl_write_host_buffer(queue, zero_copy, source_buffs[j],
+					CL_FALSE, CVTX_WORKGROUP_SIZE * sources[j].item_bytes,
+					(char*)sources[j].data
+						+ (size_t)g * CVTX_WORKGROUP_SIZE * sources[j].item_bytes,
+					0, NULL, NULL);
+				assert(status == CL_SUCCESS);
+				clSetKernelArg(cl_kernel, j, sizeof(cl_mem), source_buffs + j);
+			}
+			status = clEnqueueNDRangeKernel(queue, cl_kernel, 2, NULL,
+				global_work_size, workgroup_size, 0, NULL, kernel_events + g);
+			for (j = 0; j < num_source_args; ++j) {
+				clReleaseMemObject(source_buffs[j]);
+			}
+			if (status != CL_SUCCESS) { break; }
+		}
+		if (status == CL_SUCCESS) {
+			status = opencl_read_host_buffer(queue, zero_copy, res_buff,
+				n_chunk * result_bytes, (char*)result_data + i * result_bytes,
+				0, NULL);
+		}
+		else {
+			clFinish(queue);
+		}
+		opencl_release_events(kernel_events, g);
+		for (j = 0; j < num_target_args; ++j) { clReleaseMemObject(target_buffs[j]); }
+		clReleaseMemObject(res_buff);
+	}
+	free(kernel_events);
+	clReleaseKernel(cl_kernel);
+	return status == CL_SUCCESS ? 0 : -1;
+}
+
+static int padded_sources(int num_sources) {
+	int n_groups = num_sources / CVTX_WORKGROUP_SIZE
+		+ (num_sources % CVTX_WORKGROUP_SIZE ? 1 : 0);
+	/* Always at least one group, even if it's all padding. */
+	return (n_groups > 0 ? n_groups : 1) * CVTX_WORKGROUP_SIZE;
+}
+
+#endif
@@ -0,0 +1,71 @@
+#ifndef CVTX_OCL_DOUBLE_H
+#define CVTX_OCL_DOUBLE_H
+#include "libcvtx.h"
+/*============================================================================
+ocl_double.h
+
+Handles the opencl accelerated double precision methods.
+
+Copyright(c) 2019 HJA Bird
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files(the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+============================================================================*/
+#ifdef CVTX_USING_OPENCL
+#include "opencl_acc.h"
+
+/* These use the double precision program of the first active device. They
+return -1 if it has none (no cl_khr_fp64), the regularisation function isn't
+built in or anything else fails, in which case the CPU should be used. */
+
+int opencl_brute_force_P3Dd_M2M_vel(
+	const cvtx_P3Dd **array_start,
+	const int num_particles,
+	const cvtx_V3d *mes_start,
+	const int num_mes,
+	cvtx_V3d *result_array,
+	const cvtx_VortFunc *kernel,
+	double regularisation_radius);
+
+int opencl_brute_force_P3Dd_M2M_dvort(
+	const cvtx_P3Dd **array_start,
+	const int num_particles,
+	const cvtx_P3Dd **induced_start,
+	const int num_induced,
+	cvtx_V3d *result_array,
+	const cvtx_VortFunc *kernel,
+	double regularisation_radius);
+
+int opencl_brute_force_F3Dd_M2M_vel(
+	const cvtx_F3Dd **array_start,
+	const int num_filaments,
+	const cvtx_V3d *mes_start,
+	const int num_mes,
+	cvtx_V3d *result_array);
+
+int opencl_brute_force_P2Dd_M2M_vel(
+	const cvtx_P2Dd **array_start,
+	const int num_particles,
+	const cvtx_V2d *mes_start,
+	const int num_mes,
+	cvtx_V2d *result_array,
+	const cvtx_VortFunc *kernel,
+	double regularisation_radius);
+
+#endif
+#endif /* CVTX_OCL_DOUBLE_H */
@@ -27,19 +27,46 @@ SOFTWARE.
 #ifdef CVTX_USING_OPENCL
 
 #include <assert.h>
+#include <limits.h>
 #include <math.h>
+#include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include "context.h"
+#include "opencl_tuning.h"
+#include "stats.h"
+#include "vortfunc_builtin.h"
+#include "workspace.h"
+
+/* A program including kernels generated for a user's cvtx_VortFunc. */
+struct ocl_vortfunc_program {
+	int platform_idx;
+	int workgroup_size;
+	char *source;				/* The generated kernels. */
+	cl_program program;			/* NULL if it failed to build. */
+};
+
 static struct {
 	int initialised;						/* Indicates initialise run */
 	int num_platforms;						/* Number of OCL platforms*/
 	struct ocl_platform_state *platforms;	/* Owner of all OCL state */
-	int num_active_devices;
-	struct ocl_active_device *active_devices;	/* Devices in use. */
+	int num_vortfunc_programs;
+	struct ocl_vortfunc_program *vortfunc_programs;
 } ocl_state = { 0, 0, NULL, 0, NULL };
 
+/* The OpenCL source of the built in regularisation functions. */
+static const struct {
+	const char *name, *g_3D, *zeta_3D, *eta_3D, *g_2D, *eta_2D;
+	int viscous;
+} builtin_vortfuncs[] = {
+#define CVTX_VORTFUNC_SOURCE(NAME, G_3D, ZETA_3D, ETA_3D, G_2D, ETA_2D, VISCOUS) \
+	{ #NAME, #G_3D, #ZETA_3D, #ETA_3D, #G_2D, #ETA_2D, VISCOUS },
+	CVTX_BUILTIN_VORTFUNCS(CVTX_VORTFUNC_SOURCE)
+#undef CVTX_VORTFUNC_SOURCE
+};
+
 /* Returns number of platforms and loads them into the ocl_state. 
 -1 for error.*/
 static int load_platforms();
@@ -64,6 +91,43 @@ the build failure.
 Returns 1 if successful, 0 otherwise. */
 static int create_platform_context_and_program(struct ocl_platform_state *plat);
 
+/* Options of build_program. */
+#define CVTX_PROGRAM_DOUBLE 1		/* Kernels use double rather than float. */
+#define CVTX_PROGRAM_COMPENSATED 2	/* Compensated sums (see nbody.cl). */
+
+/* Create and build the program for a workgroup size, with the kernels of
+the built in regularisation functions and extra_source (which may be NULL)
+after nbody.cl. options are CVTX_PROGRAM_XXX flags. Returns the status of
+the build. */
+static cl_int build_program(struct ocl_platform_state *plat,
+	int workgroup_size, int options, const char *extra_source,
+	cl_program *program);
+
+/* 1 if every device of a platform supports double precision. */
+static int platform_supports_double(struct ocl_platform_state *plat);
+
+/* The kernels to add to nbody.cl for a cvtx_VortFunc that isn't built in,
+or NULL if there are none, if it wasn't started from cvtx_VortFunc_init or 
+if out of memory. To be freed by the caller. */
+static char *vortfunc_kernel_source(const cvtx_VortFunc *vort_func);
+
+/* The kernels of every built in regularisation function, or NULL if out
+of memory. To be freed by the caller. */
+static char *builtin_kernel_source();
+
+/* Append the kernels for a regularisation function with kernel name
+extension ext given the OpenCL source of its functions of rho. Kernels
+needing a function that is NULL are skipped. combined_3D sets g and f.
+Returns -1 if out of memory, when source is incomplete. */
+static int append_vortfunc_kernels(char **source, size_t *length,
+	const char *ext, const char *g_3D, const char *zeta_3D,
+	const char *combined_3D, const char *eta_3D, const char *g_2D,
+	const char *eta_2D);
+
+/* Append printf formatted text to a malloced string. Returns -1, leaving
+the string unchanged, on failure. */
+static int append_source(char **source, size_t *length, const char *format, ...);
+
 /* Generates OCL command queues. 
 On failure, platform->good is set to bad (0)
 Returns 1 if successful, 0 otherwise. */
@@ -73,6 +137,23 @@ static int load_platform_device_queues(struct ocl_platform_state *plat);
 Returns 1. */
 static int finalise_platform(struct ocl_platform_state *plat);
 
+/* Add a device to a device list. Returns the new number of devices, or -1
+if the device was already in the list or a queue couldn't be made. */
+static int device_list_add(struct ocl_device_list *list,
+	int plat_idx, int dev_idx);
+
+/* Remove a device from a device list. Returns the new number of devices,
+or -1 if the device wasn't in the list. */
+static int device_list_remove(struct ocl_device_list *list,
+	int plat_idx, int dev_idx);
+
+/* The index of a device in a device list, or -1. */
+static int device_list_find(const struct ocl_device_list *list,
+	int plat_idx, int dev_idx);
+
+/* The device list of the calling thread's current context. */
+static struct ocl_device_list *current_device_list();
+
 int opencl_init() {
 	static int tried_init = 0;
 	static int good = 0;
@@ -81,11 +162,9 @@ int opencl_init() {
 		ocl_state.initialised = 1;
 		ocl_state.num_platforms = 0;
 		ocl_state.platforms = NULL;
-		ocl_state.num_active_devices = 0;
-		ocl_state.active_devices = NULL;
 		good = load_platforms();
+		opencl_device_list_init(&context_default()->devices, 0);
 	}
-	opencl_enable_default_accelerator();
 	return good;
 }
 
@@ -96,15 +175,24 @@ int opencl_is_init() {
 void opencl_finalise() {
 	int i;
 	if (ocl_state.initialised == 1) {
+		opencl_device_list_release(&context_default()->devices);
 		for (i = 0; i < ocl_state.num_platforms; ++i) {
 			finalise_platform(&ocl_state.platforms[i]);
 		}
 		ocl_state.num_platforms = 0;
-		ocl_state.num_active_devices = 0;
 		free(ocl_state.platforms);
 		ocl_state.platforms = NULL;
-		free(ocl_state.active_devices);
+		for (i = 0; i < ocl_state.num_vortfunc_programs; ++i) {
+			if (ocl_state.vortfunc_programs[i].program != NULL) {
+				clReleaseProgram(ocl_state.vortfunc_programs[i].program);
+			}
+			free(ocl_state.vortfunc_programs[i].source);
+		}
+		free(ocl_state.vortfunc_programs);
+		ocl_state.vortfunc_programs = NULL;
+		ocl_state.num_vortfunc_programs = 0;
 		ocl_state.initialised = 0;
+		opencl_tuning_finalise();
 	}
 	assert(ocl_state.platforms == NULL);
 }
@@ -152,10 +240,13 @@ void opencl_deindex_device(int index, int *plat_idx, int *dev_idx) {
 void opencl_index_device(int *index, int plat_idx, int dev_idx) {
 	*index = -1;
 	int i, acc = 0;
-	if (ocl_state.initialised == 1 && plat_idx < ocl_state.num_platforms
+	if (ocl_state.initialised == 1 && plat_idx >= 0
+		&& plat_idx < ocl_state.num_platforms
 		&& ocl_state.platforms[plat_idx].good
-		&& ocl_state.platforms[plat_idx].num_devices < dev_idx) {
-		for (i = 0; i < plat_idx - 1; ++i) {
+		&& dev_idx >= 0 && dev_idx < ocl_state.platforms[plat_idx].num_devices) {
+		/* As opencl_deindex_device, which skips bad platforms. */
+		for (i = 0; i < plat_idx; ++i) {
+			if (!ocl_state.platforms[i].good) { continue; }
 			acc += ocl_state.platforms[i].num_devices;
 		}
 		acc += dev_idx;
@@ -163,75 +254,60 @@ void opencl_index_device(int *index, int plat_idx, int dev_idx) {
 	}
 }
 
+void opencl_device_list_init(struct ocl_device_list *list, int own_queues) {
+	int nd, np;
+	list->own_queues = own_queues;
+	list->num_active_devices = 0;
+	list->active_devices = NULL;
+	if (ocl_state.initialised == 1) {
+		/* For now we just select the first working device we find. */
+		opencl_deindex_device(0, &np, &nd);
+		if (np >= 0) {
+			device_list_add(list, np, nd);
+		}
+	}
+	return;
+}
+
+void opencl_device_list_release(struct ocl_device_list *list) {
+	int i;
+	for (i = 0; i < list->num_active_devices; ++i) {
+		clReleaseCommandQueue(list->active_devices[i].queue);
+		clReleaseCommandQueue(list->active_devices[i].transfer_queue);
+	}
+	free(list->active_devices);
+	list->active_devices = NULL;
+	list->num_active_devices = 0;
+	return;
+}
+
 int opencl_num_active_devices() {
 	int num;
 	assert(opencl_is_init() == 1);
-	num = ocl_state.num_active_devices;
+	num = current_device_list()->num_active_devices;
 	return num;
 }
 
 int opencl_add_active_device(int plat_idx, int dev_idx){
-	int already_added = 0, retv;
-	struct ocl_active_device *td;
+	int retv = -1;
 	if (ocl_state.initialised == 1) {
-		/* Check we haven't already added this device. */
-		already_added = opencl_device_in_active_list(plat_idx, dev_idx) >= 0 ? 1 : 0;
-		if (!already_added) {
-			ocl_state.active_devices = realloc(
-				ocl_state.active_devices,
-				sizeof(struct ocl_active_device) * (ocl_state.num_active_devices + 1));
-			ocl_state.num_active_devices += 1;
-			td = &ocl_state.active_devices[ocl_state.num_active_devices - 1];
-			td->device_idx = dev_idx;
-			td->platform_idx = plat_idx;
-			retv = ocl_state.num_active_devices;
-		}
-		else
-		{
-			retv = -1;
-		}
+		retv = device_list_add(current_device_list(), plat_idx, dev_idx);
 	}
 	return retv;
 }
 
 int opencl_remove_active_device(int plat_idx, int dev_idx) {
-	int lindx = 0, retv = -1;	/* linear index */
-	struct ocl_active_device *tmp_arr;
+	int retv = -1;
 	if (ocl_state.initialised == 1) {
-		lindx = opencl_device_in_active_list(plat_idx, dev_idx);
-		if (lindx >= 0) {
-			tmp_arr = malloc(sizeof(struct ocl_active_device) *
-				(ocl_state.num_active_devices - 1));
-			memcpy(tmp_arr, ocl_state.active_devices,
-				sizeof(struct ocl_active_device) * lindx);
-			memcpy(tmp_arr, ocl_state.active_devices + (lindx + 1),
-				sizeof(struct ocl_active_device) *
-				(ocl_state.num_active_devices - lindx - 1));
-			free(ocl_state.active_devices);
-			ocl_state.active_devices = tmp_arr;
-			ocl_state.num_active_devices -= 1;
-			retv = ocl_state.num_active_devices;
-		}
-		else
-		{
-			retv = -1;
-		}
+		retv = device_list_remove(current_device_list(), plat_idx, dev_idx);
 	}
 	return retv;
 }
 
 int opencl_device_in_active_list(int plat_idx, int dev_idx) {
-	int pos = -1, i;
+	int pos = -1;
 	if (ocl_state.initialised == 1) {
-		for (i = 0; i < ocl_state.num_active_devices; ++i) {
-			if (ocl_state.active_devices[i].platform_idx == plat_idx
-				&& ocl_state.active_devices[i].device_idx == dev_idx) {
-				break;
-			}
-		}
-		if (i < ocl_state.num_active_devices) {
-			pos = i;
-		}
+		pos = device_list_find(current_device_list(), plat_idx, dev_idx);
 	}
 	return pos;
 }
@@ -258,11 +334,12 @@ int opencl_get_device_state(
 	assert(queue != NULL);
 	assert(ocl_state.initialised);
 
-	int nd = ocl_state.num_active_devices;
+	struct ocl_device_list *list = current_device_list();
+	int nd = list->num_active_devices;
 	int retv, didx, pidx;
 	if (ad_idx < nd && ad_idx >= 0) {
-		didx = ocl_state.active_devices[ad_idx].device_idx;
-		pidx = ocl_state.active_devices[ad_idx].platform_idx;
+		didx = list->active_devices[ad_idx].device_idx;
+		pidx = list->active_devices[ad_idx].platform_idx;
 		assert(pidx < ocl_state.num_platforms);
 		assert(pidx >= 0);
 		assert(didx < ocl_state.platforms[pidx].num_devices);
@@ -275,7 +352,7 @@ int opencl_get_device_state(
 			retv = 0;
 			*program = ocl_state.platforms[pidx].program;
 			*context = ocl_state.platforms[pidx].context;
-			*queue = ocl_state.platforms[pidx].queues[didx];
+			*queue = list->active_devices[ad_idx].queue;
 		}
 	}
 	else
@@ -285,6 +362,156 @@ int opencl_get_device_state(
 	return retv;
 }
 
+int opencl_queue_device_index(cl_command_queue queue) {
+	struct ocl_device_list *list = current_device_list();
+	int i, lindex = -1;
+	for (i = 0; i < list->num_active_devices; ++i) {
+		if (list->active_devices[i].queue == queue) {
+			opencl_index_device(&lindex, list->active_devices[i].platform_idx,
+				list->active_devices[i].device_idx);
+		}
+	}
+	return lindex;
+}
+
+cl_program opencl_workgroup_program(
+	cl_command_queue queue,
+	int workgroup_size)
+{
+	struct ocl_platform_state *plat;
+	cl_program program = NULL;
+	int pidx, didx, vidx;
+	opencl_deindex_device(opencl_queue_device_index(queue), &pidx, &didx);
+	if (pidx < 0 || !ocl_state.platforms[pidx].good) { return NULL; }
+	plat = &ocl_state.platforms[pidx];
+	if (workgroup_size == CVTX_WORKGROUP_SIZE) { return plat->program; }
+	vidx = (int)log2(workgroup_size / CVTX_MIN_WORKGROUP_SIZE);
+	if (vidx < 0 || vidx >= CVTX_NUM_WORKGROUP_SIZES
+		|| workgroup_size != CVTX_MIN_WORKGROUP_SIZE << vidx) {
+		return NULL;
+	}
+#pragma omp critical (cvtx_opencl_programs)
+	{
+		if (plat->variant_programs[vidx] == NULL
+			&& build_program(plat, workgroup_size, 0, NULL, &program) == CL_SUCCESS) {
+			plat->variant_programs[vidx] = program;
+		}
+		else if (program != NULL) {
+			clReleaseProgram(program);
+		}
+		program = plat->variant_programs[vidx];
+	}
+	return program;
+}
+
+cl_program opencl_double_program(cl_command_queue queue)
+{
+	struct ocl_platform_state *plat;
+	cl_program program = NULL;
+	int pidx, didx;
+	opencl_deindex_device(opencl_queue_device_index(queue), &pidx, &didx);
+	if (pidx < 0 || !ocl_state.platforms[pidx].good) { return NULL; }
+	plat = &ocl_state.platforms[pidx];
+#pragma omp critical (cvtx_opencl_programs)
+	{
+		/* A failed build is remembered so that it isn't retried. */
+		if (!plat->double_program_tried) {
+			plat->double_program_tried = 1;
+			if (platform_supports_double(plat)
+				&& build_program(plat, CVTX_WORKGROUP_SIZE,
+					CVTX_PROGRAM_DOUBLE, NULL, &program)
+				== CL_SUCCESS) {
+				plat->double_program = program;
+			}
+			else if (program != NULL) {
+				clReleaseProgram(program);
+			}
+		}
+		program = plat->double_program;
+	}
+	return program;
+}
+
+cl_program opencl_compensated_program(cl_command_queue queue)
+{
+	struct ocl_platform_state *plat;
+	cl_program program = NULL;
+	int pidx, didx;
+	opencl_deindex_device(opencl_queue_device_index(queue), &pidx, &didx);
+	if (pidx < 0 || !ocl_state.platforms[pidx].good) { return NULL; }
+	plat = &ocl_state.platforms[pidx];
+#pragma omp critical (cvtx_opencl_programs)
+	{
+		if (!plat->compensated_program_tried) {
+			plat->compensated_program_tried = 1;
+			if (build_program(plat, CVTX_WORKGROUP_SIZE,
+				CVTX_PROGRAM_COMPENSATED, NULL, &program) == CL_SUCCESS) {
+				plat->compensated_program = program;
+			}
+			else if (program != NULL) {
+				clReleaseProgram(program);
+			}
+		}
+		program = plat->compensated_program;
+	}
+	return program;
+}
+
+cl_program opencl_vortfunc_program(
+	cl_command_queue queue,
+	const cvtx_VortFunc *vort_func,
+	int workgroup_size)
+{
+	struct ocl_vortfunc_program *vprog = NULL;
+	cl_program program = NULL;
+	char *source;
+	int i, pidx, didx;
+	source = vort_func != NULL ? vortfunc_kernel_source(vort_func) : NULL;
+	if (source == NULL) {
+		return opencl_workgroup_program(queue, workgroup_size);
+	}
+	opencl_deindex_device(opencl_queue_device_index(queue), &pidx, &didx);
+	if (pidx < 0 || !ocl_state.platforms[pidx].good) {
+		free(source);
+		return NULL;
+	}
+#pragma omp critical (cvtx_opencl_programs)
+	{
+		for (i = 0; i < ocl_state.num_vortfunc_programs; ++i) {
+			if (ocl_state.vortfunc_programs[i].platform_idx == pidx
+				&& ocl_state.vortfunc_programs[i].workgroup_size == workgroup_size
+				&& !strcmp(ocl_state.vortfunc_programs[i].source, source)) {
+				vprog = &ocl_state.vortfunc_programs[i];
+			}
+		}
+		if (vprog == NULL) {
+			vprog = realloc(ocl_state.vortfunc_programs,
+				sizeof(struct ocl_vortfunc_program)
+				* (ocl_state.num_vortfunc_programs + 1));
+			if (vprog != NULL) {
+				ocl_state.vortfunc_programs = vprog;
+				vprog = &vprog[ocl_state.num_vortfunc_programs++];
+				vprog->platform_idx = pidx;
+				vprog->workgroup_size = workgroup_size;
+				vprog->source = source;
+				vprog->program = NULL;
+				source = NULL;
+				/* A failed build is remembered so that it isn't retried. */
+				if (build_program(&ocl_state.platforms[pidx], workgroup_size,
+					0, vprog->source, &program) == CL_SUCCESS) {
+					vprog->program = program;
+				}
+				else if (program != NULL) {
+					clReleaseProgram(program);
+				}
+			}
+		}
+		program = vprog != NULL ? vprog->program : NULL;
+	}
+	free(source);
+	return program;
+}
+
 char* opencl_accelerator_name(int lindex) {
 	char *res = NULL;
 	int pidx, didx;
@@ -304,7 +531,224 @@ char* opencl_accelerator_name(int lindex) {
 	return res;
 }
 
+int opencl_queue_zero_copy(cl_command_queue queue) {
+	cl_device_id device;
+	cl_bool unified = CL_FALSE;
+	cl_int status;
+	status = clGetCommandQueueInfo(queue, CL_QUEUE_DEVICE,
+		sizeof(cl_device_id), &device, NULL);
+	if (status == CL_SUCCESS) {
+		status = clGetDeviceInfo(device, CL_DEVICE_HOST_UNIFIED_MEMORY,
+			sizeof(cl_bool), &unified, NULL);
+	}
+	return status == CL_SUCCESS && unified == CL_TRUE ? 1 : 0;
+}
+
+cl_command_queue opencl_transfer_queue(cl_command_queue queue) {
+	struct ocl_device_list *list = current_device_list();
+	int i;
+	for (i = 0; i < list->num_active_devices; ++i) {
+		if (list->active_devices[i].queue == queue) {
+			return list->active_devices[i].transfer_queue;
+		}
+	}
+	return queue;
+}
+
+int opencl_chunk_items(cl_command_queue queue, size_t item_bytes) {
+	cl_device_id device;
+	cl_ulong global_mem, max_alloc, budget;
+	long long items;
+	if (clGetCommandQueueInfo(queue, CL_QUEUE_DEVICE,
+			sizeof(cl_device_id), &device, NULL) != CL_SUCCESS
+		|| clGetDeviceInfo(device, CL_DEVICE_GLOBAL_MEM_SIZE,
+			sizeof(cl_ulong), &global_mem, NULL) != CL_SUCCESS
+		|| clGetDeviceInfo(device, CL_DEVICE_MAX_MEM_ALLOC_SIZE,
+			sizeof(cl_ulong), &max_alloc, NULL) != CL_SUCCESS) {
+		/* The minimum the OpenCL standard allows for a GPU. */
+		global_mem = max_alloc = 128 * 1024 * 1024;
+	}
+	/* A quarter of memory each for the targets and the sources in flight,
+	leaving room for other users of the device. */
+	budget = global_mem / 4 < max_alloc ? global_mem / 4 : max_alloc;
+	items = (long long)(budget / item_bytes);
+	items = items < INT_MAX ? items : INT_MAX;
+	return items > 2 ? (int)items : 2;
+}
+
+void* opencl_host_alloc(size_t bytes) {
+	return workspace_alloc_aligned(bytes, CVTX_HOST_BUFFER_ALIGN);
+}
+
+cl_mem opencl_create_host_buffer(
+	cl_context context,
+	int zero_copy,
+	cl_mem_flags flags,
+	size_t size,
+	void *host_ptr,
+	cl_int *status)
+{
+	if (zero_copy) {
+		return clCreateBuffer(context, flags | CL_MEM_USE_HOST_PTR,
+			size, host_ptr, status);
+	}
+	return clCreateBuffer(context, flags, size, NULL, status);
+}
+
+cl_int opencl_write_host_buffer(
+	cl_command_queue queue,
+	int zero_copy,
+	cl_mem buffer,
+	cl_bool blocking,
+	size_t size,
+	const void *host_ptr,
+	cl_uint num_events,
+	const cl_event *wait_list,
+	cl_event *event)
+{
+	if (zero_copy) {
+		/* The device already sees the data. Keep the event chain intact. */
+		return event != NULL ?
+			clEnqueueMarkerWithWaitList(queue, num_events, wait_list, event)
+			: CL_SUCCESS;
+	}
+	return clEnqueueWriteBuffer(queue, buffer, blocking, 0, size, host_ptr,
+		num_events, wait_list, event);
+}
+
+cl_int opencl_read_host_buffer(
+	cl_command_queue queue,
+	int zero_copy,
+	cl_mem buffer,
+	size_t size,
+	void *host_ptr,
+	cl_uint num_events,
+	const cl_event *wait_list)
+{
+	cl_int status;
+	cl_event event = NULL;
+	void *mapped;
+	if (zero_copy) {
+		/* Mapping a CL_MEM_USE_HOST_PTR buffer makes host_ptr up to date.
+		On unified memory this is only a synchronisation. */
+		mapped = clEnqueueMapBuffer(queue, buffer, CL_TRUE, CL_MAP_READ,
+			0, size, num_events, wait_list,
+			stats_enabled() ? &event : NULL, &status);
+		if (event != NULL) { opencl_release_events(&event, 1); }
+		if (status != CL_SUCCESS) { return status; }
+		if (mapped != host_ptr) { memcpy(host_ptr, mapped, size); }
+		status = clEnqueueUnmapMemObject(queue, buffer, mapped, 0, NULL, NULL);
+		if (status != CL_SUCCESS) { return status; }
+		/* host_ptr is workspace memory that the caller will reuse. */
+		return clFinish(queue);
+	}
+	status = clEnqueueReadBuffer(queue, buffer, CL_TRUE, 0, size, host_ptr,
+		num_events, wait_list, stats_enabled() ? &event : NULL);
+	if (event != NULL) { opencl_release_events(&event, 1); }
+	return status;
+}
+
+void opencl_release_events(cl_event *events, int num_events) {
+	cl_command_type type;
+	cl_ulong start, end;
+	int i;
+	for (i = 0; i < num_events; ++i) {
+		/* Profiling information is unavailable for markers on some
+		platforms, and for all commands if the queue doesn't allow it. */
+		if (stats_enabled()
+			&& clGetEventInfo(events[i], CL_EVENT_COMMAND_TYPE,
+				sizeof(cl_command_type), &type, NULL) == CL_SUCCESS
+			&& clGetEventProfilingInfo(events[i], CL_PROFILING_COMMAND_START,
+				sizeof(cl_ulong), &start, NULL) == CL_SUCCESS
+			&& clGetEventProfilingInfo(events[i], CL_PROFILING_COMMAND_END,
+				sizeof(cl_ulong), &end, NULL) == CL_SUCCESS
+			&& end >= start) {
+			switch (type) {
+			case CL_COMMAND_WRITE_BUFFER:
+				stats_phase_time(STATS_UPLOAD, (end - start) * 1e-9);
+				break;
+			case CL_COMMAND_NDRANGE_KERNEL:
+				stats_phase_time(STATS_COMPUTE, (end - start) * 1e-9);
+				break;
+			case CL_COMMAND_READ_BUFFER:
+			case CL_COMMAND_MAP_BUFFER:
+				stats_phase_time(STATS_DOWNLOAD, (end - start) * 1e-9);
+				break;
+			default:
+				break;
+			}
+		}
+		clReleaseEvent(events[i]);
+	}
+	return;
+}
+
 /* STATIC FUNCTIONS ---------------------------------------------------------*/
+static int device_list_add(struct ocl_device_list *list,
+	int plat_idx, int dev_idx) {
+	struct ocl_active_device *td;
+	struct ocl_platform_state *plat;
+	cl_command_queue queue, transfer_queue;
+	cl_int status;
+	if (device_list_find(list, plat_idx, dev_idx) >= 0) { return -1; }
+	plat = &ocl_state.platforms[plat_idx];
+	if (list->own_queues) {
+		queue = clCreateCommandQueue(plat->context, plat->devices[dev_idx],
+			CL_QUEUE_PROFILING_ENABLE, &status);
+		if (status != CL_SUCCESS) { return -1; }
+	}
+	else
+	{
+		queue = plat->queues[dev_idx];
+		clRetainCommandQueue(queue);
+	}
+	transfer_queue = clCreateCommandQueue(plat->context,
+		plat->devices[dev_idx], CL_QUEUE_PROFILING_ENABLE, &status);
+	if (status != CL_SUCCESS) {
+		/* Uploads will just be serialised with the work. */
+		transfer_queue = queue;
+		clRetainCommandQueue(queue);
+	}
+	list->active_devices = realloc(list->active_devices,
+		sizeof(struct ocl_active_device) * (list->num_active_devices + 1));
+	list->num_active_devices += 1;
+	td = &list->active_devices[list->num_active_devices - 1];
+	td->device_idx = dev_idx;
+	td->platform_idx = plat_idx;
+	td->queue = queue;
+	td->transfer_queue = transfer_queue;
+	return list->num_active_devices;
+}
+
+static int device_list_remove(struct ocl_device_list *list,
+	int plat_idx, int dev_idx) {
+	int lindx = device_list_find(list, plat_idx, dev_idx);
+	if (lindx < 0) { return -1; }
+	clReleaseCommandQueue(list->active_devices[lindx].queue);
+	clReleaseCommandQueue(list->active_devices[lindx].transfer_queue);
+	memmove(list->active_devices + lindx, list->active_devices + lindx + 1,
+		sizeof(struct ocl_active_device) *
+		(list->num_active_devices - lindx - 1));
+	list->num_active_devices -= 1;
+	return list->num_active_devices;
+}
+
+static int device_list_find(const struct ocl_device_list *list,
+	int plat_idx, int dev_idx) {
+	int i;
+	for (i = 0; i < list->num_active_devices; ++i) {
+		if (list->active_devices[i].platform_idx == plat_idx
+			&& list->active_devices[i].device_idx == dev_idx) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+static struct ocl_device_list *current_device_list() {
+	return &context_current()->devices;
+}
+
 static int load_platforms() {
 	assert(ocl_state.platforms == NULL);
 
@@ -399,19 +843,7 @@ static int create_platform_context_and_program(struct ocl_platform_state *plat)
 	if (plat->num_devices <= 0) { return 0; }
 
 	cl_int status;
-	char compile_options[1024] = "";
-	char tmp[128];
-	const char *program_source =
-#		include "nbody.cl"
-		;	/* Including in source makes it easier to distribute a shared lib. */
 	size_t length;
-	sprintf(tmp, "%i", CVTX_WORKGROUP_SIZE);
-	/* -cl-fast-relaxed-math is too dangerous - it ruins our NaNs on Nvidia/ */
-	strcat(compile_options, " -cl-unsafe-math-optimizations -D CVTX_CL_WORKGROUP_SIZE=");
-	strcat(compile_options, tmp);
-	sprintf(tmp, "%i", (int)log2(CVTX_WORKGROUP_SIZE));
-	strcat(compile_options, " -D CVTX_CL_LOG2_WORKGROUP_SIZE=");
-	strcat(compile_options, tmp);
 
 	plat->context = clCreateContext(
 		NULL, plat->num_devices, plat->devices, NULL, NULL, &status);
@@ -419,10 +851,7 @@ static int create_platform_context_and_program(struct ocl_platform_state *plat)
 		plat->good = 0;
 		return plat->good;
 	}
-	plat->program = clCreateProgramWithSource(
-		plat->context, 1, (const char**)&program_source, NULL, &status);
-	status = clBuildProgram(plat->program, plat->num_devices, 
-		plat->devices, compile_options, NULL, NULL);
+	status = build_program(plat, CVTX_WORKGROUP_SIZE, 0, NULL, &plat->program);
 	if (status != CL_SUCCESS) {
 		plat->good = 0;
 	}
@@ -448,6 +877,58 @@ static int create_platform_context_and_program(struct ocl_platform_state *plat)
 	return plat->good;
 }
 
+static cl_int build_program(struct ocl_platform_state *plat,
+	int workgroup_size, int options, const char *extra_source,
+	cl_program *program) {
+	cl_int status;
+	char compile_options[1024] = "";
+	char tmp[128];
+	char *builtin_source = builtin_kernel_source();
+	const char *program_source[3] = {
+#		include "nbody.cl"
+		,	/* Including in source makes it easier to distribute a shared lib. */
+		builtin_source, extra_source };
+	if (builtin_source == NULL) { return CL_OUT_OF_HOST_MEMORY; }
+	sprintf(tmp, "%i", workgroup_size);
+	/* -cl-fast-relaxed-math is too dangerous - it ruins our NaNs on Nvidia/
+	Unsafe maths would also let the compiler cancel compensation terms. */
+	if (!(options & CVTX_PROGRAM_COMPENSATED)) {
+		strcat(compile_options, " -cl-unsafe-math-optimizations");
+	}
+	strcat(compile_options, " -D CVTX_CL_WORKGROUP_SIZE=");
+	strcat(compile_options, tmp);
+	sprintf(tmp, "%i", (int)log2(workgroup_size));
+	strcat(compile_options, " -D CVTX_CL_LOG2_WORKGROUP_SIZE=");
+	strcat(compile_options, tmp);
+	if (options & CVTX_PROGRAM_DOUBLE) {
+		strcat(compile_options, " -D CVTX_CL_DOUBLE");
+	}
+	if (options & CVTX_PROGRAM_COMPENSATED) {
+		strcat(compile_options, " -D CVTX_CL_COMPENSATED");
+	}
+
+	*program = clCreateProgramWithSource(
+		plat->context, extra_source != NULL ? 3 : 2, program_source, NULL, &status);
+	free(builtin_source);
+	if (status != CL_SUCCESS) { return status; }
+	status = clBuildProgram(*program, plat->num_devices, 
+		plat->devices, compile_options, NULL, NULL);
+	return status;
+}
+
+static int platform_supports_double(struct ocl_platform_state *plat) {
+	cl_device_fp_config config;
+	int i;
+	for (i = 0; i < plat->num_devices; ++i) {
+		if (clGetDeviceInfo(plat->devices[i], CL_DEVICE_DOUBLE_FP_CONFIG,
+			sizeof(cl_device_fp_config), &config, NULL) != CL_SUCCESS
+			|| config == 0) {
+			return 0;
+		}
+	}
+	return plat->num_devices > 0;
+}
+
 static int load_platform_device_queues(struct ocl_platform_state *plat) {
 	assert(plat != NULL);
 	assert(plat->platform != NULL);
@@ -465,7 +946,7 @@ static int load_platform_device_queues(struct ocl_platform_state *plat) {
 	for (i = 0; i < plat->num_devices; ++i) {
 		plat->queues[i] = clCreateCommandQueue(
 			plat->context, plat->devices[i],
-			(cl_command_queue_properties)NULL, &status);
+			CL_QUEUE_PROFILING_ENABLE, &status);
 		if (status != CL_SUCCESS) {
 			plat->good = 0;
 		}
@@ -481,6 +962,17 @@ static int finalise_platform(struct ocl_platform_state *plat) {
 	if (plat->program != NULL) {
 		clReleaseProgram(plat->program);
 	}
+	for (i = 0; i < CVTX_NUM_WORKGROUP_SIZES; ++i) {
+		if (plat->variant_programs[i] != NULL) {
+			clReleaseProgram(plat->variant_programs[i]);
+		}
+	}
+	if (plat->double_program != NULL) {
+		clReleaseProgram(plat->double_program);
+	}
+	if (plat->compensated_program != NULL) {
+		clReleaseProgram(plat->compensated_program);
+	}
 	if (plat->queues != NULL) {
 		for (i = 0; i < plat->num_devices; ++i) {
 			clReleaseCommandQueue(plat->queues[i]);
@@ -509,6 +1001,7 @@ static int finalise_platform(struct ocl_platform_state *plat) {
 
 static int zero_new_platform(struct ocl_platform_state *plat) {
 	assert(plat != NULL);
+	int i;
 	if (plat != NULL) {
 		plat->good = 1;
 		plat->platform = NULL;
@@ -516,6 +1009,13 @@ static int zero_new_platform(struct ocl_platform_state *plat) {
 		plat->devices = NULL;
 		plat->queues = NULL;
 		plat->program = NULL;
+		for (i = 0; i < CVTX_NUM_WORKGROUP_SIZES; ++i) {
+			plat->variant_programs[i] = NULL;
+		}
+		plat->double_program = NULL;
+		plat->double_program_tried = 0;
+		plat->compensated_program = NULL;
+		plat->compensated_program_tried = 0;
 		plat->context = NULL;
 		plat->platform_name = NULL;
 		plat->device_names = NULL;
@@ -523,4 +1023,123 @@ static int zero_new_platform(struct ocl_platform_state *plat) {
 	}
 	return 0;
 }
+
+static char *vortfunc_kernel_source(const cvtx_VortFunc *vort_func) {
+	const char *ext = vort_func->cl_kernel_name_ext;
+	char *source = NULL, *combined = NULL;
+	size_t length = 0, combined_length = 0;
+	int i, err = 0;
+	if (vort_func->cl_generate != CVTX_VORTFUNC_CL_GENERATE) { return NULL; }
+	for (i = 0; i < (int)(sizeof(builtin_vortfuncs) / sizeof(builtin_vortfuncs[0])); ++i) {
+		if (!strcmp(ext, builtin_vortfuncs[i].name)) { return NULL; }
+	}
+	if (!strcmp(ext, "")) { return NULL; }
+	if (vort_func->cl_combined_3D != NULL) {
+		err |= append_source(&combined, &combined_length, 
+			"	{ float zeta;\n%s\n	f = zeta; }\n", vort_func->cl_combined_3D);
+	}
+	if (!err) {
+		err |= append_vortfunc_kernels(&source, &length, ext,
+			vort_func->cl_g_3D, vort_func->cl_zeta_3D, combined,
+			vort_func->cl_eta_3D, vort_func->cl_g_2D, vort_func->cl_eta_2D);
+	}
+	free(combined);
+	if (err) {
+		/* Don't build a truncated program - fall back to the CPU. */
+		free(source);
+		source = NULL;
+	}
+	return source;
+}
+
+static char *builtin_kernel_source() {
+	char *source = NULL;
+	size_t length = 0;
+	int i, err = 0;
+	for (i = 0; i < (int)(sizeof(builtin_vortfuncs) / sizeof(builtin_vortfuncs[0])); ++i) {
+		err |= append_vortfunc_kernels(&source, &length, builtin_vortfuncs[i].name,
+			builtin_vortfuncs[i].g_3D, builtin_vortfuncs[i].zeta_3D, NULL,
+			builtin_vortfuncs[i].viscous ? builtin_vortfuncs[i].eta_3D : NULL,
+			builtin_vortfuncs[i].g_2D,
+			builtin_vortfuncs[i].viscous ? builtin_vortfuncs[i].eta_2D : NULL);
+	}
+	if (err) {
+		free(source);
+		source = NULL;
+	}
+	return source;
+}
+
+static int append_vortfunc_kernels(char **source, size_t *length,
+	const char *ext, const char *g_3D, const char *zeta_3D,
+	const char *combined_3D, const char *eta_3D, const char *g_2D,
+	const char *eta_2D) {
+	char *g_and_f = NULL;
+	size_t gf_length = 0;
+	int err = 0;
+	/* g & zeta (called f in the templates) are needed together. */
+	if (combined_3D != NULL) {
+		err |= append_source(&g_and_f, &gf_length, "%s", combined_3D);
+	}
+	else if (g_3D != NULL && zeta_3D != NULL) {
+		err |= append_source(&g_and_f, &gf_length, "	g = (%s);\n	f = (%s);\n",
+			g_3D, zeta_3D);
+	}
+
+	if (g_3D != NULL) {
+		err |= append_source(source, length, "__kernel void cvtx_nb_P3D_vel_%s\n"
+			"	CVTX_P3D_VEL_START\n	g = (%s);\n	CVTX_P3D_VEL_END\n",
+			ext, g_3D);
+	}
+	if (g_and_f != NULL) {
+		err |= append_source(source, length, "__kernel void cvtx_nb_P3D_dvort_%s\n"
+			"	CVTX_P3D_DVORT_START\n%s	CVTX_P3D_DVORT_END\n", ext, g_and_f);
+		err |= append_source(source, length, "__kernel void cvtx_nb_P3D_vel_grad_%s\n"
+			"	CVTX_P3D_VEL_GRAD_START\n%s	CVTX_P3D_VEL_GRAD_END\n", ext, g_and_f);
+	}
+	if (eta_3D != NULL) {
+		err |= append_source(source, length, "__kernel void cvtx_nb_P3D_visc_dvort_%s\n"
+			"	CVTX_P3D_VISC_DVORT_START\n	eta = (%s);\n	CVTX_P3D_VISC_DVORT_END\n",
+			ext, eta_3D);
+	}
+	if (zeta_3D != NULL) {
+		err |= append_source(source, length, "__kernel void cvtx_nb_P3D_vort_%s\n"
+			"	CVTX_P3D_VORT_START\n	zeta = (%s);\n	CVTX_P3D_VORT_END\n",
+			ext, zeta_3D);
+	}
+	if (g_2D != NULL) {
+		err |= append_source(source, length, "__kernel void cvtx_nb_P2D_vel_%s\n"
+			"	CVTX_P2D_VEL_START\n	g = (%s);\n	CVTX_P2D_VEL_END\n",
+			ext, g_2D);
+		err |= append_source(source, length, "__kernel void cvtx_nb_P2D_smallmes_vel_%s\n"
+			"	CVTX_P2D_SMALLMES_VEL_START\n	g = (%s);\n	CVTX_P2D_SMALLMES_VEL_END\n",
+			ext, g_2D);
+	}
+	if (eta_2D != NULL) {
+		err |= append_source(source, length, "__kernel void cvtx_nb_P2D_visc_dvort_%s\n"
+			"	CVTX_P2D_VISC_DVORT_START\n	eta = (%s);\n	CVTX_P2D_VISC_DVORT_END\n",
+			ext, eta_2D);
+	}
+	free(g_and_f);
+	return err;
+}
+
+static int append_source(char **source, size_t *length, const char *format, ...) {
+	va_list args;
+	char *grown;
+	int n;
+	va_start(args, format);
+	n = vsnprintf(NULL, 0, format, args);
+	va_end(args);
+	if (n < 0) { return -1; }
+	grown = realloc(*source, *length + n + 1);
+	if (grown == NULL) { return -1; }
+	va_start(args, format);
+	vsnprintf(grown + *length, n + 1, format, args);
+	va_end(args);
+	*source = grown;
+	*length += n;
+	return 0;
+}
+
 #endif
@@ -32,7 +32,14 @@ SOFTWARE.
 #include <CL/cl.h>
 #include <bsv/bsv.h>
 
+/* The default workgroup size. Others are powers of two from
+CVTX_MIN_WORKGROUP_SIZE up to this. */
 #define CVTX_WORKGROUP_SIZE 256
+#define CVTX_MIN_WORKGROUP_SIZE 32
+#define CVTX_NUM_WORKGROUP_SIZES 4
+/* Alignment of host memory that OpenCL buffers may use directly. Intel's
+runtimes require page alignment for zero-copy. */
+#define CVTX_HOST_BUFFER_ALIGN 4096
 
 struct ocl_platform_state{
 	int good;					/* 1 if good, 0 if bad. */
@@ -40,7 +47,15 @@ struct ocl_platform_state{
 	int num_devices;
 	cl_device_id *devices;
 	cl_command_queue *queues;
-	cl_program program;
+	cl_program program;			/* Built for CVTX_WORKGROUP_SIZE. */
+	/* Programs for other workgroup sizes, built on demand. Else NULL. */
+	cl_program variant_programs[CVTX_NUM_WORKGROUP_SIZES];
+	/* Built with double precision kernels on demand. Else NULL. */
+	cl_program double_program;
+	int double_program_tried;
+	/* Built with compensated sums on demand. Else NULL. */
+	cl_program compensated_program;
+	int compensated_program_tried;
 	cl_context context;
 	char *platform_name;
 	char **device_names;		/* Pointer to array of strings. */
@@ -50,6 +65,15 @@ struct ocl_platform_state{
 struct ocl_active_device {
 	int platform_idx;
 	int device_idx;
+	cl_command_queue queue;
+	cl_command_queue transfer_queue;	/* For uploads overlapping queue. */
+};
+
+/* The devices in use by a cvtx_Context. */
+struct ocl_device_list {
+	int own_queues;				/* 1 if queues are created for this list. */
+	int num_active_devices;
+	struct ocl_active_device *active_devices;
 };
 
 /* 
@@ -76,6 +100,17 @@ void opencl_deindex_device(int index, int *plat_idx, int *dev_idx);
 invalid input. */
 void opencl_index_device(int *index, int plat_idx, int dev_idx);
 
+/* Initialise an empty device list, adding the default accelerator if
+OpenCL is initialised. If own_queues is 1, each device in the list gets its
+own command queue rather than sharing the platform's. */
+void opencl_device_list_init(struct ocl_device_list *list, int own_queues);
+
+/* Release the queues of and empty a device list. */
+void opencl_device_list_release(struct ocl_device_list *list);
+
+/* The functions below act on the devices of the calling thread's current
+cvtx_Context. */
+
 /* The number of active devices. -1 for bad. */
 int opencl_num_active_devices();
 
@@ -104,6 +139,101 @@ int opencl_get_device_state(
 	cl_context *context,
 	cl_command_queue *queue);
 
+/* The queue to put uploads on so that they overlap with work on queue.
+queue if there isn't one. Work on queue waiting for events on the transfer
+queue requires that the transfer queue has been flushed. */
+cl_command_queue opencl_transfer_queue(cl_command_queue queue);
+
+/* When streaming a problem through the device of a queue in chunks, the
+number of items of item_bytes each to put in a chunk. At least 2. */
+int opencl_chunk_items(cl_command_queue queue, size_t item_bytes);
+
+/* Host-device memory transfers -------------------------------------------
+On devices where CL_DEVICE_HOST_UNIFIED_MEMORY is true (integrated GPUs and
+CPU runtimes), copying host data into device buffers is wasted effort. The
+buffers are instead created with CL_MEM_USE_HOST_PTR over the library's own
+aligned host arrays and mapped to read them. Otherwise these are equivalent
+to clCreateBuffer / clEnqueueWriteBuffer / clEnqueueReadBuffer.
+
+Since a zero-copy buffer may use host_ptr from creation, its host data
+must be filled in before the buffer is created and host_ptr must remain
+valid until the buffer is no longer in use. */
+
+/* 1 if buffers for the device of the queue should use host memory. */
+int opencl_queue_zero_copy(cl_command_queue queue);
+
+/* Allocate host memory from the workspace for use with the functions
+below. Released with workspace_reset. */
+void* opencl_host_alloc(size_t bytes);
+
+cl_mem opencl_create_host_buffer(
+	cl_context context,
+	int zero_copy,
+	cl_mem_flags flags,
+	size_t size,
+	void *host_ptr,
+	cl_int *status);
+
+/* Make size bytes of host_ptr available to the device. The event is
+always generated if event is not NULL. */
+cl_int opencl_write_host_buffer(
+	cl_command_queue queue,
+	int zero_copy,
+	cl_mem buffer,
+	cl_bool blocking,
+	size_t size,
+	const void *host_ptr,
+	cl_uint num_events,
+	const cl_event *wait_list,
+	cl_event *event);
+
+/* Blocking read of the device's content of a buffer into host_ptr. */
+cl_int opencl_read_host_buffer(
+	cl_command_queue queue,
+	int zero_copy,
+	cl_mem buffer,
+	size_t size,
+	void *host_ptr,
+	cl_uint num_events,
+	const cl_event *wait_list);
+
+/* Release the events of a finished call, adding the device time of their
+commands to the statistics of the current call if they're enabled. */
+void opencl_release_events(cl_event *events, int num_events);
+
+/* The linear index of the device of a queue of the current context, or
+-1 if the queue isn't one of the current context's. */
+int opencl_queue_device_index(cl_command_queue queue);
+
+/* The program built with a given workgroup size for the platform of the
+device of a queue. Variants are built on first request. Returns NULL if
+it can't be built. */
+cl_program opencl_workgroup_program(
+	cl_command_queue queue,
+	int workgroup_size);
+
+/* As opencl_workgroup_program, but also containing the kernels of a
+regularisation function that isn't built into the library. These are
+generated from the OpenCL C source carried by vort_func (cl_g_3D, etc.)
+and built on first request. The source is only used if vort_func was 
+started from cvtx_VortFunc_init. vort_func may be NULL. */
+cl_program opencl_vortfunc_program(
+	cl_command_queue queue,
+	const cvtx_VortFunc *vort_func,
+	int workgroup_size);
+
+/* The program with double precision kernels for the platform of the device
+of a queue, built for CVTX_WORKGROUP_SIZE on first request. Returns NULL if
+the platform's devices lack cl_khr_fp64 or it can't be built. */
+cl_program opencl_double_program(cl_command_queue queue);
+
+/* The program with compensated sums in the P3D vel & dvort, P2D vel and
+filament vel kernels (see nbody.cl) for the platform of the device of a
+queue, built for CVTX_WORKGROUP_SIZE on first request. The results buffer
+of these kernels must be twice the number of targets long and zeroed: the
+results are the sum of each half. Returns NULL if it can't be built. */
+cl_program opencl_compensated_program(cl_command_queue queue);
+
 /* Get the name of an accelerator by linear index. */
 char* opencl_accelerator_name(int lindex);
 
@@ -0,0 +1,326 @@
+#include "opencl_tuning.h"
+/*============================================================================
+opencl_tuning.c
+
+Tuning of OpenCL workgroup sizes per device and kernel.
+
+Copyright(c) 2019 HJA Bird
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files(the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+============================================================================*/
+#ifdef CVTX_USING_OPENCL
+
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#ifdef CVTX_USING_OPENMP
+#	include <omp.h>
+#endif
+
+#include "stats.h"
+#include "vortfunc_builtin.h"
+
+/* Timings taken of each candidate. The least is used. */
+#define CVTX_TUNING_TRIALS 2
+/* Smaller calls are dominated by overheads, so aren't timed. */
+#define CVTX_TUNING_MIN_INTERACTIONS (double)(1 << 22)
+#define CVTX_TUNING_NAME_LENGTH 128
+
+struct tuning_record {
+	char device_name[CVTX_TUNING_NAME_LENGTH];
+	char kernel_name[CVTX_TUNING_NAME_LENGTH];
+	int workgroup_size;		/* 0 until tuned. */
+	int num_candidates;
+	int candidates[CVTX_NUM_WORKGROUP_SIZES];
+	int trials[CVTX_NUM_WORKGROUP_SIZES];
+	double time_per_interaction[CVTX_NUM_WORKGROUP_SIZES];
+};
+
+static struct {
+	int loaded;				/* 1 if the tuning file has been read. */
+	int num_records;
+	struct tuning_record *records;
+} tuning_state = { 0, 0, NULL };
+
+/* The path of the tuning file. Returns 0 if there is one. */
+static int tuning_file_path(char *path, size_t length);
+
+/* Read the tuning file into tuning_state. */
+static void load_tuning_file();
+
+/* Write all tuned records to the tuning file. */
+static void save_tuning_file();
+
+/* Index of the record for a device and kernel, creating it with
+candidates up to max_workgroup_size if there isn't one. */
+static int find_record(const char *device_name, const char *kernel_name,
+	size_t max_workgroup_size);
+
+/* Record the time of a trial, or that its candidate failed if status is
+not 0. */
+static void record_trial(struct ocl_tuning_trial *trial, int status);
+
+static double wall_time();
+
+int opencl_tuning_begin(
+	struct ocl_tuning_trial *trial,
+	cl_command_queue queue,
+	const char *kernel_prefix,
+	const cvtx_VortFunc *vort_func,
+	double interactions,
+	cl_program *program,
+	int *workgroup_size)
+{
+	assert(trial != NULL);
+	assert(program != NULL);
+	assert(workgroup_size != NULL);
+	char kernel_name[CVTX_TUNING_NAME_LENGTH];
+	char *device_name;
+	cl_device_id device;
+	size_t max_workgroup_size = CVTX_WORKGROUP_SIZE;
+	struct tuning_record *rec;
+	int i, ridx, size = CVTX_WORKGROUP_SIZE;
+
+	trial->record = -1;
+	trial->candidate = -1;
+	trial->interactions = interactions;
+	device_name = opencl_accelerator_name(opencl_queue_device_index(queue));
+	if (clGetCommandQueueInfo(queue, CL_QUEUE_DEVICE,
+		sizeof(cl_device_id), &device, NULL) == CL_SUCCESS) {
+		clGetDeviceInfo(device, CL_DEVICE_MAX_WORK_GROUP_SIZE,
+			sizeof(size_t), &max_workgroup_size, NULL);
+	}
+	snprintf(kernel_name, CVTX_TUNING_NAME_LENGTH, "%s%s", kernel_prefix,
+		vort_func != NULL ? vort_func->cl_kernel_name_ext : "");
+
+	if (device_name != NULL) {
+#pragma omp critical (cvtx_opencl_tuning)
+		{
+			if (!tuning_state.loaded) { load_tuning_file(); }
+			ridx = find_record(device_name, kernel_name, max_workgroup_size);
+			rec = ridx >= 0 ? &tuning_state.records[ridx] : NULL;
+			if (rec != NULL && rec->workgroup_size > 0) {
+				size = rec->workgroup_size;
+			}
+			else if (rec != NULL && interactions >= CVTX_TUNING_MIN_INTERACTIONS) {
+				for (i = 0; i < rec->num_candidates; ++i) {
+					if (rec->trials[i] < CVTX_TUNING_TRIALS) {
+						trial->record = ridx;
+						trial->candidate = i;
+						size = rec->candidates[i];
+						break;
+					}
+				}
+			}
+		}
+	}
+
+	*program = opencl_vortfunc_program(queue, vort_func, size);
+	if (*program == NULL && size != CVTX_WORKGROUP_SIZE) {
+		/* The candidate can't be built, so it won't win. This is part of
+		tuning, not an error of the call. */
+		record_trial(trial, -1);
+		size = CVTX_WORKGROUP_SIZE;
+		*program = opencl_vortfunc_program(queue, vort_func, size);
+	}
+	*workgroup_size = size;
+	trial->start = wall_time();
+	if (*program == NULL) { stats_fallback(CVTX_FALLBACK_UNSUPPORTED); }
+	return *program != NULL ? 0 : -1;
+}
+
+int opencl_tuning_begin_compensated(
+	struct ocl_tuning_trial *trial,
+	cl_command_queue queue,
+	const cvtx_VortFunc *vort_func,
+	cl_program *program,
+	int *workgroup_size)
+{
+	assert(trial != NULL);
+	assert(program != NULL);
+	assert(workgroup_size != NULL);
+	trial->record = -1;
+	trial->candidate = -1;
+	*program = vort_func == NULL || vortfunc_builtin_index(vort_func) >= 0 ?
+		opencl_compensated_program(queue) : NULL;
+	*workgroup_size = CVTX_WORKGROUP_SIZE;
+	if (*program == NULL) { stats_fallback(CVTX_FALLBACK_UNSUPPORTED); }
+	return *program != NULL ? 0 : -1;
+}
+
+void opencl_tuning_end(struct ocl_tuning_trial *trial, int status) {
+	assert(trial != NULL);
+	if (status != 0) { stats_fallback(CVTX_FALLBACK_ERROR); }
+	record_trial(trial, status);
+	return;
+}
+
+void opencl_tuning_finalise() {
+#pragma omp critical (cvtx_opencl_tuning)
+	{
+		free(tuning_state.records);
+		tuning_state.records = NULL;
+		tuning_state.num_records = 0;
+		tuning_state.loaded = 0;
+	}
+	return;
+}
+
+/* STATIC FUNCTIONS ---------------------------------------------------------*/
+static int tuning_file_path(char *path, size_t length) {
+	const char *env, *home;
+	env = getenv("CVTX_TUNING_FILE");
+	if (env != NULL) {
+		if (strlen(env) == 0 || strlen(env) >= length) { return -1; }
+		strcpy(path, env);
+		return 0;
+	}
+	home = getenv("HOME");
+	if (home == NULL) { home = getenv("USERPROFILE"); }
+	if (home == NULL
+		|| snprintf(path, length, "%s/.cvortex_tuning", home) >= (int)length) {
+		return -1;
+	}
+	return 0;
+}
+
+static void load_tuning_file() {
+	char path[1024], line[2 * CVTX_TUNING_NAME_LENGTH + 32];
+	char kernel_name[CVTX_TUNING_NAME_LENGTH], device_name[CVTX_TUNING_NAME_LENGTH];
+	struct tuning_record *rec;
+	int size;
+	FILE *file;
+	tuning_state.loaded = 1;
+	if (tuning_file_path(path, sizeof(path)) != 0) { return; }
+	file = fopen(path, "r");
+	if (file == NULL) { return; }
+	/* Each line is "kernel_name workgroup_size device name". */
+	while (fgets(line, sizeof(line), file) != NULL) {
+		if (sscanf(line, "%127s %d %127[^\n]", kernel_name, &size, device_name) != 3
+			|| size < CVTX_MIN_WORKGROUP_SIZE || size > CVTX_WORKGROUP_SIZE
+			|| (size & (size - 1)) != 0) {
+			/* The kernels' local reductions need a power of two. */
+			continue;
+		}
+		rec = realloc(tuning_state.records,
+			sizeof(struct tuning_record) * (tuning_state.num_records + 1));
+		if (rec == NULL) { break; }
+		tuning_state.records = rec;
+		rec = &tuning_state.records[tuning_state.num_records++];
+		memset(rec, 0, sizeof(struct tuning_record));
+		strcpy(rec->kernel_name, kernel_name);
+		strcpy(rec->device_name, device_name);
+		rec->workgroup_size = size;
+	}
+	fclose(file);
+	return;
+}
+
+static void save_tuning_file() {
+	char path[1024];
+	FILE *file;
+	int i;
+	if (tuning_file_path(path, sizeof(path)) != 0) { return; }
+	file = fopen(path, "w");
+	if (file == NULL) { return; }
+	for (i = 0; i < tuning_state.num_records; ++i) {
+		if (tuning_state.records[i].workgroup_size > 0) {
+			fprintf(file, "%s %d %s\n", tuning_state.records[i].kernel_name,
+				tuning_state.records[i].workgroup_size,
+				tuning_state.records[i].device_name);
+		}
+	}
+	fclose(file);
+	return;
+}
+
+static int find_record(const char *device_name, const char *kernel_name,
+	size_t max_workgroup_size) {
+	struct tuning_record *rec;
+	int i, size;
+	for (i = 0; i < tuning_state.num_records; ++i) {
+		if (!strcmp(tuning_state.records[i].kernel_name, kernel_name)
+			&& !strncmp(tuning_state.records[i].device_name, device_name,
+				CVTX_TUNING_NAME_LENGTH - 1)) {
+			return i;
+		}
+	}
+	rec = realloc(tuning_state.records,
+		sizeof(struct tuning_record) * (tuning_state.num_records + 1));
+	if (rec == NULL) { return -1; }
+	tuning_state.records = rec;
+	rec = &tuning_state.records[tuning_state.num_records];
+	memset(rec, 0, sizeof(struct tuning_record));
+	strncpy(rec->kernel_name, kernel_name, CVTX_TUNING_NAME_LENGTH - 1);
+	strncpy(rec->device_name, device_name, CVTX_TUNING_NAME_LENGTH - 1);
+	for (size = CVTX_MIN_WORKGROUP_SIZE; size <= CVTX_WORKGROUP_SIZE; size *= 2) {
+		if ((size_t)size <= max_workgroup_size) {
+			rec->candidates[rec->num_candidates++] = size;
+		}
+	}
+	if (rec->num_candidates == 0) { rec->workgroup_size = CVTX_WORKGROUP_SIZE; }
+	return tuning_state.num_records++;
+}
+
+static void record_trial(struct ocl_tuning_trial *trial, int status) {
+	struct tuning_record *rec;
+	double time_per_interaction;
+	int i, best, done;
+	if (trial->record < 0) { return; }
+	time_per_interaction = status == 0 ?
+		(wall_time() - trial->start) / trial->interactions : HUGE_VAL;
+#pragma omp critical (cvtx_opencl_tuning)
+	{
+		rec = &tuning_state.records[trial->record];
+		i = trial->candidate;
+		if (rec->workgroup_size == 0 && rec->trials[i] < CVTX_TUNING_TRIALS) {
+			rec->time_per_interaction[i] = status == 0 && rec->trials[i] > 0
+				&& rec->time_per_interaction[i] < time_per_interaction ?
+				rec->time_per_interaction[i] : time_per_interaction;
+			rec->trials[i] = status == 0 ? rec->trials[i] + 1 : CVTX_TUNING_TRIALS;
+			done = 1;
+			best = 0;
+			for (i = 0; i < rec->num_candidates; ++i) {
+				done = done && rec->trials[i] >= CVTX_TUNING_TRIALS;
+				best = rec->time_per_interaction[i] < rec->time_per_interaction[best] ?
+					i : best;
+			}
+			if (done) {
+				rec->workgroup_size = rec->time_per_interaction[best] < HUGE_VAL ?
+					rec->candidates[best] : CVTX_WORKGROUP_SIZE;
+				save_tuning_file();
+			}
+		}
+	}
+	trial->record = -1;
+	return;
+}
+
+static double wall_time() {
+#ifdef CVTX_USING_OPENMP
+	return omp_get_wtime();
+#else
+	return (double)clock() / CLOCKS_PER_SEC;
+#endif
+}
+
+#endif
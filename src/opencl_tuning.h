@@ -0,0 +1,85 @@
+#ifndef CVTX_OPENCL_TUNING_H
+#define CVTX_OPENCL_TUNING_H
+#include "libcvtx.h"
+/*============================================================================
+opencl_tuning.h
+
+Tuning of OpenCL workgroup sizes per device and kernel.
+
+Copyright(c) 2019 HJA Bird
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files(the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+============================================================================*/
+#ifdef CVTX_USING_OPENCL
+#include "opencl_acc.h"
+
+/*
+The best workgroup size (number of sources per group) differs between
+devices and kernels. Until a kernel is tuned on a device, calls that are
+large enough to time reliably try each candidate size in turn. Once all
+have been tried, the fastest is used from then on and saved to a tuning
+file so that later runs needn't repeat this.
+
+The tuning file is given by the CVTX_TUNING_FILE environment variable.
+Otherwise it is .cvortex_tuning in the user's home directory. If
+CVTX_TUNING_FILE is set but empty, nothing is saved.
+*/
+
+/* A call of an OpenCL implementation, timed for tuning. */
+struct ocl_tuning_trial {
+	int record;				/* Tuning record index. -1 if not timed. */
+	int candidate;			/* Index of the workgroup size being tried. */
+	double interactions;
+	double start;
+};
+
+/* Get the program and workgroup size to use for a call of the kernel
+kernel_prefix + vort_func->cl_kernel_name_ext (or just kernel_prefix if
+vort_func is NULL) with the given number of source-target interactions on
+the device of queue. Returns 0 if successful, -1 if there is no usable
+program. */
+int opencl_tuning_begin(
+	struct ocl_tuning_trial *trial,
+	cl_command_queue queue,
+	const char *kernel_prefix,
+	const cvtx_VortFunc *vort_func,
+	double interactions,
+	cl_program *program,
+	int *workgroup_size);
+
+/* As opencl_tuning_begin, for a call in the compensated accumulation mode.
+Only the built in regularisation functions (or vort_func NULL) have
+compensated kernels, and their workgroup size isn't tuned. Returns -1 if
+there is no usable program. */
+int opencl_tuning_begin_compensated(
+	struct ocl_tuning_trial *trial,
+	cl_command_queue queue,
+	const cvtx_VortFunc *vort_func,
+	cl_program *program,
+	int *workgroup_size);
+
+/* Finish a call begun with opencl_tuning_begin. status is the return
+value of the implementation (0 for success). */
+void opencl_tuning_end(struct ocl_tuning_trial *trial, int status);
+
+/* Forget all tuning results held in memory. */
+void opencl_tuning_finalise();
+
+#endif
+#endif /* CVTX_OPENCL_TUNING_H */
@@ -0,0 +1,382 @@
+#include "p3m.h"
+/*============================================================================
+p3m.c
+
+Particle-particle particle-mesh (P3M) methods for 3D vortex particles.
+
+Copyright(c) 2019 HJA Bird
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files(the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+============================================================================*/
+
+/*
+The interaction is split as K = K_far + (K - K_far), where K_far is the
+kernel of gaussian regularisation with a radius of a few mesh spacings.
+K_far is smooth, so it is computed accurately on the vortex-in-cell mesh.
+K - K_far decays rapidly, so it is summed directly over neighbouring
+particles found using a cell list. The near field keeps the accuracy of
+the user's regularisation.
+*/
+
+#include <assert.h>
+#include <math.h>
+#include <stdlib.h>
+
+#include "context.h"
+#include "uintkey.h"
+#include "vic.h"
+#include "stats.h"
+
+/* Gaussian splitting radius as a multiple of the mesh spacing. */
+#define CVTX_P3M_SPLIT_RATIO 2.f
+/* Kernels are treated as singular beyond where |1 - g(rho)| is below this. */
+#define CVTX_P3M_CUTOFF_TOL 1e-3f
+#define CVTX_P3M_MAX_CUTOFF_RHO 8.f
+
+/* Cell list of particles. Cell c holds particle_idx[cell_start[c]] to
+particle_idx[cell_start[c + 1] - 1]. */
+typedef struct {
+	int n[3];
+	float size;
+	float origin[3];
+	int *cell_start;
+	int *particle_idx;
+} p3m_cell_list;
+
+/* The smallest rho beyond which the kernel may be considered singular. */
+static float p3m_kernel_cutoff_rho(const cvtx_VortFunc *kernel) {
+	float rho = 0.5f;
+	while (rho < CVTX_P3M_MAX_CUTOFF_RHO
+		&& fabsf(1.f - kernel->g_3D(rho)) > CVTX_P3M_CUTOFF_TOL) {
+		rho += 0.5f;
+	}
+	return rho;
+}
+
+static int p3m_cell_list_build(p3m_cell_list *cells,
+	const cvtx_P3D **array_start, const int num_particles, float cell_size) {
+	int i, d, ncells, *cell_of;
+	float min[3], max[3];
+	minmax_xyz_posn(array_start, num_particles,
+		&min[0], &max[0], &min[1], &max[1], &min[2], &max[2]);
+	cells->size = cell_size;
+	for (d = 0; d < 3; ++d) {
+		cells->origin[d] = min[d];
+		cells->n[d] = (int)((max[d] - min[d]) / cell_size) + 1;
+	}
+	ncells = cells->n[0] * cells->n[1] * cells->n[2];
+	cells->cell_start = calloc(ncells + 1, sizeof(int));
+	cells->particle_idx = malloc(sizeof(int) * num_particles);
+	cell_of = malloc(sizeof(int) * num_particles);
+	if (cells->cell_start == NULL || cells->particle_idx == NULL
+		|| cell_of == NULL) {
+		free(cells->cell_start); free(cells->particle_idx); free(cell_of);
+		return -1;
+	}
+	/* Counting sort of particles by cell. */
+	for (i = 0; i < num_particles; ++i) {
+		int c[3];
+		for (d = 0; d < 3; ++d) {
+			c[d] = (int)((array_start[i]->coord.x[d] - cells->origin[d])
+				/ cell_size);
+			c[d] = c[d] < cells->n[d] ? c[d] : cells->n[d] - 1;
+		}
+		cell_of[i] = (c[0] * cells->n[1] + c[1]) * cells->n[2] + c[2];
+		cells->cell_start[cell_of[i] + 1] += 1;
+	}
+	for (i = 0; i < ncells; ++i) {
+		cells->cell_start[i + 1] += cells->cell_start[i];
+	}
+	for (i = 0; i < num_particles; ++i) {
+		cells->particle_idx[cells->cell_start[cell_of[i]]++] = i;
+	}
+	for (i = ncells; i > 0; --i) {
+		cells->cell_start[i] = cells->cell_start[i - 1];
+	}
+	cells->cell_start[0] = 0;
+	free(cell_of);
+	return 0;
+}
+
+static void p3m_cell_list_free(p3m_cell_list *cells) {
+	free(cells->cell_start);
+	free(cells->particle_idx);
+	return;
+}
+
+/* Range of cells [lo, hi] that may hold particles within one cell size of
+point. Returns 0 if there are none. */
+static int p3m_cell_range(const p3m_cell_list *cells, const bsv_V3f point,
+	int *lo, int *hi) {
+	int d;
+	for (d = 0; d < 3; ++d) {
+		float c = floorf((point.x[d] - cells->origin[d]) / cells->size);
+		lo[d] = c - 1.f < 0.f ? 0 : (int)c - 1;
+		hi[d] = c + 1.f > cells->n[d] - 1 ? cells->n[d] - 1 : (int)c + 1;
+		if (lo[d] > hi[d]) { return 0; }
+	}
+	return 1;
+}
+
+/* Near field velocity correction (K - K_far) at a point. */
+static bsv_V3f p3m_P3D_near_vel(
+	const p3m_cell_list *cells,
+	const cvtx_P3D **array_start,
+	const bsv_V3f mes_point,
+	const cvtx_VortFunc *kernel,
+	float regularisation_radius,
+	const cvtx_VortFunc *split_kernel,
+	float split_radius) {
+	int lo[3], hi[3], cx, cy, cz, i;
+	double rx = 0., ry = 0., rz = 0.;
+	float cutoff_sq = cells->size * cells->size;
+	bsv_V3f ret;
+	if (p3m_cell_range(cells, mes_point, lo, hi)) {
+		for (cx = lo[0]; cx <= hi[0]; ++cx) {
+			for (cy = lo[1]; cy <= hi[1]; ++cy) {
+				for (cz = lo[2]; cz <= hi[2]; ++cz) {
+					int c = (cx * cells->n[1] + cy) * cells->n[2] + cz;
+					for (i = cells->cell_start[c]; i < cells->cell_start[c + 1]; ++i) {
+						const cvtx_P3D *p = array_start[cells->particle_idx[i]];
+						bsv_V3f rad = bsv_V3f_minus(mes_point, p->coord);
+						bsv_V3f vn, vf;
+						if (bsv_V3f_dot(rad, rad) >= cutoff_sq) { continue; }
+						vn = cvtx_P3D_S2S_vel(p, mes_point, kernel,
+							regularisation_radius);
+						vf = cvtx_P3D_S2S_vel(p, mes_point, split_kernel,
+							split_radius);
+						rx += vn.x[0] - vf.x[0];
+						ry += vn.x[1] - vf.x[1];
+						rz += vn.x[2] - vf.x[2];
+					}
+				}
+			}
+		}
+	}
+	ret.x[0] = (float)rx;
+	ret.x[1] = (float)ry;
+	ret.x[2] = (float)rz;
+	return ret;
+}
+
+/* Near field vortex stretching correction (K - K_far) on a particle. */
+static bsv_V3f p3m_P3D_near_dvort(
+	const p3m_cell_list *cells,
+	const cvtx_P3D **array_start,
+	const cvtx_P3D *induced_particle,
+	const cvtx_VortFunc *kernel,
+	float regularisation_radius,
+	const cvtx_VortFunc *split_kernel,
+	float split_radius) {
+	int lo[3], hi[3], cx, cy, cz, i;
+	double rx = 0., ry = 0., rz = 0.;
+	float cutoff_sq = cells->size * cells->size;
+	bsv_V3f ret;
+	if (p3m_cell_range(cells, induced_particle->coord, lo, hi)) {
+		for (cx = lo[0]; cx <= hi[0]; ++cx) {
+			for (cy = lo[1]; cy <= hi[1]; ++cy) {
+				for (cz = lo[2]; cz <= hi[2]; ++cz) {
+					int c = (cx * cells->n[1] + cy) * cells->n[2] + cz;
+					for (i = cells->cell_start[c]; i < cells->cell_start[c + 1]; ++i) {
+						const cvtx_P3D *p = array_start[cells->particle_idx[i]];
+						bsv_V3f rad = bsv_V3f_minus(induced_particle->coord, p->coord);
+						bsv_V3f dn, df;
+						if (bsv_V3f_dot(rad, rad) >= cutoff_sq) { continue; }
+						dn = cvtx_P3D_S2S_dvort(p, induced_particle, kernel,
+							regularisation_radius);
+						df = cvtx_P3D_S2S_dvort(p, induced_particle, split_kernel,
+							split_radius);
+						rx += dn.x[0] - df.x[0];
+						ry += dn.x[1] - df.x[1];
+						rz += dn.x[2] - df.x[2];
+					}
+				}
+			}
+		}
+	}
+	ret.x[0] = (float)rx;
+	ret.x[1] = (float)ry;
+	ret.x[2] = (float)rz;
+	return ret;
+}
+
+/* Build the mesh velocity and the cell list for P3M on the bounds of the
+particles and the points in mes_start/induced_start (one may be NULL). */
+static int p3m_P3D_setup(
+	const cvtx_P3D **array_start,
+	const int num_particles,
+	const bsv_V3f *mes_start,
+	const cvtx_P3D **induced_start,
+	const int num_mes,
+	const cvtx_VortFunc *kernel,
+	float regularisation_radius,
+	const cvtx_RedistFunc *redistributor,
+	float grid_density,
+	float *split_radius,
+	vic_mesh_3D *mesh,
+	bsv_V3f **mesh_vel,
+	p3m_cell_list *cells) {
+	int i;
+	float min[3], max[3], cutoff, kernel_cutoff;
+	cvtx_VortFunc split_kernel = cvtx_VortFunc_gaussian();
+
+	*split_radius = CVTX_P3M_SPLIT_RATIO * grid_density;
+	cutoff = *split_radius * p3m_kernel_cutoff_rho(&split_kernel);
+	kernel_cutoff = fabsf(regularisation_radius) * p3m_kernel_cutoff_rho(kernel);
+	cutoff = cutoff > kernel_cutoff ? cutoff : kernel_cutoff;
+
+	minmax_xyz_posn(array_start, num_particles,
+		&min[0], &max[0], &min[1], &max[1], &min[2], &max[2]);
+	for (i = 0; i < num_mes; ++i) {
+		vic_bounds_3D(mes_start != NULL ? mes_start[i]
+			: induced_start[i]->coord, min, max);
+	}
+	if (vic_make_mesh_3D(mesh, min, max, grid_density,
+		vic_mesh_margin(redistributor)) != 0) {
+		return -1;
+	}
+	*mesh_vel = vic_P3D_mesh_vel(mesh, array_start, num_particles,
+		redistributor, *split_radius);
+	if (*mesh_vel == NULL) { return -1; }
+	if (p3m_cell_list_build(cells, array_start, num_particles, cutoff) != 0) {
+		free(*mesh_vel);
+		return -1;
+	}
+	return 0;
+}
+
+CVTX_EXPORT int cvtx_P3D_M2M_vel_p3m(
+	const cvtx_P3D **array_start,
+	const int num_particles,
+	const bsv_V3f *mes_start,
+	const int num_mes,
+	bsv_V3f *result_array,
+	const cvtx_VortFunc *kernel,
+	float regularisation_radius,
+	const cvtx_RedistFunc *redistributor,
+	float grid_density)
+{
+	assert(num_particles >= 0);
+	assert(num_mes >= 0);
+	assert(grid_density > 0.f);
+	long i;
+	float split_radius;
+	vic_mesh_3D mesh;
+	bsv_V3f *vel;
+	p3m_cell_list cells;
+	cvtx_VortFunc split_kernel = cvtx_VortFunc_gaussian();
+	stats_begin("cvtx_P3D_M2M_vel_p3m", num_particles, num_mes);
+
+	if (num_particles == 0 || num_mes == 0) {
+		for (i = 0; i < num_mes; ++i) { result_array[i] = bsv_V3f_zero(); }
+		stats_end();
+		return 0;
+	}
+	if (p3m_P3D_setup(array_start, num_particles, mes_start, NULL, num_mes,
+		kernel, regularisation_radius, redistributor, grid_density,
+		&split_radius, &mesh, &vel, &cells) != 0) {
+		stats_end();
+		return -1;
+	}
+#pragma omp parallel for schedule(dynamic, 64) num_threads(context_num_threads())
+	for (i = 0; i < num_mes; ++i) {
+		bsv_V3f far, near;
+		far = vic_P3D_m2p_vel(&mesh, vel, mes_start[i], redistributor);
+		near = p3m_P3D_near_vel(&cells, array_start, mes_start[i],
+			kernel, regularisation_radius, &split_kernel, split_radius);
+		result_array[i] = bsv_V3f_plus(far, near);
+	}
+	free(vel);
+	p3m_cell_list_free(&cells);
+	stats_end();
+	return 0;
+}
+
+CVTX_EXPORT int cvtx_P3D_M2M_dvort_p3m(
+	const cvtx_P3D **array_start,
+	const int num_particles,
+	const cvtx_P3D **induced_start,
+	const int num_induced,
+	bsv_V3f *result_array,
+	const cvtx_VortFunc *kernel,
+	float regularisation_radius,
+	const cvtx_RedistFunc *redistributor,
+	float grid_density)
+{
+	assert(num_particles >= 0);
+	assert(num_induced >= 0);
+	assert(grid_density > 0.f);
+	long i;
+	float split_radius;
+	vic_mesh_3D mesh;
+	bsv_V3f *vel;
+	p3m_cell_list cells;
+	cvtx_VortFunc split_kernel = cvtx_VortFunc_gaussian();
+	stats_begin("cvtx_P3D_M2M_dvort_p3m", num_particles, num_induced);
+
+	if (num_particles == 0 || num_induced == 0) {
+		for (i = 0; i < num_induced; ++i) { result_array[i] = bsv_V3f_zero(); }
+		stats_end();
+		return 0;
+	}
+	if (p3m_P3D_setup(array_start, num_particles, NULL, induced_start,
+		num_induced, kernel, regularisation_radius, redistributor,
+		grid_density, &split_radius, &mesh, &vel, &cells) != 0) {
+		stats_end();
+		return -1;
+	}
+#pragma omp parallel for schedule(dynamic, 64) num_threads(context_num_threads())
+	for (i = 0; i < num_induced; ++i) {
+		bsv_V3f far, near;
+		far = vic_P3D_m2p_dvort(&mesh, vel, induced_start[i], redistributor);
+		near = p3m_P3D_near_dvort(&cells, array_start, induced_start[i],
+			kernel, regularisation_radius, &split_kernel, split_radius);
+		result_array[i] = bsv_V3f_plus(far, near);
+	}
+	free(vel);
+	p3m_cell_list_free(&cells);
+	stats_end();
+	return 0;
+}
+
+CVTX_EXPORT void cvtx_P3D_p3m_enable(
+	const cvtx_RedistFunc *redistributor,
+	float grid_density)
+{
+	cvtx_Context_set_p3m(cvtx_Context_current(), redistributor, grid_density);
+	return;
+}
+
+CVTX_EXPORT void cvtx_P3D_p3m_disable(void) {
+	cvtx_Context_set_p3m(cvtx_Context_current(), NULL, 0.f);
+	return;
+}
+
+CVTX_EXPORT int cvtx_P3D_p3m_enabled(void) {
+	return context_current()->p3m;
+}
+
+int p3m_P3D_settings(cvtx_RedistFunc *redistributor, float *grid_density) {
+	const cvtx_Context *context = context_current();
+	if (context->p3m) {
+		*redistributor = context->p3m_redistributor;
+		*grid_density = context->p3m_grid_density;
+	}
+	return context->p3m;
+}
@@ -0,0 +1,35 @@
+#ifndef CVTX_P3M_H
+#define CVTX_P3M_H
+#include "libcvtx.h"
+/*============================================================================
+p3m.h
+
+Particle-particle particle-mesh (P3M) methods for 3D vortex particles.
+
+Copyright(c) 2019 HJA Bird
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files(the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+============================================================================*/
+
+/* Returns 1 and the mesh settings if cvtx_P3D_M2M_vel and
+cvtx_P3D_M2M_dvort should use P3M under the calling thread's current
+context, 0 otherwise. */
+int p3m_P3D_settings(cvtx_RedistFunc *redistributor, float *grid_density);
+
+#endif /* CVTX_P3M_H */
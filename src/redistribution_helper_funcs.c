@@ -30,6 +30,8 @@ SOFTWARE.
 #include <math.h>
 #include <stdlib.h>
 
+#include "context.h"
+
 float get_strength_threshold(
 	float* strs, int n_inpt_particles, int n_desired_particles) {
 
@@ -95,7 +97,7 @@ void farray_info(
 	ave = 0.f;
 	mi = ma = n_inpt_partices > 0 ? strs[0] : 0.f;
 	if (mean != NULL) {
-#pragma omp parallel for reduction(+: ave)
+#pragma omp parallel for reduction(+: ave) num_threads(context_num_threads())
 		for (i = 0; i < n_inpt_partices; ++i) {
 			ave += strs[i];
 		}
@@ -0,0 +1,346 @@
+#include "libcvtx.h"
+/*============================================================================
+snapshot.c
+
+Binary files of particles and filaments, mapped into memory when opened.
+
+Copyright(c) 2019 HJA Bird
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files(the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+============================================================================*/
+
+#include <assert.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#if defined(__unix__) || defined(__APPLE__)
+#	define CVTX_SNAPSHOT_MMAP
+#	include <fcntl.h>
+#	include <sys/mman.h>
+#	include <sys/stat.h>
+#	include <unistd.h>
+#endif
+
+#include "context.h"
+#include "vortfunc_builtin.h"
+
+/*
+A snapshot file is a header followed by a section for each of cvtx_P3D,
+cvtx_P2D and cvtx_F3D. Each section is the structs as laid out in memory, 
+starting at a multiple of CVTX_SNAPSHOT_ALIGN bytes from the start of the
+file. Files are only read on machines with the same byte order and struct
+layout as the one that wrote them, so that the mapped sections can be used
+in place.
+*/
+#define CVTX_SNAPSHOT_VERSION 1
+#define CVTX_SNAPSHOT_ALIGN 64
+#define CVTX_SNAPSHOT_BYTE_ORDER 0x01020304u
+/* Structs gathered for each fwrite. */
+#define CVTX_SNAPSHOT_CHUNK 4096
+
+enum snapshot_section {
+	SNAPSHOT_P3D,
+	SNAPSHOT_P2D,
+	SNAPSHOT_F3D,
+	SNAPSHOT_NUM_SECTIONS
+};
+
+struct snapshot_header {
+	char magic[8];						/* "CVTXSNAP" */
+	uint32_t version;
+	uint32_t byte_order;				/* CVTX_SNAPSHOT_BYTE_ORDER */
+	uint32_t struct_size[SNAPSHOT_NUM_SECTIONS];
+	float regularisation_radius;
+	char kernel[32];					/* cl_kernel_name_ext, or "". */
+	uint64_t count[SNAPSHOT_NUM_SECTIONS];
+	uint64_t offset[SNAPSHOT_NUM_SECTIONS];	/* From start of file. */
+};
+
+struct cvtx_Snapshot {
+	void *data;							/* The whole file. */
+	size_t size;
+	int mapped;							/* Else data was malloc'd. */
+	const struct snapshot_header *header;
+	const void **pointers[SNAPSHOT_NUM_SECTIONS];
+};
+
+static const size_t m_struct_size[SNAPSHOT_NUM_SECTIONS] = {
+	sizeof(cvtx_P3D), sizeof(cvtx_P2D), sizeof(cvtx_F3D) };
+
+static uint64_t round_up(uint64_t bytes) {
+	return (bytes + CVTX_SNAPSHOT_ALIGN - 1)
+		& ~(uint64_t)(CVTX_SNAPSHOT_ALIGN - 1);
+}
+
+/* Pad the file with zeros up to offset. */
+static int pad_to(FILE *file, uint64_t *position, uint64_t offset) {
+	static const char zeros[CVTX_SNAPSHOT_ALIGN] = { 0 };
+	size_t n = (size_t)(offset - *position);
+	assert(offset >= *position && n <= CVTX_SNAPSHOT_ALIGN);
+	if (n > 0 && fwrite(zeros, 1, n, file) != n) { return -1; }
+	*position = offset;
+	return 0;
+}
+
+/* Write the structs pointed to by start, gathered in chunks. */
+static int write_section(FILE *file, uint64_t *position,
+	const void **start, int num, size_t size) {
+	char *buffer;
+	int i, j, n;
+	if (num == 0) { return 0; }
+	buffer = malloc(size * CVTX_SNAPSHOT_CHUNK);
+	if (buffer == NULL) { return -1; }
+	for (i = 0; i < num; i += CVTX_SNAPSHOT_CHUNK) {
+		n = num - i < CVTX_SNAPSHOT_CHUNK ? num - i : CVTX_SNAPSHOT_CHUNK;
+		for (j = 0; j < n; ++j) {
+			memcpy(buffer + j * size, start[i + j], size);
+		}
+		if (fwrite(buffer, size, n, file) != (size_t)n) {
+			free(buffer);
+			return -1;
+		}
+	}
+	*position += (uint64_t)num * size;
+	free(buffer);
+	return 0;
+}
+
+CVTX_EXPORT int cvtx_Snapshot_write(
+	const char *path,
+	const cvtx_P3D **p3d_start,
+	const int num_p3d,
+	const cvtx_P2D **p2d_start,
+	const int num_p2d,
+	const cvtx_F3D **f3d_start,
+	const int num_f3d,
+	const cvtx_VortFunc *kernel,
+	float regularisation_radius)
+{
+	struct snapshot_header header;
+	const void **starts[SNAPSHOT_NUM_SECTIONS];
+	uint64_t position, end;
+	FILE *file;
+	int i, status = 0;
+	assert(num_p3d >= 0 && num_p2d >= 0 && num_f3d >= 0);
+	assert(num_p3d == 0 || p3d_start != NULL);
+	assert(num_p2d == 0 || p2d_start != NULL);
+	assert(num_f3d == 0 || f3d_start != NULL);
+	starts[SNAPSHOT_P3D] = (const void**)p3d_start;
+	starts[SNAPSHOT_P2D] = (const void**)p2d_start;
+	starts[SNAPSHOT_F3D] = (const void**)f3d_start;
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, "CVTXSNAP", 8);
+	header.version = CVTX_SNAPSHOT_VERSION;
+	header.byte_order = CVTX_SNAPSHOT_BYTE_ORDER;
+	header.regularisation_radius = regularisation_radius;
+	if (kernel != NULL) {
+		strncpy(header.kernel, kernel->cl_kernel_name_ext,
+			sizeof(header.kernel) - 1);
+	}
+	header.count[SNAPSHOT_P3D] = (uint64_t)num_p3d;
+	header.count[SNAPSHOT_P2D] = (uint64_t)num_p2d;
+	header.count[SNAPSHOT_F3D] = (uint64_t)num_f3d;
+	end = sizeof(header);
+	for (i = 0; i < SNAPSHOT_NUM_SECTIONS; ++i) {
+		header.struct_size[i] = (uint32_t)m_struct_size[i];
+		header.offset[i] = round_up(end);
+		end = header.offset[i] + header.count[i] * m_struct_size[i];
+	}
+
+	file = fopen(path, "wb");
+	if (file == NULL) { return -1; }
+	if (fwrite(&header, sizeof(header), 1, file) != 1) { status = -1; }
+	position = sizeof(header);
+	for (i = 0; i < SNAPSHOT_NUM_SECTIONS && status == 0; ++i) {
+		status = pad_to(file, &position, header.offset[i]);
+		if (status == 0) {
+			status = write_section(file, &position, starts[i],
+				(int)header.count[i], m_struct_size[i]);
+		}
+	}
+	if (fclose(file) != 0) { status = -1; }
+	return status;
+}
+
+/* Map (or failing that, read) the whole file. Returns 0 on success. */
+static int load_file(cvtx_Snapshot *snapshot, const char *path) {
+#ifdef CVTX_SNAPSHOT_MMAP
+	struct stat info;
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) { return -1; }
+	if (fstat(fd, &info) != 0 || info.st_size <= 0) {
+		close(fd);
+		return -1;
+	}
+	snapshot->size = (size_t)info.st_size;
+	snapshot->data = mmap(NULL, snapshot->size, PROT_READ, MAP_PRIVATE, fd, 0);
+	/* The mapping outlives the file descriptor. */
+	close(fd);
+	if (snapshot->data != MAP_FAILED) {
+		snapshot->mapped = 1;
+		return 0;
+	}
+	snapshot->data = NULL;
+#endif
+	FILE *file = fopen(path, "rb");
+	long size;
+	if (file == NULL) { return -1; }
+	if (fseek(file, 0, SEEK_END) != 0 || (size = ftell(file)) <= 0
+		|| fseek(file, 0, SEEK_SET) != 0) {
+		fclose(file);
+		return -1;
+	}
+	snapshot->size = (size_t)size;
+	snapshot->data = malloc(snapshot->size);
+	if (snapshot->data == NULL
+		|| fread(snapshot->data, 1, snapshot->size, file) != snapshot->size) {
+		free(snapshot->data);
+		snapshot->data = NULL;
+		fclose(file);
+		return -1;
+	}
+	fclose(file);
+	snapshot->mapped = 0;
+	return 0;
+}
+
+/* 1 if the header can be used with this build of the library. */
+static int header_valid(const struct snapshot_header *header, size_t size) {
+	int i;
+	if (memcmp(header->magic, "CVTXSNAP", 8)
+		|| header->version != CVTX_SNAPSHOT_VERSION
+		|| header->byte_order != CVTX_SNAPSHOT_BYTE_ORDER
+		|| memchr(header->kernel, '\0', sizeof(header->kernel)) == NULL) {
+		return 0;
+	}
+	for (i = 0; i < SNAPSHOT_NUM_SECTIONS; ++i) {
+		if (header->struct_size[i] != m_struct_size[i]
+			|| header->count[i] > INT_MAX
+			|| header->offset[i] % CVTX_SNAPSHOT_ALIGN != 0) {
+			return 0;
+		}
+		/* Empty sections at the end may start beyond the end of file. */
+		if (header->count[i] > 0 && (header->offset[i] > size
+			|| header->count[i] > (size - header->offset[i]) / m_struct_size[i])) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+CVTX_EXPORT cvtx_Snapshot* cvtx_Snapshot_open(const char *path) {
+	cvtx_Snapshot *snapshot = malloc(sizeof(cvtx_Snapshot));
+	const char *section;
+	long i, num;
+	int j;
+	if (snapshot == NULL) { return NULL; }
+	memset(snapshot, 0, sizeof(cvtx_Snapshot));
+	if (load_file(snapshot, path) != 0) {
+		free(snapshot);
+		return NULL;
+	}
+	snapshot->header = snapshot->data;
+	if (snapshot->size < sizeof(struct snapshot_header)
+		|| !header_valid(snapshot->header, snapshot->size)) {
+		cvtx_Snapshot_close(snapshot);
+		return NULL;
+	}
+	for (j = 0; j < SNAPSHOT_NUM_SECTIONS; ++j) {
+		num = (long)snapshot->header->count[j];
+		section = (const char*)snapshot->data + snapshot->header->offset[j];
+		snapshot->pointers[j] = malloc(sizeof(void*) * (num > 0 ? num : 1));
+		if (snapshot->pointers[j] == NULL) {
+			cvtx_Snapshot_close(snapshot);
+			return NULL;
+		}
+		/* Only the pointers are written: the pages of the file are read
+		when the pointed to structs are first used. */
+#pragma omp parallel for schedule(static) num_threads(context_num_threads())
+		for (i = 0; i < num; ++i) {
+			snapshot->pointers[j][i] = section + i * m_struct_size[j];
+		}
+	}
+	return snapshot;
+}
+
+CVTX_EXPORT void cvtx_Snapshot_close(cvtx_Snapshot *snapshot) {
+	int i;
+	if (snapshot == NULL) { return; }
+	for (i = 0; i < SNAPSHOT_NUM_SECTIONS; ++i) {
+		free((void*)snapshot->pointers[i]);
+	}
+#ifdef CVTX_SNAPSHOT_MMAP
+	if (snapshot->mapped) {
+		munmap(snapshot->data, snapshot->size);
+	}
+	else
+#endif
+	{
+		free(snapshot->data);
+	}
+	free(snapshot);
+	return;
+}
+
+CVTX_EXPORT const cvtx_P3D** cvtx_Snapshot_P3D(
+	const cvtx_Snapshot *snapshot, int *num_p3d) {
+	assert(snapshot != NULL);
+	if (num_p3d != NULL) { *num_p3d = (int)snapshot->header->count[SNAPSHOT_P3D]; }
+	return (const cvtx_P3D**)snapshot->pointers[SNAPSHOT_P3D];
+}
+
+CVTX_EXPORT const cvtx_P2D** cvtx_Snapshot_P2D(
+	const cvtx_Snapshot *snapshot, int *num_p2d) {
+	assert(snapshot != NULL);
+	if (num_p2d != NULL) { *num_p2d = (int)snapshot->header->count[SNAPSHOT_P2D]; }
+	return (const cvtx_P2D**)snapshot->pointers[SNAPSHOT_P2D];
+}
+
+CVTX_EXPORT const cvtx_F3D** cvtx_Snapshot_F3D(
+	const cvtx_Snapshot *snapshot, int *num_f3d) {
+	assert(snapshot != NULL);
+	if (num_f3d != NULL) { *num_f3d = (int)snapshot->header->count[SNAPSHOT_F3D]; }
+	return (const cvtx_F3D**)snapshot->pointers[SNAPSHOT_F3D];
+}
+
+CVTX_EXPORT int cvtx_Snapshot_kernel(
+	const cvtx_Snapshot *snapshot,
+	cvtx_VortFunc *kernel)
+{
+	assert(snapshot != NULL);
+	assert(kernel != NULL);
+	/* Built in kernels are named by their cl_kernel_name_ext. */
+#define CVTX_SNAPSHOT_KERNEL_CASE(NAME, G_3D, ZETA_3D, ETA_3D, G_2D, ETA_2D, VISCOUS) \
+	if (!strcmp(snapshot->header->kernel, #NAME)) {							\
+		*kernel = cvtx_VortFunc_##NAME();									\
+		return 0;															\
+	}
+	CVTX_BUILTIN_VORTFUNCS(CVTX_SNAPSHOT_KERNEL_CASE)
+#undef CVTX_SNAPSHOT_KERNEL_CASE
+	return -1;
+}
+
+CVTX_EXPORT float cvtx_Snapshot_regularisation_radius(
+	const cvtx_Snapshot *snapshot) {
+	assert(snapshot != NULL);
+	return snapshot->header->regularisation_radius;
+}
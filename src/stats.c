@@ -0,0 +1,274 @@
+#include "stats.h"
+/*============================================================================
+stats.c
+
+Opt in performance statistics of the public compute functions.
+
+Copyright(c) 2019 HJA Bird
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files(the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+============================================================================*/
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#ifdef CVTX_USING_OPENMP
+#	include <omp.h>
+#endif
+
+#include "context.h"
+
+/* Nesting deeper than this isn't recorded. */
+#define CVTX_STATS_MAX_DEPTH 8
+/* Calls beyond this many records are dropped. */
+#define CVTX_STATS_MAX_RECORDS (1 << 20)
+
+static struct {
+	volatile int enabled;
+	double epoch;				/* Wall time when enabled. */
+	int num_threads_seen;		/* For numbering threads. */
+	int num_records;
+	int max_records;
+	cvtx_StatsRecord *records;
+} stats_state = { 0, 0., 0, 0, 0, NULL };
+
+/* Calls in progress on this thread, innermost last. */
+static CVTX_THREAD_LOCAL cvtx_StatsRecord thread_calls[CVTX_STATS_MAX_DEPTH];
+static CVTX_THREAD_LOCAL int thread_depth = 0;
+/* Number of this thread in the records. -1 until first needed. */
+static CVTX_THREAD_LOCAL int thread_number = -1;
+
+/* The innermost call on this thread, or NULL if none is recorded. */
+static cvtx_StatsRecord *current_call();
+
+static const char *backend_name(int backend);
+static const char *fallback_name(int reason);
+static double wall_time();
+
+int stats_enabled(void) {
+	return stats_state.enabled;
+}
+
+void stats_begin(const char *function, int num_sources, int num_targets) {
+	cvtx_StatsRecord *rec;
+	if (!stats_state.enabled && thread_depth == 0) { return; }
+	thread_depth += 1;
+	rec = current_call();
+	if (rec == NULL) { return; }
+	if (thread_number < 0) {
+#pragma omp critical (cvtx_stats)
+		{
+			thread_number = stats_state.num_threads_seen++;
+		}
+	}
+	memset(rec, 0, sizeof(cvtx_StatsRecord));
+	rec->function = function;
+	rec->backend = CVTX_BACKEND_CPU;
+	rec->fallback = CVTX_FALLBACK_NONE;
+	rec->num_sources = num_sources;
+	rec->num_targets = num_targets;
+	rec->pairs = (double)num_sources * (double)num_targets;
+	rec->thread = thread_number;
+	rec->start = wall_time();
+	return;
+}
+
+void stats_end(void) {
+	cvtx_StatsRecord *rec, *grown;
+	int new_max;
+	if (thread_depth == 0) { return; }
+	rec = current_call();
+	thread_depth -= 1;
+	if (rec == NULL) { return; }
+	rec->time = wall_time() - rec->start;
+	if (rec->backend != CVTX_BACKEND_CPU) { rec->fallback = CVTX_FALLBACK_NONE; }
+#pragma omp critical (cvtx_stats)
+	{
+		if (stats_state.enabled
+			&& stats_state.num_records < CVTX_STATS_MAX_RECORDS) {
+			rec->start -= stats_state.epoch;
+			if (stats_state.num_records == stats_state.max_records) {
+				new_max = stats_state.max_records > 0 ?
+					2 * stats_state.max_records : 256;
+				grown = realloc(stats_state.records,
+					sizeof(cvtx_StatsRecord) * new_max);
+				if (grown != NULL) {
+					stats_state.records = grown;
+					stats_state.max_records = new_max;
+				}
+			}
+			if (stats_state.num_records < stats_state.max_records) {
+				stats_state.records[stats_state.num_records++] = *rec;
+			}
+		}
+	}
+	return;
+}
+
+void stats_backend(int backend) {
+	cvtx_StatsRecord *rec = current_call();
+	if (rec == NULL) { return; }
+	if (backend == CVTX_BACKEND_CPU && rec->backend != CVTX_BACKEND_CPU
+		&& rec->fallback == CVTX_FALLBACK_NONE) {
+		rec->fallback = CVTX_FALLBACK_ERROR;
+	}
+	rec->backend = backend;
+	return;
+}
+
+void stats_fallback(int reason) {
+	cvtx_StatsRecord *rec = current_call();
+	if (rec == NULL) { return; }
+	if (rec->fallback == CVTX_FALLBACK_NONE) { rec->fallback = reason; }
+	return;
+}
+
+void stats_phase_time(enum stats_phase phase, double seconds) {
+	cvtx_StatsRecord *rec = current_call();
+	if (rec == NULL) { return; }
+	switch (phase) {
+	case STATS_UPLOAD: rec->upload_time += seconds; break;
+	case STATS_COMPUTE: rec->compute_time += seconds; break;
+	case STATS_DOWNLOAD: rec->download_time += seconds; break;
+	}
+	return;
+}
+
+CVTX_EXPORT void cvtx_stats_enable(void) {
+#pragma omp critical (cvtx_stats)
+	{
+		if (!stats_state.enabled) {
+			stats_state.epoch = wall_time();
+			stats_state.enabled = 1;
+		}
+	}
+	return;
+}
+
+CVTX_EXPORT void cvtx_stats_disable(void) {
+#pragma omp critical (cvtx_stats)
+	{
+		stats_state.enabled = 0;
+	}
+	return;
+}
+
+CVTX_EXPORT int cvtx_stats_enabled(void) {
+	return stats_state.enabled;
+}
+
+CVTX_EXPORT int cvtx_stats_num_records(void) {
+	int num;
+#pragma omp critical (cvtx_stats)
+	{
+		num = stats_state.num_records;
+	}
+	return num;
+}
+
+CVTX_EXPORT int cvtx_stats_record(int index, cvtx_StatsRecord *record) {
+	assert(record != NULL);
+	int retv = -1;
+#pragma omp critical (cvtx_stats)
+	{
+		if (index >= 0 && index < stats_state.num_records) {
+			*record = stats_state.records[index];
+			retv = 0;
+		}
+	}
+	return retv;
+}
+
+CVTX_EXPORT void cvtx_stats_clear(void) {
+#pragma omp critical (cvtx_stats)
+	{
+		free(stats_state.records);
+		stats_state.records = NULL;
+		stats_state.num_records = 0;
+		stats_state.max_records = 0;
+		stats_state.epoch = wall_time();
+	}
+	return;
+}
+
+CVTX_EXPORT int cvtx_stats_write_trace(const char *path) {
+	assert(path != NULL);
+	const cvtx_StatsRecord *rec;
+	FILE *file;
+	int i, failed = 0;
+	file = fopen(path, "w");
+	if (file == NULL) { return -1; }
+#pragma omp critical (cvtx_stats)
+	{
+		/* Chrome's trace event format, times in microseconds. */
+		fprintf(file, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+		for (i = 0; i < stats_state.num_records; ++i) {
+			rec = &stats_state.records[i];
+			fprintf(file, "{\"name\": \"%s\", \"cat\": \"%s\", \"ph\": \"X\", "
+				"\"ts\": %.3f, \"dur\": %.3f, \"pid\": 0, \"tid\": %d, "
+				"\"args\": {\"sources\": %d, \"targets\": %d, \"pairs\": %.0f, "
+				"\"fallback\": \"%s\", \"upload_us\": %.3f, "
+				"\"compute_us\": %.3f, \"download_us\": %.3f}}%s\n",
+				rec->function, backend_name(rec->backend),
+				rec->start * 1e6, rec->time * 1e6, rec->thread,
+				rec->num_sources, rec->num_targets, rec->pairs,
+				fallback_name(rec->fallback), rec->upload_time * 1e6,
+				rec->compute_time * 1e6, rec->download_time * 1e6,
+				i + 1 < stats_state.num_records ? "," : "");
+		}
+		fprintf(file, "]}\n");
+	}
+	failed = ferror(file);
+	if (fclose(file) != 0) { failed = 1; }
+	return failed ? -1 : 0;
+}
+
+/* STATIC FUNCTIONS ---------------------------------------------------------*/
+static cvtx_StatsRecord *current_call() {
+	return thread_depth > 0 && thread_depth <= CVTX_STATS_MAX_DEPTH ?
+		&thread_calls[thread_depth - 1] : NULL;
+}
+
+static const char *backend_name(int backend) {
+	switch (backend) {
+	case CVTX_BACKEND_OPENCL: return "opencl";
+	case CVTX_BACKEND_HYBRID: return "hybrid";
+	default: return "cpu";
+	}
+}
+
+static const char *fallback_name(int reason) {
+	switch (reason) {
+	case CVTX_FALLBACK_NO_ACCELERATOR: return "no_accelerator";
+	case CVTX_FALLBACK_COST_MODEL: return "cost_model";
+	case CVTX_FALLBACK_FORCED: return "forced";
+	case CVTX_FALLBACK_UNSUPPORTED: return "unsupported";
+	case CVTX_FALLBACK_ERROR: return "error";
+	default: return "none";
+	}
+}
+
+static double wall_time() {
+#ifdef CVTX_USING_OPENMP
+	return omp_get_wtime();
+#else
+	return (double)clock() / CLOCKS_PER_SEC;
+#endif
+}
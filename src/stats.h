@@ -0,0 +1,69 @@
+#ifndef CVTX_STATS_H
+#define CVTX_STATS_H
+#include "libcvtx.h"
+/*============================================================================
+stats.h
+
+Opt in performance statistics of the public compute functions.
+
+Copyright(c) 2019 HJA Bird
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files(the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+============================================================================*/
+
+/*
+Each instrumented public function calls stats_begin on entry and stats_end
+before returning. Between them, the rest of the library annotates the call
+with the backend used, why the CPU was used and accelerator busy times.
+Calls may nest (cvtx_P3D_M2M_vel may call cvtx_P3D_M2M_vel_p3m, for
+instance), in which case annotations go to the innermost call.
+
+When statistics are disabled, these functions return immediately.
+*/
+
+/* Phases of an accelerator call. */
+enum stats_phase {
+	STATS_UPLOAD,
+	STATS_COMPUTE,
+	STATS_DOWNLOAD
+};
+
+/* 1 if statistics are being recorded. */
+int stats_enabled(void);
+
+/* Begin a call of function (a string literal) with num_sources sources
+and num_targets targets. */
+void stats_begin(const char *function, int num_sources, int num_targets);
+
+/* Complete the innermost call on this thread. */
+void stats_end(void);
+
+/* Record the backend (CVTX_BACKEND_XXX) of the innermost call. Going back
+to the CPU after choosing the accelerator, without a reason given by
+stats_fallback, is recorded as CVTX_FALLBACK_ERROR. */
+void stats_backend(int backend);
+
+/* Record why the innermost call uses the CPU (CVTX_FALLBACK_XXX). The
+first reason given is kept. */
+void stats_fallback(int reason);
+
+/* Add device busy time in seconds to a phase of the innermost call. */
+void stats_phase_time(enum stats_phase phase, double seconds);
+
+#endif /* CVTX_STATS_H */
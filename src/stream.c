@@ -0,0 +1,168 @@
+#include "libcvtx.h"
+/*============================================================================
+stream.c
+
+Streaming M2M methods: measurement points produced & consumed in blocks.
+
+Copyright(c) 2019 HJA Bird
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files(the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+============================================================================*/
+
+#include <assert.h>
+#include <stddef.h>
+#ifdef CVTX_USING_OPENMP
+#	include <omp.h>
+#endif
+
+#include "context.h"
+#include "workspace.h"
+
+/* Points per block if not chosen by the caller: enough to keep the 
+threads or an accelerator busy. */
+#define CVTX_STREAM_DEFAULT_BLOCK 65536
+
+typedef void(*P3D_m2m)(const cvtx_P3D **array_start, const int num_particles,
+	const bsv_V3f *mes_start, const int num_mes, bsv_V3f *result_array,
+	const cvtx_VortFunc *kernel, float regularisation_radius);
+
+static int P3D_stream(
+	P3D_m2m m2m,
+	const cvtx_P3D **array_start,
+	const int num_particles,
+	cvtx_V3f_source source,
+	cvtx_V3f_sink sink,
+	void *user_data,
+	int block_size,
+	int pipeline,
+	const cvtx_VortFunc *kernel,
+	float regularisation_radius)
+{
+	bsv_V3f *points[3], *results[3];
+	int num[3] = { 0, 0, 0 };	/* Points in each slot. */
+	int i, k, cur, next, prev, num_slots, status = 0;
+	size_t ws_mark;
+	assert(source != NULL);
+	assert(sink != NULL);
+	assert(block_size >= 0);
+	if (block_size == 0) { block_size = CVTX_STREAM_DEFAULT_BLOCK; }
+	/* The sink & source need a thread of their own. */
+	pipeline = pipeline && context_num_threads() > 1;
+	num_slots = pipeline ? 3 : 1;
+	ws_mark = workspace_mark();
+	for (i = 0; i < num_slots; ++i) {
+		points[i] = workspace_alloc(sizeof(bsv_V3f) * block_size);
+		results[i] = workspace_alloc(sizeof(bsv_V3f) * block_size);
+		if (points[i] == NULL || results[i] == NULL) {
+			workspace_reset(ws_mark);
+			return -1;
+		}
+	}
+
+	if (!pipeline) {
+		while ((num[0] = source(user_data, points[0], block_size)) > 0) {
+			assert(num[0] <= block_size);
+			m2m(array_start, num_particles, points[0], num[0], results[0],
+				kernel, regularisation_radius);
+			if (sink(user_data, points[0], results[0], num[0]) != 0) {
+				status = -1;
+				break;
+			}
+		}
+		if (num[0] < 0) { status = -1; }
+		workspace_reset(ws_mark);
+		return status;
+	}
+
+	/* Block k is computed in slot k % 3 while block k - 1 goes to the sink
+	from the slot before and block k + 1 is made in the slot after. */
+	num[0] = source(user_data, points[0], block_size);
+	context_nest_begin();
+	for (k = 0; num[k % 3] > 0 && status == 0; ++k) {
+		cur = k % 3;
+		next = (k + 1) % 3;
+		prev = (k + 2) % 3;
+		assert(num[cur] <= block_size);
+#pragma omp parallel num_threads(2)
+		{
+			int thread = 0, team_size = 1;
+#ifdef CVTX_USING_OPENMP
+			thread = omp_get_thread_num();
+			team_size = omp_get_num_threads();
+#endif
+			/* Thread 0 is the calling thread, with its context. */
+			if (thread == 0) {
+				m2m(array_start, num_particles, points[cur], num[cur],
+					results[cur], kernel, regularisation_radius);
+			}
+			if (thread == 1 || team_size == 1) {
+				if (num[prev] > 0 && sink(user_data, points[prev],
+					results[prev], num[prev]) != 0) {
+					status = -1;
+				}
+				num[prev] = 0;
+				num[next] = status == 0 ? 
+					source(user_data, points[next], block_size) : 0;
+			}
+		}
+		if (num[next] < 0) { status = -1; }
+	}
+	context_nest_end();
+	/* The last block computed. */
+	prev = (k + 2) % 3;
+	if (status == 0 && num[prev] > 0
+		&& sink(user_data, points[prev], results[prev], num[prev]) != 0) {
+		status = -1;
+	}
+	if (num[0] < 0) { status = -1; }
+	workspace_reset(ws_mark);
+	return status;
+}
+
+CVTX_EXPORT int cvtx_P3D_M2M_vel_stream(
+	const cvtx_P3D **array_start,
+	const int num_particles,
+	cvtx_V3f_source source,
+	cvtx_V3f_sink sink,
+	void *user_data,
+	const int block_size,
+	const int pipeline,
+	const cvtx_VortFunc *kernel,
+	float regularisation_radius)
+{
+	return P3D_stream(cvtx_P3D_M2M_vel, array_start, num_particles,
+		source, sink, user_data, block_size, pipeline,
+		kernel, regularisation_radius);
+}
+
+CVTX_EXPORT int cvtx_P3D_M2M_vort_stream(
+	const cvtx_P3D **array_start,
+	const int num_particles,
+	cvtx_V3f_source source,
+	cvtx_V3f_sink sink,
+	void *user_data,
+	const int block_size,
+	const int pipeline,
+	const cvtx_VortFunc *kernel,
+	float regularisation_radius)
+{
+	return P3D_stream(cvtx_P3D_M2M_vort, array_start, num_particles,
+		source, sink, user_data, block_size, pipeline,
+		kernel, regularisation_radius);
+}
@@ -27,9 +27,9 @@ SOFTWARE.
 
 #include <assert.h>
 #include <stdlib.h>
-#ifdef CVTX_USING_OPENMP
-#	include <omp.h>
-#endif
+
+#include "context.h"
+#include "workspace.h"
 
 /* STATIC DECLARATIONS -----------------------------------------------------*/
 
@@ -45,8 +45,9 @@ Uses parallel radix-8 sorting method.
 
 ui_start is an array of uibytes * num_items bytes long.
 key_start is an array of unsigned ints num_items long.
+Returns 0 on success or -1 if scratch memory could not be allocated.
 */
-static void sort_perm_multibyte_radix8(
+static int sort_perm_multibyte_radix8(
 	unsigned char* ui_start, size_t uibytes,
 	unsigned int* key_start, size_t num_items);
 
@@ -133,36 +134,36 @@ void minmax_xyz_posn(
 	return;
 }
 
-void sort_perm_UInt32Key2D(
+int sort_perm_UInt32Key2D(
 	UInt32Key2D *gridkeys,
 	unsigned int* key_start, size_t num_items) {
 	if (num_items == 0) {
-		return;	/* Nothing to do. */
+		return 0;	/* Nothing to do. */
 	}
 	else if (num_items < 1) {/*( 100000) { NOT GOOD ATM */
-		sort_perm_UInt32Key2D_quicksort(gridkeys,
-			key_start, num_items);
+		return sort_perm_UInt32Key2D_quicksort(gridkeys,
+			key_start, num_items) ? 0 : -1;
 	}
 	else {
-		sort_perm_multibyte_radix8(
+		return sort_perm_multibyte_radix8(
 			(unsigned char*)gridkeys, sizeof(UInt32Key2D),
 			key_start, num_items);
 	}
 }
 
-void sort_perm_UInt32Key3D(
+int sort_perm_UInt32Key3D(
 	UInt32Key3D *gridkeys,
 	unsigned int* key_start, size_t num_items) {
 	assert(num_items >= 0);
 	if (num_items == 0) {
-		return;	/* Nothing to do. */
+		return 0;	/* Nothing to do. */
 	}
 	else if(num_items < 1) {/*( 100000) { NOT GOOD ATM */
-		sort_perm_UInt32Key3D_quicksort(
-			gridkeys, key_start, num_items);
+		return sort_perm_UInt32Key3D_quicksort(
+			gridkeys, key_start, num_items) ? 0 : -1;
 	}
 	else {
-		sort_perm_multibyte_radix8(
+		return sort_perm_multibyte_radix8(
 			(unsigned char *)gridkeys, sizeof(UInt32Key3D),
 			key_start, num_items);
 	}
@@ -212,7 +213,7 @@ UInt32Key3D g_P3D_gridkey3D(
 	return ret;
 }
 
-void sort_perm_multibyte_radix8(
+int sort_perm_multibyte_radix8(
 	unsigned char* ui_start, size_t uibytes,
 	unsigned int* key_start, size_t num_items) {
 	/* A parallel radix sort where only the permutation of
@@ -242,19 +243,19 @@ void sort_perm_multibyte_radix8(
 	as working array (wa) or output array (oa) */
 	unsigned int *buffer = NULL, *wa = NULL, *oa = NULL;
 	unsigned int n_para = 0x1 << sizeof(char) * 8;
-#ifdef CVTX_USING_OPENMP
-	unsigned int nthreads = omp_get_num_procs();
-	omp_set_dynamic(0);
-	omp_set_num_threads(nthreads);
-#else
-	unsigned int nthreads = 1;
-#endif
+	/* Work is divided into a block per thread of the team. */
+	unsigned int nthreads = context_num_threads();
 	unsigned int *counts, *offsets, info_size = sizeof(unsigned int) * n_para;
 	/* swap = what are we writing the result of this iter into? */
 	unsigned int bit = 0, byte = 0, swap = 0, uini = (unsigned int)num_items;
-	buffer = malloc(num_items * sizeof(unsigned int));
-	counts = malloc(info_size * nthreads);
-	offsets = malloc(info_size * nthreads);
+	size_t ws_mark = workspace_mark();
+	buffer = workspace_alloc(num_items * sizeof(unsigned int));
+	counts = workspace_alloc(info_size * nthreads);
+	offsets = workspace_alloc(info_size * nthreads);
+	if (buffer == NULL || counts == NULL || offsets == NULL) {
+		workspace_reset(ws_mark);
+		return -1;
+	}
 
 	/* Number permutation array. */
 	int ci;
@@ -270,7 +271,7 @@ void sort_perm_multibyte_radix8(
 		int i = 0, j = 0, m = 0, n = 0, threadid;
 
 		/* Counting pass */
-#pragma omp parallel for private(m, n, j)
+#pragma omp parallel for private(m, n, j) num_threads(nthreads)
 		for (threadid = 0; threadid < (int)nthreads; ++threadid) {
 			m = (uini / nthreads) * threadid;
 			n = threadid == nthreads - 1 ?
@@ -282,7 +283,7 @@ void sort_perm_multibyte_radix8(
 			}
 		}
 		/* Compute offsets */
-#pragma omp parallel for private(n, j, i)
+#pragma omp parallel for private(n, j, i) num_threads(nthreads)
 		for (m = 0; m < (int)nthreads; ++m) {
 			for (n = 0; n < (int)n_para; ++n) {
 				for (j = 0; j < (int)nthreads; ++j) {
@@ -298,7 +299,7 @@ void sort_perm_multibyte_radix8(
 			}
 		}
 		/* Reorder pass*/
-#pragma omp parallel for private(m, n, j)
+#pragma omp parallel for private(m, n, j) num_threads(nthreads)
 		for (threadid = 0; threadid < (int)nthreads; ++threadid) {
 			m = (uini / nthreads) * threadid;
 			n = threadid == nthreads - 1 ?
@@ -317,13 +318,8 @@ void sort_perm_multibyte_radix8(
 	if (!swap) {
 		memcpy(key_start, buffer, num_items * sizeof(unsigned int));
 	}
-	free(buffer);
-	free(counts);
-	free(offsets);
-#ifdef CVTX_USING_OPENMP
-	omp_set_dynamic(1);
-#endif
-	return;
+	workspace_reset(ws_mark);
+	return 0;
 }
 
 static int sort_perm_UInt32Key2D_quicksort(
@@ -61,11 +61,13 @@ void minmax_xyz_posn(
 	float *xmin, float *xmax, float *ymin, float *ymax,
 	float *zmin, float *zmax);
 
-void sort_perm_UInt32Key2D(
+/* Sort permutation of gridkeys into key_start. Returns 0 on success or
+-1 if scratch memory could not be allocated. */
+int sort_perm_UInt32Key2D(
 	UInt32Key2D *gridkeys,
 	unsigned int* key_start, size_t num_items);
 
-void sort_perm_UInt32Key3D(
+int sort_perm_UInt32Key3D(
 	UInt32Key3D *gridkeys,
 	unsigned int* key_start, size_t num_items);
 
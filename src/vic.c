@@ -0,0 +1,670 @@
+#include "vic.h"
+/*============================================================================
+vic.c
+
+Vortex-in-cell (particle-mesh) velocity methods for 3D and 2D vortex
+particles.
+
+Copyright(c) 2019 HJA Bird
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files(the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+============================================================================*/
+
+/*
+The particle vorticity is interpolated onto a regular mesh using the same
+P2M step as cvtx_P3D_redistribute_on_grid. The Poisson equation for the
+stream function is then solved with an FFT convolution using a free-space
+Green's function (Hockney & Eastwood zero padding), the stream function is
+differentiated on the mesh and the result is interpolated back to the
+measurement points with the redistribution kernel.
+*/
+
+#include <assert.h>
+#include <math.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "context.h"
+#include "fft.h"
+#include "uintkey.h"
+#include "stats.h"
+
+#define CVTX_PI_D 3.14159265358979323846
+/* Mean of 1/r over a unit cube and log(r) over a unit square centered on
+the origin. Used to regularise the Green's function at r = 0. */
+#define CVTX_VIC_CUBE_MEAN_RECIP_R 2.3800774
+#define CVTX_VIC_SQUARE_MEAN_LOG_R -1.0611749
+
+typedef struct {
+	int n[2];
+	float h;
+	float origin[2];
+} vic_mesh_2D;
+
+/* Mesh vic_mesh_3D ---------------------------------------------------------*/
+
+int vic_mesh_margin(const cvtx_RedistFunc *redistributor) {
+	/* One node for differentiation, one so interpolation avoids edges. */
+	return (int)roundf(redistributor->radius) + 2;
+}
+
+void vic_bounds_3D(const bsv_V3f point, float *min, float *max) {
+	int d;
+	for (d = 0; d < 3; ++d) {
+		min[d] = min[d] > point.x[d] ? point.x[d] : min[d];
+		max[d] = max[d] < point.x[d] ? point.x[d] : max[d];
+	}
+	return;
+}
+
+/* The number of nodes needed to cover [min, max] with margin extra nodes
+each side. padded is the product of the zero padded lengths so far, and is
+multiplied by this one. Returns -1 if that would exceed
+CVTX_VIC_MAX_PADDED_NODES. */
+static int vic_mesh_length(float min, float max, float grid_density,
+	int margin, size_t *padded) {
+	double n = ceil(((double)max - (double)min) / grid_density)
+		+ 1. + 2. * margin;
+	size_t pn;
+	/* Also rejects NaN. */
+	if (!(n <= (double)CVTX_VIC_MAX_PADDED_NODES)) { return -1; }
+	pn = fft_next_pow2(2 * (size_t)n);
+	if (pn > CVTX_VIC_MAX_PADDED_NODES / *padded) { return -1; }
+	*padded *= pn;
+	return (int)n;
+}
+
+int vic_make_mesh_3D(vic_mesh_3D *mesh, const float *min,
+	const float *max, float grid_density, int margin) {
+	int d;
+	size_t padded = 1;
+	mesh->h = grid_density;
+	for (d = 0; d < 3; ++d) {
+		mesh->origin[d] = min[d] - margin * grid_density;
+		mesh->n[d] = vic_mesh_length(min[d], max[d], grid_density,
+			margin, &padded);
+		if (mesh->n[d] < 0) { return -1; }
+	}
+	return 0;
+}
+
+/* Interpolate the vorticity of the particles onto the zero padded complex
+arrays wxy (x + iy) and wz (z + 0i) of size pn. */
+static void vic_P3D_p2m(
+	const vic_mesh_3D *mesh, const size_t *pn,
+	const cvtx_P3D **array_start, const int num_particles,
+	const cvtx_RedistFunc *redistributor, double *wxy, double *wz) {
+	long i;
+	int grid_radius = (int)roundf(redistributor->radius);
+	float h = mesh->h;
+#pragma omp parallel for schedule(static) num_threads(context_num_threads())
+	for (i = 0; i < num_particles; ++i) {
+		int j, k, m;
+		UInt32Key3D key;
+		bsv_V3f p_coord, p_vort;
+		p_coord = array_start[i]->coord;
+		p_vort = array_start[i]->vorticity;
+		key = g_P3D_gridkey3D(array_start[i], h,
+			mesh->origin[0], mesh->origin[1], mesh->origin[2]);
+		for (j = -grid_radius; j <= grid_radius; ++j) {
+			for (k = -grid_radius; k <= grid_radius; ++k) {
+				for (m = -grid_radius; m <= grid_radius; ++m) {
+					float U, V, W, vortfrac;
+					size_t nx, ny, nz, idx;
+					nx = key.k.x + j;
+					ny = key.k.y + k;
+					nz = key.k.z + m;
+					U = fabsf((p_coord.x[0] - mesh->origin[0]) / h - (float)nx);
+					V = fabsf((p_coord.x[1] - mesh->origin[1]) / h - (float)ny);
+					W = fabsf((p_coord.x[2] - mesh->origin[2]) / h - (float)nz);
+					vortfrac = redistributor->func(U) * redistributor->func(V)
+						* redistributor->func(W);
+					idx = 2 * ((nx * pn[1] + ny) * pn[2] + nz);
+#pragma omp atomic
+					wxy[idx] += p_vort.x[0] * vortfrac;
+#pragma omp atomic
+					wxy[idx + 1] += p_vort.x[1] * vortfrac;
+#pragma omp atomic
+					wz[idx] += p_vort.x[2] * vortfrac;
+				}
+			}
+		}
+	}
+	return;
+}
+
+/* Fourier transform of the free-space Green's function of the Poisson
+equation, 1 / (4 pi r), on a padded mesh of size pn. If smoothing_radius
+is non-zero, the Green's function of a gaussian smoothed vorticity field,
+erf(r / (sqrt(2) s)) / (4 pi r), is used instead. The result is real and
+includes the 1 / N scaling of the inverse transform. NULL on failure. */
+static double *vic_greens_3D(const vic_mesh_3D *mesh, const size_t *pn,
+	float smoothing_radius) {
+	size_t i, j, k, ntot;
+	double *g, *tmp, h = mesh->h;
+	ntot = pn[0] * pn[1] * pn[2];
+	g = malloc(sizeof(double) * 2 * ntot);
+	if (g == NULL) { return NULL; }
+	for (i = 0; i < pn[0]; ++i) {
+		double di = (double)(i <= pn[0] / 2 ? i : pn[0] - i);
+		for (j = 0; j < pn[1]; ++j) {
+			double dj = (double)(j <= pn[1] / 2 ? j : pn[1] - j);
+			for (k = 0; k < pn[2]; ++k) {
+				double dk = (double)(k <= pn[2] / 2 ? k : pn[2] - k);
+				double r = h * sqrt(di * di + dj * dj + dk * dk);
+				size_t idx = (i * pn[1] + j) * pn[2] + k;
+				if (smoothing_radius > 0.f) {
+					double sr = sqrt(2.) * smoothing_radius;
+					g[2 * idx] = r > 0. ? erf(r / sr) / (4. * CVTX_PI_D * r)
+						: 2. / (sqrt(CVTX_PI_D) * sr * 4. * CVTX_PI_D);
+				}
+				else {
+					g[2 * idx] = r > 0. ? 1. / (4. * CVTX_PI_D * r)
+						: CVTX_VIC_CUBE_MEAN_RECIP_R / (4. * CVTX_PI_D * h);
+				}
+				g[2 * idx + 1] = 0.;
+			}
+		}
+	}
+	if (fft_c2c_3d(g, pn[0], pn[1], pn[2], 0)) {
+		free(g);
+		return NULL;
+	}
+	/* Green's function is real and even, so its transform is real. */
+	for (i = 0; i < ntot; ++i) {
+		g[i] = g[2 * i] / (double)ntot;
+	}
+	tmp = realloc(g, sizeof(double) * ntot);
+	return tmp != NULL ? tmp : g;
+}
+
+bsv_V3f *vic_P3D_mesh_vel(
+	const vic_mesh_3D *mesh,
+	const cvtx_P3D **array_start,
+	const int num_particles,
+	const cvtx_RedistFunc *redistributor,
+	float smoothing_radius) {
+	size_t pn[3], ntot, nmesh;
+	long i;
+	double *ghat = NULL, *wxy = NULL, *wz = NULL;
+	bsv_V3f *vel = NULL;
+	float recip_2h = 0.5f / mesh->h;
+
+	pn[0] = fft_next_pow2(2 * (size_t)mesh->n[0]);
+	pn[1] = fft_next_pow2(2 * (size_t)mesh->n[1]);
+	pn[2] = fft_next_pow2(2 * (size_t)mesh->n[2]);
+	ntot = pn[0] * pn[1] * pn[2];
+	nmesh = (size_t)mesh->n[0] * mesh->n[1] * mesh->n[2];
+
+	ghat = vic_greens_3D(mesh, pn, smoothing_radius);
+	wxy = calloc(2 * ntot, sizeof(double));
+	wz = calloc(2 * ntot, sizeof(double));
+	vel = malloc(sizeof(bsv_V3f) * nmesh);
+	if (ghat == NULL || wxy == NULL || wz == NULL || vel == NULL) {
+		free(ghat); free(wxy); free(wz); free(vel);
+		return NULL;
+	}
+
+	/* Stream function psi = G * omega. Vorticity x and y components are
+	transformed together as the real and imaginary parts of wxy. */
+	vic_P3D_p2m(mesh, pn, array_start, num_particles, redistributor, wxy, wz);
+	if (fft_c2c_3d(wxy, pn[0], pn[1], pn[2], 0)
+		|| fft_c2c_3d(wz, pn[0], pn[1], pn[2], 0)) {
+		free(ghat); free(wxy); free(wz); free(vel);
+		return NULL;
+	}
+#pragma omp parallel for schedule(static) num_threads(context_num_threads())
+	for (i = 0; i < (long)ntot; ++i) {
+		wxy[2 * i] *= ghat[i];
+		wxy[2 * i + 1] *= ghat[i];
+		wz[2 * i] *= ghat[i];
+		wz[2 * i + 1] *= ghat[i];
+	}
+	free(ghat);
+	if (fft_c2c_3d(wxy, pn[0], pn[1], pn[2], 1)
+		|| fft_c2c_3d(wz, pn[0], pn[1], pn[2], 1)) {
+		free(wxy); free(wz); free(vel);
+		return NULL;
+	}
+
+	/* Velocity u = curl(psi) with central differences. */
+#pragma omp parallel for schedule(static) num_threads(context_num_threads())
+	for (i = 0; i < mesh->n[0]; ++i) {
+		int j, k;
+		size_t si = pn[1] * pn[2], sj = pn[2];
+		for (j = 0; j < mesh->n[1]; ++j) {
+			for (k = 0; k < mesh->n[2]; ++k) {
+				size_t midx = ((size_t)i * mesh->n[1] + j) * mesh->n[2] + k;
+				size_t p = (size_t)i * si + (size_t)j * sj + k;
+				double dpsiy_dx, dpsiz_dx, dpsix_dy, dpsiz_dy, dpsix_dz, dpsiy_dz;
+				if (i == 0 || j == 0 || k == 0 || i == mesh->n[0] - 1
+					|| j == mesh->n[1] - 1 || k == mesh->n[2] - 1) {
+					vel[midx] = bsv_V3f_zero();
+					continue;
+				}
+				dpsiy_dx = wxy[2 * (p + si) + 1] - wxy[2 * (p - si) + 1];
+				dpsiz_dx = wz[2 * (p + si)] - wz[2 * (p - si)];
+				dpsix_dy = wxy[2 * (p + sj)] - wxy[2 * (p - sj)];
+				dpsiz_dy = wz[2 * (p + sj)] - wz[2 * (p - sj)];
+				dpsix_dz = wxy[2 * (p + 1)] - wxy[2 * (p - 1)];
+				dpsiy_dz = wxy[2 * (p + 1) + 1] - wxy[2 * (p - 1) + 1];
+				vel[midx].x[0] = (float)(dpsiz_dy - dpsiy_dz) * recip_2h;
+				vel[midx].x[1] = (float)(dpsix_dz - dpsiz_dx) * recip_2h;
+				vel[midx].x[2] = (float)(dpsiy_dx - dpsix_dy) * recip_2h;
+			}
+		}
+	}
+	free(wxy);
+	free(wz);
+	return vel;
+}
+
+bsv_V3f vic_P3D_m2p_vel(
+	const vic_mesh_3D *mesh, const bsv_V3f *vel,
+	const bsv_V3f mes_point, const cvtx_RedistFunc *redistributor) {
+	int j, k, m, d, grid_radius, key[3];
+	float rel[3];
+	double acc[3] = { 0., 0., 0. };
+	bsv_V3f ret;
+	grid_radius = (int)roundf(redistributor->radius);
+	for (d = 0; d < 3; ++d) {
+		rel[d] = (mes_point.x[d] - mesh->origin[d]) / mesh->h;
+		key[d] = (int)roundf(rel[d]);
+	}
+	for (j = key[0] - grid_radius; j <= key[0] + grid_radius; ++j) {
+		float U = redistributor->func(fabsf(rel[0] - (float)j));
+		for (k = key[1] - grid_radius; k <= key[1] + grid_radius; ++k) {
+			float V = redistributor->func(fabsf(rel[1] - (float)k));
+			for (m = key[2] - grid_radius; m <= key[2] + grid_radius; ++m) {
+				float w = U * V * redistributor->func(fabsf(rel[2] - (float)m));
+				bsv_V3f u = vel[((size_t)j * mesh->n[1] + k) * mesh->n[2] + m];
+				acc[0] += w * u.x[0];
+				acc[1] += w * u.x[1];
+				acc[2] += w * u.x[2];
+			}
+		}
+	}
+	ret.x[0] = (float)acc[0];
+	ret.x[1] = (float)acc[1];
+	ret.x[2] = (float)acc[2];
+	return ret;
+}
+
+bsv_V3f vic_P3D_m2p_dvort(
+	const vic_mesh_3D *mesh, const bsv_V3f *vel,
+	const cvtx_P3D *induced_particle, const cvtx_RedistFunc *redistributor) {
+	int j, k, m, d, grid_radius, key[3];
+	size_t stride[3];
+	float rel[3];
+	double acc[3] = { 0., 0., 0. };
+	bsv_V3f ret, vort = induced_particle->vorticity;
+	grid_radius = (int)roundf(redistributor->radius);
+	stride[0] = (size_t)mesh->n[1] * mesh->n[2];
+	stride[1] = (size_t)mesh->n[2];
+	stride[2] = 1;
+	for (d = 0; d < 3; ++d) {
+		rel[d] = (induced_particle->coord.x[d] - mesh->origin[d]) / mesh->h;
+		key[d] = (int)roundf(rel[d]);
+	}
+	for (j = key[0] - grid_radius; j <= key[0] + grid_radius; ++j) {
+		float U = redistributor->func(fabsf(rel[0] - (float)j));
+		for (k = key[1] - grid_radius; k <= key[1] + grid_radius; ++k) {
+			float V = redistributor->func(fabsf(rel[1] - (float)k));
+			for (m = key[2] - grid_radius; m <= key[2] + grid_radius; ++m) {
+				float w = U * V * redistributor->func(fabsf(rel[2] - (float)m));
+				size_t p = (size_t)j * stride[0] + (size_t)k * stride[1] + m;
+				for (d = 0; d < 3; ++d) {
+					bsv_V3f du = bsv_V3f_minus(vel[p + stride[d]], vel[p - stride[d]]);
+					acc[d] += w * bsv_V3f_dot(du, vort);
+				}
+			}
+		}
+	}
+	ret.x[0] = (float)(acc[0] * 0.5 / mesh->h);
+	ret.x[1] = (float)(acc[1] * 0.5 / mesh->h);
+	ret.x[2] = (float)(acc[2] * 0.5 / mesh->h);
+	return ret;
+}
+
+CVTX_EXPORT int cvtx_P3D_M2M_vel_vic(
+	const cvtx_P3D **array_start,
+	const int num_particles,
+	const bsv_V3f *mes_start,
+	const int num_mes,
+	bsv_V3f *result_array,
+	const cvtx_RedistFunc *redistributor,
+	float grid_density)
+{
+	assert(num_particles >= 0);
+	assert(num_mes >= 0);
+	assert(grid_density > 0.f);
+	long i;
+	int margin;
+	float min[3], max[3];
+	vic_mesh_3D mesh;
+	bsv_V3f *vel;
+	stats_begin("cvtx_P3D_M2M_vel_vic", num_particles, num_mes);
+
+	if (num_particles == 0 || num_mes == 0) {
+		for (i = 0; i < num_mes; ++i) { result_array[i] = bsv_V3f_zero(); }
+		stats_end();
+		return 0;
+	}
+	minmax_xyz_posn(array_start, num_particles,
+		&min[0], &max[0], &min[1], &max[1], &min[2], &max[2]);
+	for (i = 0; i < num_mes; ++i) {
+		vic_bounds_3D(mes_start[i], min, max);
+	}
+	margin = vic_mesh_margin(redistributor);
+	if (vic_make_mesh_3D(&mesh, min, max, grid_density, margin) != 0) {
+		stats_end();
+		return -1;
+	}
+
+	vel = vic_P3D_mesh_vel(
+		&mesh, array_start, num_particles, redistributor, 0.f);
+	if (vel == NULL) {
+		stats_end();
+		return -1;
+	}
+#pragma omp parallel for schedule(static) num_threads(context_num_threads())
+	for (i = 0; i < num_mes; ++i) {
+		result_array[i] = vic_P3D_m2p_vel(
+			&mesh, vel, mes_start[i], redistributor);
+	}
+	free(vel);
+	stats_end();
+	return 0;
+}
+
+CVTX_EXPORT int cvtx_P3D_M2M_dvort_vic(
+	const cvtx_P3D **array_start,
+	const int num_particles,
+	const cvtx_P3D **induced_start,
+	const int num_induced,
+	bsv_V3f *result_array,
+	const cvtx_RedistFunc *redistributor,
+	float grid_density)
+{
+	assert(num_particles >= 0);
+	assert(num_induced >= 0);
+	assert(grid_density > 0.f);
+	long i;
+	int margin;
+	float min[3], max[3];
+	vic_mesh_3D mesh;
+	bsv_V3f *vel;
+	stats_begin("cvtx_P3D_M2M_dvort_vic", num_particles, num_induced);
+
+	if (num_particles == 0 || num_induced == 0) {
+		for (i = 0; i < num_induced; ++i) { result_array[i] = bsv_V3f_zero(); }
+		stats_end();
+		return 0;
+	}
+	minmax_xyz_posn(array_start, num_particles,
+		&min[0], &max[0], &min[1], &max[1], &min[2], &max[2]);
+	for (i = 0; i < num_induced; ++i) {
+		vic_bounds_3D(induced_start[i]->coord, min, max);
+	}
+	margin = vic_mesh_margin(redistributor);
+	if (vic_make_mesh_3D(&mesh, min, max, grid_density, margin) != 0) {
+		stats_end();
+		return -1;
+	}
+
+	vel = vic_P3D_mesh_vel(
+		&mesh, array_start, num_particles, redistributor, 0.f);
+	if (vel == NULL) {
+		stats_end();
+		return -1;
+	}
+#pragma omp parallel for schedule(static) num_threads(context_num_threads())
+	for (i = 0; i < num_induced; ++i) {
+		result_array[i] = vic_P3D_m2p_dvort(
+			&mesh, vel, induced_start[i], redistributor);
+	}
+	free(vel);
+	stats_end();
+	return 0;
+}
+
+/* Mesh vic_mesh_2D ---------------------------------------------------------*/
+
+static void vic_bounds_2D(const bsv_V2f point, float *min, float *max) {
+	int d;
+	for (d = 0; d < 2; ++d) {
+		min[d] = min[d] > point.x[d] ? point.x[d] : min[d];
+		max[d] = max[d] < point.x[d] ? point.x[d] : max[d];
+	}
+	return;
+}
+
+static int vic_make_mesh_2D(vic_mesh_2D *mesh, const float *min,
+	const float *max, float grid_density, int margin) {
+	int d;
+	size_t padded = 1;
+	mesh->h = grid_density;
+	for (d = 0; d < 2; ++d) {
+		mesh->origin[d] = min[d] - margin * grid_density;
+		mesh->n[d] = vic_mesh_length(min[d], max[d], grid_density,
+			margin, &padded);
+		if (mesh->n[d] < 0) { return -1; }
+	}
+	return 0;
+}
+
+/* Interpolate the vorticity of the particles onto the real part of the
+zero padded complex array w of size pn. */
+static void vic_P2D_p2m(
+	const vic_mesh_2D *mesh, const size_t *pn,
+	const cvtx_P2D **array_start, const int num_particles,
+	const cvtx_RedistFunc *redistributor, double *w) {
+	long i;
+	int grid_radius = (int)roundf(redistributor->radius);
+	float h = mesh->h;
+#pragma omp parallel for schedule(static) num_threads(context_num_threads())
+	for (i = 0; i < num_particles; ++i) {
+		int j, k;
+		UInt32Key2D key;
+		bsv_V2f p_coord = array_start[i]->coord;
+		float p_vort = array_start[i]->vorticity;
+		key = g_P2D_gridkey2D(array_start[i], h,
+			mesh->origin[0], mesh->origin[1]);
+		for (j = -grid_radius; j <= grid_radius; ++j) {
+			for (k = -grid_radius; k <= grid_radius; ++k) {
+				float U, V, vortfrac;
+				size_t nx, ny;
+				nx = key.k.x + j;
+				ny = key.k.y + k;
+				U = fabsf((p_coord.x[0] - mesh->origin[0]) / h - (float)nx);
+				V = fabsf((p_coord.x[1] - mesh->origin[1]) / h - (float)ny);
+				vortfrac = redistributor->func(U) * redistributor->func(V);
+#pragma omp atomic
+				w[2 * (nx * pn[1] + ny)] += p_vort * vortfrac;
+			}
+		}
+	}
+	return;
+}
+
+/* Fourier transform of the free-space Green's function -log(r) / (2 pi)
+on a padded mesh of size pn, including the 1 / N inverse scaling. */
+static double *vic_greens_2D(const vic_mesh_2D *mesh, const size_t *pn) {
+	size_t i, j, ntot;
+	double *g, *tmp, h = mesh->h;
+	ntot = pn[0] * pn[1];
+	g = malloc(sizeof(double) * 2 * ntot);
+	if (g == NULL) { return NULL; }
+	for (i = 0; i < pn[0]; ++i) {
+		double di = (double)(i <= pn[0] / 2 ? i : pn[0] - i);
+		for (j = 0; j < pn[1]; ++j) {
+			double dj = (double)(j <= pn[1] / 2 ? j : pn[1] - j);
+			double r = h * sqrt(di * di + dj * dj);
+			size_t idx = i * pn[1] + j;
+			g[2 * idx] = r > 0. ? -log(r) / (2. * CVTX_PI_D)
+				: -(log(h) + CVTX_VIC_SQUARE_MEAN_LOG_R) / (2. * CVTX_PI_D);
+			g[2 * idx + 1] = 0.;
+		}
+	}
+	if (fft_c2c_2d(g, pn[0], pn[1], 0)) {
+		free(g);
+		return NULL;
+	}
+	for (i = 0; i < ntot; ++i) {
+		g[i] = g[2 * i] / (double)ntot;
+	}
+	tmp = realloc(g, sizeof(double) * ntot);
+	return tmp != NULL ? tmp : g;
+}
+
+static bsv_V2f *vic_P2D_mesh_vel(
+	const vic_mesh_2D *mesh,
+	const cvtx_P2D **array_start,
+	const int num_particles,
+	const cvtx_RedistFunc *redistributor) {
+	size_t pn[2], ntot, nmesh;
+	long i;
+	double *ghat = NULL, *w = NULL;
+	bsv_V2f *vel = NULL;
+	float recip_2h = 0.5f / mesh->h;
+
+	pn[0] = fft_next_pow2(2 * (size_t)mesh->n[0]);
+	pn[1] = fft_next_pow2(2 * (size_t)mesh->n[1]);
+	ntot = pn[0] * pn[1];
+	nmesh = (size_t)mesh->n[0] * mesh->n[1];
+
+	ghat = vic_greens_2D(mesh, pn);
+	w = calloc(2 * ntot, sizeof(double));
+	vel = malloc(sizeof(bsv_V2f) * nmesh);
+	if (ghat == NULL || w == NULL || vel == NULL) {
+		free(ghat); free(w); free(vel);
+		return NULL;
+	}
+
+	vic_P2D_p2m(mesh, pn, array_start, num_particles, redistributor, w);
+	if (fft_c2c_2d(w, pn[0], pn[1], 0)) {
+		free(ghat); free(w); free(vel);
+		return NULL;
+	}
+#pragma omp parallel for schedule(static) num_threads(context_num_threads())
+	for (i = 0; i < (long)ntot; ++i) {
+		w[2 * i] *= ghat[i];
+		w[2 * i + 1] *= ghat[i];
+	}
+	free(ghat);
+	if (fft_c2c_2d(w, pn[0], pn[1], 1)) {
+		free(w); free(vel);
+		return NULL;
+	}
+
+	/* Velocity (-dpsi/dy, dpsi/dx) to match cvtx_P2D_S2S_vel. */
+#pragma omp parallel for schedule(static) num_threads(context_num_threads())
+	for (i = 0; i < mesh->n[0]; ++i) {
+		int j;
+		for (j = 0; j < mesh->n[1]; ++j) {
+			size_t midx = (size_t)i * mesh->n[1] + j;
+			size_t p = (size_t)i * pn[1] + j;
+			if (i == 0 || j == 0 || i == mesh->n[0] - 1 || j == mesh->n[1] - 1) {
+				vel[midx] = bsv_V2f_zero();
+				continue;
+			}
+			vel[midx].x[0] = -(float)(w[2 * (p + 1)] - w[2 * (p - 1)]) * recip_2h;
+			vel[midx].x[1] = (float)(w[2 * (p + pn[1])] - w[2 * (p - pn[1])]) * recip_2h;
+		}
+	}
+	free(w);
+	return vel;
+}
+
+static bsv_V2f vic_P2D_m2p_vel(
+	const vic_mesh_2D *mesh, const bsv_V2f *vel,
+	const bsv_V2f mes_point, const cvtx_RedistFunc *redistributor) {
+	int j, k, d, grid_radius, key[2];
+	float rel[2];
+	double acc[2] = { 0., 0. };
+	bsv_V2f ret;
+	grid_radius = (int)roundf(redistributor->radius);
+	for (d = 0; d < 2; ++d) {
+		rel[d] = (mes_point.x[d] - mesh->origin[d]) / mesh->h;
+		key[d] = (int)roundf(rel[d]);
+	}
+	for (j = key[0] - grid_radius; j <= key[0] + grid_radius; ++j) {
+		float U = redistributor->func(fabsf(rel[0] - (float)j));
+		for (k = key[1] - grid_radius; k <= key[1] + grid_radius; ++k) {
+			float w = U * redistributor->func(fabsf(rel[1] - (float)k));
+			bsv_V2f u = vel[(size_t)j * mesh->n[1] + k];
+			acc[0] += w * u.x[0];
+			acc[1] += w * u.x[1];
+		}
+	}
+	ret.x[0] = (float)acc[0];
+	ret.x[1] = (float)acc[1];
+	return ret;
+}
+
+CVTX_EXPORT int cvtx_P2D_M2M_vel_vic(
+	const cvtx_P2D **array_start,
+	const int num_particles,
+	const bsv_V2f *mes_start,
+	const int num_mes,
+	bsv_V2f *result_array,
+	const cvtx_RedistFunc *redistributor,
+	float grid_density)
+{
+	assert(num_particles >= 0);
+	assert(num_mes >= 0);
+	assert(grid_density > 0.f);
+	long i;
+	int margin;
+	float min[2], max[2];
+	vic_mesh_2D mesh;
+	bsv_V2f *vel;
+	stats_begin("cvtx_P2D_M2M_vel_vic", num_particles, num_mes);
+
+	if (num_particles == 0 || num_mes == 0) {
+		for (i = 0; i < num_mes; ++i) { result_array[i] = bsv_V2f_zero(); }
+		stats_end();
+		return 0;
+	}
+	minmax_xy_posn(array_start, num_particles,
+		&min[0], &max[0], &min[1], &max[1]);
+	for (i = 0; i < num_mes; ++i) {
+		vic_bounds_2D(mes_start[i], min, max);
+	}
+	margin = vic_mesh_margin(redistributor);
+	if (vic_make_mesh_2D(&mesh, min, max, grid_density, margin) != 0) {
+		stats_end();
+		return -1;
+	}
+
+	vel = vic_P2D_mesh_vel(&mesh, array_start, num_particles, redistributor);
+	if (vel == NULL) {
+		stats_end();
+		return -1;
+	}
+#pragma omp parallel for schedule(static) num_threads(context_num_threads())
+	for (i = 0; i < num_mes; ++i) {
+		result_array[i] = vic_P2D_m2p_vel(
+			&mesh, vel, mes_start[i], redistributor);
+	}
+	free(vel);
+	stats_end();
+	return 0;
+}
@@ -0,0 +1,77 @@
+#ifndef CVTX_VIC_H
+#define CVTX_VIC_H
+#include "libcvtx.h"
+/*============================================================================
+vic.h
+
+Vortex-in-cell mesh apparatus shared between particle-mesh methods.
+
+Copyright(c) 2019 HJA Bird
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files(the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+============================================================================*/
+
+/* A regular mesh of nodes at origin + h * (i, j, k) */
+typedef struct {
+	int n[3];
+	float h;
+	float origin[3];
+} vic_mesh_3D;
+
+/* Number of nodes required beyond the bounds of the particles and
+measurement points for a given redistribution function. */
+int vic_mesh_margin(const cvtx_RedistFunc *redistributor);
+
+/* Extend the bounds [min, max] to include point. */
+void vic_bounds_3D(const bsv_V3f point, float *min, float *max);
+
+/* Most nodes allowed in the zero padded FFT mesh (512MB per complex
+array). Far apart particles or measurement points would otherwise ask
+for an unbounded mesh. */
+#define CVTX_VIC_MAX_PADDED_NODES ((size_t)1 << 25)
+
+/* Create a mesh covering [min, max] with margin extra nodes each side.
+Returns -1 if the zero padded mesh would have more than
+CVTX_VIC_MAX_PADDED_NODES nodes. */
+int vic_make_mesh_3D(vic_mesh_3D *mesh, const float *min,
+	const float *max, float grid_density, int margin);
+
+/* Compute the velocity on the mesh nodes. If smoothing_radius is non-zero,
+it is the velocity of a vorticity field with gaussian regularisation of that
+radius. Returns NULL if the mesh could not be allocated. Caller frees. */
+bsv_V3f *vic_P3D_mesh_vel(
+	const vic_mesh_3D *mesh,
+	const cvtx_P3D **array_start,
+	const int num_particles,
+	const cvtx_RedistFunc *redistributor,
+	float smoothing_radius);
+
+/* Interpolate the mesh velocity to a point using the redistribution
+kernel. */
+bsv_V3f vic_P3D_m2p_vel(
+	const vic_mesh_3D *mesh, const bsv_V3f *vel,
+	const bsv_V3f mes_point, const cvtx_RedistFunc *redistributor);
+
+/* Interpolate the vortex stretching grad(u)^T . vorticity of a particle
+from the mesh velocity. */
+bsv_V3f vic_P3D_m2p_dvort(
+	const vic_mesh_3D *mesh, const bsv_V3f *vel,
+	const cvtx_P3D *induced_particle, const cvtx_RedistFunc *redistributor);
+
+#endif /* CVTX_VIC_H */
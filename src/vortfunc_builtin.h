@@ -0,0 +1,171 @@
+#ifndef CVTX_VORTFUNC_BUILTIN_H
+#define CVTX_VORTFUNC_BUILTIN_H
+#include "libcvtx.h"
+/*============================================================================
+vortfunc_builtin.h
+
+The single definition of the built in vortex regularisation functions,
+shared by the CPU and OpenCL implementations.
+
+Copyright(c) 2019 HJA Bird
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files(the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+============================================================================*/
+#include <math.h>
+
+/*
+Each built in cvtx_VortFunc is a row of CVTX_BUILTIN_VORTFUNCS:
+	X(name, g_3D, zeta_3D, eta_3D, g_2D, eta_2D, viscous)
+where the functions are expressions of rho. name is also the
+cvtx_VortFunc's cl_kernel_name_ext. Rows that aren't viscous have no eta
+functions (their eta expressions are unused placeholders).
+
+The expressions are compiled as C here, in both float and double, and are
+stringified into the OpenCL kernels by opencl_acc.c, so they may only use
+the CVTX_VF_ maths macros and constants below (nbody.cl defines the OpenCL
+equivalents) and arithmetic. Other constants must be exact in float.
+*/
+#define CVTX_BUILTIN_VORTFUNCS(X)											\
+	X(singular,																\
+		1.f,																\
+		0.f,																\
+		0.f,																\
+		1.f,																\
+		0.f,																\
+		0)																	\
+	X(winckelmans,															\
+		(rho * rho + 2.5f) * rho * rho * rho								\
+			* CVTX_VF_RSQRT_POWN(rho * rho + 1.f, 5),						\
+		7.5f * CVTX_VF_RSQRT_POWN(rho * rho + 1.f, 7),						\
+		52.5f * CVTX_VF_RSQRT_POWN(rho * rho + 1.f, 9),						\
+		(rho * rho + 2.f) * rho * rho * CVTX_VF_POWN(rho * rho + 1.f, -2),	\
+		24.f * CVTX_VF_EXP(4.f * CVTX_VF_POWN(rho * rho + 1.f, -3))		\
+			* CVTX_VF_POWN(rho * rho + 1.f, -4),							\
+		1)																	\
+	X(planetary,															\
+		rho < 1.f ? rho * rho * rho : 1.f,									\
+		rho < 1.f ? 3.f : 0.f,												\
+		0.f,																\
+		rho < 1.f ? rho * rho : 1.f,										\
+		0.f,																\
+		0)																	\
+	X(gaussian,																\
+		CVTX_VF_ERF(rho * CVTX_VF_RECIP_SQRT_2)								\
+			- rho * CVTX_VF_SQRT_2_OVER_PI * CVTX_VF_EXP(-0.5f * rho * rho),\
+		CVTX_VF_SQRT_2_OVER_PI * CVTX_VF_EXP(-0.5f * rho * rho),			\
+		CVTX_VF_SQRT_2_OVER_PI * CVTX_VF_EXP(-0.5f * rho * rho),			\
+		1.f - CVTX_VF_EXP(-0.5f * rho * rho),								\
+		CVTX_VF_EXP(-0.5f * rho * rho),										\
+		1)
+
+#define CVTX_VF_EXP(X) expf(X)
+#define CVTX_VF_ERF(X) erff(X)
+#define CVTX_VF_POWN(X, N) powf((X), (float)(N))
+#define CVTX_VF_RSQRT_POWN(X, N) powf((X), -0.5f * (float)(N))
+#define CVTX_VF_RECIP_SQRT_2 0.7071067811865475f
+#define CVTX_VF_SQRT_2_OVER_PI 0.7978845608028654f
+
+enum vortfunc_builtin {
+#define CVTX_VORTFUNC_ENUM(NAME, G_3D, ZETA_3D, ETA_3D, G_2D, ETA_2D, VISCOUS) \
+	VORTFUNC_##NAME,
+	CVTX_BUILTIN_VORTFUNCS(CVTX_VORTFUNC_ENUM)
+#undef CVTX_VORTFUNC_ENUM
+	VORTFUNC_NUM_BUILTIN
+};
+
+/* Inline definitions, so that loops specialised for a built in function
+can see through them. vortfunc_combined_3D_xxx gives both g and zeta. */
+#define CVTX_VORTFUNC_INLINE(NAME, G_3D, ZETA_3D, ETA_3D, G_2D, ETA_2D, VISCOUS) \
+static inline float vortfunc_g_3D_##NAME(float rho) {							\
+	(void)rho;																	\
+	return (G_3D);																\
+}																				\
+static inline float vortfunc_zeta_3D_##NAME(float rho) {						\
+	(void)rho;																	\
+	return (ZETA_3D);															\
+}																				\
+static inline float vortfunc_eta_3D_##NAME(float rho) {							\
+	(void)rho;																	\
+	return (ETA_3D);															\
+}																				\
+static inline float vortfunc_g_2D_##NAME(float rho) {							\
+	(void)rho;																	\
+	return (G_2D);																\
+}																				\
+static inline float vortfunc_eta_2D_##NAME(float rho) {							\
+	(void)rho;																	\
+	return (ETA_2D);															\
+}																				\
+static inline void vortfunc_combined_3D_##NAME(									\
+	float rho, float *g, float *zeta) {											\
+	(void)rho;																	\
+	*g = (G_3D);																\
+	*zeta = (ZETA_3D);															\
+}
+CVTX_BUILTIN_VORTFUNCS(CVTX_VORTFUNC_INLINE)
+#undef CVTX_VORTFUNC_INLINE
+
+/* Double precision definitions, vortfunc_g_3D_d_xxx etc., for the double
+precision methods. */
+#undef CVTX_VF_EXP
+#undef CVTX_VF_ERF
+#undef CVTX_VF_POWN
+#undef CVTX_VF_RSQRT_POWN
+#undef CVTX_VF_RECIP_SQRT_2
+#undef CVTX_VF_SQRT_2_OVER_PI
+#define CVTX_VF_EXP(X) exp(X)
+#define CVTX_VF_ERF(X) erf(X)
+#define CVTX_VF_POWN(X, N) pow((X), (double)(N))
+#define CVTX_VF_RSQRT_POWN(X, N) pow((X), -0.5 * (double)(N))
+#define CVTX_VF_RECIP_SQRT_2 0.70710678118654752
+#define CVTX_VF_SQRT_2_OVER_PI 0.79788456080286536
+#define CVTX_VORTFUNC_INLINE_D(NAME, G_3D, ZETA_3D, ETA_3D, G_2D, ETA_2D, VISCOUS) \
+static inline double vortfunc_g_3D_d_##NAME(double rho) {						\
+	(void)rho;																	\
+	return (G_3D);																\
+}																				\
+static inline double vortfunc_g_2D_d_##NAME(double rho) {						\
+	(void)rho;																	\
+	return (G_2D);																\
+}																				\
+static inline void vortfunc_combined_3D_d_##NAME(								\
+	double rho, double *g, double *zeta) {										\
+	(void)rho;																	\
+	*g = (G_3D);																\
+	*zeta = (ZETA_3D);															\
+}
+CVTX_BUILTIN_VORTFUNCS(CVTX_VORTFUNC_INLINE_D)
+#undef CVTX_VORTFUNC_INLINE_D
+#undef CVTX_VF_EXP
+#undef CVTX_VF_ERF
+#undef CVTX_VF_POWN
+#undef CVTX_VF_RSQRT_POWN
+#undef CVTX_VF_RECIP_SQRT_2
+#undef CVTX_VF_SQRT_2_OVER_PI
+
+/* The index of a built in regularisation function, or -1 if vort_func
+isn't one. */
+int vortfunc_builtin_index(const cvtx_VortFunc *vort_func);
+
+/* cvtx_VortFunc::cl_generate as set by cvtx_VortFunc_init. The cl_ sources
+are only read when it has this value, so that a cvtx_VortFunc written 
+without them (where they may be uninitialised) is never dereferenced. */
+#define CVTX_VORTFUNC_CL_GENERATE 0x43565458u
+
+#endif /* CVTX_VORTFUNC_BUILTIN_H */
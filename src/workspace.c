@@ -0,0 +1,152 @@
+#include "workspace.h"
+/*============================================================================
+workspace.c
+
+Reusable scratch memory for transient buffers.
+
+Copyright(c) 2019 HJA Bird
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files(the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+============================================================================*/
+
+#include <assert.h>
+#include <stdlib.h>
+
+#include "context.h"
+
+/* Alignment of allocations. Cache line (and AVX-512) sized. */
+#define CVTX_WORKSPACE_ALIGN 64
+#define CVTX_WORKSPACE_MIN_BLOCK (1 << 16)
+
+struct workspace_block {
+	struct workspace_block *prev;
+	size_t offset;		/* Total size of blocks below this one. */
+	size_t size;
+	size_t used;
+	char *data;			/* Aligned start of memory. */
+	void *alloc;		/* As returned by malloc. */
+};
+
+static size_t round_up(size_t bytes) {
+	return (bytes + CVTX_WORKSPACE_ALIGN - 1)
+		& ~(size_t)(CVTX_WORKSPACE_ALIGN - 1);
+}
+
+/* Push a new block of at least size bytes. Returns 0 on success. */
+static int push_block(struct workspace *ws, size_t size) {
+	struct workspace_block *block = malloc(sizeof(struct workspace_block));
+	if (block == NULL) { return -1; }
+	size = size > CVTX_WORKSPACE_MIN_BLOCK ? size : CVTX_WORKSPACE_MIN_BLOCK;
+	block->alloc = malloc(size + CVTX_WORKSPACE_ALIGN);
+	if (block->alloc == NULL) {
+		free(block);
+		return -1;
+	}
+	block->data = (char*)round_up((size_t)block->alloc);
+	block->size = size;
+	block->used = 0;
+	block->prev = ws->top;
+	block->offset = ws->top != NULL ? ws->top->offset + ws->top->size : 0;
+	ws->top = block;
+	return 0;
+}
+
+static void pop_block(struct workspace *ws) {
+	struct workspace_block *block = ws->top;
+	assert(block != NULL);
+	ws->top = block->prev;
+	free(block->alloc);
+	free(block);
+	return;
+}
+
+void workspace_init(struct workspace *ws) {
+	ws->top = NULL;
+	ws->high_water = 0;
+	return;
+}
+
+void workspace_release(struct workspace *ws) {
+	while (ws->top != NULL) {
+		pop_block(ws);
+	}
+	ws->high_water = 0;
+	return;
+}
+
+size_t workspace_capacity(const struct workspace *ws) {
+	return ws->top != NULL ? ws->top->offset + ws->top->size : 0;
+}
+
+size_t workspace_mark(void) {
+	struct workspace *ws = context_workspace();
+	return ws->top != NULL ? ws->top->offset + ws->top->used : 0;
+}
+
+void* workspace_alloc(size_t bytes) {
+	return workspace_alloc_aligned(bytes, CVTX_WORKSPACE_ALIGN);
+}
+
+void* workspace_alloc_aligned(size_t bytes, size_t alignment) {
+	struct workspace *ws = context_workspace();
+	struct workspace_block *block;
+	size_t total, pad;
+	void *ret;
+	assert(alignment % CVTX_WORKSPACE_ALIGN == 0);
+	assert((alignment & (alignment - 1)) == 0);
+	bytes = round_up(bytes);
+	block = ws->top;
+	pad = block != NULL ?
+		(alignment - (size_t)(block->data + block->used) % alignment) % alignment
+		: 0;
+	if (block == NULL || block->size - block->used < bytes + pad) {
+		/* Blocks can't be moved whilst in use, so we add another. The
+		blocks are merged once they are no longer in use. */
+		if (block != NULL) { block->used = block->size; }
+		if (push_block(ws, bytes + alignment - CVTX_WORKSPACE_ALIGN) != 0) {
+			return NULL;
+		}
+		block = ws->top;
+		pad = (alignment - (size_t)block->data % alignment) % alignment;
+	}
+	ret = block->data + block->used + pad;
+	block->used += bytes + pad;
+	total = block->offset + block->used;
+	ws->high_water = total > ws->high_water ? total : ws->high_water;
+	return ret;
+}
+
+void workspace_reset(size_t mark) {
+	struct workspace *ws = context_workspace();
+	while (ws->top != NULL && ws->top->prev != NULL
+		&& ws->top->offset >= mark) {
+		pop_block(ws);
+	}
+	if (ws->top == NULL) { return; }
+	assert(mark >= ws->top->offset);
+	assert(mark <= ws->top->offset + ws->top->used);
+	ws->top->used = mark - ws->top->offset;
+	/* Once nothing is in use, replace fragmented or small storage with a
+	single block large enough for the most we've needed at once. */
+	if (mark == 0 && ws->top->size < ws->high_water) {
+		pop_block(ws);
+		push_block(ws, ws->high_water);
+	}
+	return;
+}
@@ -0,0 +1,74 @@
+#ifndef CVTX_WORKSPACE_H
+#define CVTX_WORKSPACE_H
+#include "libcvtx.h"
+/*============================================================================
+workspace.h
+
+Reusable scratch memory for transient buffers.
+
+Copyright(c) 2019 HJA Bird
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files(the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+============================================================================*/
+
+#include <stddef.h>
+
+/* A stack of scratch memory owned by a cvtx_Context. Memory is kept
+between calls and grows to the largest amount used at once, so repeated
+calls don't need to go back to the system allocator. */
+struct workspace_block;
+struct workspace {
+	struct workspace_block *top;	/* Most recently allocated block. */
+	size_t high_water;				/* Largest total use so far. */
+};
+
+void workspace_init(struct workspace *ws);
+
+/* Free all memory held by a workspace. */
+void workspace_release(struct workspace *ws);
+
+/* Bytes of memory held by a workspace. */
+size_t workspace_capacity(const struct workspace *ws);
+
+/* The functions below use the workspace of the calling thread's current
+cvtx_Context, or the calling thread's own if that is the default context.
+They must not be called by the worker threads of the library's own
+parallel regions.
+Typical usage is:
+	size_t mark = workspace_mark();
+	float *tmp = workspace_alloc(sizeof(float) * n);
+	...
+	workspace_reset(mark);
+*/
+
+/* The current position in the workspace. */
+size_t workspace_mark(void);
+
+/* Allocate aligned scratch memory that remains valid until 
+workspace_reset is called with a mark from before the allocation.
+Returns NULL on failure. */
+void* workspace_alloc(size_t bytes);
+
+/* As workspace_alloc, but aligned to a power of two multiple of 64 bytes. */
+void* workspace_alloc_aligned(size_t bytes, size_t alignment);
+
+/* Release all scratch memory allocated after mark was taken. */
+void workspace_reset(size_t mark);
+
+#endif /* CVTX_WORKSPACE_H */
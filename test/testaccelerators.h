@@ -31,6 +31,10 @@ SOFTWARE.
 #include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#ifdef _OPENMP
+#	include <omp.h>
+#endif
 
 int testAccelerators(){
     SECTION("Accelerators");
@@ -63,6 +67,303 @@ int testAccelerators(){
 		} 
 	}
 
+	/* Calls given to an accelerator run on it rather than falling back
+	to the CPU with an error: the accelerator's queue maps back to its
+	index, from which its programs (built in, double precision, 
+	compensated and generated for user functions) are found. */
+	if (cvtx_num_accelerators() > 0) {
+		const int n = 1000;
+		cvtx_P3D *particles = malloc(sizeof(cvtx_P3D) * n);
+		cvtx_P3Dd *particlesd = malloc(sizeof(cvtx_P3Dd) * n);
+		const cvtx_P3D **pparticles = malloc(sizeof(cvtx_P3D*) * n);
+		const cvtx_P3Dd **pparticlesd = malloc(sizeof(cvtx_P3Dd*) * n);
+		bsv_V3f *mes = malloc(sizeof(bsv_V3f) * n);
+		bsv_V3f *res = malloc(sizeof(bsv_V3f) * n);
+		cvtx_V3d *mesd = malloc(sizeof(cvtx_V3d) * n);
+		cvtx_V3d *resd = malloc(sizeof(cvtx_V3d) * n);
+		cvtx_VortFunc winckelmans = cvtx_VortFunc_winckelmans();
+		cvtx_VortFunc custom = cvtx_VortFunc_winckelmans();
+		cvtx_StatsRecord record;
+		int j, k, enabled[4], no_errors = 1;
+		for (j = 0; j < n; ++j) {
+			particles[j].coord = bsv_V3f_zero();
+			particles[j].coord.x[0] = (float)j / n;
+			particles[j].coord.x[1] = (float)(j % 10) / 10.f;
+			particles[j].vorticity = bsv_V3f_zero();
+			particles[j].vorticity.x[2] = 1.f;
+			particles[j].volume = 0.001f;
+			pparticles[j] = particles + j;
+			mes[j] = particles[j].coord;
+			mes[j].x[2] = 0.1f;
+			for (k = 0; k < 3; ++k) {
+				particlesd[j].coord.x[k] = particles[j].coord.x[k];
+				particlesd[j].vorticity.x[k] = particles[j].vorticity.x[k];
+				mesd[j].x[k] = mes[j].x[k];
+			}
+			particlesd[j].volume = particles[j].volume;
+			pparticlesd[j] = particlesd + j;
+		}
+		strcpy(custom.cl_kernel_name_ext, "test_winckelmans");
+		custom.cl_g_3D = "rho * rho * rho * (rho * rho + 2.5f) "
+			"* rsqrt(pown(rho * rho + 1.f, 5))";
+		for (i = 0; i < cvtx_num_accelerators(); ++i) {
+			enabled[i] = cvtx_accelerator_enabled(i);
+			cvtx_accelerator_disable(i);
+		}
+		cvtx_stats_enable();
+		for (i = 0; i < cvtx_num_accelerators(); ++i) {
+			cvtx_accelerator_enable(i);
+			cvtx_P3D_M2M_vel(pparticles, n, mes, n, res, &winckelmans, 0.1f);
+			cvtx_P3Dd_M2M_vel(pparticlesd, n, mesd, n, resd, &winckelmans, 0.1);
+			cvtx_Context_set_accumulation(NULL, CVTX_ACCUMULATE_COMPENSATED);
+			cvtx_P3D_M2M_vel(pparticles, n, mes, n, res, &winckelmans, 0.1f);
+			cvtx_Context_set_accumulation(NULL, CVTX_ACCUMULATE_DEFAULT);
+			cvtx_P3D_M2M_vel(pparticles, n, mes, n, res, &custom, 0.1f);
+			cvtx_accelerator_disable(i);
+		}
+		for (j = 0; j < cvtx_stats_num_records(); ++j) {
+			cvtx_stats_record(j, &record);
+			no_errors = no_errors && record.fallback != CVTX_FALLBACK_ERROR;
+		}
+		TEST(no_errors);
+		cvtx_stats_disable();
+		cvtx_stats_clear();
+		for (i = 0; i < cvtx_num_accelerators(); ++i) {
+			if (enabled[i]) { cvtx_accelerator_enable(i); }
+		}
+		free(particles); free(particlesd); free(pparticles); free(pparticlesd);
+		free(mes); free(res); free(mesd); free(resd);
+	}
+
+	/* Contexts have their own accelerators and thread settings. */
+	cvtx_Context *context = cvtx_Context_create();
+	TEST(context != NULL);
+	TEST(cvtx_Context_current() == NULL);
+	TEST(cvtx_Context_num_threads(context) == 0);
+	cvtx_Context_make_current(context);
+	TEST(cvtx_Context_current() == context);
+	TEST(cvtx_num_enabled_accelerators() <= cvtx_num_accelerators());
+	for (i = 0; i < cvtx_num_accelerators(); ++i) {
+		cvtx_accelerator_disable(i);
+	}
+	TEST(cvtx_num_enabled_accelerators() == 0);
+	cvtx_Context_set_num_threads(context, 1);
+	TEST(cvtx_Context_num_threads(context) == 1);
+	TEST(cvtx_Context_execution(context) == CVTX_EXECUTE_DEFAULT);
+	TEST(cvtx_Context_schedule(context) == CVTX_SCHEDULE_DEFAULT);
+	/* Scratch memory is kept to the high water mark. */
+	{
+		cvtx_P3D particles[64], output[64 * 27];
+		const cvtx_P3D *pparticles[64];
+		cvtx_RedistFunc lambda3 = cvtx_RedistFunc_lambda3();
+		size_t ws_size;
+		for (i = 0; i < 64; ++i) {
+			particles[i].coord.x[0] = (float)(i % 4);
+			particles[i].coord.x[1] = (float)((i / 4) % 4);
+			particles[i].coord.x[2] = (float)(i / 16);
+			particles[i].vorticity = bsv_V3f_zero();
+			particles[i].vorticity.x[0] = 1.f;
+			particles[i].volume = 1.f;
+			pparticles[i] = particles + i;
+		}
+		TEST(cvtx_Context_workspace_size(context) == 0);
+		cvtx_P3D_redistribute_on_grid(pparticles, 64, output, 64 * 27,
+			&lambda3, 0.5f, 0.f);
+		ws_size = cvtx_Context_workspace_size(context);
+		TEST(ws_size > 0);
+		cvtx_P3D_redistribute_on_grid(pparticles, 64, output, 64 * 27,
+			&lambda3, 0.5f, 0.f);
+		TEST(cvtx_Context_workspace_size(context) == ws_size);
+		cvtx_Context_release_workspace(context);
+		TEST(cvtx_Context_workspace_size(context) == 0);
+	}
+	/* Without accelerators, everything runs on the CPU. */
+	{
+		cvtx_P3D particles[300];
+		const cvtx_P3D *pparticles[300];
+		bsv_V3f mes[300], res[300];
+		cvtx_VortFunc winckelmans = cvtx_VortFunc_winckelmans();
+		for (i = 0; i < 300; ++i) {
+			particles[i].coord = bsv_V3f_zero();
+			particles[i].coord.x[0] = (float)i;
+			particles[i].vorticity = bsv_V3f_zero();
+			particles[i].vorticity.x[2] = 1.f;
+			particles[i].volume = 1.f;
+			pparticles[i] = particles + i;
+			mes[i] = particles[i].coord;
+			mes[i].x[1] = 1.f;
+		}
+		TEST(cvtx_predict_backend("cvtx_P3D_M2M_vel", 300, 300) == CVTX_BACKEND_CPU);
+		TEST(cvtx_predict_backend("not_a_function", 300, 300) == CVTX_BACKEND_CPU);
+		cvtx_P3D_M2M_vel(pparticles, 300, mes, 300, res, &winckelmans, 0.5f);
+		TEST(cvtx_last_backend() == CVTX_BACKEND_CPU);
+		TEST(cvtx_calibrate_dispatch() == -1);
+
+		/* Statistics record each call, and why it used the CPU. */
+		cvtx_StatsRecord record;
+		FILE *trace;
+		char trace_path[] = "cvtx_test_trace.json";
+		TEST(cvtx_stats_enabled() == 0);
+		cvtx_P3D_M2M_vel(pparticles, 300, mes, 300, res, &winckelmans, 0.5f);
+		TEST(cvtx_stats_num_records() == 0);
+		cvtx_stats_enable();
+		TEST(cvtx_stats_enabled() == 1);
+		cvtx_P3D_M2M_vel(pparticles, 300, mes, 300, res, &winckelmans, 0.5f);
+		TEST(cvtx_stats_num_records() == 1);
+		TEST(cvtx_stats_record(0, &record) == 0);
+		TEST(!strcmp(record.function, "cvtx_P3D_M2M_vel"));
+		TEST(record.backend == CVTX_BACKEND_CPU);
+		/* NONE if built without OpenCL. */
+		TEST(record.fallback == CVTX_FALLBACK_NO_ACCELERATOR
+			|| record.fallback == CVTX_FALLBACK_NONE);
+		TEST(record.num_sources == 300 && record.num_targets == 300);
+		TEST(record.pairs == 300. * 300.);
+		TEST(record.time >= 0. && record.start >= 0.);
+		TEST(cvtx_stats_record(1, &record) == -1);
+		TEST(cvtx_stats_write_trace(trace_path) == 0);
+		trace = fopen(trace_path, "r");
+		TEST(trace != NULL);
+		if (trace != NULL) {
+			TEST(fgetc(trace) == '{');
+			fclose(trace);
+			remove(trace_path);
+		}
+		cvtx_stats_disable();
+		cvtx_P3D_M2M_vel(pparticles, 300, mes, 300, res, &winckelmans, 0.5f);
+		TEST(cvtx_stats_num_records() == 1);
+		cvtx_stats_clear();
+		TEST(cvtx_stats_num_records() == 0);
+
+		/* The execution policy changes neither the results nor the
+		OpenMP settings of the caller. */
+		bsv_V3f res2[300];
+		cvtx_P3D output[300 * 27];
+		cvtx_RedistFunc lambda3 = cvtx_RedistFunc_lambda3();
+		int same = 1;
+#ifdef _OPENMP
+		int dynamic = omp_get_dynamic(), max_threads = omp_get_max_threads();
+		omp_sched_t kind, kind2;
+		int chunk, chunk2;
+		omp_get_schedule(&kind, &chunk);
+#endif
+		cvtx_Context_set_num_threads(context, 0);
+		cvtx_Context_set_execution(context, CVTX_EXECUTE_SERIAL);
+		TEST(cvtx_Context_execution(context) == CVTX_EXECUTE_SERIAL);
+		cvtx_Context_set_schedule(context, CVTX_SCHEDULE_DYNAMIC);
+		TEST(cvtx_Context_schedule(context) == CVTX_SCHEDULE_DYNAMIC);
+		cvtx_P3D_M2M_vel(pparticles, 300, mes, 300, res2, &winckelmans, 0.5f);
+		for (i = 0; i < 300; ++i) {
+			same = same && res[i].x[0] == res2[i].x[0]
+				&& res[i].x[1] == res2[i].x[1] && res[i].x[2] == res2[i].x[2];
+		}
+		TEST(same);
+		cvtx_P3D_redistribute_on_grid(pparticles, 300, output, 300 * 27,
+			&lambda3, 0.5f, 0.f);
+		cvtx_Context_set_execution(context, CVTX_EXECUTE_DEFAULT);
+		cvtx_Context_set_schedule(context, CVTX_SCHEDULE_DEFAULT);
+		/* As do copies of the sources for NUMA systems. */
+		TEST(cvtx_Context_numa(context) == CVTX_NUMA_NONE);
+		cvtx_Context_set_numa(context, CVTX_NUMA_FIRST_TOUCH);
+		TEST(cvtx_Context_numa(context) == CVTX_NUMA_FIRST_TOUCH);
+		cvtx_P3D_M2M_vel(pparticles, 300, mes, 300, res2, &winckelmans, 0.5f);
+		for (i = 0; i < 300; ++i) {
+			same = same && res[i].x[0] == res2[i].x[0]
+				&& res[i].x[1] == res2[i].x[1] && res[i].x[2] == res2[i].x[2];
+		}
+		cvtx_Context_set_numa(context, CVTX_NUMA_REPLICATE);
+		cvtx_P3D_M2M_vel(pparticles, 300, mes, 300, res2, &winckelmans, 0.5f);
+		for (i = 0; i < 300; ++i) {
+			same = same && res[i].x[0] == res2[i].x[0]
+				&& res[i].x[1] == res2[i].x[1] && res[i].x[2] == res2[i].x[2];
+		}
+		TEST(same);
+		cvtx_Context_set_numa(context, CVTX_NUMA_NONE);
+		cvtx_P3D_redistribute_on_grid(pparticles, 300, output, 300 * 27,
+			&lambda3, 0.5f, 0.f);
+#ifdef _OPENMP
+		TEST(omp_get_dynamic() == dynamic);
+		TEST(omp_get_max_threads() == max_threads);
+		omp_get_schedule(&kind2, &chunk2);
+		TEST(kind2 == kind && chunk2 == chunk);
+		/* Called from within the caller's parallel region. */
+		same = 1;
+#pragma omp parallel num_threads(2) reduction(&&:same)
+		{
+			bsv_V3f res3[300];
+			int j;
+			cvtx_P3D_M2M_vel(pparticles, 300, mes, 300, res3, &winckelmans, 0.5f);
+			for (j = 0; j < 300; ++j) {
+				same = same && res[j].x[0] == res3[j].x[0]
+					&& res[j].x[1] == res3[j].x[1] && res[j].x[2] == res3[j].x[2];
+			}
+		}
+		TEST(same);
+#endif
+	}
+	cvtx_Context_make_current(NULL);
+	TEST(cvtx_Context_current() == NULL);
+	TEST(cvtx_Context_num_threads(NULL) == 0);
+	TEST(cvtx_num_enabled_accelerators() == (cvtx_num_accelerators() > 0));
+	cvtx_Context_destroy(context);
+
+#ifdef _OPENMP
+	/* Threads can use the default context concurrently. */
+	{
+		cvtx_P3D particles[200], expected[200];
+		cvtx_P3D *pparticles[200];
+		bsv_V3f expected_sum = bsv_V3f_zero();
+		cvtx_VortFunc winckelmans = cvtx_VortFunc_winckelmans();
+		cvtx_RedistFunc lambda3 = cvtx_RedistFunc_lambda3();
+		int good = 1;
+		for (i = 0; i < 200; ++i) {
+			int j;
+			for (j = 0; j < 3; ++j) {
+				particles[i].coord.x[j] = (float)(mrand() % 100) / 10.f;
+				particles[i].vorticity.x[j] = (float)(mrand() % 100) / 100.f;
+			}
+			particles[i].volume = 0.1f;
+			pparticles[i] = expected + i;
+		}
+		memcpy(expected, particles, sizeof(particles));
+		cvtx_P3D_pedrizzetti_relaxation(pparticles, 200, 0.1f,
+			&winckelmans, 0.3f);
+		for (i = 0; i < 200; ++i) {
+			expected_sum = bsv_V3f_plus(expected_sum, expected[i].vorticity);
+		}
+#pragma omp parallel num_threads(8) reduction(&&:good)
+		{
+			cvtx_P3D mine[200], mine_output[200 * 27];
+			cvtx_P3D *pmine[200];
+			bsv_V3f sum;
+			int j, k, n;
+			for (j = 0; j < 200; ++j) { pmine[j] = mine + j; }
+			for (k = 0; k < 4; ++k) {
+				memcpy(mine, particles, sizeof(particles));
+				cvtx_P3D_pedrizzetti_relaxation(pmine, 200, 0.1f,
+					&winckelmans, 0.3f);
+				for (j = 0; j < 200; ++j) {
+					good = good && bsv_V3f_abs(bsv_V3f_minus(
+						mine[j].vorticity, expected[j].vorticity))
+						<= 1e-4f * bsv_V3f_abs(expected[j].vorticity);
+				}
+				/* The grid is randomly offset, but conserves vorticity. */
+				n = cvtx_P3D_redistribute_on_grid((const cvtx_P3D**)pmine,
+					200, mine_output, 200 * 27, &lambda3, 0.5f, 0.f);
+				sum = bsv_V3f_zero();
+				for (j = 0; j < n; ++j) {
+					sum = bsv_V3f_plus(sum, mine_output[j].vorticity);
+				}
+				good = good && n > 0 && bsv_V3f_abs(bsv_V3f_minus(sum,
+					expected_sum)) <= 1e-3f * bsv_V3f_abs(expected_sum);
+			}
+			/* Each thread has its own scratch memory. */
+			good = good && cvtx_Context_workspace_size(NULL) > 0;
+			cvtx_Context_release_workspace(NULL);
+		}
+		TEST(good);
+	}
+#endif
+
     return 0;
 }
 
@@ -0,0 +1,263 @@
+#ifndef CVTX_TEST_DOUBLE_H
+#define CVTX_TEST_DOUBLE_H
+
+/*============================================================================
+testdouble.h
+
+Test the double precision methods.
+
+Copyright(c) 2019 HJA Bird
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files(the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+============================================================================*/
+#include "../include/cvortex/libcvtx.h"
+
+#include <math.h>
+
+int testDouble() {
+	SECTION("Double");
+	const double pi = acos(-1.);
+	cvtx_VortFunc vfs = cvtx_VortFunc_singular();
+	cvtx_VortFunc vfw = cvtx_VortFunc_winckelmans();
+	{
+		/* Singular particle at the origin, analytic result (0, 1/4pi, 0). */
+		cvtx_P3Dd p = { {{0, 0, 0}}, {{0, 0, 1}}, 1 };
+		const cvtx_P3Dd *pp = &p;
+		cvtx_V3d mes = {{1, 0, 0}}, res;
+		cvtx_P3Dd_M2M_vel(&pp, 1, &mes, 1, &res, &vfs, 0.1);
+		TEST(res.x[0] == 0.);
+		TEST(fabs(res.x[1] - 1. / (4. * pi)) < 1e-15);
+		TEST(res.x[2] == 0.);
+	}
+	{
+		/* Straight singular filament, |vel| = (cos a - cos b) / (4 pi d). */
+		cvtx_F3Dd f = { {{-1, 0, 0}}, {{1, 0, 0}}, 1 };
+		const cvtx_F3Dd *pf = &f;
+		cvtx_V3d mes[2] = { {{0, 1, 0}}, {{3, 0, 0}} }, res[2];
+		cvtx_F3Dd_M2M_vel(&pf, 1, mes, 2, res);
+		TEST(fabs(fabs(res[0].x[2]) - 2. / (sqrt(2.) * 4. * pi)) < 1e-15);
+		TEST(res[0].x[0] == 0. && res[0].x[1] == 0.);
+		/* On axis. */
+		TEST(res[1].x[0] == 0. && res[1].x[1] == 0. && res[1].x[2] == 0.);
+	}
+	{
+		/* Agree with the single precision methods. */
+		cvtx_P3D ps[3] = { { {{0,0,0}}, {{1,0,0}}, 1 },
+			{ {{0.5f,0,0}}, {{0,1,0}}, 1 }, { {{0,0.3f,0.1f}}, {{0,0,1}}, 1 } };
+		cvtx_P2D p2s[3] = { { {{0,0}}, 1, 1 }, { {{0.5f,0}}, -0.5f, 1 },
+			{ {{0,0.3f}}, 2, 1 } };
+		cvtx_F3D fs[2] = { { {{0,0,0}}, {{1,0,0}}, 1 },
+			{ {{1,0,0}}, {{1,1,0.5f}}, -2 } };
+		const cvtx_P3D *pps[3] = { &ps[0], &ps[1], &ps[2] };
+		const cvtx_P2D *pp2s[3] = { &p2s[0], &p2s[1], &p2s[2] };
+		const cvtx_F3D *pfs[2] = { &fs[0], &fs[1] };
+		cvtx_P3Dd psd[3];
+		cvtx_P2Dd p2sd[3];
+		cvtx_F3Dd fsd[2];
+		const cvtx_P3Dd *ppsd[3] = { &psd[0], &psd[1], &psd[2] };
+		const cvtx_P2Dd *pp2sd[3] = { &p2sd[0], &p2sd[1], &p2sd[2] };
+		const cvtx_F3Dd *pfsd[2] = { &fsd[0], &fsd[1] };
+		bsv_V3f mes[2] = { {{0.2f,0.2f,0.2f}}, {{1,-1,0.5f}} }, res[3];
+		bsv_V2f mes2[2] = { {{0.2f,0.2f}}, {{1,-1}} }, res2[2];
+		cvtx_V3d mesd[2], resd[3];
+		cvtx_V2d mes2d[2], res2d[2];
+		int i, j, close = 1;
+		for (i = 0; i < 3; ++i) {
+			for (j = 0; j < 3; ++j) {
+				psd[i].coord.x[j] = ps[i].coord.x[j];
+				psd[i].vorticity.x[j] = ps[i].vorticity.x[j];
+			}
+			psd[i].volume = ps[i].volume;
+			for (j = 0; j < 2; ++j) { p2sd[i].coord.x[j] = p2s[i].coord.x[j]; }
+			p2sd[i].vorticity = p2s[i].vorticity;
+			p2sd[i].area = p2s[i].area;
+		}
+		for (i = 0; i < 2; ++i) {
+			for (j = 0; j < 3; ++j) {
+				fsd[i].start.x[j] = fs[i].start.x[j];
+				fsd[i].end.x[j] = fs[i].end.x[j];
+				mesd[i].x[j] = mes[i].x[j];
+			}
+			fsd[i].strength = fs[i].strength;
+			for (j = 0; j < 2; ++j) { mes2d[i].x[j] = mes2[i].x[j]; }
+		}
+
+		cvtx_P3D_M2M_vel(pps, 3, mes, 2, res, &vfw, 0.4f);
+		cvtx_P3Dd_M2M_vel(ppsd, 3, mesd, 2, resd, &vfw, 0.4);
+		for (i = 0; i < 2; ++i) for (j = 0; j < 3; ++j) {
+			close = close && fabs(res[i].x[j] - resd[i].x[j]) < 1e-5;
+		}
+		NAMED_TEST(close, "P3Dd_M2M_vel");
+
+		cvtx_P3D_M2M_dvort(pps, 3, pps, 3, res, &vfw, 0.4f);
+		cvtx_P3Dd_M2M_dvort(ppsd, 3, ppsd, 3, resd, &vfw, 0.4);
+		for (i = 0; i < 3; ++i) for (j = 0; j < 3; ++j) {
+			close = close && fabs(res[i].x[j] - resd[i].x[j]) < 1e-4;
+		}
+		NAMED_TEST(close, "P3Dd_M2M_dvort");
+
+		cvtx_P2D_M2M_vel(pp2s, 3, mes2, 2, res2, &vfw, 0.4f);
+		cvtx_P2Dd_M2M_vel(pp2sd, 3, mes2d, 2, res2d, &vfw, 0.4);
+		for (i = 0; i < 2; ++i) for (j = 0; j < 2; ++j) {
+			close = close && fabs(res2[i].x[j] - res2d[i].x[j]) < 1e-5;
+		}
+		NAMED_TEST(close, "P2Dd_M2M_vel");
+
+		cvtx_F3D_M2M_vel(pfs, 2, mes, 2, res);
+		cvtx_F3Dd_M2M_vel(pfsd, 2, mesd, 2, resd);
+		for (i = 0; i < 2; ++i) for (j = 0; j < 3; ++j) {
+			close = close && fabs(res[i].x[j] - resd[i].x[j]) < 1e-5;
+		}
+		NAMED_TEST(close, "F3Dd_M2M_vel");
+	}
+	{
+		/* Compensated float sums agree with double over many particles. */
+		const int n = 10000;
+		cvtx_P3D *ps = malloc(sizeof(cvtx_P3D) * n);
+		cvtx_P3Dd *psd = malloc(sizeof(cvtx_P3Dd) * n);
+		const cvtx_P3D **pps = malloc(sizeof(cvtx_P3D*) * n);
+		const cvtx_P3Dd **ppsd = malloc(sizeof(cvtx_P3Dd*) * n);
+		bsv_V3f mes[2] = { {{0.1f,0.2f,0.3f}}, {{2,-1,0.5f}} }, res[2], res1;
+		cvtx_V3d mesd[2], resd[2];
+		double mag;
+		int i, j, close = 1;
+		for (i = 0; i < n; ++i) {
+			for (j = 0; j < 3; ++j) {
+				ps[i].coord.x[j] = (float)sin(i * (j + 1.3)) * 3.f;
+				ps[i].vorticity.x[j] = (float)cos(i * (j + 2.7));
+				psd[i].coord.x[j] = ps[i].coord.x[j];
+				psd[i].vorticity.x[j] = ps[i].vorticity.x[j];
+			}
+			ps[i].volume = 1.f;
+			psd[i].volume = 1.;
+			pps[i] = &ps[i];
+			ppsd[i] = &psd[i];
+		}
+		for (i = 0; i < 2; ++i) for (j = 0; j < 3; ++j) {
+			mesd[i].x[j] = mes[i].x[j];
+		}
+		TEST(cvtx_Context_accumulation(NULL) == CVTX_ACCUMULATE_DEFAULT);
+		cvtx_Context_set_accumulation(NULL, CVTX_ACCUMULATE_COMPENSATED);
+		TEST(cvtx_Context_accumulation(NULL) == CVTX_ACCUMULATE_COMPENSATED);
+		cvtx_P3D_M2M_vel(pps, n, mes, 2, res, &vfw, 0.4f);
+		res1 = cvtx_P3D_M2S_vel(pps, n, mes[1], &vfw, 0.4f);
+		cvtx_Context_set_accumulation(NULL, CVTX_ACCUMULATE_DEFAULT);
+		cvtx_P3Dd_M2M_vel(ppsd, n, mesd, 2, resd, &vfw, 0.4);
+		for (i = 0; i < 2; ++i) {
+			mag = sqrt(resd[i].x[0] * resd[i].x[0] + resd[i].x[1] * resd[i].x[1]
+				+ resd[i].x[2] * resd[i].x[2]);
+			for (j = 0; j < 3; ++j) {
+				close = close && fabs(res[i].x[j] - resd[i].x[j]) < 1e-5 * mag;
+			}
+		}
+		NAMED_TEST(close, "Compensated P3D_M2M_vel");
+		for (j = 0; j < 3; ++j) {
+			close = close && fabs(res1.x[j] - res[1].x[j]) < 1e-5 * mag;
+		}
+		NAMED_TEST(close, "Compensated P3D_M2S_vel");
+
+		/* With more threads than targets, sources are split into tiles. */
+		cvtx_P2D *p2s = malloc(sizeof(cvtx_P2D) * n);
+		cvtx_P2Dd *p2sd = malloc(sizeof(cvtx_P2Dd) * n);
+		const cvtx_P2D **pp2s = malloc(sizeof(cvtx_P2D*) * n);
+		const cvtx_P2Dd **pp2sd = malloc(sizeof(cvtx_P2Dd*) * n);
+		bsv_V2f mes2[2] = { {{0.1f,0.2f}}, {{2,-1}} }, res2[2];
+		cvtx_V2d mes2d[2], res2d[2];
+		cvtx_Context *context = cvtx_Context_create();
+		cvtx_Context_make_current(context);
+		cvtx_Context_set_num_threads(context, 4);
+		for (i = 0; i < n; ++i) {
+			for (j = 0; j < 2; ++j) {
+				p2s[i].coord.x[j] = ps[i].coord.x[j];
+				p2sd[i].coord.x[j] = ps[i].coord.x[j];
+			}
+			p2s[i].vorticity = ps[i].vorticity.x[2];
+			p2sd[i].vorticity = ps[i].vorticity.x[2];
+			p2s[i].area = 1.f;
+			p2sd[i].area = 1.;
+			pp2s[i] = &p2s[i];
+			pp2sd[i] = &p2sd[i];
+		}
+		for (i = 0; i < 2; ++i) for (j = 0; j < 2; ++j) {
+			mes2d[i].x[j] = mes2[i].x[j];
+		}
+		cvtx_P3D_M2M_vel(pps, n, mes, 2, res, &vfw, 0.4f);
+		for (i = 0; i < 2; ++i) {
+			mag = sqrt(resd[i].x[0] * resd[i].x[0] + resd[i].x[1] * resd[i].x[1]
+				+ resd[i].x[2] * resd[i].x[2]);
+			for (j = 0; j < 3; ++j) {
+				close = close && fabs(res[i].x[j] - resd[i].x[j]) < 1e-4 * mag;
+			}
+		}
+		NAMED_TEST(close, "Tiled P3D_M2M_vel");
+		cvtx_P2D_M2M_vel(pp2s, n, mes2, 2, res2, &vfw, 0.4f);
+		cvtx_P2Dd_M2M_vel(pp2sd, n, mes2d, 2, res2d, &vfw, 0.4);
+		for (i = 0; i < 2; ++i) {
+			mag = sqrt(res2d[i].x[0] * res2d[i].x[0] + res2d[i].x[1] * res2d[i].x[1]);
+			for (j = 0; j < 2; ++j) {
+				close = close && fabs(res2[i].x[j] - res2d[i].x[j]) < 1e-4 * mag;
+			}
+		}
+		NAMED_TEST(close, "Tiled P2D_M2M_vel");
+		/* Tiled and untiled viscous and gradient methods agree. */
+		{
+			bsv_V3f visc[2], visc1[2], grad[6], grad1[6];
+			float visc2[2], visc21[2];
+			cvtx_P3D_M2M_visc_dvort(pps, n, pps, 2, visc, &vfw, 0.4f, 0.1f);
+			cvtx_P2D_M2M_visc_dvort(pp2s, n, pp2s, 2, visc2, &vfw, 0.4f, 0.1f);
+			cvtx_P3D_M2M_vel_grad(pps, n, mes, 2, res, grad, &vfw, 0.4f);
+			cvtx_Context_set_num_threads(context, 1);
+			cvtx_P3D_M2M_visc_dvort(pps, n, pps, 2, visc1, &vfw, 0.4f, 0.1f);
+			cvtx_P2D_M2M_visc_dvort(pp2s, n, pp2s, 2, visc21, &vfw, 0.4f, 0.1f);
+			cvtx_P3D_M2M_vel_grad(pps, n, mes, 2, res, grad1, &vfw, 0.4f);
+			cvtx_Context_set_num_threads(context, 4);
+			for (i = 0; i < 2; ++i) {
+				mag = sqrt(visc1[i].x[0] * visc1[i].x[0]
+					+ visc1[i].x[1] * visc1[i].x[1] + visc1[i].x[2] * visc1[i].x[2]);
+				for (j = 0; j < 3; ++j) {
+					close = close && fabs(visc[i].x[j] - visc1[i].x[j]) <= 1e-5 * mag;
+				}
+				close = close
+					&& fabs(visc2[i] - visc21[i]) <= 1e-5 * fabs(visc21[i]);
+			}
+			NAMED_TEST(close, "Tiled P3D and P2D_M2M_visc_dvort");
+			for (i = 0; i < 6; ++i) {
+				mag = sqrt(grad1[i].x[0] * grad1[i].x[0]
+					+ grad1[i].x[1] * grad1[i].x[1] + grad1[i].x[2] * grad1[i].x[2]);
+				for (j = 0; j < 3; ++j) {
+					close = close && fabs(grad[i].x[j] - grad1[i].x[j]) <= 1e-4 * mag;
+				}
+			}
+			NAMED_TEST(close, "Tiled P3D_M2M_vel_grad");
+		}
+		cvtx_Context_make_current(NULL);
+		cvtx_Context_destroy(context);
+		free(p2s);
+		free(p2sd);
+		free(pp2s);
+		free(pp2sd);
+		free(ps);
+		free(psd);
+		free(pps);
+		free(ppsd);
+	}
+	return 0;
+}
+
+#endif /* CVTX_TEST_DOUBLE_H */
@@ -96,6 +96,9 @@ int mrand(void)
 #include "testvortfunc.h"
 #include "testsamecpugpuresultsingle.h"
 #include "testsamecpugpuresultmany.h"
+#include "testvic.h"
+#include "testdouble.h"
+#include "testsnapshot.h"
 
 int main(int argc, char* argv[]){
 	cvtx_initialise();
@@ -104,6 +107,9 @@ int main(int argc, char* argv[]){
     testParticle();
 	testSameCpuGpuResSingle();
 	testSameCpuGpuResMany();
+	testVic();
+	testDouble();
+	testSnapshot();
 	cvtx_finalise();
 	SECTION("");
 	return print_summary();
@@ -29,6 +29,53 @@ SOFTWARE.
 #include "../include/cvortex/libcvtx.h"
 
 #include <math.h>
+#include <string.h>
+#ifdef _OPENMP
+#	include <omp.h>
+#endif
+
+/* A probe grid for the streaming methods: points are given from mes and
+the results received are kept in res. */
+struct stream_probes {
+	const bsv_V3f *mes;
+	bsv_V3f *res;
+	int num, given, received;
+	int points_match;
+	int fail_source_at;		/* Points given before the source fails, or -1. */
+};
+
+static int stream_probe_source(void *user_data, bsv_V3f *points, int max_points) {
+	struct stream_probes *probes = user_data;
+	int i, n = probes->num - probes->given;
+	if (probes->fail_source_at >= 0 && probes->given >= probes->fail_source_at) {
+		return -1;
+	}
+	n = n < max_points ? n : max_points;
+	for (i = 0; i < n; ++i) {
+		points[i] = probes->mes[probes->given + i];
+	}
+	probes->given += n;
+	return n;
+}
+
+static int stream_probe_sink(void *user_data, const bsv_V3f *points,
+	const bsv_V3f *results, int num_points) {
+	struct stream_probes *probes = user_data;
+	int i;
+	for (i = 0; i < num_points; ++i) {
+		probes->points_match = probes->points_match
+			&& bsv_V3f_isequal(points[i], probes->mes[probes->received + i]);
+		probes->res[probes->received + i] = results[i];
+	}
+	probes->received += num_points;
+	return 0;
+}
+
+static int stream_probe_sink_stop(void *user_data, const bsv_V3f *points,
+	const bsv_V3f *results, int num_points) {
+	stream_probe_sink(user_data, points, results, num_points);
+	return 1;
+}
 
 int testParticle(){
     SECTION("Particle");
@@ -107,6 +154,131 @@ int testParticle(){
     TEST(cvtx_P3D_S2S_dvort(&p2, &pzz, &vfs, 1).x[0] == 0);
     TEST(cvtx_P3D_S2S_dvort(&p2, &pzz, &vfs, 1).x[1] == 0);
     TEST(cvtx_P3D_S2S_dvort(&p2, &pzz, &vfs, 1).x[2] == 0);
+
+    /* Velocity gradient vs. finite differences and stretching. */
+    {
+        cvtx_P3D pg[3] = {
+            { {{0.f, 0.f, 0.f}},     {{1.f, 0.5f, 0.f}},   1 },
+            { {{0.3f, -0.2f, 0.1f}}, {{0.f, -1.f, 0.5f}},  1 },
+            { {{-0.1f, 0.4f, 0.2f}}, {{0.2f, 0.3f, -1.f}}, 1 } };
+        const cvtx_P3D *ppg[3] = { pg, pg + 1, pg + 2 };
+        cvtx_P3D induced = { {{0.2f, 0.1f, -0.3f}}, {{0.7f, -0.2f, 0.4f}}, 1 };
+        const cvtx_P3D *pinduced = &induced;
+        cvtx_VortFunc vfg = cvtx_VortFunc_gaussian();
+        cvtx_VortFunc vfp = cvtx_VortFunc_planetary();
+        const cvtx_VortFunc *vfuncs[4] = { &vfw, &vfs, &vfg, &vfp };
+        bsv_V3f vel, velref, grad[3], vp, vm, dvort;
+        float eps = 1e-3f, err, maxerr, trace;
+        int f, j, k;
+        for (f = 0; f < 4; ++f) {
+            cvtx_P3D_M2M_vel_grad(ppg, 3, &induced.coord, 1, &vel, grad,
+                vfuncs[f], 0.5f);
+            cvtx_P3D_M2M_vel(ppg, 3, &induced.coord, 1, &velref,
+                vfuncs[f], 0.5f);
+            TEST(bsv_V3f_abs(bsv_V3f_minus(vel, velref)) < 1e-5f);
+            maxerr = 0.f;
+            for (k = 0; k < 3; ++k) {
+                bsv_V3f xp = induced.coord, xm = induced.coord;
+                xp.x[k] += eps;
+                xm.x[k] -= eps;
+                cvtx_P3D_M2M_vel(ppg, 3, &xp, 1, &vp, vfuncs[f], 0.5f);
+                cvtx_P3D_M2M_vel(ppg, 3, &xm, 1, &vm, vfuncs[f], 0.5f);
+                for (j = 0; j < 3; ++j) {
+                    err = fabsf((vp.x[j] - vm.x[j]) / (2 * eps) - grad[j].x[k]);
+                    maxerr = err > maxerr ? err : maxerr;
+                }
+            }
+            TEST(maxerr < 1e-3f);
+            trace = grad[0].x[0] + grad[1].x[1] + grad[2].x[2];
+            TEST(fabsf(trace) < 1e-5f);
+            /* Transpose scheme: dvort_k = sum_j vort_j d vel_j / d x_k */
+            cvtx_P3D_M2M_dvort(ppg, 3, &pinduced, 1, &dvort, vfuncs[f], 0.5f);
+            maxerr = 0.f;
+            for (k = 0; k < 3; ++k) {
+                err = dvort.x[k];
+                for (j = 0; j < 3; ++j) {
+                    err -= induced.vorticity.x[j] * grad[j].x[k];
+                }
+                maxerr = fabsf(err) > maxerr ? fabsf(err) : maxerr;
+            }
+            TEST(maxerr < 1e-4f);
+        }
+    }
+    {
+        /* Streaming probes give the results of a single call, in blocks,
+        with or without pipelining. */
+        cvtx_P3D ps[64];
+        const cvtx_P3D *pps[64];
+        bsv_V3f mes[200], res[200], res_stream[200];
+        struct stream_probes probes;
+        int i, close, pipeline;
+        for (i = 0; i < 64; ++i) {
+            ps[i].coord.x[0] = (float)(mrand() % 100) / 10.f;
+            ps[i].coord.x[1] = (float)(mrand() % 100) / 10.f;
+            ps[i].coord.x[2] = (float)(mrand() % 100) / 10.f;
+            ps[i].vorticity.x[0] = (float)(mrand() % 100) / 100.f - 0.5f;
+            ps[i].vorticity.x[1] = (float)(mrand() % 100) / 100.f - 0.5f;
+            ps[i].vorticity.x[2] = (float)(mrand() % 100) / 100.f - 0.5f;
+            ps[i].volume = 0.1f;
+            pps[i] = ps + i;
+        }
+        for (i = 0; i < 200; ++i) {
+            mes[i].x[0] = (float)(i % 10);
+            mes[i].x[1] = (float)((i / 10) % 10);
+            mes[i].x[2] = (float)(i / 100) + 0.5f;
+        }
+#ifdef _OPENMP
+        int max_active_levels = omp_get_max_active_levels();
+#endif
+        for (pipeline = 0; pipeline < 2; ++pipeline) {
+            cvtx_P3D_M2M_vel(pps, 64, mes, 200, res, &vfw, 0.5f);
+            memset(&probes, 0, sizeof(probes));
+            probes.mes = mes; probes.res = res_stream; probes.num = 200;
+            probes.points_match = 1; probes.fail_source_at = -1;
+            TEST(cvtx_P3D_M2M_vel_stream(pps, 64, stream_probe_source,
+                stream_probe_sink, &probes, 16, pipeline, &vfw, 0.5f) == 0);
+            TEST(probes.given == 200 && probes.received == 200);
+            TEST(probes.points_match);
+            close = 1;
+            for (i = 0; i < 200; ++i) {
+                close = close && bsv_V3f_abs(bsv_V3f_minus(res[i], res_stream[i]))
+                    <= 1e-5f * (bsv_V3f_abs(res[i]) + 1e-5f);
+            }
+            TEST(close);
+
+            cvtx_P3D_M2M_vort(pps, 64, mes, 200, res, &vfw, 0.5f);
+            memset(&probes, 0, sizeof(probes));
+            probes.mes = mes; probes.res = res_stream; probes.num = 200;
+            probes.points_match = 1; probes.fail_source_at = -1;
+            TEST(cvtx_P3D_M2M_vort_stream(pps, 64, stream_probe_source,
+                stream_probe_sink, &probes, 0, pipeline, &vfw, 0.5f) == 0);
+            TEST(probes.received == 200);
+            close = 1;
+            for (i = 0; i < 200; ++i) {
+                close = close && bsv_V3f_abs(bsv_V3f_minus(res[i], res_stream[i]))
+                    <= 1e-5f * (bsv_V3f_abs(res[i]) + 1e-5f);
+            }
+            TEST(close);
+
+            /* Stopped by the sink or the source. */
+            memset(&probes, 0, sizeof(probes));
+            probes.mes = mes; probes.res = res_stream; probes.num = 200;
+            probes.points_match = 1; probes.fail_source_at = -1;
+            TEST(cvtx_P3D_M2M_vel_stream(pps, 64, stream_probe_source,
+                stream_probe_sink_stop, &probes, 16, pipeline, &vfw, 0.5f) == -1);
+            TEST(probes.received == 16);
+            memset(&probes, 0, sizeof(probes));
+            probes.mes = mes; probes.res = res_stream; probes.num = 200;
+            probes.points_match = 1; probes.fail_source_at = 64;
+            TEST(cvtx_P3D_M2M_vel_stream(pps, 64, stream_probe_source,
+                stream_probe_sink, &probes, 16, pipeline, &vfw, 0.5f) == -1);
+            TEST(probes.received <= 64);
+        }
+#ifdef _OPENMP
+        /* Nesting for the pipeline is undone afterwards. */
+        TEST(omp_get_max_active_levels() == max_active_levels);
+#endif
+    }
     
     return 0;
 }
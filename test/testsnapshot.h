@@ -0,0 +1,161 @@
+#ifndef CVTX_TEST_SNAPSHOT_H
+#define CVTX_TEST_SNAPSHOT_H
+
+/*============================================================================
+testsnapshot.h
+
+Test writing and mapping snapshots of particles and filaments.
+
+Copyright(c) 2019 HJA Bird
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files(the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+============================================================================*/
+#include "../include/cvortex/libcvtx.h"
+
+#include <stdio.h>
+#include <string.h>
+
+int testSnapshot() {
+	SECTION("Snapshot");
+	char path[] = "cvtx_test_snapshot.bin";
+	cvtx_P3D p3d[100];
+	cvtx_P2D p2d[50];
+	cvtx_F3D f3d[20];
+	const cvtx_P3D *pp3d[100];
+	const cvtx_P2D *pp2d[50];
+	const cvtx_F3D *pf3d[20];
+	const cvtx_P3D **sp3d;
+	const cvtx_P2D **sp2d;
+	const cvtx_F3D **sf3d;
+	cvtx_VortFunc gaussian = cvtx_VortFunc_gaussian(), kernel;
+	cvtx_Snapshot *snapshot;
+	bsv_V3f mes[10], res[10], res2[10];
+	FILE *file;
+	int i, n, same;
+	for (i = 0; i < 100; ++i) {
+		p3d[i].coord.x[0] = (float)(mrand() % 1000) / 100.f;
+		p3d[i].coord.x[1] = (float)(mrand() % 1000) / 100.f;
+		p3d[i].coord.x[2] = (float)(mrand() % 1000) / 100.f;
+		p3d[i].vorticity.x[0] = (float)(mrand() % 100) / 100.f - 0.5f;
+		p3d[i].vorticity.x[1] = (float)(mrand() % 100) / 100.f - 0.5f;
+		p3d[i].vorticity.x[2] = (float)(mrand() % 100) / 100.f - 0.5f;
+		p3d[i].volume = 0.1f;
+		pp3d[i] = p3d + i;
+	}
+	for (i = 0; i < 50; ++i) {
+		p2d[i].coord.x[0] = (float)i;
+		p2d[i].coord.x[1] = (float)(mrand() % 100) / 10.f;
+		p2d[i].vorticity = (float)(mrand() % 100) / 100.f - 0.5f;
+		p2d[i].area = 0.5f;
+		pp2d[i] = p2d + i;
+	}
+	for (i = 0; i < 20; ++i) {
+		f3d[i].start = p3d[i].coord;
+		f3d[i].end = p3d[i + 1].coord;
+		f3d[i].strength = (float)i;
+		pf3d[i] = f3d + i;
+	}
+	for (i = 0; i < 10; ++i) {
+		mes[i] = p3d[99 - i].coord;
+		mes[i].x[1] += 0.25f;
+	}
+
+	TEST(cvtx_Snapshot_write(path, pp3d, 100, pp2d, 50, pf3d, 20,
+		&gaussian, 0.3f) == 0);
+	snapshot = cvtx_Snapshot_open(path);
+	TEST(snapshot != NULL);
+	if (snapshot != NULL) {
+		sp3d = cvtx_Snapshot_P3D(snapshot, &n);
+		TEST(n == 100);
+		same = 1;
+		for (i = 0; i < n; ++i) {
+			same = same && !memcmp(sp3d[i], p3d + i, sizeof(cvtx_P3D));
+		}
+		TEST(same);
+		sp2d = cvtx_Snapshot_P2D(snapshot, &n);
+		TEST(n == 50);
+		same = 1;
+		for (i = 0; i < n; ++i) {
+			same = same && !memcmp(sp2d[i], p2d + i, sizeof(cvtx_P2D));
+		}
+		TEST(same);
+		sf3d = cvtx_Snapshot_F3D(snapshot, &n);
+		TEST(n == 20);
+		same = 1;
+		for (i = 0; i < n; ++i) {
+			same = same && !memcmp(sf3d[i], f3d + i, sizeof(cvtx_F3D));
+		}
+		TEST(same);
+		TEST(cvtx_Snapshot_regularisation_radius(snapshot) == 0.3f);
+		TEST(cvtx_Snapshot_kernel(snapshot, &kernel) == 0);
+		TEST(!strcmp(kernel.cl_kernel_name_ext, gaussian.cl_kernel_name_ext));
+		/* The mapped particles are used in place. */
+		cvtx_P3D_M2M_vel(pp3d, 100, mes, 10, res, &gaussian, 0.3f);
+		cvtx_P3D_M2M_vel(sp3d, 100, mes, 10, res2, &kernel,
+			cvtx_Snapshot_regularisation_radius(snapshot));
+		same = 1;
+		for (i = 0; i < 10; ++i) {
+			same = same && res[i].x[0] == res2[i].x[0]
+				&& res[i].x[1] == res2[i].x[1] && res[i].x[2] == res2[i].x[2];
+		}
+		TEST(same);
+		cvtx_Snapshot_close(snapshot);
+	}
+
+	/* Empty sections and no kernel. */
+	TEST(cvtx_Snapshot_write(path, pp3d, 3, NULL, 0, NULL, 0, NULL, 0.f) == 0);
+	snapshot = cvtx_Snapshot_open(path);
+	TEST(snapshot != NULL);
+	if (snapshot != NULL) {
+		cvtx_Snapshot_P3D(snapshot, &n);
+		TEST(n == 3);
+		cvtx_Snapshot_F3D(snapshot, &n);
+		TEST(n == 0);
+		TEST(cvtx_Snapshot_kernel(snapshot, &kernel) == -1);
+		cvtx_Snapshot_close(snapshot);
+	}
+
+	/* Files that aren't snapshots, or are cut short. */
+	TEST(cvtx_Snapshot_open("cvtx_no_such_snapshot.bin") == NULL);
+	file = fopen(path, "wb");
+	TEST(file != NULL);
+	if (file != NULL) {
+		fprintf(file, "Not a snapshot");
+		fclose(file);
+		TEST(cvtx_Snapshot_open(path) == NULL);
+	}
+	TEST(cvtx_Snapshot_write(path, pp3d, 100, NULL, 0, NULL, 0, NULL, 0.f) == 0);
+	file = fopen(path, "rb");
+	TEST(file != NULL);
+	if (file != NULL) {
+		/* Keep only the header and the first few particles. */
+		char start[256];
+		n = (int)fread(start, 1, sizeof(start), file);
+		fclose(file);
+		TEST(n == 256);
+		file = fopen(path, "wb");
+		fwrite(start, 1, n, file);
+		fclose(file);
+		TEST(cvtx_Snapshot_open(path) == NULL);
+	}
+	remove(path);
+	return 0;
+}
+
+#endif /* CVTX_TEST_SNAPSHOT_H */
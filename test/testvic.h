@@ -0,0 +1,203 @@
+#ifndef CVTX_TEST_VIC_H
+#define CVTX_TEST_VIC_H
+
+/*============================================================================
+testvic.h
+
+Test vortex-in-cell methods against brute force summation.
+
+Copyright(c) 2019 HJA Bird
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files(the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+============================================================================*/
+#include "../include/cvortex/libcvtx.h"
+
+#include <math.h>
+#include <stdlib.h>
+
+/* Uniform in [-0.5, 0.5]. mrand only gives 15 random bits. */
+static float vic_urand(void) {
+	return (float)mrand() / (float)0x7fff - 0.5f;
+}
+
+/* Relative L2 norm of the difference of two arrays of n floats. */
+static float vic_rel_err(const float *a, const float *b, int n) {
+	double num = 0., den = 0.;
+	int i;
+	for (i = 0; i < n; ++i) {
+		num += (a[i] - b[i]) * (a[i] - b[i]);
+		den += b[i] * b[i];
+	}
+	return (float)sqrt(num / den);
+}
+
+int testVic() {
+	SECTION("Vortex-in-cell");
+	/* Smooth gaussian blobs of vorticity discretised with particles on a
+	lattice of spacing h. The brute force methods use a regularisation
+	radius of h so both methods approximate the same continuous field. The
+	blobs are resolved by several particles per s so that the mesh
+	derivatives match the brute force stretching to a few percent. */
+	const int nl = 22, nm = 64, ni = 64;
+	const float h = 0.025f, s = 0.1f;
+	int i, j, k, np3, np2, ret;
+	float err;
+	cvtx_VortFunc vfg = cvtx_VortFunc_gaussian();
+	cvtx_VortFunc vfw = cvtx_VortFunc_winckelmans();
+	cvtx_RedistFunc m4p = cvtx_RedistFunc_m4p();
+	cvtx_P3D *p3 = malloc(sizeof(cvtx_P3D) * nl * nl * nl);
+	const cvtx_P3D **pp3 = malloc(sizeof(cvtx_P3D*) * nl * nl * nl);
+	const cvtx_P3D **ip3 = malloc(sizeof(cvtx_P3D*) * ni);
+	cvtx_P2D *p2 = malloc(sizeof(cvtx_P2D) * nl * nl);
+	const cvtx_P2D **pp2 = malloc(sizeof(cvtx_P2D*) * nl * nl);
+	bsv_V3f *m3 = malloc(sizeof(bsv_V3f) * nm);
+	bsv_V2f *m2 = malloc(sizeof(bsv_V2f) * nm);
+	bsv_V3f *r3vic = malloc(sizeof(bsv_V3f) * nm);
+	bsv_V3f *r3bf = malloc(sizeof(bsv_V3f) * nm);
+	bsv_V2f *r2vic = malloc(sizeof(bsv_V2f) * nm);
+	bsv_V2f *r2bf = malloc(sizeof(bsv_V2f) * nm);
+
+	np3 = 0;
+	for (i = 0; i < nl; ++i) {
+		for (j = 0; j < nl; ++j) {
+			for (k = 0; k < nl; ++k) {
+				float x = (i - (nl - 1) * 0.5f) * h;
+				float y = (j - (nl - 1) * 0.5f) * h;
+				float z = (k - (nl - 1) * 0.5f) * h;
+				float e = expf(-(x*x + y*y + z*z) / (2 * s*s)) * h*h*h;
+				p3[np3].coord.x[0] = x;
+				p3[np3].coord.x[1] = y;
+				p3[np3].coord.x[2] = z;
+				p3[np3].vorticity.x[0] = -10.f * y * e;
+				p3[np3].vorticity.x[1] = 10.f * x * e;
+				p3[np3].vorticity.x[2] = e;
+				p3[np3].volume = h * h * h;
+				pp3[np3] = p3 + np3;
+				++np3;
+			}
+		}
+	}
+	np2 = 0;
+	for (i = 0; i < nl; ++i) {
+		for (j = 0; j < nl; ++j) {
+			float x = (i - (nl - 1) * 0.5f) * h;
+			float y = (j - (nl - 1) * 0.5f) * h;
+			p2[np2].coord.x[0] = x;
+			p2[np2].coord.x[1] = y;
+			p2[np2].vorticity = (1.f + x) * h * h
+				* expf(-(x*x + y*y) / (2 * s*s));
+			p2[np2].area = h * h;
+			pp2[np2] = p2 + np2;
+			++np2;
+		}
+	}
+	/* Measurement points within the lattice keep the mesh small. */
+	for (i = 0; i < nm; ++i) {
+		m3[i].x[0] = 0.5f * vic_urand();
+		m3[i].x[1] = 0.5f * vic_urand();
+		m3[i].x[2] = 0.5f * vic_urand();
+		m2[i].x[0] = m3[i].x[0];
+		m2[i].x[1] = m3[i].x[1];
+	}
+	for (i = 0; i < ni; ++i) {
+		ip3[i] = pp3[(i * 43) % np3];
+	}
+
+	/* 3D velocity */
+	ret = cvtx_P3D_M2M_vel_vic(pp3, np3, m3, nm, r3vic, &m4p, h);
+	TEST(ret == 0);
+	cvtx_P3D_M2M_vel(pp3, np3, m3, nm, r3bf, &vfg, h);
+	err = vic_rel_err((float*)r3vic, (float*)r3bf, 3 * nm);
+	NAMED_TEST(err < 0.15f, "P3D VIC velocity matches brute force");
+
+	/* 3D vortex stretching */
+	ret = cvtx_P3D_M2M_dvort_vic(pp3, np3, ip3, ni, r3vic, &m4p, h);
+	TEST(ret == 0);
+	cvtx_P3D_M2M_dvort(pp3, np3, ip3, ni, r3bf, &vfg, h);
+	err = vic_rel_err((float*)r3vic, (float*)r3bf, 3 * ni);
+	NAMED_TEST(err < 0.05f, "P3D VIC stretching matches brute force");
+
+	/* 2D velocity */
+	ret = cvtx_P2D_M2M_vel_vic(pp2, np2, m2, nm, r2vic, &m4p, h);
+	TEST(ret == 0);
+	cvtx_P2D_M2M_vel(pp2, np2, m2, nm, r2bf, &vfg, h);
+	err = vic_rel_err((float*)r2vic, (float*)r2bf, 2 * nm);
+	NAMED_TEST(err < 0.1f, "P2D VIC velocity matches brute force");
+
+	/* P3M with a different regularisation to the gaussian splitting. */
+	ret = cvtx_P3D_M2M_vel_p3m(pp3, np3, m3, nm, r3vic, &vfw, h, &m4p, h);
+	TEST(ret == 0);
+	cvtx_P3D_M2M_vel(pp3, np3, m3, nm, r3bf, &vfw, h);
+	err = vic_rel_err((float*)r3vic, (float*)r3bf, 3 * nm);
+	NAMED_TEST(err < 0.03f, "P3D P3M velocity matches brute force");
+	ret = cvtx_P3D_M2M_dvort_p3m(pp3, np3, ip3, ni, r3vic, &vfw, h, &m4p, h);
+	TEST(ret == 0);
+	cvtx_P3D_M2M_dvort(pp3, np3, ip3, ni, r3bf, &vfw, h);
+	err = vic_rel_err((float*)r3vic, (float*)r3bf, 3 * ni);
+	NAMED_TEST(err < 0.1f, "P3D P3M stretching matches brute force");
+	cvtx_P3D_p3m_enable(&m4p, h);
+	TEST(cvtx_P3D_p3m_enabled());
+	cvtx_P3D_M2M_dvort(pp3, np3, ip3, ni, r3bf, &vfw, h);
+	cvtx_P3D_p3m_disable();
+	TEST(!cvtx_P3D_p3m_enabled());
+	NAMED_TEST(bsv_V3f_isequal(r3vic[0], r3bf[0]),
+		"P3M enabled M2M_dvort uses P3M");
+	/* The P3M setting belongs to a context. */
+	{
+		cvtx_Context *context = cvtx_Context_create();
+		cvtx_Context_set_p3m(context, &m4p, h);
+		TEST(cvtx_Context_p3m(context));
+		TEST(!cvtx_Context_p3m(NULL));
+		cvtx_Context_make_current(context);
+		TEST(cvtx_P3D_p3m_enabled());
+		cvtx_P3D_M2M_dvort(pp3, np3, ip3, ni, r3bf, &vfw, h);
+		NAMED_TEST(bsv_V3f_isequal(r3vic[0], r3bf[0]),
+			"Context with P3M uses P3M");
+		cvtx_Context_set_p3m(context, NULL, 0.f);
+		TEST(!cvtx_P3D_p3m_enabled());
+		cvtx_Context_make_current(NULL);
+		cvtx_Context_destroy(context);
+	}
+
+	/* Measurement points too far away for a mesh of this spacing. */
+	m3[0].x[0] = 1e5f;
+	m2[0].x[0] = 1e5f;
+	TEST(cvtx_P3D_M2M_vel_vic(pp3, np3, m3, nm, r3vic, &m4p, h) == -1);
+	TEST(cvtx_P3D_M2M_vel_p3m(pp3, np3, m3, nm, r3vic, &vfw, h, &m4p, h) == -1);
+	cvtx_P3D_p3m_enable(&m4p, h);
+	cvtx_P3D_M2M_vel(pp3, np3, m3, nm, r3vic, &vfw, h);
+	cvtx_P3D_p3m_disable();
+	cvtx_P3D_M2M_vel(pp3, np3, m3, nm, r3bf, &vfw, h);
+	NAMED_TEST(bsv_V3f_isequal(r3vic[1], r3bf[1]),
+		"P3M falls back to brute force for far points");
+	TEST(cvtx_P2D_M2M_vel_vic(pp2, np2, m2, nm, r2vic, &m4p, h) == -1);
+	m3[0].x[0] = 1e30f;
+	TEST(cvtx_P3D_M2M_vel_vic(pp3, np3, m3, nm, r3vic, &m4p, h) == -1);
+
+	/* Nothing to induce. */
+	ret = cvtx_P3D_M2M_vel_vic(pp3, 0, m3, nm, r3vic, &m4p, h);
+	TEST(ret == 0);
+	TEST(bsv_V3f_isequal(r3vic[0], bsv_V3f_zero()));
+
+	free(p3); free(pp3); free(ip3); free(p2); free(pp2); free(m3); free(m2);
+	free(r3vic); free(r3bf); free(r2vic); free(r2bf);
+	return 0;
+}
+
+#endif /* CVTX_TEST_VIC_H */
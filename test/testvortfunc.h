@@ -29,7 +29,13 @@ SOFTWARE.
 #include "../include/cvortex/libcvtx.h"
 
 #include <math.h>
+#include <string.h>
 
+/* Not recognised as built in, so the CPU M2M methods call it through 
+the cvtx_VortFunc rather than using their specialised loops. */
+static float test_wrapped_gaussian_g_3D(float rho) {
+	return cvtx_VortFunc_gaussian().g_3D(rho);
+}
 
 int testVortFunc(){
     SECTION("VortFunc");
@@ -65,6 +71,33 @@ int testVortFunc(){
     TEST(vfg.g_3D(10.f) == 1.f);
     TEST(fabs(vfg.zeta_3D(1.f) - 0.483941449f) < 1e-6);
     TEST(fabs(vfg.zeta_3D(0.5f) - 0.70413065f) < 1e-6);
+
+	{
+		/* Specialised loops for built in functions match the general one. */
+		cvtx_P3D ps[3] = { { {{0,0,0}}, {{1,0,0}}, 1 },
+			{ {{0.5f,0,0}}, {{0,1,0}}, 1 }, { {{0,0.3f,0.1f}}, {{0,0,1}}, 1 } };
+		const cvtx_P3D *pps[3] = { &ps[0], &ps[1], &ps[2] };
+		bsv_V3f mes[2] = { {{0.2f,0.2f,0.2f}}, {{1,-1,0.5f}} }, res[2], wres[2];
+		cvtx_VortFunc vfwrapped = cvtx_VortFunc_gaussian();
+		vfwrapped.g_3D = &test_wrapped_gaussian_g_3D;
+		strcpy(vfwrapped.cl_kernel_name_ext, "");
+		cvtx_P3D_M2M_vel(pps, 3, mes, 2, res, &vfg, 0.4f);
+		cvtx_P3D_M2M_vel(pps, 3, mes, 2, wres, &vfwrapped, 0.4f);
+		TEST(fabsf(res[0].x[0] - wres[0].x[0]) < 1e-5f);
+		TEST(fabsf(res[0].x[1] - wres[0].x[1]) < 1e-5f);
+		TEST(fabsf(res[1].x[2] - wres[1].x[2]) < 1e-5f);
+	}
+	{
+		/* Only a user function started from init opts in to generation. */
+		cvtx_VortFunc vfi = cvtx_VortFunc_init();
+		TEST(vfi.g_3D == NULL && vfi.combined_3D == NULL);
+		TEST(vfi.cl_kernel_name_ext[0] == '\0');
+		TEST(vfi.cl_g_3D == NULL && vfi.cl_g_2D == NULL);
+		TEST(vfi.cl_zeta_3D == NULL && vfi.cl_combined_3D == NULL);
+		TEST(vfi.cl_eta_3D == NULL && vfi.cl_eta_2D == NULL);
+		TEST(vfi.cl_generate != 0);
+		TEST(vfg.cl_generate == 0);
+	}
     return 0;
 }
 